@@ -0,0 +1,284 @@
+/*
+ * MDView render cache - finished pages on disk
+ * =============================================
+ * File operations per platform, then the shared fetch / store / evict
+ * logic. See mdcache.h.
+ *
+ * A page is <32 hex digits>.html. cache.stats beside the pages holds
+ * "hits N", "misses N", "stores N" and "evictions N" lines.
+ *
+ * (c) 2026 - MIT License
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "mdcache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <wchar.h>
+#else
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <utime.h>
+#endif
+
+/* A page as listed: name, size and time of last use */
+typedef struct { char name[40]; long long size, mtime; } Entry;
+
+enum { NAME_LEN = 32, PAGE_LEN = NAME_LEN + 5 };   /* hex digits, then ".html" */
+
+static int is_page_name(const char* s, size_t n) {
+    if (n != PAGE_LEN || memcmp(s + NAME_LEN, ".html", 5) != 0) return 0;
+    for (int i = 0; i < NAME_LEN; i++)
+        if (!((s[i] >= '0' && s[i] <= '9') || (s[i] >= 'a' && s[i] <= 'f'))) return 0;
+    return 1;
+}
+
+static int add_entry(Entry** es, int* n, int* cap, const char* name, long long size, long long mtime) {
+    if (*n == *cap) {
+        int nc = *cap ? *cap * 2 : 64;
+        Entry* ne = (Entry*)realloc(*es, sizeof(Entry) * (size_t)nc);
+        if (!ne) return -1;
+        *es = ne; *cap = nc;
+    }
+    Entry* e = &(*es)[(*n)++];
+    memcpy(e->name, name, PAGE_LEN + 1); e->size = size; e->mtime = mtime;
+    return 0;
+}
+
+#ifdef _WIN32
+
+/* dir\name; name is ASCII */
+static void* join_path(const void* dir, const char* name) {
+    const wchar_t* d = (const wchar_t*)dir;
+    size_t dn = wcslen(d), nn = strlen(name);
+    wchar_t* p = (wchar_t*)malloc((dn + nn + 2) * sizeof(wchar_t));
+    if (!p) return NULL;
+    memcpy(p, d, dn * sizeof(wchar_t)); p[dn] = L'\\';
+    for (size_t i = 0; i <= nn; i++) p[dn + 1 + i] = (wchar_t)(unsigned char)name[i];
+    return p;
+}
+
+static FILE* open_path(const void* path, const char* mode) { return _wfopen((const wchar_t*)path, mode[0] == 'w' ? L"wb" : L"rb"); }
+static int copy_path(const void* from, const void* to) { return CopyFileW((const wchar_t*)from, (const wchar_t*)to, FALSE) ? 0 : -1; }
+static int replace_path(const void* from, const void* to) { return MoveFileExW((const wchar_t*)from, (const wchar_t*)to, MOVEFILE_REPLACE_EXISTING) ? 0 : -1; }
+static int remove_path(const void* path) { return DeleteFileW((const wchar_t*)path) ? 0 : -1; }
+static int make_dir(const void* dir) { return CreateDirectoryW((const wchar_t*)dir, NULL) || GetLastError() == ERROR_ALREADY_EXISTS ? 0 : -1; }
+
+/* Last-write time is the time of last use: NTFS no longer keeps access times */
+static void touch_path(const void* path) {
+    HANDLE h = CreateFileW((const wchar_t*)path, FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                           NULL, OPEN_EXISTING, 0, NULL);
+    if (h == INVALID_HANDLE_VALUE) return;
+    FILETIME now; GetSystemTimeAsFileTime(&now);
+    SetFileTime(h, NULL, NULL, &now);
+    CloseHandle(h);
+}
+
+static long long path_size(const void* path) {
+    WIN32_FILE_ATTRIBUTE_DATA fa;
+    if (!GetFileAttributesExW((const wchar_t*)path, GetFileExInfoStandard, &fa)) return -1;
+    return (long long)(((unsigned long long)fa.nFileSizeHigh << 32) | fa.nFileSizeLow);
+}
+
+static int list_pages(const void* dir, Entry** es, int* n) {
+    void* pat = join_path(dir, "*.html");
+    if (!pat) return -1;
+    WIN32_FIND_DATAW fd; int cap = 0, rc = 0;
+    HANDLE h = FindFirstFileW((const wchar_t*)pat, &fd);
+    free(pat);
+    *es = NULL; *n = 0;
+    if (h == INVALID_HANDLE_VALUE) return GetLastError() == ERROR_FILE_NOT_FOUND ? 0 : -1;
+    do {
+        char name[PAGE_LEN + 1]; size_t nl = wcslen(fd.cFileName);
+        if ((fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || nl != PAGE_LEN) continue;
+        for (size_t i = 0; i <= nl; i++) name[i] = fd.cFileName[i] < 128 ? (char)fd.cFileName[i] : '?';
+        if (!is_page_name(name, nl)) continue;
+        rc = add_entry(es, n, &cap, name,
+                       (long long)(((unsigned long long)fd.nFileSizeHigh << 32) | fd.nFileSizeLow),
+                       (long long)(((unsigned long long)fd.ftLastWriteTime.dwHighDateTime << 32) | fd.ftLastWriteTime.dwLowDateTime));
+    } while (!rc && FindNextFileW(h, &fd));
+    FindClose(h);
+    return rc;
+}
+
+#else
+
+static void* join_path(const void* dir, const char* name) {
+    size_t dn = strlen((const char*)dir), nn = strlen(name);
+    char* p = (char*)malloc(dn + nn + 2);
+    if (!p) return NULL;
+    memcpy(p, dir, dn); p[dn] = '/'; memcpy(p + dn + 1, name, nn + 1);
+    return p;
+}
+
+static FILE* open_path(const void* path, const char* mode) { return fopen((const char*)path, mode[0] == 'w' ? "wb" : "rb"); }
+static int replace_path(const void* from, const void* to) { return rename((const char*)from, (const char*)to); }
+static int remove_path(const void* path) { return remove((const char*)path); }
+static int make_dir(const void* dir) { return mkdir((const char*)dir, 0777) == 0 || errno == EEXIST ? 0 : -1; }
+static void touch_path(const void* path) { utime((const char*)path, NULL); }
+
+static int copy_path(const void* from, const void* to) {
+    FILE* in = open_path(from, "rb");
+    if (!in) return -1;
+    FILE* out = open_path(to, "wb");
+    if (!out) { fclose(in); return -1; }
+    char buf[65536]; size_t n; int rc = 0;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+        if (fwrite(buf, 1, n, out) != n) { rc = -1; break; }
+    if (ferror(in)) rc = -1;
+    fclose(in);
+    if (fclose(out) != 0) rc = -1;
+    if (rc) remove_path(to);
+    return rc;
+}
+
+static long long path_size(const void* path) {
+    struct stat st;
+    return stat((const char*)path, &st) == 0 ? (long long)st.st_size : -1;
+}
+
+static int list_pages(const void* dir, Entry** es, int* n) {
+    DIR* d = opendir((const char*)dir);
+    int cap = 0, rc = 0;
+    *es = NULL; *n = 0;
+    if (!d) return -1;
+    struct dirent* e;
+    while (!rc && (e = readdir(d)) != NULL) {
+        if (!is_page_name(e->d_name, strlen(e->d_name))) continue;
+        char* path = (char*)join_path(dir, e->d_name);
+        struct stat st;
+        if (path && stat(path, &st) == 0 && S_ISREG(st.st_mode))
+            rc = add_entry(es, n, &cap, e->d_name, (long long)st.st_size, (long long)st.st_mtime);
+        free(path);
+    }
+    closedir(d);
+    return rc;
+}
+
+#endif
+
+/* ── Keys ────────────────────────────────────────────────────────────── */
+
+static void put_hex(char* out, unsigned long long v) {
+    static const char k_hex[] = "0123456789abcdef";
+    for (int i = 15; i >= 0; i--, v >>= 4) out[i] = k_hex[v & 15];
+}
+
+void md_cache_key(MdCacheKey* k, const void* path, size_t pathLen, long long size, long long mtime,
+                  unsigned long long content, unsigned long long settings, const char* version) {
+    /* The fixed fields, then path and version, hashed with two seeds */
+    unsigned long long f[5] = { (unsigned long long)size, (unsigned long long)mtime, content, settings, (unsigned long long)pathLen };
+    unsigned long long h[2];
+    for (int s = 0; s < 2; s++) {
+        unsigned long long v = md_hash64(f, sizeof(f), 0x6d64766963616368ULL + (unsigned long long)s);
+        v = md_hash64(path, pathLen, v);
+        h[s] = md_hash64(version, strlen(version), v);
+    }
+    put_hex(k->name, h[0]); put_hex(k->name + 16, h[1]);
+    k->name[NAME_LEN] = '\0';
+}
+
+/* ── Statistics ──────────────────────────────────────────────────────── */
+
+static void stats_read(const void* dir, MdCacheStats* st) {
+    memset(st, 0, sizeof(*st));
+    void* path = join_path(dir, "cache.stats");
+    FILE* f = path ? open_path(path, "rb") : NULL;
+    free(path);
+    if (!f) return;
+    char key[16]; long long v;
+    while (fscanf(f, "%15s %lld", key, &v) == 2) {
+        if (strcmp(key, "hits") == 0) st->hits = v;
+        else if (strcmp(key, "misses") == 0) st->misses = v;
+        else if (strcmp(key, "stores") == 0) st->stores = v;
+        else if (strcmp(key, "evictions") == 0) st->evictions = v;
+    }
+    fclose(f);
+}
+
+/* Read, add, write back: viewers opening at the same moment may lose a
+   count, which statistics can live with */
+static void stats_add(const void* dir, int hits, int misses, int stores, int evictions) {
+    MdCacheStats st; stats_read(dir, &st);
+    st.hits += hits; st.misses += misses; st.stores += stores; st.evictions += evictions;
+    void* path = join_path(dir, "cache.stats");
+    FILE* f = path ? open_path(path, "wb") : NULL;
+    free(path);
+    if (!f) return;
+    fprintf(f, "hits %lld\nmisses %lld\nstores %lld\nevictions %lld\n", st.hits, st.misses, st.stores, st.evictions);
+    fclose(f);
+}
+
+/* ── Fetch / Store ───────────────────────────────────────────────────── */
+
+static int fetch(const void* dir, const MdCacheKey* k, const void* dest) {
+    char name[PAGE_LEN + 1];
+    memcpy(name, k->name, NAME_LEN); memcpy(name + NAME_LEN, ".html", 6);
+    void* path = join_path(dir, name);
+    int hit = path && copy_path(path, dest) == 0;
+    if (hit) touch_path(path);
+    else make_dir(dir);   /* the first miss sets up the directory, so it is counted */
+    free(path);
+    stats_add(dir, hit, !hit, 0, 0);
+    return hit;
+}
+
+static int mtime_cmp(const void* a, const void* b) {
+    const Entry *x = (const Entry*)a, *y = (const Entry*)b;
+    return (x->mtime > y->mtime) - (x->mtime < y->mtime);
+}
+
+/* Remove the least recently used pages, never `keep`, until the rest fit */
+static int evict(const void* dir, const char* keep, long long budget) {
+    Entry* es; int n, gone = 0;
+    if (list_pages(dir, &es, &n)) { free(es); return 0; }
+    long long total = 0;
+    for (int i = 0; i < n; i++) total += es[i].size;
+    if (total > budget) {
+        qsort(es, (size_t)n, sizeof(Entry), mtime_cmp);
+        for (int i = 0; i < n && total > budget; i++) {
+            if (strcmp(es[i].name, keep) == 0) continue;
+            void* path = join_path(dir, es[i].name);
+            if (path && remove_path(path) == 0) { total -= es[i].size; gone++; }
+            free(path);
+        }
+    }
+    free(es);
+    return gone;
+}
+
+static int store(const void* dir, const MdCacheKey* k, const void* page, long long budget) {
+    long long size = path_size(page);
+    if (size < 0 || size > budget || make_dir(dir)) return -1;
+    char name[PAGE_LEN + 1], tmp[NAME_LEN + 5];
+    memcpy(name, k->name, NAME_LEN); memcpy(name + NAME_LEN, ".html", 6);
+    memcpy(tmp, k->name, NAME_LEN); memcpy(tmp + NAME_LEN, ".tmp", 5);
+    /* Copy under a temporary name, then rename: a reader never sees half a page */
+    void* to = join_path(dir, name);
+    void* part = join_path(dir, tmp);
+    int rc = to && part && copy_path(page, part) == 0 ? 0 : -1;
+    if (!rc && replace_path(part, to)) { remove_path(part); rc = -1; }
+    free(to); free(part);
+    if (rc) return -1;
+    stats_add(dir, 0, 0, 1, evict(dir, name, budget));
+    return 0;
+}
+
+#ifdef _WIN32
+int md_cache_fetch_w(const wchar_t* dir, const MdCacheKey* k, const wchar_t* dest) { return fetch(dir, k, dest); }
+int md_cache_store_w(const wchar_t* dir, const MdCacheKey* k, const wchar_t* page, long long budget) { return store(dir, k, page, budget); }
+int md_cache_stats_w(const wchar_t* dir, MdCacheStats* st) { stats_read(dir, st); return 0; }
+#else
+int md_cache_fetch(const char* dir, const MdCacheKey* k, const char* dest) { return fetch(dir, k, dest); }
+int md_cache_store(const char* dir, const MdCacheKey* k, const char* page, long long budget) { return store(dir, k, page, budget); }
+int md_cache_stats(const char* dir, MdCacheStats* st) { stats_read(dir, st); return 0; }
+#endif
@@ -0,0 +1,48 @@
+/*
+ * MDView render cache - finished pages on disk
+ * =============================================
+ * A directory of rendered pages, one file per key, so that reopening a
+ * file that has not changed skips the conversion. The key covers the
+ * source's path, size, modification time and content, the settings that
+ * shape the page and the producer's version. The directory is held to a
+ * byte budget by evicting the least recently used pages; a hit refreshes
+ * the page's file time. Win32 and POSIX, like mdsource.c.
+ *
+ * (c) 2026 - MIT License
+ */
+
+#ifndef MDCACHE_H
+#define MDCACHE_H
+
+#include "mdcore.h"
+
+typedef struct { char name[33]; } MdCacheKey;   /* 32 hex digits: the page is <name>.html */
+
+/* Key of a page: the source's path (pathLen bytes, as the platform spells
+   it), size and modification time, md_hash64 of its text, a hash of the
+   settings the page depends on, and a version string that changes with
+   whatever produces the page */
+void md_cache_key(MdCacheKey* k, const void* path, size_t pathLen, long long size, long long mtime,
+                  unsigned long long content, unsigned long long settings, const char* version);
+
+/* Counted in <dir>/cache.stats by every fetch and store, from any
+   process; md_cache_stats reads them (all 0 if there are none yet) */
+typedef struct { long long hits, misses, stores, evictions; } MdCacheStats;
+
+/* md_cache_fetch copies the page of key k to `dest`: 1 on a hit, 0 on a
+   miss. md_cache_store copies the page at `page` into the directory (made
+   if missing), then evicts the least recently used others until the
+   pages fit in `budget` bytes; a page bigger than that is not kept.
+   0, or -1 if it could not be stored. Only files named like pages are
+   ever removed. */
+#ifdef _WIN32
+int md_cache_fetch_w(const wchar_t* dir, const MdCacheKey* k, const wchar_t* dest);
+int md_cache_store_w(const wchar_t* dir, const MdCacheKey* k, const wchar_t* page, long long budget);
+int md_cache_stats_w(const wchar_t* dir, MdCacheStats* st);
+#else
+int md_cache_fetch(const char* dir, const MdCacheKey* k, const char* dest);
+int md_cache_store(const char* dir, const MdCacheKey* k, const char* page, long long budget);
+int md_cache_stats(const char* dir, MdCacheStats* st);
+#endif
+
+#endif /* MDCACHE_H */
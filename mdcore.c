@@ -0,0 +1,3053 @@
+/*
+ * MDView core - portable Markdown->HTML converter
+ * ================================================
+ * Block parser, inline parser, reference links and string buffer.
+ * Moved out of mdview.c so the hot path can be built, profiled and
+ * benchmarked natively on Linux (see mdview-render.c).
+ *
+ * (c) 2026 - MIT License
+ */
+
+#include "mdcore.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+/* ── Arena ───────────────────────────────────────────────────────────── */
+
+/* Bump allocator for the temporaries of one conversion: line table, block
+   list, container stack, reference map, inline and paragraph scratch.
+   Nothing is freed on its own; arena_reset drops it all at once and folds
+   the chunks into one sized for the high-water mark, so a context that is
+   reused converts without touching malloc after the first document. */
+typedef struct ArenaChunk { struct ArenaChunk* prev; size_t cap; size_t used; } ArenaChunk;
+typedef struct { ArenaChunk* head; void* last; size_t total; } Arena;
+
+#define ARENA_ALIGN(n) (((n) + 15) & ~(size_t)15)
+#define ARENA_HDR ARENA_ALIGN(sizeof(ArenaChunk))
+#define ARENA_DATA(c) ((char*)(c) + ARENA_HDR)
+
+static ArenaChunk* arena_chunk(Arena* a, size_t cap) {
+    ArenaChunk* c = (ArenaChunk*)malloc(ARENA_HDR + cap);
+    if (!c) return NULL;
+    c->prev = a->head; c->cap = cap; c->used = 0;
+    a->last = NULL;
+    return a->head = c;
+}
+
+static void* arena_alloc(Arena* a, size_t n) {
+    n = ARENA_ALIGN(n);
+    ArenaChunk* c = a->head;
+    if (!c || c->cap - c->used < n) {
+        size_t cap = c ? c->cap*2 : 65536;
+        if (cap < n) cap = n;
+        if (!(c = arena_chunk(a, cap))) return NULL;
+    }
+    void* p = ARENA_DATA(c) + c->used;
+    c->used += n; a->total += n; a->last = p;
+    return p;
+}
+
+/* realloc for arena blocks: the newest one grows in place while its chunk
+   has room, anything else moves and leaves its old copy until the reset */
+static void* arena_grow(Arena* a, void* p, size_t old, size_t n) {
+    ArenaChunk* c = a->head;
+    old = ARENA_ALIGN(old); n = ARENA_ALIGN(n);
+    if (p && p == a->last && n >= old && c->cap - c->used >= n - old) {
+        c->used += n - old; a->total += n - old;
+        return p;
+    }
+    void* q = arena_alloc(a, n);
+    if (q && p) memcpy(q, p, old < n ? old : n);
+    return q;
+}
+
+/* Make sure the next `n` bytes come from one chunk (input-size hint) */
+static void arena_reserve(Arena* a, size_t n) {
+    n = ARENA_ALIGN(n);
+    if (a->head && a->head->cap - a->head->used >= n) return;
+    if (a->head && !a->head->used && !a->head->prev) { free(a->head); a->head = NULL; }
+    arena_chunk(a, n);
+}
+
+static void arena_reset(Arena* a) {
+    ArenaChunk* c = a->head;
+    if (c && c->prev) {  /* several chunks: replace them by one that fits all */
+        while (c) { ArenaChunk* prev = c->prev; free(c); c = prev; }
+        a->head = NULL;
+        arena_chunk(a, a->total);
+    } else if (c) c->used = 0;
+    a->last = NULL; a->total = 0;
+}
+
+static void arena_free(Arena* a) {
+    ArenaChunk* c = a->head;
+    while (c) { ArenaChunk* prev = c->prev; free(c); c = prev; }
+    memset(a, 0, sizeof(*a));
+}
+
+/* ── Reference Link Map ──────────────────────────────────────────────── */
+
+/* Open-addressing hash table keyed on the ASCII-lowercased label. Labels,
+   URLs and titles are interned back to back in one string pool and slots
+   hold offsets into it; offset 0 is a reserved empty string, so a zero
+   label marks a free slot and a zero title means "no title". */
+typedef struct { unsigned hash; size_t label, labelLen, url, title; } RefLink;
+typedef struct { Arena* arena; RefLink* slots; size_t cap; size_t count; char* pool; size_t poolLen; size_t poolCap; } RefMap;
+
+#define REF_URL(m,r)   ((m)->pool + (r)->url)
+#define REF_TITLE(m,r) ((m)->pool + (r)->title)
+
+static char ref_fold(char c) { return (c>='A'&&c<='Z') ? c+32 : c; }
+
+static unsigned ref_hash(const char* s, size_t n) {
+    unsigned h = 2166136261u;  /* FNV-1a */
+    for (size_t i=0; i<n; i++) { h ^= (unsigned char)ref_fold(s[i]); h *= 16777619u; }
+    return h;
+}
+
+/* Start empty; table and pool are allocated from the arena as needed */
+static void ref_init(RefMap* m, Arena* a) { memset(m, 0, sizeof(*m)); m->arena = a; }
+
+static size_t ref_intern(RefMap* m, const char* s, size_t n, int fold) {
+    if (m->poolLen + n + 1 > m->poolCap) {
+        size_t cap = m->poolCap ? m->poolCap : 4096;
+        while (m->poolLen + n + 1 > cap) cap *= 2;
+        m->pool = (char*)arena_grow(m->arena, m->pool, m->poolCap, cap); m->poolCap = cap;
+    }
+    size_t off = m->poolLen;
+    char* d = m->pool + off;
+    for (size_t i=0; i<n; i++) d[i] = fold ? ref_fold(s[i]) : s[i];
+    d[n] = '\0';
+    m->poolLen += n + 1;
+    return off;
+}
+
+static RefLink* ref_slot(RefMap* m, const char* label, size_t n, unsigned h) {
+    size_t mask = m->cap - 1;
+    for (size_t i = h & mask;; i = (i+1) & mask) {
+        RefLink* r = &m->slots[i];
+        if (!r->label) return r;
+        if (r->hash == h && r->labelLen == n) {
+            const char* k = m->pool + r->label; size_t j = 0;
+            while (j<n && k[j]==ref_fold(label[j])) j++;
+            if (j == n) return r;
+        }
+    }
+}
+
+/* First definition of a label wins, as in most Markdown implementations */
+static void ref_add(RefMap* m, const char* label, size_t ln, const char* url, size_t un, const char* title, size_t tn) {
+    if (!m->poolLen) ref_intern(m, "", 0, 0);
+    if ((m->count+1)*2 > m->cap) {
+        RefLink* old = m->slots; size_t oldCap = m->cap;
+        m->cap = oldCap ? oldCap*2 : 64;
+        m->slots = (RefLink*)arena_alloc(m->arena, m->cap * sizeof(RefLink));
+        memset(m->slots, 0, m->cap * sizeof(RefLink));
+        for (size_t i=0; i<oldCap; i++)
+            if (old[i].label) *ref_slot(m, m->pool+old[i].label, old[i].labelLen, old[i].hash) = old[i];
+    }
+    unsigned h = ref_hash(label, ln);
+    RefLink* r = ref_slot(m, label, ln, h);
+    if (r->label) return;
+    r->hash = h; r->labelLen = ln;
+    r->label = ref_intern(m, label, ln, 1);
+    r->url = ref_intern(m, url, un, 0);
+    r->title = tn ? ref_intern(m, title, tn, 0) : 0;
+    m->count++;
+}
+
+static const RefLink* ref_find(RefMap* m, const char* label, size_t n) {
+    if (!m->count) return NULL;
+    const RefLink* r = ref_slot(m, label, n, ref_hash(label, n));
+    return r->label ? r : NULL;
+}
+
+/* ── Converter Context ───────────────────────────────────────────────── */
+
+/* Everything one conversion touches lives here, so independent contexts
+   can convert on different threads at once. Temporaries come from the
+   arena, whose memory survives between documents converted with the
+   same context. */
+struct MdContext {
+    MdOptions opts;
+    Arena arena;
+    RefMap refs;
+    char* para; size_t paraCap;    /* paragraph join buffer */
+    unsigned* brk; size_t brkCap;  /* inline: '[' -> matching ']' + 1, 0 if none */
+    const char* inlBase;           /* inline: span brk is indexed from */
+    MdSections* secs;              /* md_render_sections: index being built */
+    int secFail;                   /* ... and its items ran out of memory */
+    MdOutline* outline;            /* headings collected here, if set */
+    MdDoc* doc;                    /* md_doc_update: printed line numbers noted here ... */
+    int docFail;                   /* ... and its notes ran out of memory */
+    MdText* text;                  /* text index built here, if set ... */
+    int txTag, txSkip;             /* ... its tag scanner: in a tag (1: at the name, 3: a comment), in script/style */
+    int txClose, txNameLen;        /* closing tag, name length */
+    char txQuote, txName[6];       /* open quote in the tag, name so far (lower case) */
+};
+
+void md_options_default(MdOptions* o) { memset(o, 0, sizeof(*o)); o->headingIds = 1; o->highlight = 1; o->lineGutters = 1; }
+
+MdContext* md_context_new(const MdOptions* opts) {
+    MdContext* cx = (MdContext*)calloc(1, sizeof(MdContext));
+    if (!cx) return NULL;
+    if (opts) cx->opts = *opts; else md_options_default(&cx->opts);
+    return cx;
+}
+
+void md_context_free(MdContext* cx) {
+    if (!cx) return;
+    arena_free(&cx->arena);
+    free(cx);
+}
+
+void md_context_set_outline(MdContext* cx, MdOutline* o) { cx->outline = o; }
+void md_context_set_text(MdContext* cx, MdText* t) { cx->text = t; }
+
+/* ── CPU Dispatch ────────────────────────────────────────────────────── */
+
+/* Vector paths are compiled with per-function target attributes, so the
+   binary still runs on any x86 (or non-x86) CPU; the widest path the CPU
+   supports is picked once at run time. */
+#if defined(MD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define MD_TARGET(x) __attribute__((target(x)))
+#else
+#define MD_TARGET(x)
+#endif
+
+/* The level is read by every conversion, on any thread, and resolved on
+   first use. Resolving has no side effects and always gives the same
+   level, so threads racing to it store the same value; the load and the
+   store are atomic, so none of them sees a torn one. md_simd_select sets
+   it for benchmarks, between runs. */
+static volatile long g_simd = MD_SIMD_AUTO;
+#if defined(__GNUC__) || defined(__clang__)
+#define SIMD_GET()   ((int)__atomic_load_n(&g_simd, __ATOMIC_ACQUIRE))
+#define SIMD_SET(x)  __atomic_store_n(&g_simd, (long)(x), __ATOMIC_RELEASE)
+#elif defined(_MSC_VER)
+#define SIMD_GET()   ((int)_InterlockedOr(&g_simd, 0))
+#define SIMD_SET(x)  _InterlockedExchange(&g_simd, (long)(x))
+#else
+#define SIMD_GET()   ((int)g_simd)
+#define SIMD_SET(x)  (g_simd = (long)(x))
+#endif
+
+#if defined(MD_X86) && (defined(__GNUC__) || defined(__clang__))
+/* The CPU model is filled in once, at load, before any thread converts */
+__attribute__((constructor)) static void cpu_init(void) { __builtin_cpu_init(); }
+#endif
+
+static int cpu_simd_level(void) {
+#if defined(MD_X86) && (defined(__GNUC__) || defined(__clang__))
+    if (__builtin_cpu_supports("avx2")) return MD_SIMD_AVX2;
+    if (__builtin_cpu_supports("sse2")) return MD_SIMD_SSE2;
+#elif defined(MD_X86) && defined(_MSC_VER)
+    int r[4]; __cpuid(r, 0); int maxLeaf = r[0];
+    __cpuid(r, 1); int sse2 = (r[3] >> 26) & 1, osxsave = (r[2] >> 27) & 1, avx = (r[2] >> 28) & 1;
+    if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6) { __cpuidex(r, 7, 0); if ((r[1] >> 5) & 1) return MD_SIMD_AVX2; }
+    if (sse2) return MD_SIMD_SSE2;
+#endif
+    return MD_SIMD_NONE;
+}
+
+int md_simd_select(int level) {
+    int best = cpu_simd_level(), use = (level == MD_SIMD_AUTO || level > best) ? best : level;
+    SIMD_SET(use);
+    return use;
+}
+
+static int simd_level(void) {
+    int lv = SIMD_GET();
+    if (lv == MD_SIMD_AUTO) { lv = cpu_simd_level(); SIMD_SET(lv); }
+    return lv;
+}
+
+static unsigned md_ctz(unsigned x) {
+#if defined(_MSC_VER)
+    unsigned long r; _BitScanForward(&r, x); return (unsigned)r;
+#else
+    return (unsigned)__builtin_ctz(x);
+#endif
+}
+
+/* ── String Buffer ───────────────────────────────────────────────────── */
+
+void sb_init(StrBuf* sb) { sb_init_cap(sb, 4096); }
+void sb_init_cap(StrBuf* sb, size_t cap) { sb->cap=cap>16?cap:16; sb->data=(char*)malloc(sb->cap); if(sb->data)sb->data[0]='\0'; sb->len=0; }
+void sb_ensure(StrBuf* sb, size_t x) { while(sb->len+x+1>sb->cap){sb->cap*=2; sb->data=(char*)realloc(sb->data,sb->cap);} }
+void sb_append(StrBuf* sb, const char* s) { size_t n=strlen(s); sb_ensure(sb,n); memcpy(sb->data+sb->len,s,n); sb->len+=n; sb->data[sb->len]='\0'; }
+void sb_append_n(StrBuf* sb, const char* s, size_t n) { sb_ensure(sb,n); memcpy(sb->data+sb->len,s,n); sb->len+=n; sb->data[sb->len]='\0'; }
+void sb_append_char(StrBuf* sb, char c) { sb_ensure(sb,1); sb->data[sb->len++]=c; sb->data[sb->len]='\0'; }
+/* Escaping: find the next & < > " and copy the clean run before it whole */
+static size_t scan_esc_scalar(const char* s, size_t i, size_t n) {
+    for (; i < n; i++) { char c = s[i]; if (c=='&'||c=='<'||c=='>'||c=='"') return i; }
+    return n;
+}
+
+#ifdef MD_X86
+MD_TARGET("sse2")
+static size_t scan_esc_sse2(const char* s, size_t i, size_t n) {
+    const __m128i amp=_mm_set1_epi8('&'), lt=_mm_set1_epi8('<'), gt=_mm_set1_epi8('>'), qt=_mm_set1_epi8('"');
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v,amp), _mm_cmpeq_epi8(v,lt)),
+                                 _mm_or_si128(_mm_cmpeq_epi8(v,gt), _mm_cmpeq_epi8(v,qt)));
+        unsigned bits = (unsigned)_mm_movemask_epi8(m);
+        if (bits) return i + md_ctz(bits);
+    }
+    return scan_esc_scalar(s, i, n);
+}
+
+MD_TARGET("avx2")
+static size_t scan_esc_avx2(const char* s, size_t i, size_t n) {
+    const __m256i amp=_mm256_set1_epi8('&'), lt=_mm256_set1_epi8('<'), gt=_mm256_set1_epi8('>'), qt=_mm256_set1_epi8('"');
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(s + i));
+        __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v,amp), _mm256_cmpeq_epi8(v,lt)),
+                                    _mm256_or_si256(_mm256_cmpeq_epi8(v,gt), _mm256_cmpeq_epi8(v,qt)));
+        unsigned bits = (unsigned)_mm256_movemask_epi8(m);
+        if (bits) return i + md_ctz(bits);
+    }
+    /* Scalar tail: calling the non-VEX SSE2 path from here costs an AVX-SSE transition */
+    return scan_esc_scalar(s, i, n);
+}
+#endif
+
+/* Input is taken in slices so the worst case (every byte -> "&quot;")
+   can be reserved up front without sizing the buffer at 6x a huge run */
+#define ESC_SLICE 4096
+
+void sb_append_esc(StrBuf* sb, const char* s, size_t n) {
+    size_t (*scan)(const char*, size_t, size_t) = scan_esc_scalar;
+#ifdef MD_X86
+    switch (simd_level()) {
+    case MD_SIMD_AVX2: scan = scan_esc_avx2; break;
+    case MD_SIMD_SSE2: scan = scan_esc_sse2; break;
+    }
+#endif
+    size_t i = 0;
+    while (i < n) {
+        size_t end = n - i > ESC_SLICE ? i + ESC_SLICE : n;
+        sb_ensure(sb, (end - i) * 6);
+        char* d = sb->data + sb->len;
+        while (i < end) {
+            size_t q = scan(s, i, end);
+            memcpy(d, s + i, q - i); d += q - i; i = q;
+            if (i == end) break;
+            switch (s[i++]) {
+            case '&': memcpy(d, "&amp;", 5); d += 5; break;
+            case '<': memcpy(d, "&lt;", 4); d += 4; break;
+            case '>': memcpy(d, "&gt;", 4); d += 4; break;
+            default:  memcpy(d, "&quot;", 6); d += 6; break;
+            }
+        }
+        sb->len = (size_t)(d - sb->data);
+    }
+    sb_ensure(sb, 0);
+    sb->data[sb->len] = '\0';
+}
+
+/* ── Output Sink ─────────────────────────────────────────────────────── */
+
+static int sink_buf_write(MdSink* s, const char* data, size_t len) { sb_append_n((StrBuf*)s->user, data, len); return 0; }
+static int sink_file_write(MdSink* s, const char* data, size_t len) { return fwrite(data, 1, len, (FILE*)s->user) == len ? 0 : -1; }
+
+void md_sink_buf(MdSink* s, StrBuf* sb) { s->write = sink_buf_write; s->user = sb; s->chunk = 0; s->aligned = 0; }
+void md_sink_file(MdSink* s, FILE* f) { s->write = sink_file_write; s->user = f; s->chunk = 0; s->aligned = 0; }
+
+int md_sink_write(MdSink* s, const char* data, size_t len) { return len ? s->write(s, data, len) : 0; }
+int md_sink_puts(MdSink* s, const char* str) { return md_sink_write(s, str, strlen(str)); }
+
+/* ── Hashing ─────────────────────────────────────────────────────────── */
+
+static unsigned long long h_rotl(unsigned long long v, int r) { return (v << r) | (v >> (64 - r)); }
+static unsigned long long h_word(const unsigned char* p) { unsigned long long v; memcpy(&v, p, 8); return v; }
+
+/* Murmur3's finalizer: every input bit reaches every output bit */
+static unsigned long long h_fmix(unsigned long long h) {
+    h ^= h >> 33; h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33; h *= 0xc4ceb9fe1a85ec53ULL;
+    return h ^ (h >> 33);
+}
+
+#define H_MUL 0x9e3779b97f4a7c15ULL
+
+/* Four independent lanes of multiply-rotate over 32-byte strides, so the
+   multiplies overlap; the tail goes through the first lane */
+unsigned long long md_hash64(const void* data, size_t n, unsigned long long seed) {
+    const unsigned char* p = (const unsigned char*)data;
+    unsigned long long a = seed ^ H_MUL, b = seed + n, c = ~seed, d = seed * H_MUL + 1;
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        a = h_rotl((a ^ h_word(p + i)) * H_MUL, 31);
+        b = h_rotl((b ^ h_word(p + i + 8)) * H_MUL, 31);
+        c = h_rotl((c ^ h_word(p + i + 16)) * H_MUL, 31);
+        d = h_rotl((d ^ h_word(p + i + 24)) * H_MUL, 31);
+    }
+    for (; i + 8 <= n; i += 8) a = h_rotl((a ^ h_word(p + i)) * H_MUL, 31);
+    if (i < n) {
+        unsigned long long t = 0;
+        memcpy(&t, p + i, n - i);
+        a = h_rotl((a ^ t) * H_MUL, 31);
+    }
+    return h_fmix(a ^ h_fmix(b ^ h_fmix(c ^ h_fmix(d ^ n))));
+}
+
+/* ── Text Encoding ───────────────────────────────────────────────────── */
+
+/* One code point of UTF-8 at s[i] and its length; a malformed sequence
+   (overlong, surrogate, past U+10FFFF, cut short) is U+FFFD of length 1 */
+static size_t utf8_next(const unsigned char* s, size_t i, size_t n, unsigned* cp) {
+    unsigned c = s[i], lo = 0x80, hi = 0xBF, v;
+    size_t len;
+    if (c < 0x80) { *cp = c; return 1; }
+    if (c >= 0xC2 && c <= 0xDF) { len = 2; v = c & 0x1F; }
+    else if (c >= 0xE0 && c <= 0xEF) { len = 3; v = c & 0x0F; if (c == 0xE0) lo = 0xA0; else if (c == 0xED) hi = 0x9F; }
+    else if (c >= 0xF0 && c <= 0xF4) { len = 4; v = c & 0x07; if (c == 0xF0) lo = 0x90; else if (c == 0xF4) hi = 0x8F; }
+    else { *cp = 0xFFFD; return 1; }
+    if (n - i < len || s[i+1] < lo || s[i+1] > hi) { *cp = 0xFFFD; return 1; }
+    v = v << 6 | (s[i+1] & 0x3F);
+    for (size_t k = 2; k < len; k++) {
+        if ((s[i+k] & 0xC0) != 0x80) { *cp = 0xFFFD; return 1; }
+        v = v << 6 | (s[i+k] & 0x3F);
+    }
+    *cp = v;
+    return len;
+}
+
+static char* utf8_put(char* o, unsigned cp) {
+    if (cp < 0x80) *o++ = (char)cp;
+    else if (cp < 0x800) { *o++ = (char)(0xC0 | cp >> 6); *o++ = (char)(0x80 | (cp & 0x3F)); }
+    else if (cp < 0x10000) { *o++ = (char)(0xE0 | cp >> 12); *o++ = (char)(0x80 | (cp >> 6 & 0x3F)); *o++ = (char)(0x80 | (cp & 0x3F)); }
+    else { *o++ = (char)(0xF0 | cp >> 18); *o++ = (char)(0x80 | (cp >> 12 & 0x3F)); *o++ = (char)(0x80 | (cp >> 6 & 0x3F)); *o++ = (char)(0x80 | (cp & 0x3F)); }
+    return o;
+}
+
+/* Validation. The scalar path decodes; SSE2 skips ASCII 16 bytes at a
+   time and decodes the rest, 64 bytes at a go; AVX2 checks 32 bytes at once from three
+   nibble lookups per byte pair plus the lengths the leads ask for
+   (Keiser & Lemire, "Validating UTF-8 in less than one instruction per
+   byte"), with no branch on the data beyond the all-ASCII test. */
+
+static int utf8_valid_scalar(const unsigned char* s, size_t i, size_t n) {
+    unsigned cp;
+    while (i < n) {
+        if (s[i] < 0x80) { i++; continue; }
+        size_t l = utf8_next(s, i, n, &cp);
+        if (l == 1) return 0;
+        i += l;
+    }
+    return 1;
+}
+
+#ifdef MD_X86
+MD_TARGET("sse2")
+static int utf8_valid_sse2(const unsigned char* s, size_t n) {
+    size_t i = 0;
+    unsigned cp;
+    while (i + 16 <= n) {
+        if (!_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(s + i)))) { i += 16; continue; }
+        for (size_t end = i + 64 < n ? i + 64 : n; i < end; ) {   /* mixed text: stay scalar a while */
+            if (s[i] < 0x80) { i++; continue; }
+            size_t l = utf8_next(s, i, n, &cp);
+            if (l == 1) return 0;
+            i += l;
+        }
+    }
+    return utf8_valid_scalar(s, i, n);
+}
+
+/* Error bits of the lookups: a byte pair is bad when all three agree */
+#define U8_SHORT   0x01   /* lead or ASCII where a continuation must follow */
+#define U8_LONG    0x02   /* continuation after ASCII */
+#define U8_OVER3   0x04
+#define U8_LARGE   0x08
+#define U8_SURR    0x10
+#define U8_OVER2   0x20
+#define U8_LARGE1K 0x40   /* also OVERLONG_4 */
+#define U8_CONTS   0x80   /* two continuations: fine only inside a 3/4-byte sequence */
+#define U8_CARRY   (U8_SHORT | U8_LONG | U8_CONTS)
+#define U8_B(x)    ((char)(x))
+
+MD_TARGET("avx2")
+static int utf8_valid_avx2(const unsigned char* s, size_t n) {
+    const __m256i hi1 = _mm256_setr_epi8(
+        U8_LONG, U8_LONG, U8_LONG, U8_LONG, U8_LONG, U8_LONG, U8_LONG, U8_LONG,
+        U8_B(U8_CONTS), U8_B(U8_CONTS), U8_B(U8_CONTS), U8_B(U8_CONTS),
+        U8_SHORT | U8_OVER2, U8_SHORT, U8_SHORT | U8_OVER3 | U8_SURR, U8_SHORT | U8_LARGE | U8_LARGE1K,
+        U8_LONG, U8_LONG, U8_LONG, U8_LONG, U8_LONG, U8_LONG, U8_LONG, U8_LONG,
+        U8_B(U8_CONTS), U8_B(U8_CONTS), U8_B(U8_CONTS), U8_B(U8_CONTS),
+        U8_SHORT | U8_OVER2, U8_SHORT, U8_SHORT | U8_OVER3 | U8_SURR, U8_SHORT | U8_LARGE | U8_LARGE1K);
+#define U8_LO \
+        U8_B(U8_CARRY | U8_OVER3 | U8_OVER2 | U8_LARGE1K), U8_B(U8_CARRY | U8_OVER2), U8_B(U8_CARRY), U8_B(U8_CARRY), \
+        U8_B(U8_CARRY | U8_LARGE), U8_B(U8_CARRY | U8_LARGE | U8_LARGE1K), U8_B(U8_CARRY | U8_LARGE | U8_LARGE1K), U8_B(U8_CARRY | U8_LARGE | U8_LARGE1K), \
+        U8_B(U8_CARRY | U8_LARGE | U8_LARGE1K), U8_B(U8_CARRY | U8_LARGE | U8_LARGE1K), U8_B(U8_CARRY | U8_LARGE | U8_LARGE1K), U8_B(U8_CARRY | U8_LARGE | U8_LARGE1K), \
+        U8_B(U8_CARRY | U8_LARGE | U8_LARGE1K), U8_B(U8_CARRY | U8_LARGE | U8_LARGE1K | U8_SURR), U8_B(U8_CARRY | U8_LARGE | U8_LARGE1K), U8_B(U8_CARRY | U8_LARGE | U8_LARGE1K)
+#define U8_HI2 \
+        U8_SHORT, U8_SHORT, U8_SHORT, U8_SHORT, U8_SHORT, U8_SHORT, U8_SHORT, U8_SHORT, \
+        U8_B(U8_LONG | U8_OVER2 | U8_CONTS | U8_OVER3 | U8_LARGE1K), U8_B(U8_LONG | U8_OVER2 | U8_CONTS | U8_OVER3 | U8_LARGE), \
+        U8_B(U8_LONG | U8_OVER2 | U8_CONTS | U8_SURR | U8_LARGE), U8_B(U8_LONG | U8_OVER2 | U8_CONTS | U8_SURR | U8_LARGE), \
+        U8_SHORT, U8_SHORT, U8_SHORT, U8_SHORT
+    const __m256i lo1 = _mm256_setr_epi8(U8_LO, U8_LO), hi2 = _mm256_setr_epi8(U8_HI2, U8_HI2);
+#undef U8_LO
+#undef U8_HI2
+    /* A block ending in a lead whose sequence runs past it */
+    const __m256i tail = _mm256_setr_epi8(-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+                                          -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, U8_B(0xEF), U8_B(0xDF), U8_B(0xBF));
+    const __m256i nib = _mm256_set1_epi8(0x0F), top = _mm256_set1_epi8(U8_B(0x80));
+    __m256i prev = _mm256_setzero_si256(), err = prev, open = prev;
+    unsigned char last[32];
+    for (size_t i = 0; i < n; i += 32) {
+        __m256i v;
+        if (n - i >= 32) v = _mm256_loadu_si256((const __m256i*)(s + i));
+        else { memset(last, 0, sizeof(last)); memcpy(last, s + i, n - i); v = _mm256_loadu_si256((const __m256i*)last); }
+        if (!_mm256_movemask_epi8(v)) { err = _mm256_or_si256(err, open); open = _mm256_setzero_si256(); }
+        else {
+            __m256i carry = _mm256_permute2x128_si256(prev, v, 0x21);   /* prev's high lane, v's low lane */
+            __m256i p1 = _mm256_alignr_epi8(v, carry, 15), p2 = _mm256_alignr_epi8(v, carry, 14), p3 = _mm256_alignr_epi8(v, carry, 13);
+            __m256i sc = _mm256_and_si256(_mm256_and_si256(
+                _mm256_shuffle_epi8(hi1, _mm256_and_si256(_mm256_srli_epi16(p1, 4), nib)),
+                _mm256_shuffle_epi8(lo1, _mm256_and_si256(p1, nib))),
+                _mm256_shuffle_epi8(hi2, _mm256_and_si256(_mm256_srli_epi16(v, 4), nib)));
+            __m256i must = _mm256_and_si256(_mm256_or_si256(_mm256_subs_epu8(p2, _mm256_set1_epi8(U8_B(0xE0 - 0x80))),
+                                                            _mm256_subs_epu8(p3, _mm256_set1_epi8(U8_B(0xF0 - 0x80)))), top);
+            err = _mm256_or_si256(err, _mm256_xor_si256(must, sc));
+            open = _mm256_subs_epu8(v, tail);
+        }
+        prev = v;
+    }
+    err = _mm256_or_si256(err, open);
+    return _mm256_testz_si256(err, err);
+}
+#endif
+
+int md_utf8_valid(const char* s, size_t n) {
+    const unsigned char* u = (const unsigned char*)s;
+#ifdef MD_X86
+    switch (simd_level()) {
+    case MD_SIMD_AVX2: return utf8_valid_avx2(u, n);
+    case MD_SIMD_SSE2: return utf8_valid_sse2(u, n);
+    }
+#endif
+    return utf8_valid_scalar(u, 0, n);
+}
+
+/* UTF-8 -> UTF-16: ASCII blocks are widened whole; a block with anything
+   else starts a scalar stretch of four blocks, so mixed-script text does
+   not pay for a failed vector test every 16 bytes. Units never outnumber
+   bytes, so an output of n units is always enough. */
+static size_t u8to16_run(const unsigned char* s, size_t i, size_t end, size_t n, unsigned short* o, size_t* kp) {
+    size_t k = *kp;
+    while (i < end) {
+        unsigned cp = s[i];
+        if (cp < 0x80) { o[k++] = (unsigned short)cp; i++; continue; }
+        i += utf8_next(s, i, n, &cp);
+        if (cp >= 0x10000) { cp -= 0x10000; o[k++] = (unsigned short)(0xD800 | cp >> 10); o[k++] = (unsigned short)(0xDC00 | (cp & 0x3FF)); }
+        else o[k++] = (unsigned short)cp;
+    }
+    *kp = k;
+    return i;
+}
+
+#ifdef MD_X86
+MD_TARGET("sse2")
+static size_t u8to16_sse2(const unsigned char* s, size_t n, unsigned short* o) {
+    const __m128i z = _mm_setzero_si128();
+    size_t i = 0, k = 0;
+    while (i + 16 <= n) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+        if (_mm_movemask_epi8(v)) { i = u8to16_run(s, i, i + 64 < n ? i + 64 : n, n, o, &k); continue; }
+        _mm_storeu_si128((__m128i*)(o + k), _mm_unpacklo_epi8(v, z));
+        _mm_storeu_si128((__m128i*)(o + k + 8), _mm_unpackhi_epi8(v, z));
+        i += 16; k += 16;
+    }
+    u8to16_run(s, i, n, n, o, &k);
+    return k;
+}
+
+MD_TARGET("avx2")
+static size_t u8to16_avx2(const unsigned char* s, size_t n, unsigned short* o) {
+    size_t i = 0, k = 0;
+    while (i + 32 <= n) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(s + i));
+        if (_mm256_movemask_epi8(v)) { i = u8to16_run(s, i, i + 128 < n ? i + 128 : n, n, o, &k); continue; }
+        _mm256_storeu_si256((__m256i*)(o + k), _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)));
+        _mm256_storeu_si256((__m256i*)(o + k + 16), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1)));
+        i += 32; k += 32;
+    }
+    u8to16_run(s, i, n, n, o, &k);
+    return k;
+}
+#endif
+
+size_t md_utf8_to_utf16(const char* s, size_t n, unsigned short* out) {
+    const unsigned char* u = (const unsigned char*)s;
+    size_t k = 0;
+#ifdef MD_X86
+    switch (simd_level()) {
+    case MD_SIMD_AVX2: return u8to16_avx2(u, n, out);
+    case MD_SIMD_SSE2: return u8to16_sse2(u, n, out);
+    }
+#endif
+    u8to16_run(u, 0, n, n, out, &k);
+    return k;
+}
+
+/* UTF-16 -> UTF-8, from bytes in either order; at most 3 bytes per unit
+   (a pair makes 4 from 2). ASCII blocks are narrowed whole, the rest as above. */
+static unsigned u16_at(const unsigned char* b, size_t i, int be) {
+    return be ? (unsigned)b[2*i] << 8 | b[2*i+1] : (unsigned)b[2*i+1] << 8 | b[2*i];
+}
+
+static size_t u16to8_run(const unsigned char* b, size_t i, size_t end, size_t n, int be, char* o, size_t* kp) {
+    char* p = o + *kp;
+    while (i < end) {
+        unsigned u = u16_at(b, i++, be);
+        if (u < 0x80) { *p++ = (char)u; continue; }
+        if (u >= 0xD800 && u <= 0xDFFF) {
+            unsigned l = u <= 0xDBFF && i < n ? u16_at(b, i, be) : 0;
+            if (l >= 0xDC00 && l <= 0xDFFF) { u = 0x10000 + ((u - 0xD800) << 10) + (l - 0xDC00); i++; }
+            else u = 0xFFFD;   /* unpaired */
+        }
+        p = utf8_put(p, u);
+    }
+    *kp = (size_t)(p - o);
+    return i;
+}
+
+#ifdef MD_X86
+MD_TARGET("sse2")
+static size_t u16to8_sse2(const unsigned char* b, size_t n, int be, char* o) {
+    const __m128i high = _mm_set1_epi16((short)0xFF80), z = _mm_setzero_si128();
+    size_t i = 0, k = 0;
+    while (i + 8 <= n) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(b + 2*i));
+        if (be) v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, high), z)) != 0xFFFF) { i = u16to8_run(b, i, i + 32 < n ? i + 32 : n, n, be, o, &k); continue; }
+        _mm_storel_epi64((__m128i*)(o + k), _mm_packus_epi16(v, v));
+        i += 8; k += 8;
+    }
+    u16to8_run(b, i, n, n, be, o, &k);
+    return k;
+}
+
+MD_TARGET("avx2")
+static size_t u16to8_avx2(const unsigned char* b, size_t n, int be, char* o) {
+    const __m256i high = _mm256_set1_epi16((short)0xFF80), z = _mm256_setzero_si256();
+    size_t i = 0, k = 0;
+    while (i + 16 <= n) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(b + 2*i));
+        if (be) v = _mm256_or_si256(_mm256_slli_epi16(v, 8), _mm256_srli_epi16(v, 8));
+        if ((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_and_si256(v, high), z)) != 0xFFFFFFFFu) { i = u16to8_run(b, i, i + 64 < n ? i + 64 : n, n, be, o, &k); continue; }
+        /* packus works per 128-bit lane: gather the two low quarters */
+        __m256i p = _mm256_permute4x64_epi64(_mm256_packus_epi16(v, v), 0xD8);
+        _mm_storeu_si128((__m128i*)(o + k), _mm256_castsi256_si128(p));
+        i += 16; k += 16;
+    }
+    u16to8_run(b, i, n, n, be, o, &k);
+    return k;
+}
+#endif
+
+size_t md_utf16_to_utf8(const void* s, size_t n, int bigEndian, char* out) {
+    const unsigned char* b = (const unsigned char*)s;
+    size_t k = 0;
+#ifdef MD_X86
+    switch (simd_level()) {
+    case MD_SIMD_AVX2: return u16to8_avx2(b, n, bigEndian, out);
+    case MD_SIMD_SSE2: return u16to8_sse2(b, n, bigEndian, out);
+    }
+#endif
+    u16to8_run(b, 0, n, n, bigEndian, out, &k);
+    return k;
+}
+
+/* Windows-1252 0x80-0x9F; its five holes pass through as C1 controls,
+   as Windows converts them. 0xA0-0xFF are Latin-1. */
+static const unsigned short k_cp1252[32] = {
+    0x20AC,0x0081,0x201A,0x0192,0x201E,0x2026,0x2020,0x2021,0x02C6,0x2030,0x0160,0x2039,0x0152,0x008D,0x017D,0x008F,
+    0x0090,0x2018,0x2019,0x201C,0x201D,0x2022,0x2013,0x2014,0x02DC,0x2122,0x0161,0x203A,0x0153,0x009D,0x017E,0x0178
+};
+
+size_t md_legacy_to_utf8(const void* s, size_t n, const unsigned short* table, char* out) {
+    const unsigned char* b = (const unsigned char*)s;
+    char* o = out;
+    for (size_t i = 0; i < n; i++) {
+        unsigned c = b[i];
+        if (c < 0x80) { *o++ = (char)c; continue; }
+        unsigned cp = table ? table[c - 0x80] : c < 0xA0 ? k_cp1252[c - 0x80] : c;
+        o = utf8_put(o, cp ? cp : 0xFFFD);
+    }
+    return (size_t)(o - out);
+}
+
+int md_encoding_detect(const void* data, size_t len, size_t* bom) {
+    const unsigned char* b = (const unsigned char*)data;
+    *bom = 0;
+    if (len >= 3 && b[0] == 0xEF && b[1] == 0xBB && b[2] == 0xBF) { *bom = 3; return MD_ENC_UTF8; }
+    if (len >= 2 && b[0] == 0xFF && b[1] == 0xFE) { *bom = 2; return MD_ENC_UTF16LE; }
+    if (len >= 2 && b[0] == 0xFE && b[1] == 0xFF) { *bom = 2; return MD_ENC_UTF16BE; }
+    /* No BOM: UTF-16 of mostly Latin text has a NUL in every other byte */
+    size_t pairs = (len < 4096 ? len : 4096) / 2, ze = 0, zo = 0;
+    for (size_t i = 0; i < pairs; i++) { ze += !b[2*i]; zo += !b[2*i+1]; }
+    if (pairs >= 2 && zo * 2 > pairs && ze * 8 < zo) return MD_ENC_UTF16LE;
+    if (pairs >= 2 && ze * 2 > pairs && zo * 8 < ze) return MD_ENC_UTF16BE;
+    return len && !md_utf8_valid((const char*)b, len) ? MD_ENC_LEGACY : MD_ENC_UTF8;
+}
+
+/* ── Inline Scanner ──────────────────────────────────────────────────── */
+
+/* Finds the next byte at or after i where an inline rule could fire:
+   \ ` ! [ ~ * _ < the ':' of a bare URL, or the first of two spaces.
+   Everything before it is plain text and is copied as one run. */
+static const unsigned char k_inlTrig[256] = {
+    ['\\']=1, ['`']=1, ['!']=1, ['[']=1, ['~']=1, ['*']=1, ['_']=1, ['<']=1, [':']=1, [' ']=2
+};
+
+static size_t scan_inline_scalar(const char* t, size_t i, size_t len) {
+    for (; i < len; i++) {
+        unsigned char k = k_inlTrig[(unsigned char)t[i]];
+        if (k == 1 || (k == 2 && i+1 < len && t[i+1] == ' ')) return i;
+    }
+    return len;
+}
+
+#ifdef MD_X86
+MD_TARGET("sse2")
+static size_t scan_inline_sse2(const char* t, size_t i, size_t len) {
+    const __m128i c0=_mm_set1_epi8('\\'), c1=_mm_set1_epi8('`'), c2=_mm_set1_epi8('!'), c3=_mm_set1_epi8('['),
+                  c4=_mm_set1_epi8('~'), c5=_mm_set1_epi8('*'), c6=_mm_set1_epi8('_'), c7=_mm_set1_epi8('<'),
+                  c8=_mm_set1_epi8(':'), sp=_mm_set1_epi8(' ');
+    for (; i + 17 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(t + i));
+        __m128i w = _mm_loadu_si128((const __m128i*)(t + i + 1));
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v,c0), _mm_cmpeq_epi8(v,c1)),
+                                              _mm_or_si128(_mm_cmpeq_epi8(v,c2), _mm_cmpeq_epi8(v,c3))),
+                                 _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v,c4), _mm_cmpeq_epi8(v,c5)),
+                                              _mm_or_si128(_mm_cmpeq_epi8(v,c6), _mm_cmpeq_epi8(v,c7))));
+        m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(v,c8), _mm_and_si128(_mm_cmpeq_epi8(v,sp), _mm_cmpeq_epi8(w,sp))));
+        unsigned bits = (unsigned)_mm_movemask_epi8(m);
+        if (bits) return i + md_ctz(bits);
+    }
+    return scan_inline_scalar(t, i, len);
+}
+
+MD_TARGET("avx2")
+static size_t scan_inline_avx2(const char* t, size_t i, size_t len) {
+    const __m256i c0=_mm256_set1_epi8('\\'), c1=_mm256_set1_epi8('`'), c2=_mm256_set1_epi8('!'), c3=_mm256_set1_epi8('['),
+                  c4=_mm256_set1_epi8('~'), c5=_mm256_set1_epi8('*'), c6=_mm256_set1_epi8('_'), c7=_mm256_set1_epi8('<'),
+                  c8=_mm256_set1_epi8(':'), sp=_mm256_set1_epi8(' ');
+    for (; i + 33 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(t + i));
+        __m256i w = _mm256_loadu_si256((const __m256i*)(t + i + 1));
+        __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v,c0), _mm256_cmpeq_epi8(v,c1)),
+                                                    _mm256_or_si256(_mm256_cmpeq_epi8(v,c2), _mm256_cmpeq_epi8(v,c3))),
+                                    _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v,c4), _mm256_cmpeq_epi8(v,c5)),
+                                                    _mm256_or_si256(_mm256_cmpeq_epi8(v,c6), _mm256_cmpeq_epi8(v,c7))));
+        m = _mm256_or_si256(m, _mm256_or_si256(_mm256_cmpeq_epi8(v,c8), _mm256_and_si256(_mm256_cmpeq_epi8(v,sp), _mm256_cmpeq_epi8(w,sp))));
+        unsigned bits = (unsigned)_mm256_movemask_epi8(m);
+        if (bits) return i + md_ctz(bits);
+    }
+    /* Scalar tail, as in scan_esc_avx2 */
+    return scan_inline_scalar(t, i, len);
+}
+#endif
+
+static size_t scan_inline(const char* t, size_t i, size_t len) {
+#ifdef MD_X86
+    switch (simd_level()) {
+    case MD_SIMD_AVX2: return scan_inline_avx2(t, i, len);
+    case MD_SIMD_SSE2: return scan_inline_sse2(t, i, len);
+    }
+#endif
+    return scan_inline_scalar(t, i, len);
+}
+
+/* ── Markdown Inline Parser ──────────────────────────────────────────── */
+
+/* Matching ']' for the '[' at t[i] (depth counted, as before), or len if
+   it has none inside this span. Answered from the table parse_inline
+   builds once for the whole top-level span with a bracket stack. */
+static size_t bracket_close(MdContext* cx, const char* t, size_t len, size_t i) {
+    size_t base = (size_t)(t - cx->inlBase);
+    unsigned m = cx->brk[base + i];
+    return (m && m - 1 - base < len) ? m - 1 - base : len;
+}
+
+/* Closer scans only ever run forward to the end of the span, so once a
+   scan from position p finds nothing, every later scan for the same
+   delimiter fails too. Remembering that bound keeps unmatched openers
+   from rescanning the rest of the paragraph each time. */
+typedef struct { size_t tilde, b3[2], b2[2], i1[2], gt, paren, tick[8]; } NoCloser;
+
+static void inline_run(MdContext* cx, StrBuf* sb, const char* t, size_t len) {
+    size_t i = 0;
+    NoCloser nc; memset(&nc, 0xff, sizeof(nc));  /* SIZE_MAX: nothing known yet */
+    while (i < len) {
+        /* Backslash escape */
+        if (t[i]=='\\' && i+1<len) {
+            char nx=t[i+1];
+            if(nx=='*'||nx=='_'||nx=='`'||nx=='['||nx==']'||nx=='('||nx==')'||nx=='#'||nx=='~'||nx=='!'||nx=='|'||nx=='\\'||nx=='-')
+            { sb_append_esc(sb,&t[i+1],1); i+=2; continue; }
+        }
+        /* Line break (2+ trailing spaces + \n) */
+        if (t[i]==' ' && i+1<len && t[i+1]==' ') {
+            size_t j=i+2; while(j<len&&t[j]==' ')j++;
+            if(j<len&&t[j]=='\n'){ sb_append(sb,"<br>\n"); i=j+1; continue; }
+            sb_append_n(sb,t+i,j-i); i=j; continue;  /* every later space in the run fails the same way */
+        }
+        /* Inline code */
+        if (t[i]=='`') {
+            int tk=0; size_t st=i; while(i<len&&t[i]=='`'){tk++;i++;}
+            size_t e=i; int found=0;
+            if(tk<=8&&i>=nc.tick[tk-1]) e=len;
+            while(e<=len-tk){
+                if(t[e]=='`'){ int ct=0;size_t ce=e; while(ce<len&&t[ce]=='`'){ct++;ce++;}
+                    if(ct==tk){ sb_append(sb,"<code>"); sb_append_esc(sb,t+i,e-i); sb_append(sb,"</code>"); i=ce; found=1; break; } e=ce;
+                } else e++;
+            }
+            if(!found){ sb_append_esc(sb,t+st,tk); if(tk<=8&&i<nc.tick[tk-1])nc.tick[tk-1]=i; }
+            continue;
+        }
+        /* Image ![alt](url) or ![alt][ref] */
+        if (t[i]=='!' && i+1<len && t[i+1]=='[') {
+            size_t as=i+2,j=bracket_close(cx,t,len,i+1);
+            if(j<len&&j+1<len&&t[j+1]=='('){
+                /* Inline: ![alt](url) */
+                size_t us=j+2,ue=us>=nc.paren?len:us; while(ue<len&&t[ue]!=')')ue++;
+                if(ue>=len&&us<nc.paren) nc.paren=us;
+                if(ue<len){ sb_append(sb,"<img alt=\""); sb_append_esc(sb,t+as,j-as);
+                    sb_append(sb,"\" src=\""); sb_append_esc(sb,t+us,ue-us);
+                    sb_append(sb,"\" style=\"max-width:100%\">"); i=ue+1; continue; }
+            }
+            if(j<len&&j+1<len&&t[j+1]=='['){
+                /* Reference: ![alt][label] */
+                size_t ls=j+2,le=ls; while(le<len&&t[le]!=']')le++;
+                if(le<len){ const RefLink* r=ref_find(&cx->refs,t+ls,le-ls);
+                    if(r){ sb_append(sb,"<img alt=\""); sb_append_esc(sb,t+as,j-as);
+                        sb_append(sb,"\" src=\""); sb_append(sb,REF_URL(&cx->refs,r));
+                        if(r->title){sb_append(sb,"\" title=\""); sb_append(sb,REF_TITLE(&cx->refs,r));}
+                        sb_append(sb,"\" style=\"max-width:100%\">"); i=le+1; continue; }
+                }
+            }
+            /* Also try ![alt] with alt as the label */
+            if(j<len) {
+                const RefLink* r=ref_find(&cx->refs,t+as,j-as);
+                if(r){ sb_append(sb,"<img alt=\""); sb_append_esc(sb,t+as,j-as);
+                    sb_append(sb,"\" src=\""); sb_append(sb,REF_URL(&cx->refs,r));
+                    if(r->title){sb_append(sb,"\" title=\""); sb_append(sb,REF_TITLE(&cx->refs,r));}
+                    sb_append(sb,"\" style=\"max-width:100%\">"); i=j+1; continue; }
+            }
+        }
+        /* Link [text](url) or [text][ref] */
+        if (t[i]=='[') {
+            size_t ts=i+1,j=bracket_close(cx,t,len,i);
+            if(j<len&&j+1<len&&t[j+1]=='('){
+                /* Inline: [text](url) */
+                size_t us=j+2,ue=us>=nc.paren?len:us; while(ue<len&&t[ue]!=')')ue++;
+                if(ue>=len&&us<nc.paren) nc.paren=us;
+                if(ue<len){ sb_append(sb,"<a href=\""); sb_append_esc(sb,t+us,ue-us);
+                    sb_append(sb,"\">"); inline_run(cx,sb,t+ts,j-ts); sb_append(sb,"</a>"); i=ue+1; continue; }
+            }
+            if(j<len&&j+1<len&&t[j+1]=='['){
+                /* Reference: [text][label] */
+                size_t ls=j+2,le=ls; while(le<len&&t[le]!=']')le++;
+                if(le<len){ const RefLink* r=ref_find(&cx->refs,t+ls,le-ls);
+                    if(r){ sb_append(sb,"<a href=\""); sb_append(sb,REF_URL(&cx->refs,r));
+                        if(r->title){sb_append(sb,"\" title=\""); sb_append(sb,REF_TITLE(&cx->refs,r));}
+                        sb_append(sb,"\">"); inline_run(cx,sb,t+ts,j-ts); sb_append(sb,"</a>"); i=le+1; continue; }
+                }
+            }
+            /* Also try [text] with text as the label */
+            if(j<len&&(j+1>=len||t[j+1]!='(')) {
+                const RefLink* r=ref_find(&cx->refs,t+ts,j-ts);
+                if(r){ sb_append(sb,"<a href=\""); sb_append(sb,REF_URL(&cx->refs,r));
+                    if(r->title){sb_append(sb,"\" title=\""); sb_append(sb,REF_TITLE(&cx->refs,r));}
+                    sb_append(sb,"\">"); inline_run(cx,sb,t+ts,j-ts); sb_append(sb,"</a>"); i=j+1; continue; }
+            }
+        }
+        /* Strikethrough ~~text~~ */
+        if (t[i]=='~'&&i+1<len&&t[i+1]=='~') {
+            size_t s2=i+2,e2=s2>=nc.tilde?len:s2; while(e2+1<len&&!(t[e2]=='~'&&t[e2+1]=='~'))e2++;
+            if(e2+1>=len&&s2<nc.tilde) nc.tilde=s2;
+            if(e2+1<len){ sb_append(sb,"<del>"); inline_run(cx,sb,t+s2,e2-s2); sb_append(sb,"</del>"); i=e2+2; continue; }
+        }
+        /* Bold+Italic ***text*** */
+        if ((t[i]=='*'||t[i]=='_')&&i+2<len&&t[i+1]==t[i]&&t[i+2]==t[i]) {
+            char m=t[i]; int k=m=='_'; size_t s3=i+3,e3=s3>=nc.b3[k]?len:s3;
+            while(e3+2<len&&!(t[e3]==m&&t[e3+1]==m&&t[e3+2]==m))e3++;
+            if(e3+2>=len&&s3<nc.b3[k]) nc.b3[k]=s3;
+            if(e3+2<len){ sb_append(sb,"<strong><em>"); inline_run(cx,sb,t+s3,e3-s3); sb_append(sb,"</em></strong>"); i=e3+3; continue; }
+        }
+        /* Bold **text** */
+        if ((t[i]=='*'||t[i]=='_')&&i+1<len&&t[i+1]==t[i]) {
+            char m=t[i]; int k=m=='_'; size_t s2=i+2,e2=s2>=nc.b2[k]?len:s2;
+            while(e2+1<len&&!(t[e2]==m&&t[e2+1]==m))e2++;
+            if(e2+1>=len&&s2<nc.b2[k]) nc.b2[k]=s2;
+            if(e2+1<len&&e2>s2){ sb_append(sb,"<strong>"); inline_run(cx,sb,t+s2,e2-s2); sb_append(sb,"</strong>"); i=e2+2; continue; }
+        }
+        /* Italic *text* */
+        if ((t[i]=='*'||t[i]=='_')&&i+1<len&&t[i+1]!=t[i]&&t[i+1]!=' ') {
+            char m=t[i]; int k=m=='_'; size_t s1=i+1,e1=s1>=nc.i1[k]?len:s1; while(e1<len&&t[e1]!=m)e1++;
+            if(e1>=len&&s1<nc.i1[k]) nc.i1[k]=s1;
+            if(e1<len&&e1>s1&&t[e1-1]!=' '){ sb_append(sb,"<em>"); inline_run(cx,sb,t+s1,e1-s1); sb_append(sb,"</em>"); i=e1+1; continue; }
+        }
+        /* Autolink bare URLs */
+        if (i+8<len&&(strncmp(t+i,"https://",8)==0||strncmp(t+i,"http://",7)==0)) {
+            size_t us=i; while(i<len&&t[i]!=' '&&t[i]!='\n'&&t[i]!='\r'&&t[i]!=')'&&t[i]!='>'&&t[i]!='"')i++;
+            while(i>us&&(t[i-1]=='.'||t[i-1]==','||t[i-1]==';'))i--;
+            sb_append(sb,"<a href=\""); sb_append_esc(sb,t+us,i-us); sb_append(sb,"\">"); sb_append_esc(sb,t+us,i-us); sb_append(sb,"</a>"); continue;
+        }
+        /* Inline HTML — pass through <tag>, </tag>, <tag attr="val">, <br/>, etc. */
+        if (t[i]=='<' && i+1<len && (isalpha(t[i+1]) || t[i+1]=='/' || t[i+1]=='!')) {
+            size_t j=i+1>=nc.gt?len:i+1;
+            /* Find the closing > */
+            while(j<len && t[j]!='>') j++;
+            if (j>=len && i+1<nc.gt) nc.gt=i+1;
+            if (j<len) {
+                /* Pass through raw */
+                sb_ensure(sb, j-i+1);
+                for(size_t k=i; k<=j; k++) sb_append_char(sb, t[k]);
+                i=j+1; continue;
+            }
+        }
+        /* Plain text: copy up to the next byte a rule above could fire on */
+        { size_t q=scan_inline(t,i+1,len);
+            if(q<len&&t[q]==':'){  /* a bare URL starts at its scheme, not the colon */
+                if(q>=i+6&&memcmp(t+q-5,"https",5)==0) q-=5;
+                else if(q>=i+5&&memcmp(t+q-4,"http",4)==0) q-=4;
+            }
+            sb_append_esc(sb,t+i,q-i); i=q; }
+    }
+}
+
+static void parse_inline(MdContext* cx, StrBuf* sb, const char* t, size_t len) {
+    /* One pass pairs every '[' with its ']'; the upper half is the stack */
+    if (2*len > cx->brkCap) {
+        size_t cap = 2*len + 64;
+        cx->brk = (unsigned*)arena_grow(&cx->arena, cx->brk, cx->brkCap * sizeof(unsigned), cap * sizeof(unsigned));
+        cx->brkCap = cap;
+    }
+    unsigned* open = cx->brk + len; size_t top = 0;
+    for (size_t i=0; i<len; i++) {
+        if (t[i]=='[') { cx->brk[i] = 0; open[top++] = (unsigned)i; }
+        else if (t[i]==']' && top) cx->brk[open[--top]] = (unsigned)i + 1;
+    }
+    cx->inlBase = t;
+    inline_run(cx, sb, t, len);
+}
+
+/* ── Syntax Highlighter ──────────────────────────────────────────────── */
+
+/* Fenced code in a known language is tokenized line by line as it is
+   emitted and wrapped in the sh-* spans the page styles. One pass, so
+   nothing inside a string or comment is taken for anything else. A
+   comment or string left open at the end of a line carries over to the
+   next in *state. */
+
+enum { SH_NONE, SH_JS, SH_PY, SH_C, SH_SQL, SH_SH, SH_CSS, SH_PHP, SH_HTML };
+enum { SHS_CODE, SHS_BLOCK, SHS_HTMLCM, SHS_TPL, SHS_TRI2, SHS_TRI1 };
+
+/* Keyword sets: perfect hashes. kw_hash with the seed noted puts every
+   word of a set in its own slot; the seed is the first that does, found
+   offline, so a changed list needs a new search (or a bigger table). */
+static unsigned kw_hash(const char* s, size_t n, unsigned seed) {
+    unsigned h = seed;
+    for (size_t i = 0; i < n; i++) h = (h ^ (unsigned char)s[i]) * 16777619u;
+    return h ^ (h >> 15);
+}
+
+static const char* const k_kwJs[128] = {  /* seed 963 */
+    [2]="export", [6]="null", [7]="function", [8]="instanceof", [17]="case", [21]="continue",
+    [25]="new", [27]="from", [29]="class", [33]="switch", [34]="extends", [36]="false", [39]="do",
+    [46]="typeof", [49]="default", [52]="of", [61]="else", [66]="if", [75]="try", [76]="return",
+    [79]="for", [83]="await", [84]="true", [85]="catch", [92]="let", [93]="finally", [95]="import",
+    [97]="throw", [98]="while", [101]="var", [102]="async", [106]="this", [110]="undefined",
+    [114]="break", [116]="const", [118]="yield", [122]="in"
+};
+static const char* const k_kwPy[128] = {  /* seed 318 */
+    [1]="else", [7]="from", [10]="lambda", [12]="with", [14]="self", [18]="global", [20]="True",
+    [23]="as", [25]="continue", [31]="False", [35]="in", [44]="for", [49]="finally", [53]="except",
+    [55]="try", [59]="while", [63]="not", [64]="nonlocal", [71]="break", [72]="return", [75]="if",
+    [78]="and", [80]="is", [84]="import", [88]="elif", [96]="print", [100]="or", [103]="pass",
+    [105]="None", [106]="del", [114]="class", [116]="yield", [118]="raise", [120]="def",
+    [123]="assert"
+};
+static const char* const k_kwC[256] = {  /* seed 8067 */
+    [2]="let", [4]="if", [6]="async", [12]="NULL", [14]="func", [18]="mut", [20]="void",
+    [22]="static", [29]="defer", [34]="typedef", [39]="double", [42]="private", [47]="impl",
+    [73]="mod", [74]="use", [81]="protected", [84]="package", [85]="true", [87]="false",
+    [90]="virtual", [97]="await", [99]="extern", [101]="short", [103]="struct", [110]="nullptr",
+    [111]="case", [113]="sizeof", [123]="match", [124]="pub", [127]="import", [132]="union",
+    [135]="return", [142]="enum", [148]="select", [151]="interface", [152]="class", [160]="null",
+    [162]="override", [163]="volatile", [164]="int", [172]="float", [174]="const", [176]="var",
+    [178]="goto", [184]="default", [188]="long", [190]="unsigned", [192]="signed", [194]="range",
+    [198]="new", [199]="delete", [201]="type", [204]="continue", [208]="fn", [212]="auto",
+    [215]="else", [216]="char", [224]="do", [228]="for", [233]="break", [236]="while",
+    [238]="register", [239]="public", [247]="loop", [252]="chan", [253]="switch", [254]="this"
+};
+static const char* const k_kwSql[128] = {  /* seed 8079 */
+    [1]="max", [3]="delete", [4]="join", [6]="null", [10]="where", [13]="outer", [15]="values",
+    [17]="avg", [20]="left", [22]="all", [23]="by", [24]="drop", [26]="index", [29]="table",
+    [30]="exists", [33]="having", [34]="distinct", [36]="min", [38]="offset", [41]="is", [46]="in",
+    [53]="right", [54]="on", [57]="between", [66]="select", [71]="sum", [72]="create",
+    [74]="rollback", [77]="order", [79]="commit", [82]="count", [88]="from", [90]="as", [91]="and",
+    [92]="begin", [93]="not", [94]="union", [95]="alter", [98]="update", [103]="like", [106]="or",
+    [107]="insert", [108]="limit", [110]="group", [113]="inner", [114]="into", [123]="set"
+};
+static const char* const k_kwSh[128] = {  /* seed 421 */
+    [1]="for", [2]="source", [7]="pip", [9]="exit", [10]="fi", [11]="mkdir", [14]="if", [15]="cat",
+    [16]="ls", [20]="apt", [22]="in", [23]="local", [26]="chown", [30]="return", [37]="export",
+    [39]="chmod", [40]="cd", [41]="npm", [44]="cp", [47]="echo", [49]="awk", [54]="then", [57]="mv",
+    [65]="else", [69]="do", [72]="esac", [76]="case", [80]="done", [82]="sudo", [85]="rm",
+    [86]="yum", [89]="while", [102]="grep", [107]="sed", [123]="function", [125]="elif"
+};
+static const char* const k_kwCss[64] = {  /* seed 470 */
+    [1]="inline", [2]="background", [6]="auto", [11]="none", [14]="position", [15]="padding",
+    [16]="width", [17]="relative", [18]="fixed", [20]="border", [25]="color", [26]="important",
+    [29]="grid", [32]="font", [34]="bottom", [35]="block", [41]="inherit", [42]="top", [44]="flex",
+    [45]="solid", [48]="transparent", [49]="absolute", [50]="right", [54]="height", [55]="margin",
+    [57]="display", [60]="left"
+};
+static const char* const k_kwPhp[128] = {  /* seed 74 */
+    [0]="static", [2]="return", [5]="echo", [6]="switch", [9]="var", [14]="while", [18]="try",
+    [21]="else", [22]="private", [26]="throw", [30]="require", [31]="unset", [32]="print",
+    [40]="for", [43]="continue", [48]="use", [49]="break", [61]="do", [64]="class", [67]="if",
+    [71]="case", [77]="array", [80]="protected", [83]="isset", [89]="false", [94]="namespace",
+    [101]="new", [103]="empty", [105]="finally", [107]="elseif", [110]="public", [111]="null",
+    [113]="function", [115]="include", [116]="catch", [117]="foreach", [122]="true"
+};
+typedef struct { const char* name; unsigned char lang; } ShName;
+static const ShName k_shNames[] = {
+    {"js",SH_JS}, {"javascript",SH_JS}, {"typescript",SH_JS}, {"ts",SH_JS},
+    {"python",SH_PY}, {"py",SH_PY},
+    {"c",SH_C}, {"cpp",SH_C}, {"csharp",SH_C}, {"cs",SH_C}, {"java",SH_C}, {"rust",SH_C}, {"go",SH_C},
+    {"sql",SH_SQL},
+    {"bash",SH_SH}, {"sh",SH_SH}, {"shell",SH_SH}, {"zsh",SH_SH},
+    {"css",SH_CSS}, {"scss",SH_CSS}, {"less",SH_CSS},
+    {"php",SH_PHP},
+    {"html",SH_HTML}, {"xml",SH_HTML}
+};
+typedef struct { const char* const* slot; unsigned mask, seed; } KwSet;
+static const KwSet k_kwSets[] = {
+    [SH_JS]  = { k_kwJs,  127, 963u },  [SH_PY]  = { k_kwPy,  127, 318u },
+    [SH_C]   = { k_kwC,   255, 8067u },   [SH_SQL] = { k_kwSql, 127, 8079u },
+    [SH_SH]  = { k_kwSh,  127, 421u },  [SH_CSS] = { k_kwCss, 63, 470u },
+    [SH_PHP] = { k_kwPhp, 127, 74u }
+};
+
+/* Language of a fence info string (its first word), SH_NONE if unknown */
+static int sh_lang(const char* s, size_t n) {
+    size_t w = 0;
+    while (w < n && s[w] != ' ' && s[w] != '\t') w++;
+    for (size_t k = 0; k < sizeof(k_shNames)/sizeof(k_shNames[0]); k++) {
+        const char* nm = k_shNames[k].name;
+        size_t i = 0;
+        while (i < w && nm[i] && tolower((unsigned char)s[i]) == nm[i]) i++;
+        if (i == w && !nm[i]) return k_shNames[k].lang;
+    }
+    return SH_NONE;
+}
+
+static int is_keyword(int lang, const char* s, size_t n) {
+    const KwSet* ks = &k_kwSets[lang];
+    char low[16];
+    if (!ks->slot || n >= sizeof(low)) return 0;
+    if (lang == SH_SQL) {  /* any case */
+        for (size_t i = 0; i < n; i++) low[i] = (char)tolower((unsigned char)s[i]);
+        s = low;
+    }
+    const char* kw = ks->slot[kw_hash(s, n, ks->seed) & ks->mask];
+    return kw && strncmp(kw, s, n) == 0 && kw[n] == '\0';
+}
+
+static void sh_span(StrBuf* sb, const char* cls, const char* s, size_t n) {
+    sb_append(sb, "<span class=\""); sb_append(sb, cls); sb_append(sb, "\">");
+    sb_append_esc(sb, s, n); sb_append(sb, "</span>");
+}
+
+/* End of a comment or string that continues from i: just past its closing
+   `q` (qn bytes; `esc` escapes the next byte, 0: none), or n with *state
+   set to `open` */
+static size_t sh_close(const char* s, size_t i, size_t n, const char* q, size_t qn, char esc, int open, int* state) {
+    for (; i + qn <= n; i++) {
+        if (esc && s[i] == esc) { i++; continue; }
+        if (s[i] == q[0] && memcmp(s + i, q, qn) == 0) { *state = SHS_CODE; return i + qn; }
+    }
+    *state = open;
+    return n;
+}
+
+static int is_ident(char c) { return isalnum((unsigned char)c) || c == '_'; }
+static int line_lead(const char* s, size_t i) { while (i && (s[i-1] == ' ' || s[i-1] == '\t')) i--; return i == 0; }
+
+static void sh_line(StrBuf* sb, int lang, int* state, const char* s, size_t n) {
+    size_t i = 0, plain = 0;   /* s[plain, i) is copied as is */
+    switch (*state) {          /* finish what the last line left open */
+    case SHS_BLOCK:  i = sh_close(s, 0, n, "*/", 2, 0, SHS_BLOCK, state); sh_span(sb, "sh-cm", s, i); break;
+    case SHS_HTMLCM: i = sh_close(s, 0, n, "-->", 3, 0, SHS_HTMLCM, state); sh_span(sb, "sh-cm", s, i); break;
+    case SHS_TPL:    i = sh_close(s, 0, n, "`", 1, '\\', SHS_TPL, state); sh_span(sb, "sh-str", s, i); break;
+    case SHS_TRI2:   i = sh_close(s, 0, n, "\"\"\"", 3, '\\', SHS_TRI2, state); sh_span(sb, "sh-str", s, i); break;
+    case SHS_TRI1:   i = sh_close(s, 0, n, "'''", 3, '\\', SHS_TRI1, state); sh_span(sb, "sh-str", s, i); break;
+    }
+    plain = i;
+    while (i < n) {
+        char c = s[i], d = i + 1 < n ? s[i+1] : '\0';
+        const char* cls = NULL; size_t j = i;
+        if (lang == SH_HTML && c == '<' && n - i >= 4 && memcmp(s + i, "<!--", 4) == 0) {
+            j = sh_close(s, i + 4, n, "-->", 3, 0, SHS_HTMLCM, state); cls = "sh-cm";
+        } else if (lang == SH_HTML && c == '<') {
+            size_t k = i + 1 + (d == '/'), e = k;
+            while (e < n && (isalnum((unsigned char)s[e]) || s[e] == '-' || s[e] == ':') && (e > k || isalpha((unsigned char)s[e]))) e++;
+            if (e > k) { sb_append_esc(sb, s + plain, k - plain); sh_span(sb, "sh-tag", s + k, e - k); i = plain = e; continue; }
+        } else if (c == '/' && d == '*' && lang != SH_PY && lang != SH_SH && lang != SH_HTML) {
+            j = sh_close(s, i + 2, n, "*/", 2, 0, SHS_BLOCK, state); cls = "sh-cm";
+        } else if ((c == '/' && d == '/' && (lang == SH_JS || lang == SH_C || lang == SH_PHP))
+                || (c == '-' && d == '-' && lang == SH_SQL)
+                || (c == '#' && (lang == SH_PY || lang == SH_PHP || (lang == SH_SH && (i == 0 || s[i-1] == ' ' || s[i-1] == '\t'))))) {
+            j = n; cls = "sh-cm";
+        } else if (c == '#' && lang == SH_C && line_lead(s, i)) {  /* preprocessor directive */
+            j = i + 1; while (j < n && is_ident(s[j])) j++;
+            cls = "sh-kw";
+        } else if (c == '"' || c == '\'' || (c == '`' && lang != SH_HTML && lang != SH_CSS)) {
+            cls = "sh-str";
+            if (lang == SH_PY && d == c && i + 2 < n && s[i+2] == c)
+                j = sh_close(s, i + 3, n, c == '"' ? "\"\"\"" : "'''", 3, '\\', c == '"' ? SHS_TRI2 : SHS_TRI1, state);
+            else if (c == '`' && lang == SH_JS)
+                j = sh_close(s, i + 1, n, "`", 1, '\\', SHS_TPL, state);
+            else {  /* ends with the line; an unclosed quote (don't, 'a) is no string */
+                int st; j = sh_close(s, i + 1, n, &c, 1, '\\', -1, &st);
+                if (st < 0) { i++; continue; }
+            }
+        } else if (isdigit((unsigned char)c)) {
+            j = i + 1;
+            if (c == '0' && (d == 'x' || d == 'X')) { j = i + 2; while (j < n && isxdigit((unsigned char)s[j])) j++; }
+            else {
+                while (j < n && (isdigit((unsigned char)s[j]) || s[j] == '.')) j++;
+                if (j < n && (s[j] == 'e' || s[j] == 'E')) {
+                    size_t e = j + 1 + (j + 1 < n && (s[j+1] == '+' || s[j+1] == '-'));
+                    if (e < n && isdigit((unsigned char)s[e])) { j = e; while (j < n && isdigit((unsigned char)s[j])) j++; }
+                }
+            }
+            if (j < n && is_ident(s[j])) { while (j < n && is_ident(s[j])) j++; i = j; continue; }  /* 1st, 0b1 */
+            cls = "sh-num";
+        } else if (isalpha((unsigned char)c) || c == '_') {
+            j = i + 1;
+            while (j < n && (is_ident(s[j]) || (lang == SH_HTML && s[j] == '-'))) j++;
+            size_t k = j;
+            while (k < n && (s[k] == ' ' || s[k] == '\t')) k++;
+            if (lang == SH_HTML) { if (k < n && s[k] == '=' && i > 0 && (s[i-1] == ' ' || s[i-1] == '\t')) cls = "sh-attr"; }
+            else if (is_keyword(lang, s + i, j - i)) cls = "sh-kw";
+            else if (k < n && s[k] == '(') cls = "sh-fn";
+            if (!cls) { i = j; continue; }
+        }
+        if (!cls) { i++; continue; }
+        sb_append_esc(sb, s + plain, i - plain);
+        sh_span(sb, cls, s + i, j - i);
+        i = plain = j;
+    }
+    sb_append_esc(sb, s + plain, n - plain);
+}
+
+/* ── Grammars ────────────────────────────────────────────────────────── */
+
+/* Languages beyond the built-in ones, from grammar files (format in
+   README.md). All patterns of a grammar - keywords, tokens, the word
+   pattern, the openers of comments and strings - are compiled into one
+   DFA over byte classes: each pattern is a chain of positions (a
+   Glushkov automaton) and subset construction merges them. Lexing a
+   line is then one table walk per token; the longest match wins, the
+   earlier rule on a tie, and the word pattern comes last. */
+
+enum { GR_WORD, GR_TOKEN, GR_COMMENT, GR_SPAN, GR_BLOCK };
+enum { GC_PLAIN, GC_KW, GC_STR, GC_NUM, GC_CM, GC_FN, GC_OP, GC_TYPE, GC_TAG, GC_ATTR, GC_COUNT };
+enum { GR_MAX_POS = 4096, GR_MAX_STATES = 4096, GR_MAX_RULES = 4096, GR_NAMES = 120, GR_CLOSE = 12 };
+
+static const char* const k_grClass[GC_COUNT] = { "plain", "kw", "str", "num", "cm", "fn", "op", "type", "tag", "attr" };
+static const char* const k_grSpan[GC_COUNT] = { "", "sh-kw", "sh-str", "sh-num", "sh-cm", "sh-fn", "sh-op", "sh-type", "sh-tag", "sh-attr" };
+
+typedef struct { unsigned char kind, cls, esc, closeLen; char close[GR_CLOSE]; } GrRule;
+
+/* One allocation: the struct, then next[], accept[] and rule[] */
+struct MdGrammar {
+    char names[GR_NAMES];         /* lowercase, space-separated */
+    int calls;                    /* a word followed by '(' is sh-fn */
+    int states, classes, rules;
+    unsigned char byteClass[256];
+    unsigned short* next;         /* [state * classes + class]; 0 = no match */
+    short* accept;                /* rule matched on reaching a state, -1 none */
+    GrRule* rule;
+};
+
+static MdGrammar* gr_alloc(int states, int classes, int rules) {
+    size_t head = (sizeof(MdGrammar) + 7) & ~(size_t)7;
+    size_t nx = (size_t)states * classes * sizeof(unsigned short), ac = (size_t)states * sizeof(short);
+    MdGrammar* g = (MdGrammar*)calloc(1, head + nx + ac + (size_t)rules * sizeof(GrRule));
+    if (!g) return NULL;
+    g->states = states; g->classes = classes; g->rules = rules;
+    g->next = (unsigned short*)((char*)g + head);
+    g->accept = (short*)((char*)g->next + nx);
+    g->rule = (GrRule*)((char*)g->accept + ac);
+    return g;
+}
+
+void md_grammar_free(MdGrammar* g) { free(g); }
+
+/* Build state: positions of all patterns so far, in rule order */
+typedef struct { unsigned char set[32]; char rep; } GrPos;   /* rep: '*', '+', '?' or 0 */
+typedef struct {
+    GrPos* pos; int npos;
+    GrRule* rule; int* first; int nrules;   /* first[r]: rule r's first position; first[nrules] = npos */
+    char* err; size_t errLen;
+} GrBuild;
+
+#define GR_SET(s, b) ((s)[(unsigned char)(b) >> 3] |= (unsigned char)(1u << ((b) & 7)))
+#define GR_HAS(s, b) (((s)[(unsigned char)(b) >> 3] >> ((b) & 7)) & 1)
+
+static int gr_error(GrBuild* b, int line, const char* msg, const char* what, size_t wn) {
+    if (b->err && b->errLen) snprintf(b->err, b->errLen, "line %d: %s%s%.*s", line, msg, wn ? " " : "", (int)wn, what);
+    return -1;
+}
+
+static int gr_rule(GrBuild* b, int kind, int cls) {
+    if (b->nrules >= GR_MAX_RULES) return -1;
+    GrRule* r = &b->rule[b->nrules];
+    memset(r, 0, sizeof(*r)); r->kind = (unsigned char)kind; r->cls = (unsigned char)cls;
+    b->first[b->nrules++] = b->npos;
+    b->first[b->nrules] = b->npos;
+    return 0;
+}
+
+static GrPos* gr_pos(GrBuild* b) {
+    if (b->npos >= GR_MAX_POS) return NULL;
+    GrPos* p = &b->pos[b->npos++];
+    memset(p, 0, sizeof(*p));
+    b->first[b->nrules] = b->npos;
+    return p;
+}
+
+static int gr_literal(GrBuild* b, const char* s, size_t n, int nocase) {
+    for (size_t i = 0; i < n; i++) {
+        GrPos* p = gr_pos(b);
+        if (!p) return -1;
+        GR_SET(p->set, s[i]);
+        if (nocase && isalpha((unsigned char)s[i])) { GR_SET(p->set, tolower((unsigned char)s[i])); GR_SET(p->set, toupper((unsigned char)s[i])); }
+    }
+    return 0;
+}
+
+/* After a backslash: \d \w \s add their class and return -1, \t \n map,
+   anything else stands for itself */
+static int gr_escape(char c, unsigned char* set) {
+    int k;
+    switch (c) {
+    case 'd': for (k = '0'; k <= '9'; k++) GR_SET(set, k); return -1;
+    case 'w': for (k = 0; k < 256; k++) if (isalnum(k) || k == '_') GR_SET(set, k); return -1;
+    case 's': GR_SET(set, ' '); GR_SET(set, '\t'); return -1;
+    case 't': return '\t';
+    case 'n': return '\n';
+    default:  return (unsigned char)c;
+    }
+}
+
+/* A pattern: literal bytes, `.`, `[...]` classes (ranges, leading ^, the
+   escapes above) and \-escapes, each optionally followed by * + or ?.
+   No groups or alternation: alternatives are separate lines. */
+static int gr_regex(GrBuild* b, int line, const char* s, size_t n) {
+    int start = b->npos, nullable = 1;
+    for (size_t i = 0; i < n; ) {
+        GrPos* p = gr_pos(b);
+        if (!p) return gr_error(b, line, "too many patterns", "", 0);
+        char c = s[i++];
+        if (c == '.') { memset(p->set, 0xFF, 32); p->set['\n' >> 3] &= (unsigned char)~(1u << ('\n' & 7)); }
+        else if (c == '\\') {
+            if (i >= n) return gr_error(b, line, "trailing \\ in", s, n);
+            int e = gr_escape(s[i++], p->set);
+            if (e >= 0) GR_SET(p->set, e);
+        } else if (c == '[') {
+            int neg = i < n && s[i] == '^', any = 0;
+            if (neg) i++;
+            while (i < n && (s[i] != ']' || !any)) {
+                int lo = (unsigned char)s[i++];
+                any = 1;
+                if (lo == '\\' && i < n) { lo = gr_escape(s[i++], p->set); if (lo < 0) continue; }
+                int hi = lo;
+                if (i + 1 < n && s[i] == '-' && s[i+1] != ']') {
+                    hi = (unsigned char)s[i+1]; i += 2;
+                    if (hi == '\\' && i < n) { hi = gr_escape(s[i++], p->set); if (hi < 0) hi = lo; }
+                }
+                for (int k = lo; k <= hi; k++) GR_SET(p->set, k);
+            }
+            if (i >= n) return gr_error(b, line, "unclosed [ in", s, n);
+            i++;
+            if (neg) for (int k = 0; k < 32; k++) p->set[k] = (unsigned char)~p->set[k];
+        } else GR_SET(p->set, c);
+        if (i < n && (s[i] == '*' || s[i] == '+' || s[i] == '?')) p->rep = s[i++];
+        if (p->rep != '*' && p->rep != '?') nullable = 0;
+    }
+    if (b->npos == start || nullable) return gr_error(b, line, "pattern matches nothing:", s, n);
+    return 0;
+}
+
+static int gr_class(const char* s, size_t n) {
+    for (int c = 0; c < GC_COUNT; c++) if (strlen(k_grClass[c]) == n && memcmp(k_grClass[c], s, n) == 0) return c;
+    return -1;
+}
+
+/* Next whitespace-separated word of v[*i, n) */
+static size_t gr_word(const char* v, size_t* i, size_t n, const char** w) {
+    while (*i < n && (v[*i] == ' ' || v[*i] == '\t')) (*i)++;
+    *w = v + *i;
+    size_t k = *i;
+    while (*i < n && v[*i] != ' ' && v[*i] != '\t') (*i)++;
+    return *i - k;
+}
+
+/* One rule line. Pass 0 takes the settings, pass 1 the rules, in file
+   order, so `nocase` and `word` may come anywhere. */
+static int gr_line_rule(GrBuild* b, MdGrammar* hdr, int* nocase, const char** word, size_t* wordLen,
+                        int pass, int line, const char* k, size_t kn, const char* v, size_t vn) {
+    size_t i = 0, wn; const char* w;
+    #define KEY(s) (kn == sizeof(s) - 1 && memcmp(k, s, kn) == 0)
+    if (KEY("names") || KEY("calls") || KEY("nocase") || KEY("word")) {
+        if (pass) return 0;
+        if (KEY("calls")) hdr->calls = vn && v[0] != '0';
+        else if (KEY("nocase")) *nocase = vn && v[0] != '0';
+        else if (KEY("word")) { *word = v; *wordLen = vn; }
+        else while ((wn = gr_word(v, &i, vn, &w)) > 0) {
+            size_t at = strlen(hdr->names);
+            if (at + wn + 2 > sizeof(hdr->names)) return gr_error(b, line, "too many names", "", 0);
+            if (at) hdr->names[at++] = ' ';
+            for (size_t c = 0; c < wn; c++) hdr->names[at + c] = (char)tolower((unsigned char)w[c]);
+            hdr->names[at + wn] = '\0';
+        }
+        return 0;
+    }
+    if (!pass) return 0;
+    if (KEY("comment")) {
+        while ((wn = gr_word(v, &i, vn, &w)) > 0)
+            if (gr_rule(b, GR_COMMENT, GC_CM) || gr_literal(b, w, wn, 0)) return gr_error(b, line, "grammar too large", "", 0);
+        return 0;
+    }
+    int kind = KEY("keywords") ? GR_TOKEN : KEY("token") ? GR_TOKEN : KEY("span") ? GR_SPAN : KEY("block") ? GR_BLOCK : -1;
+    if (kind < 0) return gr_error(b, line, "unknown key", k, kn);
+    wn = gr_word(v, &i, vn, &w);
+    int cls = gr_class(w, wn);
+    if (cls < 0) return gr_error(b, line, "unknown class", w, wn);
+    if (KEY("keywords")) {
+        while ((wn = gr_word(v, &i, vn, &w)) > 0)
+            if (gr_rule(b, GR_TOKEN, cls) || gr_literal(b, w, wn, *nocase)) return gr_error(b, line, "grammar too large", "", 0);
+        return 0;
+    }
+    if (KEY("token")) {
+        while (i < vn && (v[i] == ' ' || v[i] == '\t')) i++;
+        if (gr_rule(b, GR_TOKEN, cls)) return gr_error(b, line, "grammar too large", "", 0);
+        return gr_regex(b, line, v + i, vn - i);
+    }
+    /* span / block: <class> <open> <close> [<escape>] */
+    const char *o, *c, *e; size_t on = gr_word(v, &i, vn, &o), cn = gr_word(v, &i, vn, &c), en = gr_word(v, &i, vn, &e);
+    if (!on || !cn) return gr_error(b, line, "needs an opening and a closing delimiter", "", 0);
+    if (cn > GR_CLOSE || en > 1) return gr_error(b, line, "delimiter too long", "", 0);
+    if (gr_rule(b, kind, cls) || gr_literal(b, o, on, 0)) return gr_error(b, line, "grammar too large", "", 0);
+    GrRule* r = &b->rule[b->nrules - 1];
+    memcpy(r->close, c, cn); r->closeLen = (unsigned char)cn; r->esc = en ? (unsigned char)e[0] : 0;
+    return 0;
+    #undef KEY
+}
+
+/* Positions reachable after position p of rule r (p < 0: the rule's
+   first ones), added to set `to` if they admit byte `c` */
+static void gr_follow(const GrBuild* b, int r, int p, unsigned c, unsigned* to) {
+    int end = b->first[r + 1], j = p < 0 ? b->first[r] : p + 1;
+    if (p >= 0 && (b->pos[p].rep == '*' || b->pos[p].rep == '+') && GR_HAS(b->pos[p].set, c)) to[(p+1) >> 5] |= 1u << ((p+1) & 31);
+    for (; j < end; j++) {
+        if (GR_HAS(b->pos[j].set, c)) to[(j+1) >> 5] |= 1u << ((j+1) & 31);
+        if (b->pos[j].rep != '*' && b->pos[j].rep != '?') break;
+    }
+}
+
+static int gr_is_last(const GrBuild* b, int r, int p) {
+    for (int j = p + 1; j < b->first[r + 1]; j++) if (b->pos[j].rep != '*' && b->pos[j].rep != '?') return 0;
+    return 1;
+}
+
+/* Subset construction. A DFA state is a set of positions just matched,
+   bit p+1 for position p and bit 0 for "nothing yet" (the start). */
+static MdGrammar* gr_build(GrBuild* b, const MdGrammar* hdr) {
+    unsigned char cls[256] = {0}; int ncls = 1;
+    for (int p = 0; p < b->npos; p++) {   /* refine byte classes by every position's set */
+        short map[512]; int n = 0;
+        for (int k = 0; k < 512; k++) map[k] = -1;
+        for (int c = 0; c < 256; c++) {
+            int key = cls[c] * 2 + GR_HAS(b->pos[p].set, c);
+            if (map[key] < 0) map[key] = (short)n++;
+            cls[c] = (unsigned char)map[key];
+        }
+        ncls = n;
+    }
+    int rep[256];
+    for (int c = 255; c >= 0; c--) rep[cls[c]] = c;
+    int* owner = (int*)malloc(sizeof(int) * (b->npos ? b->npos : 1));
+    for (int r = 0; owner && r < b->nrules; r++) for (int p = b->first[r]; p < b->first[r+1]; p++) owner[p] = r;
+
+    size_t words = (size_t)(b->npos + 1 + 31) / 32;
+    unsigned* sets = (unsigned*)calloc((size_t)GR_MAX_STATES * words, sizeof(unsigned));
+    unsigned short* next = (unsigned short*)calloc((size_t)GR_MAX_STATES * ncls, sizeof(unsigned short));
+    short* accept = (short*)malloc(sizeof(short) * GR_MAX_STATES);
+    int* slot = (int*)calloc(GR_MAX_STATES * 2, sizeof(int));    /* open hash of sets -> state + 1 */
+    unsigned* to = (unsigned*)malloc(sizeof(unsigned) * words);
+    int* in = (int*)malloc(sizeof(int) * (size_t)(b->npos + 1));   /* members of the state at hand */
+    MdGrammar* g = NULL;
+    int states = 2, fail = !owner || !sets || !next || !accept || !slot || !to || !in;
+    if (fail) goto done;
+    sets[words] = 1;   /* state 0: empty (no match), state 1: start */
+    for (int st = 1; st < states && !fail; st++) {
+        const unsigned* cur = sets + (size_t)st * words;
+        int nin = 0;
+        for (size_t w = 0; w < words; w++)
+            for (unsigned x = cur[w]; x; x &= x - 1) in[nin++] = (int)(w * 32 + md_ctz(x)) - 1;
+        accept[st] = -1;
+        for (int k = 0; k < nin; k++) {
+            int p = in[k];
+            if (p >= 0 && gr_is_last(b, owner[p], p) && (accept[st] < 0 || owner[p] < accept[st])) accept[st] = (short)owner[p];
+        }
+        for (int c = 0; c < ncls; c++) {
+            memset(to, 0, sizeof(unsigned) * words);
+            int any = 0;
+            for (int k = 0; k < nin; k++) {
+                if (in[k] >= 0) gr_follow(b, owner[in[k]], in[k], (unsigned)rep[c], to);
+                else for (int r = 0; r < b->nrules; r++) gr_follow(b, r, -1, (unsigned)rep[c], to);
+            }
+            unsigned h = 2166136261u;
+            for (size_t w = 0; w < words; w++) { any |= to[w] != 0; h = (h ^ to[w]) * 16777619u; }
+            if (!any) continue;
+            unsigned k = h & (GR_MAX_STATES * 2 - 1);
+            while (slot[k] && memcmp(sets + (size_t)(slot[k] - 1) * words, to, sizeof(unsigned) * words) != 0) k = (k + 1) & (GR_MAX_STATES * 2 - 1);
+            if (!slot[k]) {
+                if (states >= GR_MAX_STATES) { fail = 1; break; }
+                memcpy(sets + (size_t)states * words, to, sizeof(unsigned) * words);
+                slot[k] = ++states;
+            }
+            next[st * ncls + c] = (unsigned short)(slot[k] - 1);
+        }
+    }
+    if (fail) { if (b->err && b->errLen) snprintf(b->err, b->errLen, "grammar too complex (over %d DFA states)", GR_MAX_STATES); goto done; }
+    accept[0] = -1;
+    g = gr_alloc(states, ncls, b->nrules);
+    if (!g) goto done;
+    memcpy(g->names, hdr->names, sizeof(g->names)); g->calls = hdr->calls;
+    memcpy(g->byteClass, cls, sizeof(cls));
+    memcpy(g->next, next, sizeof(unsigned short) * (size_t)states * ncls);
+    memcpy(g->accept, accept, sizeof(short) * (size_t)states);
+    memcpy(g->rule, b->rule, sizeof(GrRule) * (size_t)b->nrules);
+done:
+    free(owner); free(sets); free(next); free(accept); free(slot); free(to); free(in);
+    return g;
+}
+
+MdGrammar* md_grammar_compile(const char* text, size_t len, char* err, size_t errLen) {
+    GrBuild b; memset(&b, 0, sizeof(b));
+    MdGrammar hdr; memset(&hdr, 0, sizeof(hdr));
+    b.err = err; b.errLen = errLen;
+    if (err && errLen) err[0] = '\0';
+    b.pos = (GrPos*)malloc(sizeof(GrPos) * GR_MAX_POS);
+    b.rule = (GrRule*)malloc(sizeof(GrRule) * (GR_MAX_RULES + 1));
+    b.first = (int*)malloc(sizeof(int) * (GR_MAX_RULES + 2));
+    MdGrammar* g = NULL;
+    int nocase = 0, rc = 0; const char* word = "[A-Za-z_][A-Za-z0-9_]*"; size_t wordLen = strlen(word);
+    if (!b.pos || !b.rule || !b.first) goto done;
+    b.first[0] = 0;
+    for (int pass = 0; pass < 2 && !rc; pass++) {
+        size_t i = 0; int line = 0;
+        while (i < len && !rc) {
+            size_t e = i; while (e < len && text[e] != '\n') e++;
+            size_t ls = i, le = e; i = e + 1; line++;
+            while (ls < le && (text[ls] == ' ' || text[ls] == '\t')) ls++;
+            while (le > ls && (text[le-1] == ' ' || text[le-1] == '\t' || text[le-1] == '\r')) le--;
+            if (ls == le || text[ls] == ';') continue;
+            size_t eq = ls; while (eq < le && text[eq] != '=') eq++;
+            if (eq == le) { rc = gr_error(&b, line, "expected key = value", "", 0); break; }
+            size_t ke = eq; while (ke > ls && (text[ke-1] == ' ' || text[ke-1] == '\t')) ke--;
+            size_t vs = eq + 1; while (vs < le && (text[vs] == ' ' || text[vs] == '\t')) vs++;
+            rc = gr_line_rule(&b, &hdr, &nocase, &word, &wordLen, pass, line, text + ls, ke - ls, text + vs, le - vs);
+        }
+    }
+    if (!rc && !hdr.names[0]) rc = gr_error(&b, 0, "no names", "", 0);
+    if (!rc && wordLen && (gr_rule(&b, GR_WORD, GC_PLAIN) || gr_regex(&b, 0, word, wordLen))) rc = -1;
+    if (!rc && !b.nrules) rc = gr_error(&b, 0, "no rules", "", 0);
+    if (!rc) g = gr_build(&b, &hdr);
+done:
+    free(b.pos); free(b.rule); free(b.first);
+    return g;
+}
+
+/* Serialized form: a tag, the sizes, then the arrays, in native byte
+   order (a cache never leaves the machine that wrote it) */
+static const char k_grTag[8] = { 'M','D','G','R','A','M', 1, (char)sizeof(GrRule) };
+
+void md_grammar_save(const MdGrammar* g, StrBuf* out) {
+    int head[4] = { g->states, g->classes, g->rules, g->calls };
+    sb_append_n(out, k_grTag, sizeof(k_grTag));
+    sb_append_n(out, (const char*)head, sizeof(head));
+    sb_append_n(out, g->names, sizeof(g->names));
+    sb_append_n(out, (const char*)g->byteClass, sizeof(g->byteClass));
+    sb_append_n(out, (const char*)g->next, sizeof(unsigned short) * (size_t)g->states * g->classes);
+    sb_append_n(out, (const char*)g->accept, sizeof(short) * (size_t)g->states);
+    sb_append_n(out, (const char*)g->rule, sizeof(GrRule) * (size_t)g->rules);
+}
+
+MdGrammar* md_grammar_load(const void* data, size_t len) {
+    const char* d = (const char*)data;
+    int head[4];
+    size_t fixed = sizeof(k_grTag) + sizeof(head) + GR_NAMES + 256;
+    if (len < fixed || memcmp(d, k_grTag, sizeof(k_grTag)) != 0) return NULL;
+    memcpy(head, d + sizeof(k_grTag), sizeof(head));
+    int states = head[0], classes = head[1], rules = head[2];
+    if (states < 2 || states > GR_MAX_STATES || classes < 1 || classes > 256 || rules < 1 || rules > GR_MAX_RULES) return NULL;
+    size_t nx = sizeof(unsigned short) * (size_t)states * classes, ac = sizeof(short) * (size_t)states;
+    if (len != fixed + nx + ac + sizeof(GrRule) * (size_t)rules) return NULL;
+    MdGrammar* g = gr_alloc(states, classes, rules);
+    if (!g) return NULL;
+    const char* p = d + sizeof(k_grTag) + sizeof(head);
+    g->calls = head[3] != 0;
+    memcpy(g->names, p, GR_NAMES); p += GR_NAMES;
+    memcpy(g->byteClass, p, 256); p += 256;
+    memcpy(g->next, p, nx); p += nx;
+    memcpy(g->accept, p, ac); p += ac;
+    memcpy(g->rule, p, sizeof(GrRule) * (size_t)rules);
+    /* Damaged tables must not send the lexer out of bounds */
+    int ok = g->names[GR_NAMES - 1] == '\0';
+    for (int c = 0; c < 256; c++) ok &= g->byteClass[c] < classes;
+    for (size_t k = 0; k < (size_t)states * classes; k++) ok &= g->next[k] < states;
+    for (int s = 0; s < states; s++) ok &= g->accept[s] >= -1 && g->accept[s] < rules;
+    for (int r = 0; r < rules; r++) ok &= g->rule[r].kind <= GR_BLOCK && g->rule[r].cls < GC_COUNT && g->rule[r].closeLen <= GR_CLOSE
+                                         && (g->rule[r].closeLen > 0 || g->rule[r].kind < GR_SPAN);
+    if (!ok) { free(g); return NULL; }
+    return g;
+}
+
+/* Grammar whose names include the first word of an info string, or -1 */
+static int gr_find(const MdContext* cx, const char* s, size_t n) {
+    size_t w = 0;
+    while (w < n && s[w] != ' ' && s[w] != '\t') w++;
+    for (int k = 0; w && k < cx->opts.grammarCount; k++) {
+        const char* nm = cx->opts.grammars[k]->names;
+        while (*nm) {
+            size_t e = 0; while (nm[e] && nm[e] != ' ') e++;
+            size_t c = 0;
+            while (c < w && c < e && tolower((unsigned char)s[c]) == nm[c]) c++;
+            if (c == w && e == w) return k;
+            nm += e; while (*nm == ' ') nm++;
+        }
+    }
+    return -1;
+}
+
+/* Maximal munch walks the DFA past the end of the token it returns, and
+   the next token's walk may cover the same ground: a line of "a.a.a..."
+   against an `[A-Za-z0-9_.-]+\s*=` rule rescans to the end of the line
+   from every position. So, as in Reps' linear tokenizer, each (state,
+   position) pair seen after a token's last accept is remembered as
+   failed, and a later walk that reaches it stops there. Overruns up to
+   GR_MEMO_RUN bytes cost at most that much a token and are not kept; the
+   set, open-addressed on state | position << 16, is made for a line on
+   its first longer one. */
+enum { GR_MEMO_RUN = 64 };
+
+typedef struct { unsigned long long* keys; size_t mask, count; } GrMemo;
+
+/* Near the position's neighbours: walks go along the line */
+static size_t gr_memo_slot(const GrMemo* m, int st, size_t k) { return (k * 4 + ((unsigned)st * 0x9E3779B1u >> 28)) & m->mask; }
+
+static int gr_memo_has(const GrMemo* m, int st, size_t k) {
+    unsigned long long key = (unsigned long long)k << 16 | (unsigned)st;
+    for (size_t h = gr_memo_slot(m, st, k); m->keys[h]; h = (h + 1) & m->mask)
+        if (m->keys[h] == key) return 1;
+    return 0;
+}
+
+static int gr_memo_init(GrMemo* m, size_t n) {   /* room for 4 pairs a byte; keys are never 0 (state >= 1) */
+    size_t cap = 1024; while (cap < n * 4) cap *= 2;
+    m->keys = (unsigned long long*)calloc(cap, sizeof(unsigned long long));
+    m->mask = m->keys ? cap - 1 : 0;
+    return m->keys != NULL;
+}
+
+static void gr_memo_add(GrMemo* m, int st, size_t k) {
+    if (m->count * 2 >= m->mask) return;   /* full: later walks just run on */
+    unsigned long long key = (unsigned long long)k << 16 | (unsigned)st;
+    size_t h = gr_memo_slot(m, st, k);
+    while (m->keys[h] && m->keys[h] != key) h = (h + 1) & m->mask;
+    if (!m->keys[h]) { m->keys[h] = key; m->count++; }
+}
+
+/* An unclosed span rescans to the end of the line too, from every opener
+   after it ("\"\"\"... against a `"` span with `\` escape). A scan that
+   found no close from p finds none from any later q it passed through
+   unescaped: one an even run of `esc` bytes back from q, counted from p */
+enum { GR_OPEN_SPANS = 8 };
+
+typedef struct { int rule; size_t at; } GrOpen;
+
+static int gr_passed(const char* s, size_t p, size_t q, char esc) {
+    size_t c = 0;
+    while (esc && q > p && s[q-1] == esc) { q--; c++; }
+    return !(c & 1);
+}
+
+static void gr_line(StrBuf* sb, const MdGrammar* g, int* state, const char* s, size_t n) {
+    GrMemo memo = { NULL, 0, 0 };
+    GrOpen unclosed[GR_OPEN_SPANS]; int nopen = 0;
+    size_t i = 0, plain;
+    if (*state > 0 && *state <= g->rules) {   /* inside a block left open */
+        const GrRule* r = &g->rule[*state - 1];
+        i = sh_close(s, 0, n, r->close, r->closeLen, (char)r->esc, *state, state);
+        if (i) sh_span(sb, k_grSpan[r->cls], s, i);
+    }
+    plain = i;
+    while (i < n) {
+        int st = 1, best = -1, stj = 1; size_t j = i, k = i;
+        for (; k < n; k++) {
+            if (memo.keys && gr_memo_has(&memo, st, k)) break;
+            st = g->next[st * g->classes + g->byteClass[(unsigned char)s[k]]];
+            if (!st) break;
+            if (g->accept[st] >= 0) { best = g->accept[st]; j = k + 1; stj = st; }
+        }
+        /* Every pair the walk went through after j leads to no accept */
+        if (k - j > GR_MEMO_RUN && (memo.keys || gr_memo_init(&memo, n)))
+            for (k = j; k < n && !gr_memo_has(&memo, stj, k); k++) {
+                gr_memo_add(&memo, stj, k);
+                stj = g->next[stj * g->classes + g->byteClass[(unsigned char)s[k]]];
+                if (!stj) break;
+            }
+        if (best < 0) { i++; continue; }
+        const GrRule* r = &g->rule[best];
+        int cls = r->cls;
+        if (r->kind == GR_WORD && g->calls) {
+            size_t k = j; while (k < n && (s[k] == ' ' || s[k] == '\t')) k++;
+            if (k < n && s[k] == '(') cls = GC_FN;
+        } else if (r->kind == GR_COMMENT) j = n;
+        else if (r->kind == GR_SPAN) {   /* not closed on this line: no string */
+            int m = 0, open;
+            while (m < nopen && unclosed[m].rule != best) m++;
+            if (m < nopen && j >= unclosed[m].at && gr_passed(s, unclosed[m].at, j, (char)r->esc)) { i = j; continue; }
+            size_t e = sh_close(s, j, n, r->close, r->closeLen, (char)r->esc, -1, &open);
+            if (open < 0) {
+                if (m == nopen && nopen < GR_OPEN_SPANS) { unclosed[nopen].rule = best; unclosed[nopen++].at = j; }
+                else if (m < nopen && j < unclosed[m].at) unclosed[m].at = j;
+                i = j; continue;
+            }
+            j = e;
+        } else if (r->kind == GR_BLOCK) j = sh_close(s, j, n, r->close, r->closeLen, (char)r->esc, best + 1, state);
+        if (cls == GC_PLAIN) { i = j; continue; }
+        sb_append_esc(sb, s + plain, i - plain);
+        sh_span(sb, k_grSpan[cls], s + i, j - i);
+        i = plain = j;
+    }
+    sb_append_esc(sb, s + plain, n - plain);
+    free(memo.keys);
+}
+
+/* ── Text Index ──────────────────────────────────────────────────────── */
+
+/* The page text is taken from the HTML as each block is emitted, with a
+   small tag scanner whose state lives in the context: tags may run over
+   several raw HTML lines. */
+
+static void tx_block(MdContext* cx, int line, int section) {
+    MdText* t = cx->text;
+    if (t->failed) return;
+    if (t->count >= t->cap) {
+        int cap = t->cap ? t->cap*2 : 256;
+        MdTextBlock* nb = (MdTextBlock*)realloc(t->blocks, (size_t)cap * sizeof(MdTextBlock));
+        if (!nb) { t->failed = 1; return; }
+        t->blocks = nb; t->cap = cap;
+    }
+    MdTextBlock* b = &t->blocks[t->count++];
+    b->off = t->text.len; b->line = line; b->section = section;
+}
+
+static void tx_utf8(StrBuf* sb, unsigned cp) {
+    if (cp == 0 || cp > 0x10FFFF || (cp >= 0xD800 && cp < 0xE000)) cp = 0xFFFD;
+    if (cp < 0x80) { sb->data[sb->len++] = (char)cp; return; }
+    if (cp < 0x800) { sb->data[sb->len++] = (char)(0xC0 | cp >> 6); }
+    else {
+        if (cp < 0x10000) sb->data[sb->len++] = (char)(0xE0 | cp >> 12);
+        else { sb->data[sb->len++] = (char)(0xF0 | cp >> 18); sb->data[sb->len++] = (char)(0x80 | ((cp >> 12) & 0x3F)); }
+        sb->data[sb->len++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    }
+    sb->data[sb->len++] = (char)(0x80 | (cp & 0x3F));
+}
+
+/* Entity at s[0] == '&' of at most n bytes: its length, and the code point
+   in *cp; 0 for one the browser would show as typed (as far as we know) */
+static size_t tx_entity(const char* s, size_t n, unsigned* cp) {
+    static const struct { const char* e; unsigned c; } named[] = {
+        { "amp;", '&' }, { "lt;", '<' }, { "gt;", '>' }, { "quot;", '"' }, { "apos;", '\'' }, { "nbsp;", 0xA0 } };
+    if (n > 1 && s[1] == '#') {
+        size_t i = 2; unsigned v = 0; int hex = i < n && (s[i] == 'x' || s[i] == 'X'), digits = 0;
+        if (hex) i++;
+        for (; i < n && i < 12; i++, digits++) {
+            char c = s[i];
+            if (c >= '0' && c <= '9') v = v * (hex ? 16 : 10) + (unsigned)(c - '0');
+            else if (hex && ((c|0x20) >= 'a' && (c|0x20) <= 'f')) v = v * 16 + (unsigned)((c|0x20) - 'a' + 10);
+            else break;
+        }
+        if (!digits || i >= n || s[i] != ';') return 0;
+        *cp = v; return i + 1;
+    }
+    for (size_t k = 0; k < sizeof(named)/sizeof(named[0]); k++) {
+        size_t l = strlen(named[k].e);
+        if (n > l && memcmp(s + 1, named[k].e, l) == 0) { *cp = named[k].c; return l + 1; }
+    }
+    return 0;
+}
+
+/* Take the text of sb[from..to) into the index */
+static void tx_take(MdContext* cx, const char* s, size_t from, size_t to) {
+    StrBuf* t = &cx->text->text;
+    if (cx->text->failed || from >= to) return;
+    sb_ensure(t, (to - from) * 3);   /* an entity may grow: &#1; is 3 bytes of U+FFFD */
+    size_t (*scan)(const char*, size_t, size_t) = scan_esc_scalar;
+#ifdef MD_X86
+    switch (simd_level()) {
+    case MD_SIMD_AVX2: scan = scan_esc_avx2; break;
+    case MD_SIMD_SSE2: scan = scan_esc_sse2; break;
+    }
+#endif
+    for (size_t i = from; i < to; i++) {
+        if (!cx->txTag && !cx->txSkip) {   /* text: copy up to the next & or < (or > ") whole */
+            size_t q = scan(s, i, to);
+            memcpy(t->data + t->len, s + i, q - i); t->len += q - i; i = q;
+            if (i == to) break;
+        }
+        if (cx->txQuote) {   /* rest of a quoted attribute value */
+            const char* q = (const char*)memchr(s + i, cx->txQuote, to - i);
+            if (!q) break;
+            i = (size_t)(q - s); cx->txQuote = 0; continue;
+        }
+        if (cx->txTag == 2)  /* after the name: on to > or a quote */
+            while (i < to && s[i] != '>' && s[i] != '"' && s[i] != '\'') i++;
+        if (i == to) break;
+        char c = s[i];
+        if (cx->txTag) {
+            if (cx->txTag == 1) {   /* reading the name */
+                if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+                    if (cx->txNameLen < (int)sizeof(cx->txName)) cx->txName[cx->txNameLen] = (char)(c | 0x20);
+                    cx->txNameLen++; continue;
+                }
+                if (c == '/' && !cx->txNameLen && !cx->txClose) { cx->txClose = 1; continue; }
+                if ((c == '!' || c == '?') && !cx->txNameLen) { cx->txTag = 3; continue; }   /* comment: no quotes */
+                /* script/style bodies are no text; 1 and 2 say which one is open */
+                int which = cx->txNameLen == 6 && memcmp(cx->txName, "script", 6) == 0 ? 1
+                          : cx->txNameLen == 5 && memcmp(cx->txName, "style", 5) == 0 ? 2 : 0;
+                if (which && !cx->txClose && !cx->txSkip) cx->txSkip = which;
+                else if (which && cx->txClose && cx->txSkip == which) cx->txSkip = 0;
+                cx->txTag = 2;
+            }
+            if (c == '>') cx->txTag = 0;
+            else if ((c == '"' || c == '\'') && cx->txTag == 2) cx->txQuote = c;
+            continue;
+        }
+        if (c == '<' && i + 1 < to) {
+            char d = s[i+1];
+            if ((d >= 'a' && d <= 'z') || (d >= 'A' && d <= 'Z') || d == '/' || d == '!' || d == '?') {
+                cx->txTag = 1; cx->txNameLen = 0; cx->txClose = 0; continue;
+            }
+        }
+        if (cx->txSkip) continue;
+        unsigned cp; size_t el;
+        if (c == '&' && (el = tx_entity(s + i, to - i, &cp)) != 0) { tx_utf8(t, cp); i += el - 1; continue; }
+        t->data[t->len++] = c;
+    }
+    t->data[t->len] = '\0';
+}
+
+/* Case folding that keeps every character's UTF-8 length, so folded text
+   lines up byte for byte with the original */
+static unsigned fold_cp(unsigned c) {
+    if (c < 0x80) return c >= 'A' && c <= 'Z' ? c + 32 : c;
+    if (c < 0x100) return c >= 0xC0 && c <= 0xDE && c != 0xD7 ? c + 32 : c;
+    if (c < 0x180) {
+        if (c == 0x130 || c == 0x131 || c == 0x138 || c == 0x149) return c;
+        if (c == 0x178) return 0xFF;
+        if ((c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17E)) return c & 1 ? c + 1 : c;
+        return c & 1 ? c : c + 1;
+    }
+    if (c >= 0x386 && c <= 0x3AB) {
+        if (c == 0x386) return 0x3AC;
+        if (c >= 0x388 && c <= 0x38A) return c + 0x25;
+        if (c == 0x38C) return 0x3CC;
+        if (c == 0x38E || c == 0x38F) return c + 0x3F;
+        return c >= 0x391 && c != 0x3A2 ? c + 32 : c;
+    }
+    if (c == 0x3C2) return 0x3C3;
+    if (c >= 0x400 && c <= 0x40F) return c + 0x50;
+    if (c >= 0x410 && c <= 0x42F) return c + 32;
+    if ((c >= 0x460 && c <= 0x481) || (c >= 0x48A && c <= 0x4BF) || (c >= 0x4D0 && c <= 0x52F)) return c & 1 ? c : c + 1;
+    if (c >= 0x4C1 && c <= 0x4CE) return c & 1 ? c + 1 : c;
+    if (c >= 0x531 && c <= 0x556) return c + 0x30;
+    if ((c >= 0x1E00 && c <= 0x1E95) || (c >= 0x1EA0 && c <= 0x1EFF)) return c & 1 ? c : c + 1;
+    if (c >= 0xFF21 && c <= 0xFF3A) return c + 32;
+    return c;
+}
+
+static void fold_utf8(char* d, const char* s, size_t n) {
+    const unsigned char* u = (const unsigned char*)s;
+    for (size_t i = 0; i < n; ) {
+        /* Eight ASCII bytes at a time: set 0x20 where a byte is in A..Z */
+        while (i + 8 <= n) {
+            unsigned long long w; memcpy(&w, s + i, 8);
+            if (w & 0x8080808080808080ull) break;
+            unsigned long long up = (w + 0x3F3F3F3F3F3F3F3Full) & ~(w + 0x2525252525252525ull) & 0x8080808080808080ull;
+            w |= up >> 2; memcpy(d + i, &w, 8); i += 8;
+        }
+        if (i == n) break;
+        unsigned c = u[i];
+        if (c < 0x80) { d[i] = (char)(c >= 'A' && c <= 'Z' ? c + 32 : c); i++; continue; }
+        if ((c & 0xE0) == 0xC0 && i + 1 < n && (u[i+1] & 0xC0) == 0x80) {
+            unsigned cp = (c & 0x1F) << 6 | (u[i+1] & 0x3F), f = cp >= 0x80 ? fold_cp(cp) : cp;
+            d[i] = (char)(0xC0 | f >> 6); d[i+1] = (char)(0x80 | (f & 0x3F)); i += 2; continue;
+        }
+        if ((c & 0xF0) == 0xE0 && i + 2 < n && (u[i+1] & 0xC0) == 0x80 && (u[i+2] & 0xC0) == 0x80) {
+            unsigned cp = (c & 0x0F) << 12 | (u[i+1] & 0x3F) << 6 | (u[i+2] & 0x3F), f = cp >= 0x800 ? fold_cp(cp) : cp;
+            d[i] = (char)(0xE0 | f >> 12); d[i+1] = (char)(0x80 | ((f >> 6) & 0x3F)); d[i+2] = (char)(0x80 | (f & 0x3F)); i += 3; continue;
+        }
+        d[i] = (char)c; i++;
+    }
+}
+
+/* Conversion done: fold the text for find */
+static void tx_finish(MdContext* cx) {
+    MdText* t = cx->text;
+    if (t->failed) return;
+    t->fold.len = 0; sb_ensure(&t->fold, t->text.len);
+    fold_utf8(t->fold.data, t->text.data, t->text.len);
+    t->fold.len = t->text.len; t->fold.data[t->fold.len] = '\0';
+}
+
+/* Substring search: the first and last needle bytes are compared at every
+   position of a vector at once, and only where both agree is the rest
+   compared. First match at or after `i`, or n. */
+static size_t find_scalar(const char* h, size_t i, size_t n, const char* nd, size_t m) {
+    while (i + m <= n) {
+        const char* p = (const char*)memchr(h + i, nd[0], n - m + 1 - i);
+        if (!p) return n;
+        i = (size_t)(p - h);
+        if (memcmp(p + 1, nd + 1, m - 1) == 0) return i;
+        i++;
+    }
+    return n;
+}
+
+#ifdef MD_X86
+MD_TARGET("sse2")
+static size_t find_sse2(const char* h, size_t i, size_t n, const char* nd, size_t m) {
+    const __m128i f = _mm_set1_epi8(nd[0]), l = _mm_set1_epi8(nd[m-1]);
+    for (; i + m - 1 + 16 <= n; i += 16) {
+        __m128i a = _mm_cmpeq_epi8(f, _mm_loadu_si128((const __m128i*)(h + i)));
+        __m128i b = _mm_cmpeq_epi8(l, _mm_loadu_si128((const __m128i*)(h + i + m - 1)));
+        unsigned bits = (unsigned)_mm_movemask_epi8(_mm_and_si128(a, b));
+        while (bits) {
+            unsigned k = md_ctz(bits);
+            if (memcmp(h + i + k + 1, nd + 1, m - 1) == 0) return i + k;
+            bits &= bits - 1;
+        }
+    }
+    return find_scalar(h, i, n, nd, m);
+}
+
+MD_TARGET("avx2")
+static size_t find_avx2(const char* h, size_t i, size_t n, const char* nd, size_t m) {
+    const __m256i f = _mm256_set1_epi8(nd[0]), l = _mm256_set1_epi8(nd[m-1]);
+    for (; i + m - 1 + 32 <= n; i += 32) {
+        __m256i a = _mm256_cmpeq_epi8(f, _mm256_loadu_si256((const __m256i*)(h + i)));
+        __m256i b = _mm256_cmpeq_epi8(l, _mm256_loadu_si256((const __m256i*)(h + i + m - 1)));
+        unsigned bits = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(a, b));
+        while (bits) {
+            unsigned k = md_ctz(bits);
+            if (memcmp(h + i + k + 1, nd + 1, m - 1) == 0) return i + k;
+            bits &= bits - 1;
+        }
+    }
+    return find_scalar(h, i, n, nd, m);
+}
+#endif
+
+static int word_byte(unsigned char c) { return c >= 0x80 || c == '_' || (c >= '0' && c <= '9') || ((c|0x20) >= 'a' && (c|0x20) <= 'z'); }
+
+int md_text_find(const MdText* t, const char* needle, size_t n, int flags, MdMatches* m) {
+    m->count = 0;
+    if (!n || !t->count) return 0;
+    const StrBuf* hay = flags & MD_FIND_CASE ? &t->text : &t->fold;
+    if (hay->len != t->text.len) return 0;   /* not folded: the conversion failed */
+    char small[256];
+    char* nd = n <= sizeof(small) ? small : (char*)malloc(n);
+    if (!nd) return -1;
+    if (flags & MD_FIND_CASE) memcpy(nd, needle, n); else fold_utf8(nd, needle, n);
+    size_t (*find)(const char*, size_t, size_t, const char*, size_t) = find_scalar;
+#ifdef MD_X86
+    switch (simd_level()) {
+    case MD_SIMD_AVX2: find = find_avx2; break;
+    case MD_SIMD_SSE2: find = find_sse2; break;
+    default: break;
+    }
+#endif
+    const char* h = hay->data; size_t len = hay->len;
+    int bi = 0, rc = 0;
+    for (size_t i = find(h, 0, len, nd, n); i < len; i = find(h, i, len, nd, n)) {
+        while (bi + 1 < t->count && t->blocks[bi+1].off <= i) bi++;
+        size_t end = bi + 1 < t->count ? t->blocks[bi+1].off : len;
+        if (i + n > end ||
+            ((flags & MD_FIND_WORDS) && ((i > t->blocks[bi].off && word_byte((unsigned char)h[i-1]) && word_byte((unsigned char)h[i]))
+                                      || (i + n < end && word_byte((unsigned char)h[i+n]) && word_byte((unsigned char)h[i+n-1]))))) { i++; continue; }
+        if (m->count == m->cap) {
+            size_t cap = m->cap ? m->cap*2 : 256;
+            size_t* na = (size_t*)realloc(m->at, cap * sizeof(size_t));
+            if (!na) { rc = -1; break; }
+            m->at = na; m->cap = cap;
+        }
+        m->at[m->count++] = i;
+        i += n;
+    }
+    if (nd != small) free(nd);
+    return rc;
+}
+
+void md_matches_free(MdMatches* m) { free(m->at); memset(m, 0, sizeof(*m)); }
+
+int md_text_block(const MdText* t, size_t off) {
+    int lo = 0, hi = t->count;   /* first block starting past off */
+    while (lo < hi) { int mid = (lo + hi) / 2; if (t->blocks[mid].off <= off) lo = mid + 1; else hi = mid; }
+    return lo - 1;
+}
+
+void md_text_free(MdText* t) { free(t->text.data); free(t->fold.data); free(t->blocks); memset(t, 0, sizeof(*t)); }
+
+/* ── Markdown Block Parser Helpers ───────────────────────────────────── */
+
+/* ASCII case-insensitive compare (portable stand-in for _strnicmp) */
+static int md_strnicmp(const char* a, const char* b, size_t n) {
+    for (size_t k=0; k<n; k++) {
+        int ca=tolower((unsigned char)a[k]), cb=tolower((unsigned char)b[k]);
+        if (ca!=cb) return ca-cb;
+        if (!ca) return 0;
+    }
+    return 0;
+}
+
+/* Lines are spans into the source buffer and are not NUL-terminated:
+   SPAN_AT reads character k of a span, yielding '\0' past its end. */
+#define SPAN_AT(p,n,k) ((size_t)(k)<(n)?(p)[k]:'\0')
+
+static int has_prefix(const char* p, size_t n, const char* s, size_t k) { return n>=k && memcmp(p,s,k)==0; }
+static int count_leading(const char* l, size_t n, char c) { size_t k=0; while(k<n&&l[k]==c)k++; return (int)k; }
+static int get_indent(const char* l, size_t n) { size_t k=0; while(k<n&&l[k]==' ')k++; if(k<n&&l[k]=='\t')return (int)k+4; return (int)k; }
+
+/* Line table: offset/length/indent over the source text, no per-line copies */
+typedef struct { size_t off; size_t len; int indent; } Line;
+typedef struct { const char* base; Line* lines; int count; } Lines;
+
+static int count_lines(const char* text, size_t len) {
+    int n=0; const char* p=text; const char* end=text+len;
+    while(p<end){ const char* eol=(const char*)memchr(p,'\n',(size_t)(end-p)); n++; if(!eol)break; p=eol+1; }
+    return n;
+}
+
+/* `count` from count_lines, so the table is allocated once at its size */
+static Lines split_lines(Arena* a, const char* text, size_t len, int count) {
+    Lines r; r.base=text; r.count=0; r.lines=(Line*)arena_alloc(a,(size_t)(count+1)*sizeof(Line));
+    const char* p=text; const char* end=text+len;
+    while(p<end){ const char* eol=(const char*)memchr(p,'\n',(size_t)(end-p)); if(!eol)eol=end;
+        size_t ll=(size_t)(eol-p); if(ll>0&&p[ll-1]=='\r')ll--;
+        Line* ln=&r.lines[r.count++]; ln->off=(size_t)(p-text); ln->len=ll; ln->indent=get_indent(p,ll);
+        p=eol; if(p<end)p++;
+    } return r;
+}
+#define LN_PTR(L,k) ((L).base+(L).lines[k].off)
+#define LN_LEN(L,k) ((L).lines[k].len)
+
+static int is_hr(const char* l, size_t n) {
+    const char* p=l; const char* end=l+n; while(p<end&&*p==' ')p++;
+    char c=p<end?*p:'\0'; if(c!='-'&&c!='*'&&c!='_')return 0;
+    int k=0; while(p<end){if(*p==c)k++;else if(*p!=' ')return 0;p++;} return k>=3;
+}
+
+static int is_table_sep(const char* l, size_t n) {
+    const char* p=l; const char* end=l+n; while(p<end&&*p==' ')p++; if(p<end&&*p=='|')p++;
+    int cells=0;
+    while(p<end){ while(p<end&&*p==' ')p++; if(p<end&&*p==':')p++; if(p>=end||*p!='-')return 0; while(p<end&&*p=='-')p++; if(p<end&&*p==':')p++; while(p<end&&*p==' ')p++; cells++; if(p<end&&*p=='|'){p++;continue;} if(p>=end)break; return 0; }
+    return cells>0;
+}
+
+static int parse_trow(const char* l, size_t n, char cells[][1024], int mx) {
+    const char* p=l; const char* end=l+n; while(p<end&&*p==' ')p++; if(p<end&&*p=='|')p++;
+    int nc=0;
+    while(p<end&&nc<mx){
+        const char* s=p; int ic=0;
+        while(p<end){if(*p=='`')ic=!ic;if(*p=='\\'&&p+1<end){p+=2;continue;}if(*p=='|'&&!ic)break;p++;}
+        const char* e=p; while(s<e&&*s==' ')s++; while(e>s&&*(e-1)==' ')e--;
+        size_t cl=e-s; if(cl>=1024)cl=1023; memcpy(cells[nc],s,cl); cells[nc][cl]='\0'; nc++;
+        if(p<end&&*p=='|')p++;
+    }
+    if(nc>0&&cells[nc-1][0]=='\0')nc--;
+    return nc;
+}
+
+static void parse_talign(const char* l, size_t n, char al[], int mx) {
+    const char* p=l; const char* end=l+n; while(p<end&&*p==' ')p++; if(p<end&&*p=='|')p++; int c=0;
+    while(p<end&&c<mx){ while(p<end&&*p==' ')p++; int left=(p<end&&*p==':');if(left)p++; while(p<end&&*p=='-')p++; int right=(p<end&&*p==':');if(right)p++; while(p<end&&*p==' ')p++;
+        if(left&&right)al[c]='c'; else if(right)al[c]='r'; else al[c]='l'; c++; if(p<end&&*p=='|')p++;
+    }
+}
+
+static int is_ul(const char* t, size_t n) { return n>=2&&(t[0]=='-'||t[0]=='*'||t[0]=='+')&&t[1]==' '; }
+static int is_ol(const char* t, size_t n) { size_t i=0; while(i<n&&t[i]>='0'&&t[i]<='9')i++; if(i==0||i>9)return 0; if(i+1<n&&(t[i]=='.'||t[i]==')')&&t[i+1]==' ')return (int)i+2; return 0; }
+
+/* Setext underline test: line made only of '=' (returns 1) or only of '-' (returns 2) */
+static int setext_kind(const char* l, size_t n) {
+    const char* nx=l; const char* end=l+n; while(nx<end&&*nx==' ')nx++;
+    size_t nl=(size_t)(end-nx); if(nl<1)return 0;
+    int ae=1,ad=1; for(size_t j=0;j<nl&&(ae||ad);j++){if(nx[j]!='=')ae=0;if(nx[j]!='-')ad=0;}
+    return ae?1:ad?2:0;
+}
+
+/* Reference definition line: [label]: URL "title". Registers it in `refs`
+   unless that is NULL; returns 1 if the line is a definition (and so
+   renders as blank). */
+static int parse_refdef(RefMap* refs, const char* rl, size_t rn) {
+    const char* end = rl + rn;
+    while (rl < end && *rl == ' ') rl++;
+    if (rl >= end || rl[0] != '[') return 0;
+    /* Parse [label]: */
+    const char* ls = rl + 1;
+    const char* le = ls;
+    while (le < end && *le != ']') le++;
+    if (le + 1 >= end || *(le+1) != ':') return 0;
+    size_t labLen = le - ls;
+    if (labLen == 0) return 0;
+    /* Check it's not a task list item like [x] or [ ] */
+    if (labLen == 1 && (ls[0]=='x' || ls[0]=='X' || ls[0]==' ')) return 0;
+    const char* up = le + 2;
+    while (up < end && *up == ' ') up++;
+    /* Parse URL (optionally in angle brackets) */
+    const char* us; size_t ul;
+    if (up < end && *up == '<') {
+        up++;
+        const char* ue = up;
+        while (ue < end && *ue != '>') ue++;
+        us = up; ul = ue - up;
+        up = (ue < end) ? ue + 1 : ue;
+    } else {
+        const char* ue = up;
+        while (ue < end && *ue != ' ' && *ue != '\t' && *ue != '"') ue++;
+        us = up; ul = ue - up;
+        up = ue;
+    }
+    if (ul == 0) return 0;
+    if (!refs) return 1;
+    /* Parse optional title in quotes */
+    const char* ts = up; size_t tl = 0;
+    while (up < end && (*up == ' ' || *up == '\t')) up++;
+    if (up < end && *up == '"') {
+        up++;
+        const char* te = up;
+        while (te < end && *te != '"') te++;
+        ts = up; tl = te - up;
+    }
+    ref_add(refs, ls, labLen, us, ul, ts, tl);
+    return 1;
+}
+
+/* Blockquote continuation: strips "> " / ">" or keeps a lazy line.
+   Returns 0 on an empty line, which closes the quote. */
+static int bq_child(const char** p, size_t* n) {
+    while (*n>0 && **p==' ') { (*p)++; (*n)--; }
+    if (*n == 0) return 0;
+    if ((*p)[0]=='>' && (SPAN_AT(*p,*n,1)==' '||SPAN_AT(*p,*n,1)=='\0')) {
+        size_t k = SPAN_AT(*p,*n,1)==' ' ? 2 : 1; *p += k; *n -= k;
+    }
+    return 1;
+}
+
+static int is_html_block(const char* tr, size_t tn) {
+    static const char* block_tags[] = {
+        "div","p","table","thead","tbody","tr","th","td","ul","ol","li",
+        "h1","h2","h3","h4","h5","h6","pre","blockquote","hr","br",
+        "section","article","aside","nav","header","footer","main",
+        "figure","figcaption","details","summary","dl","dt","dd",
+        "form","fieldset","input","textarea","select","button","label",
+        "video","audio","source","iframe","canvas","svg","img",
+        "style","script","!--", NULL
+    };
+    for (int t=0; block_tags[t]; t++) {
+        size_t tl = strlen(block_tags[t]);
+        if (1+tl <= tn && md_strnicmp(tr+1, block_tags[t], tl)==0) {
+            char after = SPAN_AT(tr,tn,1+tl);
+            if (after==' '||after=='>'||after=='\0'||after=='\n'||after=='/'||after=='\r') return 1;
+        }
+        /* Also match closing tags like </div> at start of line */
+        if (SPAN_AT(tr,tn,1)=='/' && 2+tl <= tn && md_strnicmp(tr+2, block_tags[t], tl)==0) {
+            char after = SPAN_AT(tr,tn,2+tl);
+            if (after=='>'||after=='\0'||after=='\n'||after==' ') return 1;
+        }
+    }
+    return 0;
+}
+
+/* ── Block Tree ──────────────────────────────────────────────────────── */
+
+/* The block structure is built in one pass over the line table and stored
+   as a flat pre-order list: containers are an OPEN/CLOSE pair, leaves carry
+   a span into the source. The emitter then walks the list in a plain loop,
+   so neither stage recurses however deep blockquotes and lists nest. */
+
+enum {
+    B_BQ_OPEN, B_BQ_CLOSE,
+    B_LIST_OPEN, B_LIST_CLOSE,         /* a = ordered */
+    B_ITEM_OPEN, B_ITEM_NEST, B_ITEM_CLOSE, /* open: a = task, b = checked, span = first line */
+    B_HEADING, B_SETEXT,               /* a = level, line = source line for the id */
+    B_HR,
+    B_FENCE, B_ICODE, B_CODE_LINE, B_CODE_BLANK, B_CODE_CLOSE, /* fence: span = language, a = has info string */
+    B_TABLE, B_TROW, B_TABLE_CLOSE,    /* table: span = header row, followed by a B_SPAN separator row */
+    B_HTML_LINE,
+    B_PARA,                            /* len = number of B_SPAN lines that follow */
+    B_SPAN
+};
+
+/* +1 / -1 for kinds that open / close something a chunk must not split */
+static const signed char k_nest[] = { 1,-1, 1,-1, 1,0,-1, 0,0, 0, 1,1,0,0,-1, 1,0,-1, 0, 0, 0 };
+
+/* Rough rendered height of each kind, in lines of body text, plus one
+   line per EST_COLS bytes of paragraph, item or heading text */
+static const unsigned char k_estLines[] = { 1,0, 1,0, 1,0,0, 3,3, 2, 2,2,1,1,0, 2,2,1, 1, 2, 0 };
+enum { EST_COLS = 80 };
+
+typedef struct { size_t off; size_t len; int line; unsigned char kind, a, b; } Block;
+typedef struct { Block* items; int count; int cap; } BlockList;
+
+/* Open containers. A list item's nested lines keep their indentation, so
+   only blockquotes rewrite the span as it travels down the stack. */
+enum { F_BQ, F_LIST, F_ITEM };
+typedef struct { int kind; int bi; int ordered; int nested; } Frame;
+
+enum { LEAF_NONE, LEAF_FENCE, LEAF_ICODE, LEAF_TABLE, LEAF_HTML, LEAF_PARA };
+
+typedef struct {
+    Arena* arena;
+    Lines lines;
+    RefMap* refs;
+    BlockList bl;
+    Frame* frames; int depth; int fcap;
+    int leaf;     /* open leaf block of the innermost document */
+    char fence;   /* LEAF_FENCE: '`' or '~' */
+    int skip;     /* next line already consumed (setext underline, table separator) */
+    int para;     /* LEAF_PARA: index of its B_PARA block */
+    int cur;      /* line being routed, stamped on the blocks it adds */
+} BlockParser;
+
+static Block* bp_add(BlockParser* bp, int kind, const char* p, size_t n) {
+    if (bp->bl.count >= bp->bl.cap) {
+        int cap = bp->bl.cap ? bp->bl.cap*2 : 256;
+        bp->bl.items = (Block*)arena_grow(bp->arena, bp->bl.items, bp->bl.cap * sizeof(Block), cap * sizeof(Block));
+        bp->bl.cap = cap;
+    }
+    Block* b = &bp->bl.items[bp->bl.count++];
+    b->kind = (unsigned char)kind; b->a = 0; b->b = 0; b->line = bp->cur;
+    b->off = p ? (size_t)(p - bp->lines.base) : 0; b->len = p ? n : 0;
+    return b;
+}
+
+static void bp_push(BlockParser* bp, int kind, int bi, int ordered) {
+    if (bp->depth >= bp->fcap) {
+        int cap = bp->fcap ? bp->fcap*2 : 16;
+        bp->frames = (Frame*)arena_grow(bp->arena, bp->frames, bp->fcap * sizeof(Frame), cap * sizeof(Frame));
+        bp->fcap = cap;
+    }
+    Frame* f = &bp->frames[bp->depth++];
+    f->kind = kind; f->bi = bi; f->ordered = ordered; f->nested = 0;
+}
+
+static void bp_end_leaf(BlockParser* bp) {
+    switch (bp->leaf) {
+    case LEAF_FENCE: case LEAF_ICODE: bp_add(bp, B_CODE_CLOSE, NULL, 0); break;
+    case LEAF_TABLE: bp_add(bp, B_TABLE_CLOSE, NULL, 0); break;
+    case LEAF_PARA:  bp->bl.items[bp->para].len = (size_t)(bp->bl.count - bp->para - 1); break;
+    }
+    bp->leaf = LEAF_NONE; bp->skip = 0;
+}
+
+static void bp_pop(BlockParser* bp) {
+    bp_end_leaf(bp);
+    Frame* f = &bp->frames[--bp->depth];
+    if (f->kind == F_BQ) bp_add(bp, B_BQ_CLOSE, NULL, 0);
+    else if (f->kind == F_ITEM) bp_add(bp, B_ITEM_CLOSE, NULL, 0);
+    else bp_add(bp, B_LIST_CLOSE, NULL, 0)->a = (unsigned char)f->ordered;
+}
+
+/* A line's span on its way down the frame stack. The indent is cached:
+   only blockquote markers change it, and list frames test it per level. */
+typedef struct { const char* p; size_t n; int indent; int k; int in; } Cursor;
+
+static void cur_start(BlockParser* bp, Cursor* c, int j, int add) {
+    c->k = 0; c->in = j < bp->lines.count;
+    if (!c->in) return;
+    c->p = LN_PTR(bp->lines,j); c->n = LN_LEN(bp->lines,j); c->indent = bp->lines.lines[j].indent;
+    if (parse_refdef(add ? bp->refs : NULL,c->p,c->n)) { c->n = 0; c->indent = 0; }
+}
+
+/* Lookahead: walk the cursor down to frame `upto`; 0 once the line drops out */
+static int cur_reach(BlockParser* bp, Cursor* c, int upto) {
+    for (; c->in && c->k < upto; c->k++) {
+        Frame* f = &bp->frames[c->k];
+        if (f->kind == F_BQ) {
+            if (!bq_child(&c->p,&c->n)) c->in = 0;
+            else if (parse_refdef(NULL,c->p,c->n)) { c->n = 0; c->indent = 0; }
+            else c->indent = get_indent(c->p,c->n);
+        } else if (f->kind == F_LIST) {
+            if ((size_t)c->indent < c->n && c->indent <= f->bi+1) c->in = 0;
+            else c->k++;
+        }
+    }
+    return c->in;
+}
+
+/* Span of line j as seen inside the first `upto` frames, for one-line
+   lookahead; NULL when the line does not reach that depth. */
+static const char* bp_peek(BlockParser* bp, int j, int upto, size_t* pn) {
+    Cursor c; cur_start(bp, &c, j, 0);
+    if (!cur_reach(bp, &c, upto)) return NULL;
+    *pn = c.n; return c.p;
+}
+
+/* Follow line j down the open containers. Returns how many frames it
+   continues; pp, pn and pind receive the line's span and indent there. */
+static int bp_route(BlockParser* bp, int j, const char** pp, size_t* pn, int* pind) {
+    Cursor c, nx; cur_start(bp, &c, j, 1); nx.in = -1;
+    int k = 0;
+    for (; k<bp->depth; k++) {
+        Frame* f = &bp->frames[k];
+        if (f->kind == F_BQ) {
+            if (!bq_child(&c.p,&c.n)) break;
+            if (parse_refdef(bp->refs,c.p,c.n)) { c.n = 0; c.indent = 0; }
+            else c.indent = get_indent(c.p,c.n);
+        } else if (f->kind == F_LIST) {
+            if (k+1 >= bp->depth) { k++; break; }  /* between items: list level */
+            int in;
+            if ((size_t)c.indent >= c.n) {
+                /* Blank: stays in the item if the next line does */
+                if (nx.in < 0) cur_start(bp, &nx, j+1, 0);
+                in = cur_reach(bp, &nx, k) && nx.indent > f->bi+1;
+            } else in = c.indent > f->bi+1;
+            if (!in) { k++; break; }
+            Frame* it = &bp->frames[++k];
+            if (!it->nested) { it->nested = 1; bp_add(bp, B_ITEM_NEST, NULL, 0); }
+        }
+    }
+    *pp = c.p; *pn = c.n; *pind = c.indent;
+    return k;
+}
+
+static int bp_peek_indent(BlockParser* bp, int j, int upto) {
+    Cursor c; cur_start(bp, &c, j, 0);
+    return cur_reach(bp, &c, upto) ? c.indent : 0;
+}
+
+/* Handle one line in the innermost open container */
+static void bp_line(BlockParser* bp, int j, const char* p, size_t n, int indent) {
+    for (;;) {
+        const char* tr = p + indent;
+        size_t tn = (size_t)indent < n ? n - indent : 0;
+
+        /* Between list items */
+        if (bp->depth > 0 && bp->frames[bp->depth-1].kind == F_LIST) {
+            Frame* f = &bp->frames[bp->depth-1];
+            if (tn == 0) return;
+            int iu=is_ul(tr,tn)&&indent<=f->bi+1; int om=is_ol(tr,tn); int io=om&&indent<=f->bi+1;
+            if (!iu&&!io&&indent<=f->bi) { bp_pop(bp); continue; }
+            if (iu||io) {
+                int skip=iu?2:om; const char* ic=tr+skip; size_t icn=tn-skip;
+                int task=0,chk=0;
+                if(has_prefix(ic,icn,"[ ] ",4)){task=1;ic+=4;icn-=4;}
+                else if(has_prefix(ic,icn,"[x] ",4)||has_prefix(ic,icn,"[X] ",4)){task=1;chk=1;ic+=4;icn-=4;}
+                Block* b = bp_add(bp, B_ITEM_OPEN, ic, icn); b->a = (unsigned char)task; b->b = (unsigned char)chk;
+                bp_push(bp, F_ITEM, 0, 0);
+            }
+            return;
+        }
+
+        if (bp->skip) { bp->skip = 0; return; }
+
+        switch (bp->leaf) {
+        case LEAF_FENCE: {
+            const char* ct=p; while(ct<p+n&&*ct==' ')ct++;
+            size_t ctn=n-(size_t)(ct-p);
+            if((bp->fence=='`'&&has_prefix(ct,ctn,"```",3))||(bp->fence=='~'&&has_prefix(ct,ctn,"~~~",3))){ bp_end_leaf(bp); return; }
+            /* A bare '>' closing a quote adds no trailing code line */
+            size_t nn;
+            if (n==0 && bp->depth>0 && bp->frames[bp->depth-1].kind==F_BQ && !bp_peek(bp,j+1,bp->depth,&nn)) return;
+            bp_add(bp, B_CODE_LINE, p, n); return;
+        }
+        case LEAF_ICODE:
+            if (n == 0) {
+                if (bp_peek_indent(bp, j+1, bp->depth) >= 4) { bp_add(bp, B_CODE_BLANK, NULL, 0); return; }
+                bp_end_leaf(bp); continue;
+            }
+            if (indent < 4) { bp_end_leaf(bp); continue; }
+            bp_add(bp, B_CODE_LINE, p+4, n>4?n-4:0); return;
+        case LEAF_TABLE: {
+            const char* rl=p; size_t rn=n; while(rn>0&&*rl==' '){rl++;rn--;}
+            if (rn==0||!memchr(rl,'|',rn)) { bp_end_leaf(bp); continue; }
+            bp_add(bp, B_TROW, p, n); return;
+        }
+        case LEAF_HTML:
+            if (n == 0) { bp_end_leaf(bp); continue; }
+            bp_add(bp, B_HTML_LINE, p, n); return;
+        case LEAF_PARA: {
+            size_t nn = 0; const char* nx;
+            if (setext_kind(p,n) || tn==0 || (tr[0]=='#'&&SPAN_AT(tr,tn,1)==' ') || is_hr(p,n)
+                || (tr[0]=='>'&&(SPAN_AT(tr,tn,1)==' '||SPAN_AT(tr,tn,1)=='\0'))
+                || has_prefix(tr,tn,"```",3) || has_prefix(tr,tn,"~~~",3) || is_ul(tr,tn) || is_ol(tr,tn)
+                || ((nx = bp_peek(bp, j+1, bp->depth, &nn)) && is_table_sep(nx,nn))) {
+                bp_end_leaf(bp); continue;
+            }
+            bp_add(bp, B_SPAN, tr, tn); return;
+        }
+        }
+
+        /* No open leaf: start a new block */
+        if (tn == 0) return;
+
+        /* Fenced code block */
+        if (has_prefix(tr,tn,"```",3) || has_prefix(tr,tn,"~~~",3)) {
+            const char* te=tr+tn; const char* lang=tr+3; while(lang<te&&*lang==' ')lang++;
+            const char* le=lang; while(le<te&&*le!=' '&&*le!='`'&&*le!='~')le++;
+            bp_add(bp, B_FENCE, lang, (size_t)(le-lang))->a = (unsigned char)(lang<te);
+            bp->leaf = LEAF_FENCE; bp->fence = tr[0]; return;
+        }
+
+        /* Indented code block */
+        if (indent>=4 && !is_ul(tr,tn) && !is_ol(tr,tn)) {
+            bp_add(bp, B_ICODE, NULL, 0); bp->leaf = LEAF_ICODE; continue;
+        }
+
+        /* ATX Headings with id for TOC */
+        if (tr[0]=='#') {
+            int lv=count_leading(tr,tn,'#');
+            if(lv>=1&&lv<=6&&SPAN_AT(tr,tn,lv)==' '){
+                const char* c=tr+lv+1; size_t cl=tn-lv-1;
+                while(cl>0&&c[cl-1]=='#')cl--;
+                while(cl>0&&c[cl-1]==' ')cl--;
+                Block* b = bp_add(bp, B_HEADING, c, cl); b->a = (unsigned char)lv; b->line = j;
+                return;
+            }
+        }
+
+        /* Setext headings: the underline is the next line of this container */
+        size_t nn = 0; const char* nx = bp_peek(bp, j+1, bp->depth, &nn);
+        { int sk = nx ? setext_kind(nx,nn) : 0;
+            if (sk==1 || (sk==2 && !is_hr(nx,nn))) {
+                bp_add(bp, B_SETEXT, tr, tn)->a = (unsigned char)sk; bp->skip = 1; return;
+            }
+        }
+
+        /* HR */
+        if (is_hr(p,n)) { bp_add(bp, B_HR, NULL, 0); return; }
+
+        /* Blockquote */
+        if (tr[0]=='>'&&(SPAN_AT(tr,tn,1)==' '||SPAN_AT(tr,tn,1)=='\0')) {
+            bp_add(bp, B_BQ_OPEN, NULL, 0); bp_push(bp, F_BQ, 0, 0);
+            bq_child(&p,&n);
+            if (parse_refdef(bp->refs,p,n)) n = 0;
+            indent = get_indent(p,n);
+            continue;
+        }
+
+        /* Table: header row followed by a separator row */
+        if (nx && is_table_sep(nx,nn)) {
+            bp_add(bp, B_TABLE, p, n); bp_add(bp, B_SPAN, nx, nn);
+            bp->leaf = LEAF_TABLE; bp->skip = 1; return;
+        }
+
+        /* Lists */
+        if (is_ul(tr,tn) || is_ol(tr,tn)) {
+            int ordered = is_ol(tr,tn) != 0;
+            bp_add(bp, B_LIST_OPEN, NULL, 0)->a = (unsigned char)ordered;
+            bp_push(bp, F_LIST, indent, ordered);
+            continue;
+        }
+
+        /* Raw HTML blocks — pass through unescaped */
+        if (tr[0]=='<' && is_html_block(tr,tn)) { bp->leaf = LEAF_HTML; continue; }
+
+        /* Paragraph */
+        bp->para = bp->bl.count; bp_add(bp, B_PARA, NULL, 0);
+        bp->leaf = LEAF_PARA;
+        bp_add(bp, B_SPAN, tr, tn); return;
+    }
+}
+
+/* ── Markdown Block Parser ───────────────────────────────────────────── */
+
+/* Start a section at output position `pos`, before top-level block b;
+   returns its index. A heading that comes first takes over the one open. */
+static int sec_open(MdContext* cx, int si, size_t pos, const Block* b) {
+    MdSections* ss = cx->secs;
+    if (si >= 0 && pos == ss->items[si].off) {
+        MdSection* s = &ss->items[si];
+        s->line = b->line; s->level = (b->kind == B_HEADING || b->kind == B_SETEXT) ? b->a : 0;
+        return si;
+    }
+    if (ss->count >= ss->cap) {
+        int cap = ss->cap ? ss->cap*2 : 64;
+        MdSection* ni = (MdSection*)realloc(ss->items, (size_t)cap * sizeof(MdSection));
+        if (!ni) { cx->secFail = 1; return si; }  /* keep filling the last one */
+        ss->items = ni; ss->cap = cap;
+    }
+    if (si >= 0) ss->items[si].len = pos - ss->items[si].off;
+    MdSection* s = &ss->items[ss->count];
+    memset(s, 0, sizeof(*s));
+    s->off = pos; s->line = b->line;
+    s->level = (b->kind == B_HEADING || b->kind == B_SETEXT) ? b->a : 0;
+    return ss->count++;
+}
+
+/* A new entry at the end of o; NULL once memory has run out */
+static MdHeading* outline_add(MdOutline* o) {
+    if (o->failed) return NULL;
+    if (o->count >= o->cap) {
+        int cap = o->cap ? o->cap*2 : 64;
+        MdHeading* ni = (MdHeading*)realloc(o->items, (size_t)cap * sizeof(MdHeading));
+        if (!ni) { o->failed = 1; return NULL; }
+        o->items = ni; o->cap = cap;
+    }
+    if (!o->text.data) sb_init(&o->text);
+    return &o->items[o->count++];
+}
+
+/* Record the heading whose inner HTML is sb[from..]: its text is that
+   HTML without the tags, so entities stay escaped for reuse in a page */
+static void out_heading(MdContext* cx, const Block* b, int section, const StrBuf* sb, size_t from) {
+    MdOutline* o = cx->outline;
+    MdHeading* h = outline_add(o);
+    if (!h) return;
+    h->level = b->a; h->line = b->line; h->section = section;
+    h->anchored = b->kind == B_HEADING && cx->opts.headingIds;
+    h->textOff = o->text.len;
+    sb_ensure(&o->text, sb->len - from + 1);
+    char q = 0; int tag = 0;   /* inside a tag, and in which quotes */
+    for (size_t i = from; i < sb->len; i++) {
+        char c = sb->data[i];
+        if (tag) { if (q) { if (c == q) q = 0; } else if (c == '"' || c == '\'') q = c; else if (c == '>') tag = 0; }
+        else if (c == '<') tag = 1;
+        else o->text.data[o->text.len++] = c;
+    }
+    o->text.data[o->text.len] = '\0';
+    h->textLen = o->text.len - h->textOff;
+}
+
+/* Line-number gutter of the code block opened by b: an empty span whose
+   numbers, one per line, the page shows through content:attr(data-n), so
+   they are never part of the text that find, copy or select see */
+static void ln_gutter(StrBuf* sb, const char* src, const Block* b, const Block* end) {
+    int lines = 0, n = 0;   /* up to the last line that is not blank */
+    for (const Block* k = b + 1; k < end && k->kind != B_CODE_CLOSE; k++) {
+        n++;
+        for (size_t c = 0; k->kind == B_CODE_LINE && c < k->len; c++)
+            if (src[k->off + c] != ' ' && src[k->off + c] != '\t') { lines = n; break; }
+    }
+    if (!lines) return;
+    sb_append(sb, "<span class=\"ln-nums\" data-n=\"");
+    for (n = 1; n <= lines; n++) {
+        char num[16]; int d = 0;
+        for (int v = n; v; v /= 10) num[d++] = (char)('0' + v % 10);
+        sb_ensure(sb, (size_t)d + 1);
+        while (d) sb->data[sb->len++] = num[--d];
+        sb->data[sb->len++] = n < lines ? '\n' : '"';
+    }
+    sb->data[sb->len] = '\0';
+    sb_append(sb, "></span>");
+}
+
+/* A line number is printed at sb offset `at`: noted for md_doc_update,
+   which moves it when it reuses the block further down */
+static void doc_num(MdContext* cx, size_t at) {
+    MdDoc* d = cx->doc;
+    if (d->numCount >= d->numCap) {
+        int cap = d->numCap ? d->numCap*2 : 256;
+        size_t* na = (size_t*)realloc(d->numAt, (size_t)cap * sizeof(size_t));
+        if (!na) { cx->docFail = 1; return; }
+        d->numAt = na; d->numCap = cap;
+    }
+    d->numAt[d->numCount++] = at;
+}
+
+/* "<tag", marked with the source line of a top-level block (line >= 0) */
+static void open_tag(MdContext* cx, StrBuf* sb, const char* tag, int line) {
+    sb_append_char(sb, '<'); sb_append(sb, tag);
+    if (line < 0) return;
+    char num[32]; sprintf(num, " data-line=\"%d\"", line);
+    if (cx->doc) doc_num(cx, sb->len + 12);
+    sb_append(sb, num);
+}
+
+/* Flag (in b, which these kinds leave unused) the code blocks and quotes
+   to open collapsed: code by its line count, a quote by the estimated
+   height of everything inside it. Both ends get the flag, so the emitter
+   needs no stack of its own. */
+static void mark_collapse(MdContext* cx, BlockList* bl) {
+    typedef struct { int bi; size_t est, bytes; } Open;
+    Open* st = NULL; int n = 0, cap = 0, code = -1;
+    size_t est = 0, bytes = 0;   /* running totals, quotes take the difference */
+    size_t maxCode = (size_t)cx->opts.collapseCode, maxQuote = (size_t)cx->opts.collapseQuote;
+    for (int k = 0; k < bl->count; k++) {
+        Block* b = &bl->items[k];
+        est += k_estLines[b->kind];
+        switch (b->kind) {
+        case B_ITEM_OPEN: case B_HEADING: case B_SETEXT: case B_SPAN: bytes += b->len; break;
+        case B_FENCE: case B_ICODE: code = k; break;
+        case B_CODE_CLOSE:
+            if (maxCode && code >= 0 && (size_t)(k - code - 1) > maxCode) bl->items[code].b = b->b = 1;
+            code = -1; break;
+        case B_BQ_OPEN:
+            if (!maxQuote) break;
+            if (n == cap) { int nc = cap ? cap*2 : 16; st = (Open*)arena_grow(&cx->arena, st, cap * sizeof(Open), nc * sizeof(Open)); cap = nc; }
+            st[n].bi = k; st[n].est = est; st[n].bytes = bytes; n++; break;
+        case B_BQ_CLOSE:
+            if (!n) break;
+            n--;
+            if (est - st[n].est + (bytes - st[n].bytes) / EST_COLS > maxQuote) bl->items[st[n].bi].b = b->b = 1;
+            break;
+        }
+    }
+}
+
+/* Collapsed block: the class on its opening tag, then before its end tag
+   a fade over the cut-off edge, and after it the button that expands it */
+static const char k_collapseClass[] = " class=\"mdv-collapsible\"";
+static const char k_collapseFade[] = "<div class=\"mdv-collapse-fade\"></div>";
+static const char k_collapseBtn[] = "<button class=\"mdv-expand-btn\">&#9660; Show more</button>\n";
+
+/* The button's label is no document text: the index takes what comes
+   before it and moves past it */
+static void collapse_btn(MdContext* cx, StrBuf* sb, size_t* txFrom) {
+    if (cx->text) tx_take(cx, sb->data, *txFrom, sb->len);
+    sb_append(sb, k_collapseBtn);
+    *txFrom = sb->len;
+}
+
+/* With a sink, the buffer is flushed into it between blocks; an aligned
+   sink only gets whole top-level blocks (a raw HTML run counts as one).
+   Sections are cut at the same kind of boundary. */
+static int emit_blocks(MdContext* cx, StrBuf* sb, const char* src, const BlockList* bl, MdSink* out) {
+    char cells[64][1024]; char al[64]; int nc = 0;
+    int codeStart = 0; /* next code line follows the <code> tag directly */
+    int shLang = SH_NONE, shState = SHS_CODE;  /* fenced block being highlighted */
+    const MdGrammar* shGram = NULL;            /* ... by this grammar instead */
+    int depth = 0;     /* open containers, code blocks and tables */
+    size_t sent = 0;   /* bytes already handed to the sink */
+    MdSections* ss = cx->secs;
+    size_t secMax = ss && ss->maxBytes ? ss->maxBytes : 65536;
+    int si = -1;       /* section being filled */
+    size_t txFrom = 0; /* text index: output not taken yet */
+    for (int k = 0; k < bl->count; k++) {
+        const Block* b = &bl->items[k];
+        int boundary = depth == 0 && !(b->kind == B_HTML_LINE && k && bl->items[k-1].kind == B_HTML_LINE);
+        if (cx->text) { tx_take(cx, sb->data, txFrom, sb->len); txFrom = sb->len; }
+        if (out && sb->len >= (out->chunk ? out->chunk : 65536) && (!out->aligned || boundary)) {
+            if (out->write(out, sb->data, sb->len)) return -1;
+            sent += sb->len; sb->len = 0; sb->data[0] = '\0'; txFrom = 0;
+        }
+        int title = 0;
+        if (ss && boundary) {
+            size_t pos = sent + sb->len;
+            int head = b->kind == B_HEADING || b->kind == B_SETEXT;
+            if (si < 0 || head || pos - ss->items[si].off >= secMax) {
+                si = sec_open(cx, si, pos, b);
+                title = si >= 0 && head && ss->items[si].off == pos;
+            }
+        }
+        /* Top-level blocks other than raw HTML carry their line */
+        int mark = cx->opts.blockLines && boundary && b->kind != B_HTML_LINE ? b->line : -1;
+        if (cx->text && boundary) tx_block(cx, mark, si);
+        depth += k_nest[b->kind];
+        size_t text = 0;   /* bytes of wrapping text, for the height estimate */
+        size_t hFrom;      /* heading: where its inner HTML starts in sb */
+        const char* s = src + b->off;
+        switch (b->kind) {
+        case B_BQ_OPEN:    open_tag(cx,sb,"blockquote",mark); if(b->b) sb_append(sb,k_collapseClass); sb_append(sb,">\n"); break;
+        case B_BQ_CLOSE:
+            if(b->b){ sb_append(sb,k_collapseFade); sb_append(sb,"</blockquote>\n"); collapse_btn(cx,sb,&txFrom); }
+            else sb_append(sb,"</blockquote>\n");
+            break;
+        case B_LIST_OPEN:  open_tag(cx,sb,b->a?"ol":"ul",mark); sb_append(sb,">\n"); break;
+        case B_LIST_CLOSE: sb_append(sb,b->a?"</ol>\n":"</ul>\n"); break;
+        case B_ITEM_OPEN:
+            sb_append(sb,"<li>");
+            if(b->a) sb_append(sb,b->b?"<input type=\"checkbox\" checked disabled> ":"<input type=\"checkbox\" disabled> ");
+            parse_inline(cx,sb,s,b->len); text = b->len; break;
+        case B_ITEM_NEST:  sb_append(sb,"\n"); break;
+        case B_ITEM_CLOSE: sb_append(sb,"</li>\n"); break;
+        case B_HEADING: {
+            char tag[8]; sprintf(tag,"h%d",b->a);
+            char idnum[16]; sprintf(idnum,"%d",b->line);
+            open_tag(cx,sb,tag,mark);
+            if(cx->opts.headingIds){ if(cx->doc) doc_num(cx,sb->len+10); sb_append(sb," id=\"mdv-h"); sb_append(sb,idnum); sb_append(sb,"\""); }
+            sb_append(sb,">");
+            hFrom = sb->len;
+            if (title) ss->items[si].titleOff = sent + sb->len;
+            parse_inline(cx,sb,s,b->len);
+            if (title) ss->items[si].titleLen = sent + sb->len - ss->items[si].titleOff;
+            if (cx->outline) out_heading(cx,b,ss ? si : -1,sb,hFrom);
+            sb_append(sb,"</"); sb_append(sb,tag); sb_append(sb,">\n"); text = b->len; break;
+        }
+        case B_SETEXT:
+            open_tag(cx,sb,b->a==1?"h1":"h2",mark); sb_append(sb,">");
+            hFrom = sb->len;
+            if (title) ss->items[si].titleOff = sent + sb->len;
+            parse_inline(cx,sb,s,b->len);
+            if (title) ss->items[si].titleLen = sent + sb->len - ss->items[si].titleOff;
+            if (cx->outline) out_heading(cx,b,ss ? si : -1,sb,hFrom);
+            sb_append(sb,b->a==1?"</h1>\n":"</h2>\n"); text = b->len; break;
+        case B_HR: open_tag(cx,sb,"hr",mark); sb_append(sb,">\n"); break;
+        case B_FENCE:
+            open_tag(cx,sb,"pre",mark); if(b->b) sb_append(sb,k_collapseClass); sb_append(sb,">"); if(cx->opts.lineGutters) ln_gutter(sb,src,b,bl->items+bl->count);
+            sb_append(sb,"<code");
+            if(b->a){ sb_append(sb," class=\"language-"); sb_append_esc(sb,s,b->len); sb_append(sb,"\""); }
+            sb_append(sb,">"); codeStart = 1;
+            shLang = SH_NONE; shGram = NULL; shState = SHS_CODE;
+            if(cx->opts.highlight && b->a){ int gi = gr_find(cx,s,b->len); if(gi >= 0) shGram = cx->opts.grammars[gi]; else shLang = sh_lang(s,b->len); }
+            break;
+        case B_ICODE: open_tag(cx,sb,"pre",mark); if(b->b) sb_append(sb,k_collapseClass); sb_append(sb,">"); if(cx->opts.lineGutters) ln_gutter(sb,src,b,bl->items+bl->count);
+            sb_append(sb,"<code>"); codeStart = 1; shLang = SH_NONE; shGram = NULL; break;
+        case B_CODE_LINE:
+            if(!codeStart) sb_append(sb,"\n");
+            if(shGram) gr_line(sb,shGram,&shState,s,b->len);
+            else if(shLang) sh_line(sb,shLang,&shState,s,b->len); else sb_append_esc(sb,s,b->len);
+            codeStart = 0; break;
+        case B_CODE_BLANK: sb_append(sb,"\n"); codeStart = 0; break;
+        case B_CODE_CLOSE:
+            if(b->b){ sb_append(sb,"</code>"); sb_append(sb,k_collapseFade); sb_append(sb,"</pre>\n"); collapse_btn(cx,sb,&txFrom); }
+            else sb_append(sb,"</code></pre>\n");
+            break;
+        case B_TABLE: {
+            const Block* sep = &bl->items[++k];
+            memset(al,'l',sizeof(al));
+            nc=parse_trow(s,b->len,cells,64); parse_talign(src+sep->off,sep->len,al,64);
+            open_tag(cx,sb,"table",mark); sb_append(sb,">\n<thead>\n<tr>\n");
+            for(int c=0;c<nc;c++){
+                sb_append(sb,"<th"); if(al[c]=='c')sb_append(sb," style=\"text-align:center\""); else if(al[c]=='r')sb_append(sb," style=\"text-align:right\"");
+                sb_append(sb,">"); parse_inline(cx,sb,cells[c],strlen(cells[c])); sb_append(sb,"</th>\n");
+            }
+            sb_append(sb,"</tr>\n</thead>\n<tbody>\n"); break;
+        }
+        case B_TROW: {
+            int rc=parse_trow(s,b->len,cells,64); sb_append(sb,"<tr>\n");
+            for(int c=0;c<nc;c++){
+                sb_append(sb,"<td"); if(al[c]=='c')sb_append(sb," style=\"text-align:center\""); else if(al[c]=='r')sb_append(sb," style=\"text-align:right\"");
+                sb_append(sb,">"); if(c<rc)parse_inline(cx,sb,cells[c],strlen(cells[c])); sb_append(sb,"</td>\n");
+            }
+            sb_append(sb,"</tr>\n"); break;
+        }
+        case B_TABLE_CLOSE: sb_append(sb,"</tbody>\n</table>\n"); break;
+        case B_HTML_LINE: sb_append_n(sb,s,b->len); sb_append(sb,"\n"); break;
+        case B_PARA: {
+            /* Join the spans; the buffer is sized up front, so plain memcpy */
+            size_t need = b->len;
+            for (size_t m = 1; m <= b->len; m++) need += bl->items[k+m].len;
+            if (need > cx->paraCap) { cx->para = (char*)arena_grow(&cx->arena, cx->para, cx->paraCap, need); cx->paraCap = need; }
+            size_t pl = 0;
+            for (size_t m = 0; m < b->len; m++) {
+                const Block* ln = &bl->items[++k];
+                if (m) cx->para[pl++] = '\n';
+                memcpy(cx->para+pl, src+ln->off, ln->len); pl += ln->len;
+            }
+            open_tag(cx,sb,"p",mark); sb_append(sb,">"); parse_inline(cx,sb,cx->para,pl); sb_append(sb,"</p>\n");
+            text = pl; break;
+        }
+        }
+        if (si >= 0) ss->items[si].height += k_estLines[b->kind] + (int)(text / EST_COLS);
+    }
+    if (si >= 0) ss->items[si].len = sent + sb->len - ss->items[si].off;
+    if (cx->text) tx_take(cx, sb->data, txFrom, sb->len);
+    if (out && sb->len && out->write(out, sb->data, sb->len)) return -1;
+    return 0;
+}
+
+/* Stage 1: one pass over the lines builds the block list, in the arena */
+static void parse_blocks(MdContext* cx, const char* markdown, size_t mdLen, BlockParser* bp) {
+    /* Size the first chunk from the line count: line table plus about one
+       block per line, with room for the reference map and inline scratch */
+    Arena* a = &cx->arena;
+    int nl = count_lines(markdown, mdLen);
+    arena_reserve(a, (size_t)(nl+16) * (sizeof(Line) + sizeof(Block)) + mdLen/4 + 65536);
+    memset(bp, 0, sizeof(*bp));
+    bp->arena = a;
+    bp->lines = split_lines(a, markdown, mdLen, nl);
+    ref_init(&cx->refs, a);
+    bp->refs = &cx->refs;
+    bp->bl.cap = bp->lines.count + 16;  /* roughly one block per line */
+    bp->bl.items = (Block*)arena_alloc(a, bp->bl.cap * sizeof(Block));
+
+    for (int j = 0; j < bp->lines.count; j++) {
+        const char* p; size_t n; int indent;
+        bp->cur = j;
+        int keep = bp_route(bp, j, &p, &n, &indent);
+        while (bp->depth > keep) bp_pop(bp);
+        bp_line(bp, j, p, n, indent);
+    }
+    bp->cur = bp->lines.count;
+    while (bp->depth > 0) bp_pop(bp);
+    bp_end_leaf(bp);
+}
+
+static int render(MdContext* cx, const char* markdown, size_t mdLen, StrBuf* sb, MdSink* out) {
+    Arena* a = &cx->arena;
+    if (cx->outline) { cx->outline->count = 0; cx->outline->text.len = 0; cx->outline->failed = 0; }
+    if (cx->text) {
+        MdText* t = cx->text;
+        t->count = 0; t->failed = 0; t->fold.len = 0;
+        if (!t->text.data) sb_init(&t->text);
+        if (!t->fold.data) sb_init(&t->fold);
+        t->text.len = 0;
+        cx->txTag = cx->txSkip = 0; cx->txQuote = 0;
+    }
+    BlockParser bp;
+    parse_blocks(cx, markdown, mdLen, &bp);
+
+    /* Stage 2: render it */
+    if (cx->opts.collapseCode > 0 || cx->opts.collapseQuote > 0) mark_collapse(cx, &bp.bl);
+    int rc = emit_blocks(cx, sb, markdown, &bp.bl, out);
+    if (cx->text) tx_finish(cx);
+
+    cx->para = NULL; cx->paraCap = 0; cx->brk = NULL; cx->brkCap = 0;
+    arena_reset(a);
+    return rc;
+}
+
+char* md_render(MdContext* cx, const char* markdown, size_t mdLen) {
+    /* The output outlives the arena, so it is the one malloc'd buffer;
+       sized from the input it rarely has to grow */
+    StrBuf sb; sb_init_cap(&sb, mdLen + mdLen/4 + 4096);
+    if (!sb.data) return NULL;
+    render(cx, markdown, mdLen, &sb, NULL);
+    return sb.data;
+}
+
+int md_render_to(MdContext* cx, const char* markdown, size_t mdLen, MdSink* out) {
+    /* Staging buffer: a chunk plus the block that crosses the threshold */
+    StrBuf sb; sb_init_cap(&sb, (out->chunk ? out->chunk : 65536) + 4096);
+    if (!sb.data) return -1;
+    int rc = render(cx, markdown, mdLen, &sb, out);
+    free(sb.data);
+    return rc;
+}
+
+char* md_render_sections(MdContext* cx, const char* markdown, size_t mdLen, MdSections* secs) {
+    secs->count = 0;
+    cx->secs = secs; cx->secFail = 0;
+    char* html = md_render(cx, markdown, mdLen);
+    cx->secs = NULL;
+    if (html && !cx->secFail) return html;
+    free(html); md_sections_free(secs);
+    return NULL;
+}
+
+/* Top-level blocks as emit_blocks finds them: a paragraph's lines and a
+   table's separator row belong to it, consecutive raw HTML lines are one
+   run. The items where each starts, then bl->count, in the arena; their
+   number in *n. */
+static int* top_blocks(Arena* a, const BlockList* bl, int* n) {
+    int* at = (int*)arena_alloc(a, ((size_t)bl->count + 1) * sizeof(int));
+    int depth = 0;
+    *n = 0;
+    for (int k = 0; k < bl->count; k++) {
+        const Block* b = &bl->items[k];
+        if (depth == 0 && !(b->kind == B_HTML_LINE && k && bl->items[k-1].kind == B_HTML_LINE)) at[(*n)++] = k;
+        depth += k_nest[b->kind];
+        if (b->kind == B_PARA) k += (int)b->len;
+        else if (b->kind == B_TABLE) k++;
+    }
+    at[*n] = bl->count;
+    return at;
+}
+
+/* Each block ends before the next one's line, less the blank lines */
+int md_source_map(MdContext* cx, const char* markdown, size_t mdLen, MdSourceMap* m) {
+    BlockParser bp; int n, rc = 0;
+    parse_blocks(cx, markdown, mdLen, &bp);
+    const int* top = top_blocks(&cx->arena, &bp.bl, &n);
+    m->count = 0;
+    if (n > m->cap) {
+        MdSourceBlock* nb = (MdSourceBlock*)realloc(m->items, (size_t)n * sizeof(MdSourceBlock));
+        if (nb) { m->items = nb; m->cap = n; } else rc = -1;
+    }
+    for (int i = 0; i < n && !rc; i++) {
+        const Block* b = &bp.bl.items[top[i]];
+        MdSourceBlock* e = &m->items[m->count++];
+        e->line = b->line; e->raw = b->kind == B_HTML_LINE;
+        e->end = i + 1 < n ? bp.bl.items[top[i+1]].line : bp.lines.count;
+        while (e->end > e->line + 1) {
+            const char* l = LN_PTR(bp.lines, e->end-1); size_t ln = LN_LEN(bp.lines, e->end-1), j = 0;
+            while (j < ln && (l[j] == ' ' || l[j] == '\t')) j++;
+            if (j < ln) break;
+            e->end--;
+        }
+    }
+    arena_reset(&cx->arena);
+    return rc;
+}
+
+int md_source_map_find(const MdSourceMap* m, int line) {
+    int lo = 0, hi = m->count;   /* first block starting past `line` */
+    while (lo < hi) { int mid = (lo + hi) / 2; if (m->items[mid].line <= line) lo = mid + 1; else hi = mid; }
+    return lo - 1;
+}
+
+void md_source_map_free(MdSourceMap* m) { free(m->items); memset(m, 0, sizeof(*m)); }
+
+void md_sections_free(MdSections* s) { free(s->items); s->items = NULL; s->count = s->cap = 0; }
+
+void md_outline_toc(const MdOutline* o, int maxLevel, StrBuf* out) {
+    for (int k = 0; k < o->count; k++) {
+        const MdHeading* h = &o->items[k];
+        if (h->level > maxLevel || (!h->anchored && h->section < 0)) continue;
+        char num[48];
+        sprintf(num, "<a class=\"ti t%d\"", h->level); sb_append(out, num);
+        if (h->anchored) { sprintf(num, " href=\"#mdv-h%d\"", h->line); sb_append(out, num); }
+        if (h->section >= 0) { sprintf(num, " data-s=\"%d\"", h->section); sb_append(out, num); }
+        sb_append(out, ">");
+        sb_append_n(out, o->text.data + h->textOff, h->textLen);
+        sb_append(out, "</a>");
+    }
+}
+
+void md_outline_free(MdOutline* o) { free(o->items); free(o->text.data); memset(o, 0, sizeof(*o)); }
+
+char* md_to_html(const char* markdown) { return md_to_html_n(markdown, strlen(markdown)); }
+
+char* md_to_html_n(const char* markdown, size_t mdLen) {
+    MdContext* cx = md_context_new(NULL);
+    if (!cx) return NULL;
+    char* html = md_render(cx, markdown, mdLen);
+    md_context_free(cx);
+    return html;
+}
+
+/* ── Block Diff ──────────────────────────────────────────────────────── */
+
+/* A block's HTML depends on its own items, the link definitions and the
+   options: emit_blocks carries nothing else from one top-level block to
+   the next. So the hash of its source, seeded with the other two, says
+   when the old HTML can be copied; only the line numbers printed in it
+   (data-line, heading ids) follow the block to its new line. The source
+   runs to the next block, taking in the blank lines and definitions
+   after it, which can decide where it ends. */
+
+void md_doc_free(MdDoc* d) { free(d->html.data); free(d->blocks); free(d->numAt); md_outline_free(&d->outline); memset(d, 0, sizeof(*d)); }
+void md_doc_diff_free(MdDocDiff* df) { free(df->items); memset(df, 0, sizeof(*df)); }
+
+/* Old block ob of od, appended to cx->doc with its lines moved by `shift` */
+static void doc_copy(MdContext* cx, const MdDoc* od, const MdDocBlock* ob, int shift) {
+    MdDoc* d = cx->doc;
+    const char* h = od->html.data + ob->off;
+    size_t pos = 0;
+    for (int i = 0; i < ob->nums; i++) {
+        size_t at = od->numAt[ob->num + i] - ob->off, e = at;
+        long v = 0;
+        while (e < ob->len && h[e] >= '0' && h[e] <= '9') v = v*10 + (h[e++] - '0');
+        char num[24]; sprintf(num, "%ld", v + shift);
+        sb_append_n(&d->html, h + pos, at - pos);
+        doc_num(cx, d->html.len);
+        sb_append(&d->html, num);
+        pos = e;
+    }
+    sb_append_n(&d->html, h + pos, ob->len - pos);
+    for (int i = 0; i < ob->heads; i++) {
+        const MdHeading* oh = &od->outline.items[ob->head + i];
+        MdHeading* nh = outline_add(&d->outline);
+        if (!nh) return;
+        *nh = *oh; nh->line += shift; nh->textOff = d->outline.text.len;
+        sb_append_n(&d->outline.text, od->outline.text.data + oh->textOff, oh->textLen);
+    }
+}
+
+static int diff_add(MdDocDiff* df, int at, int del, int to, int ins) {
+    if (df->count >= df->cap) {
+        int cap = df->cap ? df->cap*2 : 16;
+        MdDocHunk* ni = (MdDocHunk*)realloc(df->items, (size_t)cap * sizeof(MdDocHunk));
+        if (!ni) return -1;
+        df->items = ni; df->cap = cap;
+    }
+    MdDocHunk* h = &df->items[df->count++];
+    memset(h, 0, sizeof(*h));
+    h->at = at; h->del = del; h->to = to; h->ins = ins;
+    return 0;
+}
+
+/* Edits the diff looks for before it settles for one hunk over the lot */
+enum { DIFF_MAX = 256 };
+
+/* Myers: furthest x on diagonal k after d edits, given the row of d-1.
+   One step down (an insertion) from k+1 or right (a deletion) from k-1,
+   whichever gets further without leaving the m x n grid; -1 if neither
+   can. *down says which it was. */
+static int diff_step(const int* v, int d, int k, int m, int n, int* down) {
+    int x0 = k + 1 <= d - 1 ? v[k+1] : -1;
+    int x1 = k - 1 >= 1 - d && v[k-1] >= 0 ? v[k-1] + 1 : -1;
+    if (x0 >= 0 && x0 - k > n) x0 = -1;
+    if (x1 > m) x1 = -1;
+    *down = x0 >= x1;
+    return *down ? x0 : x1;
+}
+
+/* Hunks between the old blocks a and the new b: their common ends set
+   aside, the shortest edit script of the hashes in between */
+static int diff_blocks(Arena* ar, const MdDocBlock* a, int m, const MdDocBlock* b, int n, MdDocDiff* df) {
+    int p = 0, s = 0, D = -1, down;
+    while (p < m && p < n && a[p].hash == b[p].hash) p++;
+    while (s < m - p && s < n - p && a[m-1-s].hash == b[n-1-s].hash) s++;
+    a += p; b += p; m -= p + s; n -= p + s;
+    if (!m && !n) return 0;
+    int** rows = (int**)arena_alloc(ar, (DIFF_MAX + 1) * sizeof(int*));
+    for (int d = 0; d <= DIFF_MAX && D < 0; d++) {
+        int* v = (int*)arena_alloc(ar, (size_t)(2*d + 1) * sizeof(int)) + d;   /* v[-d..d] */
+        rows[d] = v;
+        for (int k = -d; k <= d; k += 2) {
+            int x = d ? diff_step(rows[d-1], d, k, m, n, &down) : 0;
+            if (x >= 0) for (int y = x - k; x < m && y < n && a[x].hash == b[y].hash; y++) x++;
+            v[k] = x;
+            if (x == m && x - k == n) { D = d; break; }
+        }
+    }
+    if (D < 0) return diff_add(df, p, m, p, n);
+
+    /* Walk back to mark the old blocks deleted and the new ones inserted;
+       runs of them between the blocks kept are the hunks */
+    char* gone = (char*)arena_alloc(ar, (size_t)m + (size_t)n + 2);
+    char* added = gone + m + 1;
+    memset(gone, 0, (size_t)m + (size_t)n + 2);
+    for (int d = D, x = m, y = n; d > 0; d--) {
+        int k = x - y, px = diff_step(rows[d-1], d, k, m, n, &down);
+        if (down) { x = px; y = px - k - 1; added[y] = 1; }
+        else { x = px - 1; y = x - k + 1; gone[x] = 1; }
+    }
+    int first = df->count;
+    for (int i = 0, j = 0; i < m || j < n; ) {
+        if (i < m && j < n && !gone[i] && !added[j]) { i++; j++; continue; }
+        int i0 = i, j0 = j;
+        while (i < m && gone[i]) i++;
+        while (j < n && added[j]) j++;
+        if (i == i0 && j == j0) { df->count = first; return diff_add(df, p, m, p, n); }   /* cannot happen */
+        if (diff_add(df, p + i0, i - i0, p + j0, j - j0)) return -1;
+    }
+    return 0;
+}
+
+/* A page finds a hunk by the blocks at its ends: widen each one until
+   both are marked (or the document's start and end), merging hunks that
+   meet. The blocks taken in are the same on both sides. */
+static void diff_anchor(MdDocDiff* df, const MdDocBlock* a, int m, const MdDocBlock* b, int marks) {
+    int out = 0;
+    for (int i = 0; i < df->count; i++) {
+        MdDocHunk h = df->items[i];
+        for (;;) {
+            int next = i + 1 < df->count ? df->items[i+1].at : m;
+            while (h.at + h.del < next && !(marks && !a[h.at + h.del].raw)) { h.del++; h.ins++; }
+            if (h.at + h.del < next || i + 1 >= df->count) break;
+            const MdDocHunk* nx = &df->items[++i];   /* ran into the next one */
+            h.del = nx->at + nx->del - h.at; h.ins = nx->to + nx->ins - h.to;
+        }
+        int lo = out ? df->items[out-1].at + df->items[out-1].del : 0;
+        if (h.del) while (h.at > lo && !(marks && !a[h.at].raw)) { h.at--; h.to--; h.del++; h.ins++; }
+        if (out && h.at <= lo) {
+            MdDocHunk* pv = &df->items[out-1];
+            pv->del = h.at + h.del - pv->at; pv->ins = h.to + h.ins - pv->to;
+        } else df->items[out++] = h;
+    }
+    df->count = out;
+    for (int i = 0; i < out; i++) {
+        MdDocHunk* h = &df->items[i];
+        int end = h->at + h->del;
+        h->lineEnd = end < m ? a[end].line : -1;
+        h->lineAt = !h->del ? h->lineEnd : h->at ? a[h->at].line : -1;
+        h->shift = end < m ? b[h->to + h->ins].line - a[end].line : 0;
+    }
+}
+
+int md_doc_update(MdContext* cx, MdDoc* d, const char* markdown, size_t mdLen, MdDocDiff* df) {
+    BlockParser bp; int n, converted = 0;
+    Arena* a = &cx->arena;
+    parse_blocks(cx, markdown, mdLen, &bp);
+    if (cx->opts.collapseCode > 0 || cx->opts.collapseQuote > 0) mark_collapse(cx, &bp.bl);
+    const int* top = top_blocks(a, &bp.bl, &n);
+
+    /* Seed: every option that shapes the HTML, then the link definitions */
+    const MdOptions* o = &cx->opts;
+    int ov[7] = { o->headingIds, o->highlight, o->lineGutters, o->blockLines, o->collapseCode, o->collapseQuote, o->grammarCount };
+    unsigned long long seed = md_hash64(ov, sizeof(ov), (unsigned long long)(size_t)o->grammars);
+    seed = md_hash64(cx->refs.pool, cx->refs.poolLen, seed);
+
+    /* The old blocks by hash: open addressing, index + 1 */
+    size_t mask = 15;
+    while (mask < (size_t)d->count * 2) mask = mask * 2 + 1;
+    int* slot = (int*)arena_alloc(a, (mask + 1) * sizeof(int));
+    memset(slot, 0, (mask + 1) * sizeof(int));
+    for (int i = 0; i < d->count; i++) {
+        size_t h = (size_t)d->blocks[i].hash & mask;
+        while (slot[h]) h = (h + 1) & mask;
+        slot[h] = i + 1;
+    }
+
+    MdDoc nd; memset(&nd, 0, sizeof(nd));
+    nd.blocks = (MdDocBlock*)malloc((size_t)(n ? n : 1) * sizeof(MdDocBlock));
+    nd.cap = n;
+    sb_init_cap(&nd.html, d->html.len > mdLen ? d->html.len + 4096 : mdLen + mdLen/4 + 4096);
+    MdOutline* outline = cx->outline; MdText* text = cx->text; MdSections* secs = cx->secs;
+    cx->doc = &nd; cx->docFail = 0; cx->outline = &nd.outline; cx->text = NULL; cx->secs = NULL;
+    for (int i = 0; i < n && nd.blocks && nd.html.data; i++) {
+        const Block* first = &bp.bl.items[top[i]];
+        int line = first->line, next = i + 1 < n ? bp.bl.items[top[i+1]].line : bp.lines.count;
+        if (next <= line) next = line + 1;   /* two blocks on a line: both take it */
+        size_t from = line < bp.lines.count ? bp.lines.lines[line].off : mdLen;
+        size_t to = next < bp.lines.count ? bp.lines.lines[next].off : mdLen;
+        MdDocBlock* b = &nd.blocks[nd.count++];
+        b->hash = md_hash64(markdown + from, to - from, seed);
+        b->line = line; b->raw = first->kind == B_HTML_LINE;
+        b->off = nd.html.len; b->num = nd.numCount; b->head = nd.outline.count;
+        size_t h = (size_t)b->hash & mask;
+        while (slot[h] && d->blocks[slot[h] - 1].hash != b->hash) h = (h + 1) & mask;
+        if (slot[h]) doc_copy(cx, d, &d->blocks[slot[h] - 1], line - d->blocks[slot[h] - 1].line);
+        else {
+            BlockList one = { bp.bl.items + top[i], top[i+1] - top[i], 0 };
+            emit_blocks(cx, &nd.html, markdown, &one, NULL);
+            converted++;
+        }
+        b->len = nd.html.len - b->off; b->nums = nd.numCount - b->num; b->heads = nd.outline.count - b->head;
+    }
+    cx->doc = NULL; cx->outline = outline; cx->text = text; cx->secs = secs;
+
+    int rc = !nd.blocks || !nd.html.data || nd.count < n || cx->docFail || nd.outline.failed ? -1 : 0;
+    if (!rc && df) {
+        df->count = 0; df->converted = converted;
+        rc = diff_blocks(a, d->blocks, d->count, nd.blocks, nd.count, df);
+        if (!rc) diff_anchor(df, d->blocks, d->count, nd.blocks, o->blockLines);
+    }
+    cx->para = NULL; cx->paraCap = 0; cx->brk = NULL; cx->brkCap = 0;
+    arena_reset(a);
+    if (rc) { md_doc_free(&nd); return -1; }
+    md_doc_free(d);
+    *d = nd;
+    return 0;
+}
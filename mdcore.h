@@ -0,0 +1,313 @@
+/*
+ * MDView core - portable Markdown->HTML converter
+ * ================================================
+ * Shared by the Total Commander plugin (mdview.c) and the command-line
+ * tools. Plain C99, no platform headers: builds with MinGW, MSVC and
+ * any POSIX toolchain.
+ *
+ * (c) 2026 - MIT License
+ */
+
+#ifndef MDCORE_H
+#define MDCORE_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/* ── String Buffer ───────────────────────────────────────────────────── */
+
+typedef struct { char* data; size_t len; size_t cap; } StrBuf;
+
+void sb_init(StrBuf* sb);
+void sb_init_cap(StrBuf* sb, size_t cap);   /* initial capacity, e.g. from input size */
+void sb_ensure(StrBuf* sb, size_t x);
+void sb_append(StrBuf* sb, const char* s);
+void sb_append_n(StrBuf* sb, const char* s, size_t n);
+void sb_append_char(StrBuf* sb, char c);
+void sb_append_esc(StrBuf* sb, const char* s, size_t n);
+
+/* ── SIMD ────────────────────────────────────────────────────────────── */
+
+/* Scanning paths. MD_SIMD_AUTO (the default) picks the widest one the CPU
+   supports; the others force a path, for benchmarks and cross-checks.
+   Process-wide; returns the path now in use. Conversions resolve the
+   default on their own, safely from any thread; call this only while
+   none is running. */
+enum { MD_SIMD_AUTO = -1, MD_SIMD_NONE = 0, MD_SIMD_SSE2 = 1, MD_SIMD_AVX2 = 2 };
+
+int md_simd_select(int level);
+
+/* ── Text Encoding ───────────────────────────────────────────────────── */
+
+/* What a source file is written in. md_encoding_detect goes by the BOM
+   (its length in *bom), then by NUL bytes in every other position (UTF-16
+   without one), then by whether the bytes are valid UTF-8; anything else
+   is legacy 8-bit text. */
+enum { MD_ENC_UTF8 = 0, MD_ENC_UTF16LE = 1, MD_ENC_UTF16BE = 2, MD_ENC_LEGACY = 3 };
+
+int md_encoding_detect(const void* data, size_t len, size_t* bom);
+
+/* 1 if the n bytes are well-formed UTF-8 (no overlong forms, surrogates
+   or code points past U+10FFFF), else 0 */
+int md_utf8_valid(const char* s, size_t n);
+
+/* One pass each, into an output sized for the worst case: n units for
+   UTF-8 -> UTF-16, 3n bytes for the other two. Malformed input becomes
+   U+FFFD. They return the length written.
+   md_utf16_to_utf8 takes n units as bytes in the given order; a legacy
+   table maps bytes 0x80-0xFF to UTF-16, NULL meaning Windows-1252. */
+size_t md_utf8_to_utf16(const char* s, size_t n, unsigned short* out);
+size_t md_utf16_to_utf8(const void* s, size_t n, int bigEndian, char* out);
+size_t md_legacy_to_utf8(const void* s, size_t n, const unsigned short* table, char* out);
+
+/* ── Output Sink ─────────────────────────────────────────────────────── */
+
+/* Where streamed HTML goes. Output is staged in a buffer and handed to
+   write() between blocks once about `chunk` bytes have gathered, so a
+   conversion never holds the whole page. write() returns 0 to go on,
+   anything else to abort, and may change `chunk` for the next piece.
+   Fill in write/user for a chunked callback. */
+typedef struct MdSink {
+    int (*write)(struct MdSink* s, const char* data, size_t len);
+    void* user;
+    size_t chunk;   /* flush threshold; 0 = 64 KB */
+    int aligned;    /* 1: split only between top-level blocks, so every
+                       piece is a well-formed fragment to append on its own */
+} MdSink;
+
+void md_sink_buf(MdSink* s, StrBuf* sb);   /* append to an initialized StrBuf */
+void md_sink_file(MdSink* s, FILE* f);     /* fwrite to an open stream */
+
+/* Direct writes, for whoever assembles a page around the body */
+int md_sink_write(MdSink* s, const char* data, size_t len);
+int md_sink_puts(MdSink* s, const char* str);
+
+/* ── Hashing ─────────────────────────────────────────────────────────── */
+
+/* 64-bit hash of n bytes, for cache keys and change detection (not for
+   tables an attacker can fill). Same value on every platform of the same
+   byte order. */
+unsigned long long md_hash64(const void* data, size_t n, unsigned long long seed);
+
+/* ── Sections ────────────────────────────────────────────────────────── */
+
+/* A run of top-level blocks that starts at a top-level heading (or, in a
+   long stretch without one, wherever it grew past `maxBytes`). Viewers of
+   huge pages keep only the sections near the viewport in the DOM and lay
+   out the rest from the estimated heights. */
+typedef struct {
+    size_t off, len;            /* its HTML, within the whole output */
+    size_t titleOff, titleLen;  /* inner HTML of the opening heading; len 0: none */
+    int line;                   /* first source line, 0-based */
+    int level;                  /* level of that heading, 0: none */
+    int height;                 /* estimated height, in lines of body text */
+} MdSection;
+
+typedef struct {
+    MdSection* items; int count; int cap;
+    size_t maxBytes;            /* split heading-less runs past this; 0 = 64 KB */
+} MdSections;
+
+void md_sections_free(MdSections* s);   /* frees the items; maxBytes is kept */
+
+/* ── Outline ─────────────────────────────────────────────────────────── */
+
+/* Every heading of a conversion, in document order, gathered while it
+   runs: what a table of contents, a heading search or a "jump to" needs
+   without looking at the HTML again. */
+typedef struct {
+    int level;                  /* 1-6 */
+    int line;                   /* source line, 0-based */
+    int anchored;               /* has id="mdv-h<line>" (ATX heading with headingIds) */
+    int section;                /* md_render_sections: its section, else -1 */
+    size_t textOff, textLen;    /* plain text, within `text`: tags dropped, entities kept */
+} MdHeading;
+
+typedef struct {
+    MdHeading* items; int count; int cap;
+    StrBuf text;                /* all the headings' text, one after another */
+    int failed;                 /* memory ran out: the outline stops short */
+} MdOutline;
+
+/* Table of contents for headings up to maxLevel: one
+   <a class="ti t<level>" href="#mdv-h<line>" data-s="<section>"> per
+   heading that has an id or a section, ready to place in the page. */
+void md_outline_toc(const MdOutline* o, int maxLevel, StrBuf* out);
+
+void md_outline_free(MdOutline* o);
+
+/* ── Text Index ──────────────────────────────────────────────────────── */
+
+/* The text of a conversion as a page shows it (tags dropped, entities
+   decoded, scripts and styles left out), cut at top-level blocks. A block
+   with a line is the element marked data-line="<line>" (MdOptions.
+   blockLines), so a match found here can be marked in the page by walking
+   only that element's text. */
+typedef struct {
+    size_t off;                 /* its text runs from here to the next block's */
+    int line;                   /* source line = its data-line; -1: raw HTML, no mark */
+    int section;                /* md_render_sections: its section, else -1 */
+} MdTextBlock;
+
+typedef struct {
+    StrBuf text;                /* UTF-8 */
+    StrBuf fold;                /* the same, case-folded: same length, same offsets */
+    MdTextBlock* blocks; int count; int cap;
+    int failed;                 /* memory ran out: the index is incomplete */
+} MdText;
+
+void md_text_free(MdText* t);
+
+/* Block holding text offset `off` (binary search); -1 if there is none */
+int md_text_block(const MdText* t, size_t off);
+
+/* Find: case-insensitive unless MD_FIND_CASE (folding covers Latin,
+   Greek, Cyrillic and Armenian); MD_FIND_WORDS skips matches inside a
+   word. Matches never overlap or cross a block. */
+enum { MD_FIND_CASE = 1, MD_FIND_WORDS = 2 };
+
+typedef struct { size_t* at; size_t count, cap; } MdMatches;   /* text offsets */
+
+/* All matches of `n` bytes of UTF-8 `needle` into m (its old ones are
+   dropped); each is n bytes long. 0, or -1 if memory ran out. */
+int md_text_find(const MdText* t, const char* needle, size_t n, int flags, MdMatches* m);
+void md_matches_free(MdMatches* m);
+
+/* ── Source Map ──────────────────────────────────────────────────────── */
+
+/* The source lines of every top-level block, in document order: the
+   elements MdOptions.blockLines marks data-line="<line>", and raw HTML
+   runs, which carry no mark. A viewer that measures where the marked
+   elements are can map between a source line and a scroll position. */
+typedef struct {
+    int line, end;              /* source lines [line, end), 0-based, trailing blank lines left out */
+    int raw;                    /* raw HTML run: no data-line */
+} MdSourceBlock;
+
+typedef struct { MdSourceBlock* items; int count; int cap; } MdSourceMap;
+
+/* Block holding `line`, else the last one before it; -1 if none
+   (md_source_map, below, fills one) */
+int md_source_map_find(const MdSourceMap* m, int line);
+void md_source_map_free(MdSourceMap* m);
+
+/* ── Block Diff ──────────────────────────────────────────────────────── */
+
+/* A conversion kept block by block, for a viewer that follows a file as
+   it is edited. md_doc_update (below) converts each new version reusing
+   the HTML of every top-level block whose source did not change (with
+   its line numbers moved if the block did) and says which runs of
+   blocks were replaced, so a page can be patched instead of reloaded. */
+typedef struct {
+    unsigned long long hash;    /* its source up to the next block, the link definitions, the options */
+    int line;                   /* first source line, 0-based */
+    int raw;                    /* raw HTML run: no data-line */
+    size_t off, len;            /* its HTML, within `html` */
+    int num, nums;              /* its printed line numbers, within `numAt` */
+    int head, heads;            /* its headings, within `outline` */
+} MdDocBlock;
+
+typedef struct {
+    StrBuf html;                /* the whole conversion, the same as md_render's */
+    MdDocBlock* blocks; int count, cap;
+    size_t* numAt; int numCount, numCap;   /* where html prints a line (data-line, heading id) */
+    MdOutline outline;          /* every heading, as md_context_set_outline gathers them */
+} MdDoc;
+
+/* Old blocks [at, at+del) became new blocks [to, to+ins); the blocks up
+   to the next hunk are the same, `shift` lines further down. Hunks start
+   and end next to blocks a page can find by their data-line: lineAt and
+   lineEnd are the old lines of blocks `at` and at+del, -1 for the start
+   and the end of the document (lineAt = lineEnd when nothing goes). */
+typedef struct { int at, del, to, ins; int lineAt, lineEnd, shift; } MdDocHunk;
+
+typedef struct {
+    MdDocHunk* items; int count, cap;
+    int converted;              /* blocks converted; the others were reused */
+} MdDocDiff;
+
+void md_doc_free(MdDoc* d);
+void md_doc_diff_free(MdDocDiff* df);
+
+/* ── Grammars ────────────────────────────────────────────────────────── */
+
+/* A highlighter for a further language, compiled from a grammar file (see
+   README.md) into DFA tables. Read-only once built: any number of
+   contexts may share one. mdgrammar.c loads a directory of them. */
+typedef struct MdGrammar MdGrammar;
+
+/* Compile `len` bytes of grammar text. NULL on error, with the reason
+   (and line) in err. */
+MdGrammar* md_grammar_compile(const char* text, size_t len, char* err, size_t errLen);
+
+/* The compiled tables, appended to `out` for a cache, and read back;
+   md_grammar_load returns NULL for data that is damaged or was written
+   by another build. */
+void md_grammar_save(const MdGrammar* g, StrBuf* out);
+MdGrammar* md_grammar_load(const void* data, size_t len);
+void md_grammar_free(MdGrammar* g);
+
+/* ── Converter ───────────────────────────────────────────────────────── */
+
+typedef struct {
+    int headingIds;   /* id="mdv-h<line>" on ATX headings, used by the TOC (default 1) */
+    int highlight;    /* sh-* spans in fenced code of known languages (default 1) */
+    int lineGutters;  /* <span class="ln-nums" data-n="1..n"> opening each <pre> (default 1) */
+    int blockLines;   /* data-line="<source line>" on every top-level block (default 0) */
+    int collapseCode;   /* code blocks of more lines than this open collapsed, with a fade
+                           and a "Show more" button after them (default 0: never) */
+    int collapseQuote;  /* the same for blockquotes, by estimated height in lines of body text */
+    MdGrammar* const* grammars; int grammarCount;   /* more languages, looked up first (not owned) */
+} MdOptions;
+
+void md_options_default(MdOptions* o);
+
+/* Converter context: options, reference links and scratch memory for one
+   conversion at a time. Contexts share nothing, so each thread converting
+   in parallel needs its own; reusing one keeps its scratch buffers. */
+typedef struct MdContext MdContext;
+
+MdContext* md_context_new(const MdOptions* opts);   /* NULL: defaults */
+void md_context_free(MdContext* cx);
+
+/* Collect into `o` (zeroed, or emptied by md_outline_free) on every
+   conversion of cx from now on, each starting it over; NULL stops. */
+void md_context_set_outline(MdContext* cx, MdOutline* o);
+
+/* The same for the text index of each conversion */
+void md_context_set_text(MdContext* cx, MdText* t);
+
+/* Convert `len` bytes of UTF-8 Markdown (need not be NUL-terminated) to an
+   HTML fragment. Returns a malloc'd string owned by the caller. */
+char* md_render(MdContext* cx, const char* markdown, size_t len);
+
+/* Same conversion, streamed into `out` instead of returned in one piece;
+   the bytes written equal md_render's result. 0 on success, -1 if the
+   sink failed or memory ran out. */
+int md_render_to(MdContext* cx, const char* markdown, size_t len, MdSink* out);
+
+/* md_render, also filling `secs` (zeroed, or emptied by md_sections_free)
+   with the section index of the result. NULL if memory ran out. */
+char* md_render_sections(MdContext* cx, const char* markdown, size_t len, MdSections* secs);
+
+/* The source map of len bytes of Markdown into m (zeroed, or emptied by
+   md_source_map_free): only the block structure is parsed, no HTML is
+   produced. 0, or -1 if memory ran out. */
+int md_source_map(MdContext* cx, const char* markdown, size_t len, MdSourceMap* m);
+
+/* Make d (zeroed, or filled by an earlier call) the conversion of len
+   bytes of Markdown, converting only the blocks it does not hold yet; a
+   change to the link definitions or the options converts them all. With df, it is set to the hunks from the old blocks to the new.
+   0, or -1 if memory ran out (d is then as it was). */
+int md_doc_update(MdContext* cx, MdDoc* d, const char* markdown, size_t len, MdDocDiff* df);
+
+/* Convert a NUL-terminated UTF-8 Markdown document to an HTML fragment.
+   Returns a malloc'd string owned by the caller (release with free).
+   One-shot wrappers around md_render with a private default context. */
+char* md_to_html(const char* markdown);
+
+/* Same, for a buffer of known length that need not be NUL-terminated
+   (e.g. a memory-mapped file). Lines are indexed in place, never copied. */
+char* md_to_html_n(const char* markdown, size_t len);
+
+#endif /* MDCORE_H */
@@ -0,0 +1,250 @@
+/*
+ * MDView grammars - highlighter grammars from a directory
+ * ========================================================
+ * Directory listing and file access per platform, then one shared loader
+ * that takes each grammar from the cache when its stamp (name, size,
+ * modification time) still matches, and compiles it otherwise. See
+ * mdgrammar.h.
+ *
+ * Cache file: an 8-byte tag, then per grammar the name length (4 bytes),
+ * the name as the platform spells it, mtime and size (8 bytes each), the
+ * table length (4 bytes) and the tables of md_grammar_save. Native byte
+ * order; anything that does not parse is recompiled.
+ *
+ * (c) 2026 - MIT License
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "mdgrammar.h"
+#include "mdsource.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <wchar.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+/* A grammar file as listed: name (NUL-terminated, in the platform's
+   characters) and stamp */
+typedef struct { char* name; size_t nameLen; long long mtime, size; } GFile;
+
+static const char k_cacheTag[8] = { 'M','D','V','G','C','A','C','1' };
+
+static int add_file(GFile** fs, int* n, int* cap, const void* name, size_t nameLen, size_t nul, long long mtime, long long size) {
+    if (*n == *cap) {
+        int nc = *cap ? *cap * 2 : 16;
+        GFile* nf = (GFile*)realloc(*fs, sizeof(GFile) * (size_t)nc);
+        if (!nf) return -1;
+        *fs = nf; *cap = nc;
+    }
+    GFile* f = &(*fs)[*n];
+    f->name = (char*)calloc(1, nameLen + nul);
+    if (!f->name) return -1;
+    memcpy(f->name, name, nameLen);
+    f->nameLen = nameLen; f->mtime = mtime; f->size = size;
+    (*n)++;
+    return 0;
+}
+
+#ifdef _WIN32
+
+static FILE* open_path(const void* path, const char* mode) { return _wfopen((const wchar_t*)path, mode[0] == 'w' ? L"wb" : L"rb"); }
+
+static FILE* open_in_dir(const void* dir, const GFile* f) {
+    const wchar_t* d = (const wchar_t*)dir;
+    size_t dn = wcslen(d), nn = f->nameLen / sizeof(wchar_t);
+    wchar_t* path = (wchar_t*)malloc((dn + nn + 2) * sizeof(wchar_t));
+    if (!path) return NULL;
+    memcpy(path, d, dn * sizeof(wchar_t)); path[dn] = L'\\';
+    memcpy(path + dn + 1, f->name, f->nameLen); path[dn + 1 + nn] = L'\0';
+    FILE* fp = _wfopen(path, L"rb");
+    free(path);
+    return fp;
+}
+
+static void name_utf8(const GFile* f, char* out, int n) {
+    if (!WideCharToMultiByte(CP_UTF8, 0, (const wchar_t*)f->name, -1, out, n, NULL, NULL)) out[0] = '\0';
+}
+
+static int list_dir(const void* dir, GFile** fs, int* n) {
+    const wchar_t* d = (const wchar_t*)dir;
+    size_t dn = wcslen(d);
+    wchar_t* pat = (wchar_t*)malloc((dn + 8) * sizeof(wchar_t));
+    if (!pat) return -1;
+    memcpy(pat, d, dn * sizeof(wchar_t)); wcscpy(pat + dn, L"\\*.lang");
+    WIN32_FIND_DATAW fd; int cap = 0, rc = 0;
+    HANDLE h = FindFirstFileW(pat, &fd);
+    free(pat);
+    *fs = NULL; *n = 0;
+    if (h == INVALID_HANDLE_VALUE) return GetLastError() == ERROR_FILE_NOT_FOUND ? 0 : -1;
+    do {
+        size_t nl = wcslen(fd.cFileName);
+        /* *.lang also matches longer extensions through 8.3 names */
+        if ((fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || nl < 6 || _wcsicmp(fd.cFileName + nl - 5, L".lang") != 0) continue;
+        rc = add_file(fs, n, &cap, fd.cFileName, nl * sizeof(wchar_t), sizeof(wchar_t),
+                      (long long)(((unsigned long long)fd.ftLastWriteTime.dwHighDateTime << 32) | fd.ftLastWriteTime.dwLowDateTime),
+                      (long long)(((unsigned long long)fd.nFileSizeHigh << 32) | fd.nFileSizeLow));
+    } while (!rc && FindNextFileW(h, &fd));
+    FindClose(h);
+    return rc;
+}
+
+#else
+
+static int has_suffix(const char* s, size_t n, const char* x) { size_t k = strlen(x); return n > k && memcmp(s + n - k, x, k) == 0; }
+
+static FILE* open_path(const void* path, const char* mode) { return fopen((const char*)path, mode[0] == 'w' ? "wb" : "rb"); }
+
+static char* join_path(const char* dir, const char* name) {
+    size_t dn = strlen(dir), nn = strlen(name);
+    char* p = (char*)malloc(dn + nn + 2);
+    if (!p) return NULL;
+    memcpy(p, dir, dn); p[dn] = '/'; memcpy(p + dn + 1, name, nn + 1);
+    return p;
+}
+
+static FILE* open_in_dir(const void* dir, const GFile* f) {
+    char* path = join_path((const char*)dir, f->name);
+    FILE* fp = path ? fopen(path, "rb") : NULL;
+    free(path);
+    return fp;
+}
+
+static void name_utf8(const GFile* f, char* out, int n) { snprintf(out, (size_t)n, "%s", f->name); }
+
+static int list_dir(const void* dir, GFile** fs, int* n) {
+    DIR* d = opendir((const char*)dir);
+    int cap = 0, rc = 0;
+    *fs = NULL; *n = 0;
+    if (!d) return -1;
+    struct dirent* e;
+    while (!rc && (e = readdir(d)) != NULL) {
+        size_t nl = strlen(e->d_name);
+        if (!has_suffix(e->d_name, nl, ".lang")) continue;
+        char* path = join_path((const char*)dir, e->d_name);
+        struct stat st;
+        if (path && stat(path, &st) == 0 && S_ISREG(st.st_mode))
+            rc = add_file(fs, n, &cap, e->d_name, nl, 1, (long long)st.st_mtime, (long long)st.st_size);
+        free(path);
+    }
+    closedir(d);
+    return rc;
+}
+
+#endif
+
+static int name_cmp(const void* a, const void* b) {
+    const GFile *x = (const GFile*)a, *y = (const GFile*)b;
+    int c = memcmp(x->name, y->name, x->nameLen < y->nameLen ? x->nameLen : y->nameLen);
+    return c ? c : (x->nameLen > y->nameLen) - (x->nameLen < y->nameLen);
+}
+
+/* Tables the old cache holds for this file at this stamp, or NULL */
+static const char* cache_find(const char* c, size_t len, const GFile* f, size_t* blobLen) {
+    if (len < sizeof(k_cacheTag) || memcmp(c, k_cacheTag, sizeof(k_cacheTag)) != 0) return NULL;
+    size_t i = sizeof(k_cacheTag);
+    while (len - i >= 4) {
+        unsigned nl, bl; long long mt, sz;
+        memcpy(&nl, c + i, 4); i += 4;
+        if (nl > len - i || len - i - nl < 20) return NULL;
+        const char* nm = c + i; i += nl;
+        memcpy(&mt, c + i, 8); memcpy(&sz, c + i + 8, 8); memcpy(&bl, c + i + 16, 4); i += 20;
+        if (bl > len - i) return NULL;
+        if (nl == f->nameLen && memcmp(nm, f->name, nl) == 0 && mt == f->mtime && sz == f->size) { *blobLen = bl; return c + i; }
+        i += bl;
+    }
+    return NULL;
+}
+
+static void cache_put(StrBuf* out, const GFile* f, const char* blob, size_t bl) {
+    unsigned nl = (unsigned)f->nameLen, b = (unsigned)bl;
+    sb_append_n(out, (const char*)&nl, 4); sb_append_n(out, f->name, f->nameLen);
+    sb_append_n(out, (const char*)&f->mtime, 8); sb_append_n(out, (const char*)&f->size, 8);
+    sb_append_n(out, (const char*)&b, 4); sb_append_n(out, blob, bl);
+}
+
+static void note_error(MdGrammars* g, const GFile* f, const char* why) {
+    char name[80];
+    if (g->error[0]) return;
+    name_utf8(f, name, (int)sizeof(name));
+    snprintf(g->error, sizeof(g->error), "%s: %s", name, why);
+}
+
+static int load(MdGrammars* g, const void* dir, const void* cache) {
+    memset(g, 0, sizeof(*g));
+    GFile* fs; int n;
+    if (list_dir(dir, &fs, &n)) {
+        for (int k = 0; k < n; k++) free(fs[k].name);
+        free(fs);
+        return -1;
+    }
+    if (n) qsort(fs, (size_t)n, sizeof(GFile), name_cmp);
+    for (int k = 0; k < n; k++) {
+        g->stamp = md_hash64(fs[k].name, fs[k].nameLen, g->stamp);
+        g->stamp = md_hash64(&fs[k].mtime, sizeof(fs[k].mtime), g->stamp);
+        g->stamp = md_hash64(&fs[k].size, sizeof(fs[k].size), g->stamp);
+    }
+
+    MdSource old; FILE* cf = cache ? open_path(cache, "rb") : NULL;
+    if (!cf || md_source_read(&old, cf)) { memset(&old, 0, sizeof(old)); old.data = ""; }
+    if (cf) fclose(cf);
+
+    StrBuf out; sb_init(&out);
+    sb_append_n(&out, k_cacheTag, sizeof(k_cacheTag));
+    g->items = (MdGrammar**)calloc(n ? (size_t)n : 1, sizeof(MdGrammar*));
+    for (int k = 0; g->items && k < n; k++) {
+        size_t bl = 0;
+        const char* blob = cache_find(old.data, old.len, &fs[k], &bl);
+        MdGrammar* gr = blob ? md_grammar_load(blob, bl) : NULL;
+        StrBuf tbl = {0};
+        if (gr) g->cached++;
+        else {
+            MdSource text; char err[160];
+            FILE* in = open_in_dir(dir, &fs[k]);
+            if (!in || md_source_read(&text, in)) { if (in) fclose(in); note_error(g, &fs[k], "cannot read"); continue; }
+            fclose(in);
+            if (md_source_text(&text, NULL)) { md_source_close(&text); note_error(g, &fs[k], "out of memory"); continue; }
+            gr = md_grammar_compile(text.data, text.len, err, sizeof(err));
+            md_source_close(&text);
+            if (!gr) { note_error(g, &fs[k], err[0] ? err : "out of memory"); continue; }
+            g->compiled++;
+            sb_init(&tbl); md_grammar_save(gr, &tbl);
+            blob = tbl.data; bl = tbl.len;
+        }
+        cache_put(&out, &fs[k], blob, bl);
+        free(tbl.data);
+        g->items[g->count++] = gr;
+    }
+
+    /* Rewrite the cache only when it no longer matches the directory */
+    if (cache && g->items && (out.len != old.len || memcmp(out.data, old.data, out.len) != 0)) {
+        FILE* w = open_path(cache, "wb");
+        if (w) { fwrite(out.data, 1, out.len, w); fclose(w); }
+    }
+    free(out.data);
+    md_source_close(&old);
+    for (int k = 0; k < n; k++) free(fs[k].name);
+    free(fs);
+    return g->items ? 0 : -1;
+}
+
+#ifdef _WIN32
+int md_grammars_load_w(MdGrammars* g, const wchar_t* dir, const wchar_t* cache) { return load(g, dir, cache); }
+#else
+int md_grammars_load(MdGrammars* g, const char* dir, const char* cache) { return load(g, dir, cache); }
+#endif
+
+void md_grammars_free(MdGrammars* g) {
+    for (int k = 0; k < g->count; k++) md_grammar_free(g->items[k]);
+    free(g->items);
+    memset(g, 0, sizeof(*g));
+}
@@ -0,0 +1,36 @@
+/*
+ * MDView grammars - highlighter grammars from a directory
+ * ========================================================
+ * Compiles every *.lang file of a directory into the DFA tables of
+ * md_grammar_compile and keeps the result in one cache file, keyed by
+ * each file's name, size and modification time, so later loads only
+ * read the tables back. Win32 and POSIX, like mdsource.c.
+ *
+ * (c) 2026 - MIT License
+ */
+
+#ifndef MDGRAMMAR_H
+#define MDGRAMMAR_H
+
+#include "mdcore.h"
+
+typedef struct {
+    MdGrammar** items; int count;   /* for MdOptions.grammars / grammarCount */
+    int compiled, cached;           /* how this load got them */
+    unsigned long long stamp;       /* hash of the files' names, sizes and times: changes with the set */
+    char error[256];                /* first file that failed to compile, "" if none */
+} MdGrammars;
+
+/* Load the grammars of `dir`, in file name order, compiling only those
+   missing from or stale in the cache at `cache` (NULL: no cache), which
+   is then rewritten if anything changed. A file that fails to compile is
+   skipped. 0 on success, -1 if the directory cannot be read. */
+#ifdef _WIN32
+int md_grammars_load_w(MdGrammars* g, const wchar_t* dir, const wchar_t* cache);
+#else
+int md_grammars_load(MdGrammars* g, const char* dir, const char* cache);
+#endif
+
+void md_grammars_free(MdGrammars* g);
+
+#endif /* MDGRAMMAR_H */
@@ -0,0 +1,182 @@
+/*
+ * MDView source input - read-only view of a Markdown file
+ * ========================================================
+ * Win32 file mapping in the plugin, POSIX mmap in the command-line tools,
+ * heap read as the fallback for both. See mdsource.h.
+ *
+ * A mapping shows the file as it is on disk. On Windows, a file with a
+ * mapped view cannot be truncated (ERROR_USER_MAPPED_FILE), so an editor
+ * that saves in place fails while it is mapped; and a view of a file on
+ * a share or removable disk that goes away faults its reader with
+ * EXCEPTION_IN_PAGE_ERROR. Only files on fixed disks are mapped, and the
+ * plugin keeps the view only while it converts (md_source_detach). Under
+ * POSIX, truncation succeeds and faults (SIGBUS) a reader past the new
+ * end; the command-line tools convert once and exit.
+ *
+ * (c) 2026 - MIT License
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "mdsource.h"
+#include "mdcore.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/* Point data/len past a UTF-8 BOM; nothing is copied */
+static void skip_bom(MdSource* s) {
+    const unsigned char* b = (const unsigned char*)s->base;
+    s->data = (const char*)s->base; s->len = s->size;
+    if (s->size >= 3 && b[0]==0xEF && b[1]==0xBB && b[2]==0xBF) { s->data += 3; s->len -= 3; }
+}
+
+static int set_empty(MdSource* s) { memset(s, 0, sizeof(*s)); s->data = ""; return 0; }
+
+int md_source_read(MdSource* s, FILE* f) {
+    memset(s, 0, sizeof(*s));
+    size_t cap = 65536, len = 0;
+    char* buf = (char*)malloc(cap);
+    if (!buf) return -1;
+    for (;;) {
+        if (len == cap) { cap *= 2; char* nb = (char*)realloc(buf, cap); if (!nb) { free(buf); return -1; } buf = nb; }
+        size_t n = fread(buf + len, 1, cap - len, f);
+        if (n == 0) break;
+        len += n;
+    }
+    if (ferror(f)) { free(buf); return -1; }
+    s->base = buf; s->size = len;
+    skip_bom(s);
+    return 0;
+}
+
+int md_source_text(MdSource* s, const unsigned short* legacy) {
+    size_t bom;
+    int enc = md_encoding_detect(s->base, s->size, &bom);
+    if (enc == MD_ENC_UTF8) { s->encoding = enc; return 0; }   /* data is already past the BOM */
+    const char* b = (const char*)s->base + bom;
+    size_t n = s->size - bom;
+    /* Worst case: 3 bytes per legacy byte or per UTF-16 unit, and U+FFFD
+       for an odd trailing byte */
+    char* out = (char*)malloc((enc == MD_ENC_LEGACY ? n * 3 : n / 2 * 3 + 3) + 1);
+    if (!out) return -1;
+    size_t len;
+    if (enc == MD_ENC_LEGACY) len = md_legacy_to_utf8(b, n, legacy, out);
+    else {
+        len = md_utf16_to_utf8(b, n / 2, enc == MD_ENC_UTF16BE, out);
+        if (n & 1) { memcpy(out + len, "\xEF\xBF\xBD", 3); len += 3; }
+    }
+    char* fit = (char*)realloc(out, len + 1);
+    if (fit) out = fit;
+    md_source_close(s);
+    s->base = out; s->size = len; s->data = out; s->len = len; s->encoding = enc;
+    return 0;
+}
+
+int md_source_detach(MdSource* s) {
+    if (!s->mapped) return 0;
+    char* buf = (char*)malloc(s->size);
+    if (!buf) return -1;
+    memcpy(buf, s->base, s->size);
+    MdSource h = *s;
+    h.base = buf; h.data = buf + (s->data - (const char*)s->base); h.mapped = 0;
+    md_source_close(s);
+    *s = h;
+    return 0;
+}
+
+#ifdef _WIN32
+
+/* Local fixed disks only: elsewhere the file can vanish under a view */
+static int mappable(const wchar_t* path) {
+    wchar_t vol[MAX_PATH];
+    return GetVolumePathNameW(path, vol, MAX_PATH) && GetDriveTypeW(vol) == DRIVE_FIXED;
+}
+
+int md_source_open_w(MdSource* s, const wchar_t* path) {
+    memset(s, 0, sizeof(*s));
+    /* Share everything, so the file can still be edited or replaced while viewed */
+    HANDLE f = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
+                           NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL|FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (f == INVALID_HANDLE_VALUE) return -1;
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(f, &sz) || (unsigned long long)sz.QuadPart > (size_t)-1) { CloseHandle(f); return -1; }
+    if (sz.QuadPart == 0) { CloseHandle(f); return set_empty(s); }
+
+    /* The view keeps the mapping and the file open; both handles can go */
+    HANDLE m = mappable(path) ? CreateFileMappingW(f, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+    void* v = m ? MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (m) CloseHandle(m);
+    if (v) {
+        CloseHandle(f);
+        s->base = v; s->size = (size_t)sz.QuadPart; s->mapped = 1;
+        skip_bom(s);
+        return 0;
+    }
+
+    /* Not on a fixed disk, or no address space for a view (32-bit, huge
+       file): read it instead */
+    char* buf = (char*)malloc((size_t)sz.QuadPart);
+    size_t got = 0;
+    while (buf && got < (size_t)sz.QuadPart) {
+        DWORD want = (DWORD)((size_t)sz.QuadPart - got > 0x40000000 ? 0x40000000 : (size_t)sz.QuadPart - got), n = 0;
+        if (!ReadFile(f, buf + got, want, &n, NULL) || n == 0) break;
+        got += n;
+    }
+    CloseHandle(f);
+    if (!buf) return -1;
+    s->base = buf; s->size = got;
+    skip_bom(s);
+    return 0;
+}
+
+void md_source_close(MdSource* s) {
+    if (s->mapped) UnmapViewOfFile(s->base); else free(s->base);
+    memset(s, 0, sizeof(*s));
+}
+
+#else
+
+int md_source_open(MdSource* s, const char* path) {
+    memset(s, 0, sizeof(*s));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0) { close(fd); return -1; }
+
+    /* Pipes, devices and the like are read; regular files are mapped */
+    if (S_ISREG(st.st_mode) && st.st_size == 0) { close(fd); return set_empty(s); }
+    if (!S_ISREG(st.st_mode) || (unsigned long long)st.st_size > (size_t)-1) {
+        FILE* f = fdopen(fd, "rb");
+        if (!f) { close(fd); return -1; }
+        int rc = md_source_read(s, f);
+        fclose(f);
+        return rc;
+    }
+
+    void* v = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (v == MAP_FAILED) return -1;
+    posix_madvise(v, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);  /* read-ahead: the converter walks it front to back */
+    s->base = v; s->size = (size_t)st.st_size; s->mapped = 1;
+    skip_bom(s);
+    return 0;
+}
+
+void md_source_close(MdSource* s) {
+    if (s->mapped) munmap(s->base, s->size); else free(s->base);
+    memset(s, 0, sizeof(*s));
+}
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ * MDView source input - read-only view of a Markdown file
+ * ========================================================
+ * Maps the file into memory (Win32 file mapping or POSIX mmap) so the
+ * converter reads it in place, with no private copy; md_source_detach
+ * swaps the view for a heap copy once a caller that keeps the text is
+ * done converting. Pipes, empty files, files on Windows drives that are
+ * not fixed disks and anything that cannot be mapped are read into the
+ * heap instead; callers see the same struct either way.
+ *
+ * (c) 2026 - MIT License
+ */
+
+#ifndef MDSOURCE_H
+#define MDSOURCE_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/* `data`/`len` is the text past any UTF-8 BOM, skipped by offset rather
+   than moved. It is NOT NUL-terminated: pass the length along
+   (md_render, md_to_html_n). */
+typedef struct {
+    const char* data; size_t len;
+    void* base; size_t size;   /* whole view, as mapped or allocated */
+    int mapped;                /* 1: base is a mapping, 0: heap (or NULL) */
+    int encoding;              /* MD_ENC_* found by md_source_text (else 0) */
+} MdSource;
+
+/* Open and map a file. 0 on success, -1 on error (s is then empty). */
+#ifdef _WIN32
+int md_source_open_w(MdSource* s, const wchar_t* path);
+#else
+int md_source_open(MdSource* s, const char* path);
+#endif
+
+/* Read a whole stream (e.g. stdin) into the heap, same BOM handling */
+int md_source_read(MdSource* s, FILE* f);
+
+/* Make the text UTF-8 for the converter: detects the encoding of the
+   whole view (md_encoding_detect) and, for UTF-16 or legacy 8-bit text,
+   swaps the view for a transcoded heap copy. `legacy` maps bytes
+   0x80-0xFF (NULL: Windows-1252). 0, or -1 if memory ran out, leaving s
+   as it was. */
+int md_source_text(MdSource* s, const unsigned short* legacy);
+
+/* Copy a mapped view to the heap and unmap it, so the file is no longer
+   held (a mapped file cannot be truncated on Windows). 0, also when s
+   is not mapped, or -1 if memory ran out, leaving s as it was. */
+int md_source_detach(MdSource* s);
+
+void md_source_close(MdSource* s);
+
+#endif /* MDSOURCE_H */
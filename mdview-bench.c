@@ -0,0 +1,1386 @@
+/*
+ * mdview-bench - converter benchmark suite
+ * =========================================
+ * Generates synthetic Markdown corpora of fixed shapes and sizes, runs
+ * md_to_html over each one and reports throughput, allocation count,
+ * peak heap, peak RSS and the output/input byte ratio. "ctx ms" and
+ * "ctx allocs" repeat the timing and count with one MdContext reused
+ * across runs. The checked-in
+ * test.md and markdown_en.md are measured as fixed fixtures.
+ *
+ * Corpora come from a fixed-seed generator, so numbers are reproducible
+ * across machines and commits.
+ *
+ * Usage:
+ *   mdview-bench [-s 1,10,50,200] [-c shape,...] [-n runs] [-f dir] [-w dir] [-t threads] [-m] [-k] [-i dir] [-v] [-x] [-l] [-r] [-u] [-g dir]
+ *
+ *   -s MB,...     corpus sizes in MB (default 1,10)
+ *   -c NAME,...   shapes to run: prose,table,nested,deep,inline,code,links,intl (default all)
+ *   -n RUNS       timed runs per corpus, best is reported (default 3)
+ *   -f DIR        directory holding test.md / markdown_en.md (default .)
+ *   -w DIR        also write each generated corpus to DIR/<shape>-<MB>mb.md
+ *   -t THREADS    then convert every corpus on THREADS threads at once, each
+ *                 with its own MdContext, and check each output byte for byte
+ *                 against the single-threaded result (exit status 1 on mismatch)
+ *   -m            SIMD microbenchmark: convert every corpus once per scanning
+ *                 path (scalar, SSE2, AVX2 as the CPU allows), then time the
+ *                 sb_append_esc kernel alone against the old per-byte
+ *                 routine; all paths must produce the same output
+ *   -k            output sink: stream every corpus through md_render_to in
+ *                 64 KB chunks, check the stream against md_render and
+ *                 compare time and peak heap of the two; then again in
+ *                 block-aligned pieces (32 KB first, 256 KB after), each of
+ *                 which must be a balanced fragment
+ *   -i DIR        source input: write every corpus to a file in DIR, then
+ *                 load and convert it with the old read-into-heap path and
+ *                 with mdsource's mmap; load time, total and peak heap
+ *   -v            sections: convert with md_render_sections and check that
+ *                 the sections tile the output, each one balanced and each
+ *                 headed one starting at its heading; count, largest and
+ *                 estimated height
+ *   -x            find: build the text index with data-line marks (check
+ *                 one mark per marked block), then time md_text_find for
+ *                 a few needles on every scanning path against a naive
+ *                 search; all must count the same matches
+ *   -l            source map: time md_source_map against a conversion and
+ *                 check that its blocks are the output's data-line marks,
+ *                 in order, and cover the source in order without overlap
+ *   -r            block diff: take every corpus through random edits with
+ *                 md_doc_update, checking each version against md_render
+ *                 and the old HTML patched by its hunks against both; time
+ *                 the update against a full conversion
+ *   -u            encoding: check UTF-8 validation and UTF-8 <-> UTF-16
+ *                 transcoding on every scanning path against plain scalar
+ *                 references (boundary cases, random bytes, every corpus),
+ *                 time them, and load each corpus back from UTF-16 files
+ *   -g DIR        grammars: compile every .lang in DIR, check its tables come
+ *                 back byte for byte through save and load and render alike,
+ *                 time lines made to rescan (they must stay linear), and
+ *                 load DIR twice through a cache, the second time compiling
+ *                 nothing
+ *
+ * Build (Linux, glibc):
+ *   gcc -O2 -pthread -o mdview-bench mdview-bench.c mdcore.c mdsource.c mdgrammar.c
+ *
+ * (c) 2026 - MIT License
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/resource.h>
+
+#include "mdcore.h"
+#include "mdsource.h"
+#include "mdgrammar.h"
+
+/* ── Allocation accounting ───────────────────────────────────────────── */
+
+/* Interpose the C allocator so every malloc/realloc made by the converter
+   is counted. glibc exports the real implementation as __libc_*. */
+extern void* __libc_malloc(size_t);
+extern void* __libc_calloc(size_t, size_t);
+extern void* __libc_realloc(void*, size_t);
+extern void  __libc_free(void*);
+
+static size_t g_allocs = 0, g_live = 0, g_peak = 0;
+
+static void track_add(void* p) {
+    if (!p) return;
+    __atomic_fetch_add(&g_allocs, 1, __ATOMIC_RELAXED);
+    size_t live = __atomic_add_fetch(&g_live, malloc_usable_size(p), __ATOMIC_RELAXED);
+    if (live > g_peak) g_peak = live;
+}
+static void track_del(void* p) {
+    if (p) __atomic_fetch_sub(&g_live, malloc_usable_size(p), __ATOMIC_RELAXED);
+}
+
+void* malloc(size_t n) { void* p = __libc_malloc(n); track_add(p); return p; }
+void* calloc(size_t a, size_t b) { void* p = __libc_calloc(a, b); track_add(p); return p; }
+void  free(void* p) { track_del(p); __libc_free(p); }
+void* realloc(void* p, size_t n) {
+    size_t old = p ? malloc_usable_size(p) : 0;
+    void* q = __libc_realloc(p, n);
+    if (!q) return NULL;
+    if (!p) { track_add(q); return q; }
+    __atomic_fetch_add(&g_allocs, 1, __ATOMIC_RELAXED);
+    size_t live = __atomic_add_fetch(&g_live, malloc_usable_size(q) - old, __ATOMIC_RELAXED);
+    if (live > g_peak) g_peak = live;
+    return q;
+}
+
+/* ── Helpers ─────────────────────────────────────────────────────────── */
+
+static double now_sec(void) {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static long peak_rss_kb(void) {
+    struct rusage ru; getrusage(RUSAGE_SELF, &ru); return ru.ru_maxrss;
+}
+
+static unsigned g_seed = 0x4d445657u; /* "MDVW" */
+static unsigned rnd(void) { g_seed = g_seed * 1103515245u + 12345u; return (g_seed >> 8) & 0xFFFFFF; }
+static void rnd_reset(void) { g_seed = 0x4d445657u; }
+
+static const char* WORDS[] = {
+    "the","viewer","renders","markdown","quickly","while","keeping","memory","use","low",
+    "plugin","lister","commander","total","table","block","parser","inline","emphasis","link",
+    "reference","heading","section","document","changelog","release","version","fixed","added","removed",
+    "snake_case_name","value","config","option","default","user","file","path","buffer","stream"
+};
+#define NWORDS (sizeof(WORDS)/sizeof(WORDS[0]))
+static const char* word(void) { return WORDS[rnd() % NWORDS]; }
+
+static void sentence(StrBuf* sb, int n) {
+    for (int w = 0; w < n; w++) {
+        if (w) sb_append_char(sb, ' ');
+        unsigned k = rnd() % 40;
+        if (k == 0)      { sb_append(sb, "**"); sb_append(sb, word()); sb_append(sb, "**"); }
+        else if (k == 1) { sb_append(sb, "*"); sb_append(sb, word()); sb_append(sb, "*"); }
+        else if (k == 2) { sb_append(sb, "`"); sb_append(sb, word()); sb_append(sb, "`"); }
+        else if (k == 3) { sb_append(sb, "["); sb_append(sb, word()); sb_append(sb, "](https://example.com/"); sb_append(sb, word()); sb_append(sb, ")"); }
+        else if (k == 4) { sb_append(sb, "~~"); sb_append(sb, word()); sb_append(sb, "~~"); }
+        else if (k == 5) { sb_append(sb, word()); sb_append(sb, " & <"); sb_append(sb, word()); sb_append(sb, ">"); }
+        else sb_append(sb, word());
+    }
+    sb_append(sb, ".");
+}
+
+/* ── Corpus shapes ───────────────────────────────────────────────────── */
+
+static void gen_prose(StrBuf* sb, size_t target) {
+    int sec = 0;
+    while (sb->len < target) {
+        char h[64]; sprintf(h, "\n## Section %d\n\n", ++sec); sb_append(sb, h);
+        for (int p = 0; p < 6; p++) {
+            int lines = 2 + rnd() % 5;
+            for (int l = 0; l < lines; l++) { sentence(sb, 8 + rnd() % 10); sb_append_char(sb, '\n'); }
+            sb_append_char(sb, '\n');
+        }
+    }
+}
+
+static void gen_table(StrBuf* sb, size_t target) {
+    int t = 0;
+    while (sb->len < target) {
+        char h[64]; sprintf(h, "\n### Table %d\n\n", ++t); sb_append(sb, h);
+        sb_append(sb, "| Name | Type | Default | Min | Max | Description |\n");
+        sb_append(sb, "|:-----|:----:|--------:|----:|----:|-------------|\n");
+        for (int r = 0; r < 50; r++) {
+            char row[256];
+            sprintf(row, "| `%s_%d` | %s | %u | %u | %u | ", word(), r, word(), rnd() % 1000, rnd() % 10, 1000 + rnd() % 9000);
+            sb_append(sb, row); sentence(sb, 6 + rnd() % 6); sb_append(sb, " |\n");
+        }
+        sb_append_char(sb, '\n');
+    }
+}
+
+static void gen_nested(StrBuf* sb, size_t target) {
+    static const char* pad[] = { "", "  ", "    ", "      ", "        " };
+    while (sb->len < target) {
+        for (int d = 0; d < 5; d++) {
+            for (int k = 0; k < 2; k++) {
+                sb_append(sb, pad[d]); sb_append(sb, (d & 1) ? "1. " : "- ");
+                sentence(sb, 5 + rnd() % 6); sb_append_char(sb, '\n');
+            }
+        }
+        for (int d = 3; d >= 0; d--) {
+            sb_append(sb, pad[d]); sb_append(sb, "- "); sentence(sb, 4 + rnd() % 4); sb_append_char(sb, '\n');
+        }
+        sb_append_char(sb, '\n');
+        for (int d = 1; d <= 4; d++) {
+            for (int k = 0; k < 2; k++) {
+                for (int q = 0; q < d; q++) sb_append(sb, "> ");
+                sentence(sb, 6 + rnd() % 6); sb_append_char(sb, '\n');
+            }
+        }
+        sb_append_char(sb, '\n');
+    }
+}
+
+/* Pathological nesting: 32-level quote and bullet ladders */
+static void gen_deep(StrBuf* sb, size_t target) {
+    while (sb->len < target) {
+        for (int d = 1; d <= 32; d++) {
+            for (int q = 0; q < d; q++) sb_append(sb, "> ");
+            sentence(sb, 4 + rnd() % 4); sb_append_char(sb, '\n');
+        }
+        sb_append_char(sb, '\n');
+        for (int d = 0; d < 32; d++) {
+            for (int q = 0; q < d; q++) sb_append(sb, "  ");
+            sb_append(sb, "- "); sentence(sb, 4 + rnd() % 4); sb_append_char(sb, '\n');
+        }
+        sb_append_char(sb, '\n');
+    }
+}
+
+/* Adversarial 64 KB paragraphs: unmatched '[' and '<', long space runs,
+   snake_case identifiers, stray emphasis and tilde delimiters, link and
+   image destinations never closed */
+static void gen_inline(StrBuf* sb, size_t target) {
+    static const char* unit[] = { "[a ", "<a ", "x          ", "snake_case_name ", "a*b ", "**a ", "~~a ", "`a `` ",
+                                  "[a](", "[*a](", "[`](", "![a](" };
+    int u = 0;
+    while (sb->len < target) {
+        size_t end = sb->len + 64 * 1024;
+        while (sb->len < end) sb_append(sb, unit[u]);
+        sb_append(sb, "\n\n");
+        u = (u + 1) % (int)(sizeof(unit)/sizeof(unit[0]));
+    }
+}
+
+static void gen_code(StrBuf* sb, size_t target) {
+    static const char* langs[] = { "c", "javascript", "python", "sql", "bash", "" };
+    static const char* code[] = {
+        "for (int i = 0; i < n; i++) { total += data[i] * 2; }",
+        "const r = await fetch(\"/api/items?id=\" + id); // load",
+        "if x > 10 and not done: print(f\"value {x}\")",
+        "SELECT name, count(*) FROM users WHERE age > 18 GROUP BY name;",
+        "grep -rn \"TODO\" src/ | sed 's/<[^>]*>//g' > todo.txt",
+        "    return a && b || (c << 2) > d;",
+        "/* block comment with \"quotes\" & <tags> */"
+    };
+    int b = 0;
+    while (sb->len < target) {
+        char h[64]; sprintf(h, "\n### Example %d\n\n", ++b); sb_append(sb, h);
+        sentence(sb, 10); sb_append(sb, "\n\n```"); sb_append(sb, langs[rnd() % 6]); sb_append_char(sb, '\n');
+        int lines = 10 + rnd() % 40;
+        for (int l = 0; l < lines; l++) { sb_append(sb, code[rnd() % 7]); sb_append_char(sb, '\n'); }
+        sb_append(sb, "```\n\n");
+        if (rnd() % 3 == 0) {
+            for (int l = 0; l < 8; l++) { sb_append(sb, "    "); sb_append(sb, code[rnd() % 7]); sb_append_char(sb, '\n'); }
+            sb_append_char(sb, '\n');
+        }
+    }
+}
+
+static void gen_links(StrBuf* sb, size_t target) {
+    /* Uses first, definitions at the end of each chapter, as generated API docs do */
+    int ch = 0;
+    while (sb->len < target) {
+        int nref = 200, base = ch * nref;
+        char h[64]; sprintf(h, "\n## Chapter %d\n\n", ++ch); sb_append(sb, h);
+        for (int p = 0; p < 40; p++) {
+            for (int u = 0; u < 8; u++) {
+                char l[96]; int id = base + (int)(rnd() % nref);
+                if (u & 1) sprintf(l, "see [%s][ref-%d], ", word(), id);
+                else sprintf(l, "[Ref-%d] and ![img][REF-%d] ", id, id);
+                sb_append(sb, l);
+            }
+            sentence(sb, 6); sb_append(sb, "\n\n");
+        }
+        for (int r = 0; r < nref; r++) {
+            char d[256];
+            sprintf(d, "[ref-%d]: https://docs.example.com/api/v2/%s/%s/%d \"%s %d\"\n", base + r, word(), word(), r, word(), r);
+            sb_append(sb, d);
+        }
+    }
+}
+
+/* Prose in several scripts: 2-, 3- and 4-byte UTF-8 among the ASCII */
+static const char* INTL[] = {
+    "привет","документ","быстро","λόγος","κείμενο","文档","渲染","速度","メモリ","표","빠르게",
+    "😀","🚀","café","naïve","größe","résumé","the","viewer","markdown","plugin","memory"
+};
+#define NINTL (sizeof(INTL)/sizeof(INTL[0]))
+
+static void gen_intl(StrBuf* sb, size_t target) {
+    int sec = 0;
+    while (sb->len < target) {
+        char h[64]; sprintf(h, "\n## Раздел %d\n\n", ++sec); sb_append(sb, h);
+        for (int p = 0; p < 6; p++) {
+            int lines = 2 + rnd() % 5;
+            for (int l = 0; l < lines; l++) {
+                int n = 8 + rnd() % 10;
+                for (int w = 0; w < n; w++) { if (w) sb_append_char(sb, ' '); sb_append(sb, INTL[rnd() % NINTL]); }
+                sb_append(sb, ".\n");
+            }
+            sb_append_char(sb, '\n');
+        }
+    }
+}
+
+typedef struct { const char* name; void (*gen)(StrBuf*, size_t); } Shape;
+static const Shape SHAPES[] = {
+    { "prose",  gen_prose  },
+    { "table",  gen_table  },
+    { "nested", gen_nested },
+    { "deep",   gen_deep   },
+    { "inline", gen_inline },
+    { "code",   gen_code   },
+    { "links",  gen_links  },
+    { "intl",   gen_intl   },
+};
+#define NSHAPES (int)(sizeof(SHAPES)/sizeof(SHAPES[0]))
+
+/* ── Measurement ─────────────────────────────────────────────────────── */
+
+static void bench_one(const char* name, const char* md, size_t len, int runs) {
+    /* Small inputs are looped until each timed sample covers >= 50 ms */
+    int reps = 1;
+    { double t0 = now_sec(); free(md_to_html(md)); double dt = now_sec() - t0;
+      if (dt < 0.05) reps = (int)(0.05 / (dt > 1e-6 ? dt : 1e-6)) + 1; }
+
+    double best = 0;
+    for (int r = 0; r < runs; r++) {
+        double t0 = now_sec();
+        for (int k = 0; k < reps; k++) free(md_to_html(md));
+        double dt = (now_sec() - t0) / reps;
+        if (r == 0 || dt < best) best = dt;
+    }
+
+    /* One instrumented run for allocation count, peak heap and output size */
+    size_t a0 = g_allocs, live0 = g_live; g_peak = g_live;
+    char* html = md_to_html(md);
+    size_t allocs = g_allocs - a0, peak = g_peak - live0;
+    size_t outLen = html ? strlen(html) : 0;
+    free(html);
+
+    /* The same with one context reused across conversions: its arena is
+       already sized, so only the output is malloc'd */
+    MdContext* cx = md_context_new(NULL);
+    free(md_render(cx, md, len));
+    double ctxBest = 0;
+    for (int r = 0; r < runs; r++) {
+        double t0 = now_sec();
+        for (int k = 0; k < reps; k++) free(md_render(cx, md, len));
+        double dt = (now_sec() - t0) / reps;
+        if (r == 0 || dt < ctxBest) ctxBest = dt;
+    }
+    size_t c0 = g_allocs;
+    free(md_render(cx, md, len));
+    size_t ctxAllocs = g_allocs - c0;
+    md_context_free(cx);
+
+    double mb = (double)len / (1024.0 * 1024.0);
+    printf("%-22s %9.2f %10.3f %9.1f %10zu %10.3f %10zu %10.2f %7.2f %9.1f\n",
+           name, mb, best * 1e3, best > 0 ? mb / best : 0.0, allocs, ctxBest * 1e3, ctxAllocs,
+           (double)peak / (1024.0 * 1024.0), len ? (double)outLen / (double)len : 0.0,
+           (double)peak_rss_kb() / 1024.0);
+    fflush(stdout);
+}
+
+static char* slurp(const char* path, size_t* outLen) {
+    FILE* f = fopen(path, "rb"); if (!f) return NULL;
+    fseek(f, 0, SEEK_END); long sz = ftell(f); fseek(f, 0, SEEK_SET);
+    char* buf = (char*)malloc((size_t)sz + 1); if (!buf) { fclose(f); return NULL; }
+    size_t n = fread(buf, 1, (size_t)sz, f); buf[n] = '\0'; fclose(f);
+    if (n >= 3 && (unsigned char)buf[0]==0xEF && (unsigned char)buf[1]==0xBB && (unsigned char)buf[2]==0xBF) {
+        memmove(buf, buf + 3, n - 2); n -= 3;
+    }
+    *outLen = n;
+    return buf;
+}
+
+static int in_list(const char* list, const char* name) {
+    if (!list) return 1;
+    size_t nl = strlen(name);
+    for (const char* p = list; *p; ) {
+        const char* e = strchr(p, ','); size_t l = e ? (size_t)(e - p) : strlen(p);
+        if (l == nl && strncmp(p, name, l) == 0) return 1;
+        if (!e) break;
+        p = e + 1;
+    }
+    return 0;
+}
+
+/* ── Concurrency check ───────────────────────────────────────────────── */
+
+typedef struct { char name[64]; char* md; size_t len; char* ref; size_t refLen; } Doc;
+
+typedef struct {
+    const Doc* docs; int ndocs; int rounds; int id;
+    size_t bytes; int converted; int mismatches;
+} Worker;
+
+/* Each worker converts every document `rounds` times, starting at a
+   different offset so the threads are on different inputs at once */
+static void* worker_main(void* arg) {
+    Worker* w = (Worker*)arg;
+    MdContext* cx = md_context_new(NULL);
+    for (int r = 0; r < w->rounds; r++) {
+        for (int k = 0; k < w->ndocs; k++) {
+            const Doc* d = &w->docs[(w->id + k) % w->ndocs];
+            char* html = md_render(cx, d->md, d->len);
+            size_t n = html ? strlen(html) : 0;
+            if (!html || n != d->refLen || memcmp(html, d->ref, n) != 0) {
+                if (w->mismatches++ == 0) fprintf(stderr, "mdview-bench: thread %d: %s differs from single-threaded output\n", w->id, d->name);
+            }
+            w->bytes += d->len; w->converted++;
+            free(html);
+        }
+    }
+    md_context_free(cx);
+    return NULL;
+}
+
+static int stress(Doc* docs, int ndocs, int threads, int rounds) {
+    for (int k = 0; k < ndocs; k++) {
+        docs[k].ref = md_to_html_n(docs[k].md, docs[k].len);
+        docs[k].refLen = docs[k].ref ? strlen(docs[k].ref) : 0;
+    }
+    Worker* ws = (Worker*)calloc((size_t)threads, sizeof(Worker));
+    pthread_t* ts = (pthread_t*)calloc((size_t)threads, sizeof(pthread_t));
+    double t0 = now_sec();
+    for (int t = 0; t < threads; t++) {
+        ws[t].docs = docs; ws[t].ndocs = ndocs; ws[t].rounds = rounds; ws[t].id = t;
+        pthread_create(&ts[t], NULL, worker_main, &ws[t]);
+    }
+    size_t bytes = 0; int converted = 0, bad = 0;
+    for (int t = 0; t < threads; t++) {
+        pthread_join(ts[t], NULL);
+        bytes += ws[t].bytes; converted += ws[t].converted; bad += ws[t].mismatches;
+    }
+    double dt = now_sec() - t0;
+    double mb = (double)bytes / (1024.0 * 1024.0);
+    printf("\n%d threads: %d conversions, %.1f MB in %.1f ms (%.1f MB/s aggregate), %d mismatch(es)\n",
+           threads, converted, mb, dt * 1e3, dt > 0 ? mb / dt : 0.0, bad);
+    for (int k = 0; k < ndocs; k++) free(docs[k].ref);
+    free(ws); free(ts);
+    return bad ? 1 : 0;
+}
+
+/* ── SIMD paths ──────────────────────────────────────────────────────── */
+
+static double time_render(MdContext* cx, const Doc* d, int runs, char** out) {
+    double best = 0;
+    for (int r = 0; r < runs; r++) {
+        double t0 = now_sec();
+        char* html = md_render(cx, d->md, d->len);
+        double dt = now_sec() - t0;
+        if (r == 0 || dt < best) best = dt;
+        if (r + 1 < runs || !out) free(html); else *out = html;
+    }
+    return best;
+}
+
+/* The per-byte sb_append_esc this tree used before the bulk kernel, kept
+   as the baseline for the escaping rows */
+static void esc_bytewise(StrBuf* sb, const char* s, size_t n) {
+    for(size_t i=0;i<n;i++) switch(s[i]){
+        case '&': sb_append(sb,"&amp;"); break;
+        case '<': sb_append(sb,"&lt;"); break;
+        case '>': sb_append(sb,"&gt;"); break;
+        case '"': sb_append(sb,"&quot;"); break;
+        default:  sb_append_char(sb,s[i]); break;
+    }
+}
+
+/* Escape the document line by line, as code blocks do */
+static double time_escape(const Doc* d, int runs, int bytewise, StrBuf* out) {
+    double best = 0;
+    for (int r = 0; r < runs; r++) {
+        out->len = 0; out->data[0] = '\0';
+        double t0 = now_sec();
+        for (const char* p = d->md; p < d->md + d->len; ) {
+            const char* e = memchr(p, '\n', (size_t)(d->md + d->len - p));
+            size_t n = e ? (size_t)(e - p) + 1 : (size_t)(d->md + d->len - p);
+            if (bytewise) esc_bytewise(out, p, n); else sb_append_esc(out, p, n);
+            p += n;
+        }
+        double dt = now_sec() - t0;
+        if (r == 0 || dt < best) best = dt;
+    }
+    return best;
+}
+
+static int simd_paths(Doc* docs, int ndocs, int runs) {
+    static const char* names[] = { "scalar", "sse2", "avx2" };
+    int top = md_simd_select(MD_SIMD_AUTO), bad = 0;
+    MdContext* cx = md_context_new(NULL);
+    printf("\n%-22s %-7s %10s %9s %8s\n", "corpus", "path", "best ms", "MB/s", "speedup");
+    for (int k = 0; k < ndocs; k++) {
+        const Doc* d = &docs[k];
+        double mb = (double)d->len / (1024.0 * 1024.0), base = 0;
+        char* ref = NULL;
+        for (int lv = MD_SIMD_NONE; lv <= top; lv++) {
+            md_simd_select(lv);
+            char* html = NULL;
+            double dt = time_render(cx, d, runs, &html);
+            if (lv == MD_SIMD_NONE) { base = dt; ref = html; }
+            else {
+                if (!html || strcmp(html, ref) != 0) { bad++; fprintf(stderr, "mdview-bench: %s: %s output differs from scalar\n", d->name, names[lv]); }
+                free(html);
+            }
+            printf("%-22s %-7s %10.3f %9.1f %7.2fx\n", d->name, names[lv], dt * 1e3, dt > 0 ? mb / dt : 0.0, dt > 0 ? base / dt : 0.0);
+        }
+        free(ref);
+    }
+    md_context_free(cx);
+
+    /* sb_append_esc kernel alone, against the per-byte routine */
+    printf("\n%-22s %-9s %10s %9s %8s\n", "sb_append_esc", "path", "best ms", "MB/s", "speedup");
+    StrBuf ref, out; sb_init(&ref); sb_init(&out);
+    for (int k = 0; k < ndocs; k++) {
+        const Doc* d = &docs[k];
+        double mb = (double)d->len / (1024.0 * 1024.0);
+        double base = time_escape(d, runs, 1, &ref);
+        printf("%-22s %-9s %10.3f %9.1f %7.2fx\n", d->name, "per-byte", base * 1e3, base > 0 ? mb / base : 0.0, 1.0);
+        for (int lv = MD_SIMD_NONE; lv <= top; lv++) {
+            md_simd_select(lv);
+            double dt = time_escape(d, runs, 0, &out);
+            if (out.len != ref.len || memcmp(out.data, ref.data, ref.len) != 0) { bad++; fprintf(stderr, "mdview-bench: %s: %s escaping differs\n", d->name, names[lv]); }
+            printf("%-22s %-9s %10.3f %9.1f %7.2fx\n", d->name, names[lv], dt * 1e3, dt > 0 ? mb / dt : 0.0, dt > 0 ? base / dt : 0.0);
+        }
+    }
+    free(ref.data); free(out.data);
+    md_simd_select(MD_SIMD_AUTO);
+    return bad ? 1 : 0;
+}
+
+/* ── Output sink ─────────────────────────────────────────────────────── */
+
+/* Chunked callback sink that checks the stream against md_render's result */
+typedef struct { const char* ref; size_t refLen; size_t pos; int chunks; int bad; size_t first, rest; unsigned skip; } Expect;
+
+static size_t count_str(const char* p, size_t n, const char* k) {
+    size_t c = 0, kl = strlen(k);
+    for (const char* e = p + n; (p = memchr(p, k[0], (size_t)(e - p))) && (size_t)(e - p) >= kl; p++)
+        if (memcmp(p, k, kl) == 0) c++;
+    return c;
+}
+
+/* A block-aligned piece opens and closes every container it touches.
+   Only the converter's own tag forms count, not raw HTML in the corpora
+   (prose has inline "<table>" words); a pair the whole page leaves
+   unbalanced (raw HTML closing it) is left out via `skip`. */
+static const char* k_pairs[][2] = {
+    { "<blockquote>\n", "</blockquote>\n" }, { "<ul>\n", "</ul>\n" }, { "<ol>\n", "</ol>\n" },
+    { "<li>", "</li>\n" }, { "<pre><code", "</code></pre>\n" }, { "<table>\n<thead>", "</table>\n" } };
+
+static unsigned unbalanced(const char* p, size_t n, unsigned skip) {
+    unsigned m = 0;
+    for (int i = 0; i < 6; i++)
+        if (!(skip >> i & 1) && count_str(p, n, k_pairs[i][0]) != count_str(p, n, k_pairs[i][1])) m |= 1u << i;
+    return m;
+}
+
+static int expect_write(MdSink* s, const char* data, size_t len) {
+    Expect* e = (Expect*)s->user;
+    if (e->pos + len > e->refLen || memcmp(e->ref + e->pos, data, len) != 0) e->bad = 1;
+    if (s->aligned && unbalanced(data, len, e->skip)) e->bad = 1;
+    if (s->aligned && !e->chunks) { e->first = len; s->chunk = e->rest; }  /* small first piece, as the plugin does */
+    e->pos += len; e->chunks++;
+    return 0;
+}
+
+static int sink_check(Doc* docs, int ndocs, int runs) {
+    int bad = 0;
+    MdContext* cx = md_context_new(NULL);
+    printf("\n%-22s %10s %10s %10s %10s %8s %8s %8s\n", "md_render_to", "buf ms", "buf peak", "sink ms", "sink peak", "chunks", "aligned", "first KB");
+    for (int k = 0; k < ndocs; k++) {
+        const Doc* d = &docs[k];
+        free(md_render(cx, d->md, d->len));  /* size the arena for both */
+
+        size_t live0 = g_live; g_peak = g_live;
+        char* ref = md_render(cx, d->md, d->len);
+        size_t bufPeak = g_peak - live0;
+        double bufBest = time_render(cx, d, runs, NULL);
+
+        Expect e = { ref, ref ? strlen(ref) : 0, 0, 0, 0, 0, 0, 0 };
+        MdSink sink = { expect_write, &e, 0, 0 };
+        live0 = g_live; g_peak = g_live;
+        int rc = md_render_to(cx, d->md, d->len, &sink);
+        size_t sinkPeak = g_peak - live0;
+        if (rc || e.bad || e.pos != e.refLen) { bad++; fprintf(stderr, "mdview-bench: %s: streamed output differs from md_render\n", d->name); }
+        int chunks = e.chunks;
+
+        double sinkBest = 0;
+        for (int r = 0; r < runs; r++) {
+            e.pos = 0;
+            double t0 = now_sec();
+            md_render_to(cx, d->md, d->len, &sink);
+            double dt = now_sec() - t0;
+            if (r == 0 || dt < sinkBest) sinkBest = dt;
+        }
+
+        /* Block-aligned pieces: 32 KB first, then 256 KB */
+        Expect a = { ref, e.refLen, 0, 0, 0, 0, 262144, ref ? unbalanced(ref, e.refLen, 0) : 0 };
+        MdSink al = { expect_write, &a, 32768, 1 };
+        if (md_render_to(cx, d->md, d->len, &al) || a.bad || a.pos != a.refLen) { bad++; fprintf(stderr, "mdview-bench: %s: aligned pieces differ from md_render or split a block\n", d->name); }
+        free(ref);
+        printf("%-22s %10.3f %10.2f %10.3f %10.2f %8d %8d %8.1f\n", d->name, bufBest * 1e3, (double)bufPeak / (1024.0 * 1024.0),
+               sinkBest * 1e3, (double)sinkPeak / (1024.0 * 1024.0), chunks, a.chunks, (double)a.first / 1024.0);
+    }
+    md_context_free(cx);
+    return bad ? 1 : 0;
+}
+
+/* ── Source input ────────────────────────────────────────────────────── */
+
+/* The plugin's old read path: heap copy, BOM dropped with a memmove */
+static char* read_copy(const char* path, size_t* outLen) {
+    FILE* f = fopen(path, "rb"); if (!f) return NULL;
+    fseek(f, 0, SEEK_END); long sz = ftell(f); fseek(f, 0, SEEK_SET);
+    char* buf = (char*)malloc((size_t)sz + 1); if (!buf) { fclose(f); return NULL; }
+    size_t n = fread(buf, 1, (size_t)sz, f); buf[n] = '\0'; fclose(f);
+    if (n >= 3 && (unsigned char)buf[0]==0xEF && (unsigned char)buf[1]==0xBB && (unsigned char)buf[2]==0xBF) { memmove(buf, buf + 3, n - 2); n -= 3; }
+    *outLen = n;
+    return buf;
+}
+
+/* Write each corpus to a file, then load and convert it both ways.
+   The file was just written, so both paths read from the page cache. */
+static int input_paths(Doc* docs, int ndocs, int runs, const char* dir) {
+    int bad = 0;
+    MdContext* cx = md_context_new(NULL);
+    printf("\n%-22s %-5s %10s %10s %10s\n", "source input", "path", "load ms", "total ms", "peak heap");
+    for (int k = 0; k < ndocs; k++) {
+        const Doc* d = &docs[k];
+        char path[1024]; snprintf(path, sizeof(path), "%s/mdview-bench-%d-XXXXXX", dir, (int)getpid());
+        int fd = mkstemp(path);
+        FILE* f = fd >= 0 ? fdopen(fd, "wb") : NULL;
+        if (!f) { fprintf(stderr, "mdview-bench: cannot create a file in %s\n", dir); bad++; break; }
+        fwrite(d->md, 1, d->len, f); fclose(f);
+        free(md_render(cx, d->md, d->len));  /* size the arena first */
+
+        char* ref = NULL;
+        for (int way = 0; way < 2; way++) {
+            double bestLoad = 0, bestTotal = 0; size_t peak = 0;
+            for (int r = 0; r < runs; r++) {
+                size_t live0 = g_live; g_peak = g_live;
+                double t0 = now_sec();
+                MdSource src; char* copy = NULL; const char* md; size_t len = 0;
+                if (way == 0) { copy = read_copy(path, &len); md = copy; }
+                else { if (md_source_open(&src, path)) src.data = NULL; md = src.data; len = src.len; }
+                double t1 = now_sec();
+                char* html = md ? md_render(cx, md, len) : NULL;
+                if (way == 0) free(copy); else md_source_close(&src);
+                double t2 = now_sec();
+                if (r == 0 || t1 - t0 < bestLoad) bestLoad = t1 - t0;
+                if (r == 0 || t2 - t0 < bestTotal) bestTotal = t2 - t0;
+                if (g_peak - live0 > peak) peak = g_peak - live0;
+                if (!html) { bad++; fprintf(stderr, "mdview-bench: %s: cannot load\n", d->name); }
+                else if (!ref) ref = html;
+                else { if (strcmp(html, ref) != 0) { bad++; fprintf(stderr, "mdview-bench: %s: mapped output differs\n", d->name); } free(html); }
+            }
+            printf("%-22s %-5s %10.3f %10.3f %10.2f\n", d->name, way ? "mmap" : "read",
+                   bestLoad * 1e3, bestTotal * 1e3, (double)peak / (1024.0 * 1024.0));
+        }
+        free(ref);
+        unlink(path);
+    }
+    md_context_free(cx);
+    return bad ? 1 : 0;
+}
+
+/* ── Sections ────────────────────────────────────────────────────────── */
+
+static int section_check(Doc* docs, int ndocs, int runs) {
+    int bad = 0;
+    MdContext* cx = md_context_new(NULL);
+    printf("\n%-22s %10s %10s %10s %10s %10s %10s\n", "md_render_sections", "ms", "render ms", "sections", "headed", "max KB", "est lines");
+    for (int k = 0; k < ndocs; k++) {
+        const Doc* d = &docs[k];
+        char* ref = md_render(cx, d->md, d->len);
+        size_t refLen = ref ? strlen(ref) : 0;
+        double plain = time_render(cx, d, runs, NULL);
+
+        MdSections ss; memset(&ss, 0, sizeof(ss));
+        double best = 0; char* html = NULL;
+        for (int r = 0; r < runs; r++) {
+            free(html);
+            double t0 = now_sec();
+            html = md_render_sections(cx, d->md, d->len, &ss);
+            double dt = now_sec() - t0;
+            if (r == 0 || dt < best) best = dt;
+        }
+
+        int ok = html && ref && strcmp(html, ref) == 0;
+        unsigned skip = ok ? unbalanced(ref, refLen, 0) : 0;
+        size_t pos = 0, maxLen = 0; long lines = 0; int headed = 0;
+        for (int i = 0; ok && i < ss.count; i++) {
+            const MdSection* s = &ss.items[i];
+            if (s->off != pos || s->len == 0 || unbalanced(ref + s->off, s->len, skip)) ok = 0;
+            if (s->level && (ref[s->off] != '<' || ref[s->off+1] != 'h' || s->titleOff < s->off || s->titleOff + s->titleLen > s->off + s->len)) ok = 0;
+            pos += s->len; lines += s->height; headed += s->level > 0;
+            if (s->len > maxLen) maxLen = s->len;
+        }
+        if (!ok || pos != refLen) { bad++; fprintf(stderr, "mdview-bench: %s: sections do not tile the output\n", d->name); }
+        printf("%-22s %10.3f %10.3f %10d %10d %10.1f %10ld\n", d->name, best * 1e3, plain * 1e3, ss.count, headed,
+               (double)maxLen / 1024.0, lines);
+        free(html); free(ref); md_sections_free(&ss);
+    }
+    md_context_free(cx);
+    return bad ? 1 : 0;
+}
+
+/* ── Find ────────────────────────────────────────────────────────────── */
+
+/* Naive reference: every non-overlapping match of the folded needle in
+   the folded text that stays within one block */
+static size_t find_naive(const MdText* t, const char* nd, size_t n) {
+    size_t c = 0; int b = 0;
+    for (size_t i = 0; i + n <= t->fold.len; ) {
+        while (b + 1 < t->count && t->blocks[b+1].off <= i) b++;
+        size_t end = b + 1 < t->count ? t->blocks[b+1].off : t->fold.len;
+        if (memcmp(t->fold.data + i, nd, n) == 0 && i + n <= end) { c++; i += n; } else i++;
+    }
+    return c;
+}
+
+static int find_check(Doc* docs, int ndocs, int runs) {
+    static const char* names[] = { "scalar", "sse2", "avx2" };
+    static const char* needles[] = { "the", "Markdown", "snake_case_name", "keeping memory", "zebra" };
+    int top = md_simd_select(MD_SIMD_AUTO), bad = 0;
+    MdOptions o; md_options_default(&o); o.blockLines = 1;
+    MdContext* cx = md_context_new(&o);
+    MdText tx; memset(&tx, 0, sizeof(tx));
+    MdMatches m; memset(&m, 0, sizeof(m));
+    printf("\n%-22s %10s %10s %10s %10s\n", "text index", "ms", "render ms", "text KB", "blocks");
+    for (int k = 0; k < ndocs; k++) {
+        const Doc* d = &docs[k];
+        double plain = time_render(cx, d, runs, NULL), best = 0;
+        md_context_set_text(cx, &tx);
+        char* html = NULL;
+        for (int r = 0; r < runs; r++) {
+            free(html);
+            double t0 = now_sec();
+            html = md_render(cx, d->md, d->len);
+            double dt = now_sec() - t0;
+            if (r == 0 || dt < best) best = dt;
+        }
+        md_context_set_text(cx, NULL);
+        /* Every marked block is one data-line attribute of the output */
+        int marked = 0;
+        for (int i = 0; i < tx.count; i++) marked += tx.blocks[i].line >= 0;
+        if (!html || tx.failed || count_str(html, strlen(html), " data-line=\"") != (size_t)marked) {
+            bad++; fprintf(stderr, "mdview-bench: %s: text blocks do not match the marked elements\n", d->name);
+        }
+        free(html);
+        printf("%-22s %10.3f %10.3f %10.1f %10d\n", d->name, best * 1e3, plain * 1e3, (double)tx.text.len / 1024.0, tx.count);
+
+        for (size_t q = 0; q < sizeof(needles)/sizeof(needles[0]); q++) {
+            size_t n = strlen(needles[q]);
+            char nd[64]; for (size_t i = 0; i <= n; i++) nd[i] = (char)(needles[q][i] >= 'A' && needles[q][i] <= 'Z' ? needles[q][i] + 32 : needles[q][i]);
+            double t0 = now_sec();
+            size_t ref = find_naive(&tx, nd, n);
+            double base = now_sec() - t0;
+            printf("  %-20s %-7s %10.3f %10zu\n", needles[q], "naive", base * 1e3, ref);
+            for (int lv = MD_SIMD_NONE; lv <= top; lv++) {
+                md_simd_select(lv);
+                double bt = 0;
+                for (int r = 0; r < runs; r++) {
+                    double f0 = now_sec();
+                    md_text_find(&tx, needles[q], n, 0, &m);
+                    double dt = now_sec() - f0;
+                    if (r == 0 || dt < bt) bt = dt;
+                }
+                if (m.count != ref) { bad++; fprintf(stderr, "mdview-bench: %s: %s finds %zu of %zu \"%s\"\n", d->name, names[lv], m.count, ref, needles[q]); }
+                printf("  %-20s %-7s %10.3f %10zu %7.1fx\n", "", names[lv], bt * 1e3, m.count, bt > 0 ? base / bt : 0.0);
+            }
+            md_simd_select(MD_SIMD_AUTO);
+        }
+    }
+    md_matches_free(&m); md_text_free(&tx);
+    md_context_free(cx);
+    return bad ? 1 : 0;
+}
+
+/* ── Source map ──────────────────────────────────────────────────────── */
+
+/* The map against the page: its blocks other than raw HTML are the
+   output's data-line attributes, in order, and no two overlap */
+static int map_check(Doc* docs, int ndocs, int runs) {
+    int bad = 0;
+    MdOptions o; md_options_default(&o); o.blockLines = 1;
+    MdContext* cx = md_context_new(&o);
+    MdSourceMap m; memset(&m, 0, sizeof(m));
+    printf("\n%-22s %10s %10s %10s %10s\n", "source map", "ms", "render ms", "blocks", "raw");
+    for (int k = 0; k < ndocs; k++) {
+        const Doc* d = &docs[k];
+        char* html = NULL;
+        double plain = time_render(cx, d, runs, &html), best = 0;
+        int rc = 0;
+        for (int r = 0; r < runs; r++) {
+            double t0 = now_sec();
+            rc |= md_source_map(cx, d->md, d->len, &m);
+            double dt = now_sec() - t0;
+            if (r == 0 || dt < best) best = dt;
+        }
+        int lines = 0, raw = 0, ok = !rc && html;
+        for (size_t i = 0; i < d->len; i++) lines += d->md[i] == '\n';
+        if (d->len && d->md[d->len-1] != '\n') lines++;
+        const char* h = html;
+        for (int i = 0; ok && i < m.count; i++) {
+            const MdSourceBlock* b = &m.items[i];
+            if (b->line >= b->end || (i && b->line < m.items[i-1].end) || b->end > lines) ok = 0;
+            if (b->raw) { raw++; continue; }
+            h = h ? strstr(h, " data-line=\"") : NULL;
+            if (!h || atoi(h + 12) != b->line) ok = 0; else h += 12;
+        }
+        if (ok && h && strstr(h, " data-line=\"")) ok = 0;
+        if (!ok) { bad++; fprintf(stderr, "mdview-bench: %s: source map does not match the marked blocks\n", d->name); }
+        for (int line = 0; ok && line < lines; line += 97) {
+            int i = md_source_map_find(&m, line);
+            if (i >= 0 ? m.items[i].line > line || (i + 1 < m.count && m.items[i+1].line <= line) : m.count && m.items[0].line <= line) {
+                bad++; fprintf(stderr, "mdview-bench: %s: md_source_map_find(%d) = %d\n", d->name, line, i); break;
+            }
+        }
+        free(html);
+        printf("%-22s %10.3f %10.3f %10d %10d\n", d->name, best * 1e3, plain * 1e3, m.count, raw);
+    }
+    md_source_map_free(&m);
+    md_context_free(cx);
+    return bad ? 1 : 0;
+}
+
+/* ── Block diff ──────────────────────────────────────────────────────── */
+
+/* Lines a random edit puts in: every kind of block, fences and raw HTML
+   left open, and a link definition, which changes the references */
+static const char* k_edits[] = {
+    "# Edited heading", "## Sub heading", "", "- new item", "1. first", "> quoted line", "```", "```c",
+    "    indented code", "| a | b |", "|---|---|", "<div>", "</div>", "<!-- note -->", "---",
+    "Setext title\n=====", "Text with [a link][w] and *emphasis*.", "- [ ] task", "[w]: https://example.com/w"
+};
+#define NEDITS (sizeof(k_edits)/sizeof(k_edits[0]))
+
+/* Start of the line at or after a random offset, then n lines further */
+static size_t edit_line(const char* md, size_t len) {
+    size_t p = len ? rnd() % (len + 1) : 0;
+    while (p < len && p && md[p-1] != '\n') p++;
+    return p;
+}
+static size_t edit_skip(const char* md, size_t len, size_t p, unsigned n) {
+    while (n-- && p < len) { const char* nl = memchr(md + p, '\n', len - p); p = nl ? (size_t)(nl - md) + 1 : len; }
+    return p;
+}
+
+/* One random edit of md into out: lines deleted, put in, copied
+   elsewhere, or one line made longer */
+static void random_edit(StrBuf* out, const char* md, size_t len) {
+    size_t a = edit_line(md, len), b = edit_skip(md, len, a, 1 + rnd() % 4), c;
+    out->len = 0;
+    switch (rnd() % 4) {
+    case 0: sb_append_n(out, md, a); sb_append_n(out, md + b, len - b); break;
+    case 1: sb_append_n(out, md, a); sb_append(out, k_edits[rnd() % NEDITS]); sb_append_char(out, '\n'); sb_append_n(out, md + a, len - a); break;
+    case 2: c = edit_line(md, len); sb_append_n(out, md, c); sb_append_n(out, md + a, b - a); sb_append_n(out, md + c, len - c); break;
+    default:
+        c = edit_skip(md, len, a, 1);
+        if (c > a && md[c-1] == '\n') c--;
+        sb_append_n(out, md, c); sb_append(out, " changed"); sb_append_n(out, md + c, len - c); break;
+    }
+}
+
+/* A kept block as the script moves it: its data-line and heading ids */
+static void shift_block(StrBuf* out, const char* h, size_t n, int shift) {
+    static const char* keys[] = { " data-line=\"", " id=\"mdv-h" };
+    size_t i = 0, from = 0;
+    while (i < n) {
+        int k = 0;
+        while (k < 2 && (n - i < strlen(keys[k]) || memcmp(h + i, keys[k], strlen(keys[k])) != 0)) k++;
+        if (k == 2) { i++; continue; }
+        i += strlen(keys[k]);
+        sb_append_n(out, h + from, i - from);
+        char num[24]; snprintf(num, sizeof(num), "%ld", strtol(h + i, NULL, 10) + shift); sb_append(out, num);
+        while (i < n && h[i] >= '0' && h[i] <= '9') i++;
+        from = i;
+    }
+    sb_append_n(out, h + from, n - from);
+}
+
+/* The old page patched as the plugin does it: each hunk's blocks swapped
+   for the new HTML, the ones between with their lines moved. Also checks
+   that the blocks kept match and that a page can find every hunk. */
+static int page_patch(StrBuf* out, const char* html, const MdDocBlock* ob, int m, const MdDoc* d, const MdDocDiff* df) {
+    int i = 0, j = 0, shift = 0, ok = 1;
+    out->len = 0;
+    for (int h = 0; h <= df->count; h++) {
+        int end = h < df->count ? df->items[h].at : m;
+        if (end < i || (h && h < df->count && end == i)) return 0;   /* out of order, or touching */
+        for (; i < end; i++, j++) {
+            if (j >= d->count || ob[i].hash != d->blocks[j].hash || ob[i].line + shift != d->blocks[j].line) ok = 0;
+            shift_block(out, html + ob[i].off, ob[i].len, shift);
+        }
+        if (h == df->count) break;
+        const MdDocHunk* x = &df->items[h];
+        int e = x->at + x->del;
+        if (x->to != j || e > m) return 0;
+        if (e < m ? ob[e].raw || x->lineEnd != ob[e].line : x->lineEnd != -1) ok = 0;
+        if (!x->del ? x->lineAt != x->lineEnd : x->at ? ob[x->at].raw || x->lineAt != ob[x->at].line : x->lineAt != -1) ok = 0;
+        if (x->ins) {
+            const MdDocBlock *f = &d->blocks[x->to], *l = &d->blocks[x->to + x->ins - 1];
+            sb_append_n(out, d->html.data + f->off, l->off + l->len - f->off);
+        }
+        i = e; j = x->to + x->ins; shift = x->shift;
+    }
+    return ok && j == d->count;
+}
+
+static int same_outline(const MdOutline* a, const MdOutline* b) {
+    if (a->count != b->count) return 0;
+    for (int i = 0; i < a->count; i++) {
+        const MdHeading *x = &a->items[i], *y = &b->items[i];
+        if (x->level != y->level || x->line != y->line || x->anchored != y->anchored || x->section != y->section
+            || x->textLen != y->textLen || memcmp(a->text.data + x->textOff, b->text.data + y->textOff, x->textLen) != 0) return 0;
+    }
+    return 1;
+}
+
+/* Every corpus through a series of random edits, each version brought up
+   to date from the one before: md_doc_update must give md_render's HTML
+   and outline, and the old page patched by the hunks must give it too.
+   Timed against the full conversion; then an update with no change must
+   convert nothing. */
+static int doc_check(Doc* docs, int ndocs, int runs) {
+    int bad = 0, versions = 4 + 4 * runs;
+    MdOptions o; md_options_default(&o); o.blockLines = 1; o.collapseCode = 14; o.collapseQuote = 13;
+    MdContext* cx = md_context_new(&o);
+    MdOutline ref; memset(&ref, 0, sizeof(ref));
+    printf("\n%-22s %10s %10s %10s %10s %10s\n", "block diff", "blocks", "update ms", "render ms", "converted", "hunks");
+    for (int k = 0; k < ndocs; k++) {
+        const Doc* dc = &docs[k];
+        MdDoc d; memset(&d, 0, sizeof(d));
+        MdDocDiff df; memset(&df, 0, sizeof(df));
+        StrBuf cur, next, page; sb_init(&cur); sb_init(&next); sb_init(&page);
+        sb_append_n(&cur, dc->md, dc->len);
+        double upd = 0, full = 0; long conv = 0, hunks = 0;
+        rnd_reset();
+        for (int v = 0; v <= versions && !bad; v++) {
+            if (v > 0) {
+                int n = 1 + (int)(rnd() % 3);
+                for (int e = 0; e < n; e++) { random_edit(&next, cur.data, cur.len); StrBuf t = cur; cur = next; next = t; }
+            }
+            char* oldHtml = d.count ? (char*)malloc(d.html.len + 1) : NULL;
+            MdDocBlock* ob = d.count ? (MdDocBlock*)malloc((size_t)d.count * sizeof(MdDocBlock)) : NULL;
+            int m = d.count;
+            if (m) { memcpy(oldHtml, d.html.data, d.html.len + 1); memcpy(ob, d.blocks, (size_t)m * sizeof(MdDocBlock)); }
+            double t0 = now_sec();
+            int rc = md_doc_update(cx, &d, cur.data, cur.len, &df);
+            double t1 = now_sec();
+            md_context_set_outline(cx, &ref);
+            char* html = md_render(cx, cur.data, cur.len);
+            double t2 = now_sec();
+            md_context_set_outline(cx, NULL);
+            if (v > 0) { upd += t1 - t0; full += t2 - t1; conv += df.converted; hunks += df.count; }
+            const char* why = rc ? "update failed"
+                            : !html || d.html.len != strlen(html) || memcmp(d.html.data, html, d.html.len) != 0 ? "HTML differs from md_render"
+                            : !same_outline(&d.outline, &ref) ? "outline differs"
+                            : m && !page_patch(&page, oldHtml, ob, m, &d, &df) ? "hunks do not line up"
+                            : m && (page.len != d.html.len || memcmp(page.data, d.html.data, page.len) != 0) ? "patched page differs" : NULL;
+            if (why) { bad++; fprintf(stderr, "mdview-bench: %s: version %d: %s\n", dc->name, v, why); }
+            free(html); free(oldHtml); free(ob);
+        }
+        if (!bad && (md_doc_update(cx, &d, cur.data, cur.len, &df) || df.count || df.converted)) {
+            bad++; fprintf(stderr, "mdview-bench: %s: an update without changes converted %d blocks\n", dc->name, df.converted);
+        }
+        printf("%-22s %10d %10.3f %10.3f %10.1f %10.1f\n", dc->name, d.count, upd * 1e3 / versions, full * 1e3 / versions,
+               (double)conv / versions, (double)hunks / versions);
+        md_doc_free(&d); md_doc_diff_free(&df);
+        free(cur.data); free(next.data); free(page.data);
+    }
+    md_outline_free(&ref);
+    md_context_free(cx);
+    return bad ? 1 : 0;
+}
+
+/* ── Encoding ────────────────────────────────────────────────────────── */
+
+/* Plain references: one code point at a time, decoded first and then
+   checked for overlong forms, surrogates and range; malformed input is
+   U+FFFD for its first byte, as in mdcore */
+static size_t u8_ref_next(const unsigned char* s, size_t i, size_t n, unsigned* cp) {
+    static const unsigned minv[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+    unsigned c = s[i];
+    int len = c < 0x80 ? 1 : (c & 0xE0) == 0xC0 ? 2 : (c & 0xF0) == 0xE0 ? 3 : (c & 0xF8) == 0xF0 ? 4 : 0;
+    *cp = 0xFFFD;
+    if (!len || n - i < (size_t)len) return 1;
+    unsigned v = len == 1 ? c : c & (0x7Fu >> len);
+    for (int k = 1; k < len; k++) { if ((s[i+k] & 0xC0) != 0x80) return 1; v = v << 6 | (s[i+k] & 0x3F); }
+    if (v < minv[len] || v > 0x10FFFF || (v >= 0xD800 && v <= 0xDFFF)) return 1;
+    *cp = v;
+    return (size_t)len;
+}
+
+static int valid_ref(const char* s, size_t n) {
+    unsigned cp;
+    for (size_t i = 0; i < n; ) { size_t l = u8_ref_next((const unsigned char*)s, i, n, &cp); if (cp == 0xFFFD && l == 1) return 0; i += l; }
+    return 1;
+}
+
+static size_t u8to16_ref(const char* s, size_t n, unsigned short* o) {
+    size_t k = 0; unsigned cp;
+    for (size_t i = 0; i < n; ) {
+        i += u8_ref_next((const unsigned char*)s, i, n, &cp);
+        if (cp >= 0x10000) { o[k++] = (unsigned short)(0xD7C0 + (cp >> 10)); o[k++] = (unsigned short)(0xDC00 | (cp & 0x3FF)); }
+        else o[k++] = (unsigned short)cp;
+    }
+    return k;
+}
+
+static size_t u16to8_ref(const unsigned short* s, size_t n, char* o) {
+    size_t k = 0;
+    for (size_t i = 0; i < n; i++) {
+        unsigned u = s[i];
+        if (u >= 0xD800 && u <= 0xDBFF && i + 1 < n && s[i+1] >= 0xDC00 && s[i+1] <= 0xDFFF) { u = 0x10000 + ((u - 0xD800) << 10) + (s[i+1] - 0xDC00); i++; }
+        else if (u >= 0xD800 && u <= 0xDFFF) u = 0xFFFD;
+        if (u < 0x80) o[k++] = (char)u;
+        else if (u < 0x800) { o[k++] = (char)(0xC0 | u >> 6); o[k++] = (char)(0x80 | (u & 0x3F)); }
+        else if (u < 0x10000) { o[k++] = (char)(0xE0 | u >> 12); o[k++] = (char)(0x80 | (u >> 6 & 0x3F)); o[k++] = (char)(0x80 | (u & 0x3F)); }
+        else { o[k++] = (char)(0xF0 | u >> 18); o[k++] = (char)(0x80 | (u >> 12 & 0x3F)); o[k++] = (char)(0x80 | (u >> 6 & 0x3F)); o[k++] = (char)(0x80 | (u & 0x3F)); }
+    }
+    return k;
+}
+
+/* Every path on one input against the references; 0 if all agree */
+static int enc_agree(const char* s, size_t n, unsigned short* w, unsigned short* wr, char* o, char* orf) {
+    int top = md_simd_select(MD_SIMD_AUTO), bad = 0;
+    int v = valid_ref(s, n);
+    size_t k = u8to16_ref(s, n, wr), b = u16to8_ref(wr, k, orf);
+    for (int lv = MD_SIMD_NONE; lv <= top; lv++) {
+        md_simd_select(lv);
+        if (md_utf8_valid(s, n) != v) bad = 1;
+        if (md_utf8_to_utf16(s, n, w) != k || memcmp(w, wr, k * 2) != 0) bad = 1;
+        if (md_utf16_to_utf8(wr, k, 0, o) != b || memcmp(o, orf, b) != 0) bad = 1;
+    }
+    md_simd_select(MD_SIMD_AUTO);
+    return bad;
+}
+
+/* Malformed and boundary sequences at every offset around the vector
+   widths, after ASCII or after a multi-byte character, then random
+   strings over the bytes that matter */
+static int enc_edges(void) {
+    static const char* cases[] = {
+        "\xC0\x80", "\xC1\xBF", "\xE0\x80\x80", "\xE0\x9F\xBF", "\xED\xA0\x80", "\xED\xBF\xBF", "\xF0\x80\x80\x80",
+        "\xF0\x8F\xBF\xBF", "\xF4\x90\x80\x80", "\xF5\x80\x80\x80", "\xF8\x88\x80\x80\x80", "\xFF", "\x80", "\xBF\x80",
+        "\xC2", "\xE2\x82", "\xF0\x9F\x98", "\xC2\x41", "\xE2\x41\x82", "\xC2\xA9", "\xE2\x82\xAC", "\xED\x9F\xBF",
+        "\xEE\x80\x80", "\xF0\x9F\x98\x80", "\xF4\x8F\xBF\xBF", "\xE2\x82\xAC\xF0\x9F\x98\x80\xC2\xA9"
+    };
+    static const unsigned char alpha[] = { 'a', ' ', 0x80, 0x8F, 0x90, 0x9F, 0xA0, 0xBF, 0xC0, 0xC2, 0xDF, 0xE0, 0xE2, 0xED, 0xEF, 0xF0, 0xF4, 0xF5, 0xFF };
+    char s[160], o[480], orf[480]; unsigned short w[160], wr[160];
+    int bad = 0, tried = 0;
+    for (size_t c = 0; c < sizeof(cases)/sizeof(cases[0]); c++)
+        for (int lead = 0; lead < 2; lead++)
+            for (int off = 0; off < 70; off++)
+                for (int tail = 0; tail < 40; tail += 13) {
+                    size_t cl = strlen(cases[c]), n = 0;
+                    memset(s, 'a', sizeof(s));
+                    if (lead) memcpy(s, "\xC3\xA9", 2);
+                    memcpy(s + off + 2, cases[c], cl); n = (size_t)off + 2 + cl + (size_t)tail;
+                    if (enc_agree(s, n, w, wr, o, orf)) { if (!bad++) fprintf(stderr, "mdview-bench: encoding paths disagree on case %zu at offset %d\n", c, off); }
+                    tried++;
+                }
+    rnd_reset();
+    for (int r = 0; r < 200000; r++) {
+        size_t n = 1 + rnd() % 150;
+        for (size_t i = 0; i < n; i++) s[i] = (char)(rnd() % 4 ? alpha[rnd() % sizeof(alpha)] : 0x80 + rnd() % 128);
+        if (enc_agree(s, n, w, wr, o, orf)) { if (!bad++) fprintf(stderr, "mdview-bench: encoding paths disagree on random input %d\n", r); }
+        tried++;
+    }
+    printf("\n%-22s %d inputs, %d disagreeing\n", "encoding edge cases", tried, bad);
+    return bad ? 1 : 0;
+}
+
+/* One transcoder timed per path, checked against the reference output */
+typedef size_t (*EncFn)(const void* in, size_t n, void* out, int be);
+static size_t enc_u8to16(const void* in, size_t n, void* out, int be) { (void)be; return md_utf8_to_utf16((const char*)in, n, (unsigned short*)out); }
+static size_t enc_u16to8(const void* in, size_t n, void* out, int be) { return md_utf16_to_utf8(in, n, be, (char*)out); }
+static size_t enc_valid(const void* in, size_t n, void* out, int be) { (void)out; (void)be; return (size_t)md_utf8_valid((const char*)in, n); }
+
+static int enc_time(const char* doc, const char* kernel, EncFn fn, const void* in, size_t n, int be, void* out,
+                    const void* ref, size_t refLen, size_t unit, double base, double mb, int runs) {
+    static const char* names[] = { "scalar", "sse2", "avx2" };
+    int top = md_simd_select(MD_SIMD_AUTO), bad = 0;
+    for (int lv = MD_SIMD_NONE; lv <= top; lv++) {
+        md_simd_select(lv);
+        double best = 0; size_t got = 0;
+        for (int r = 0; r < runs; r++) {
+            double t0 = now_sec();
+            got = fn(in, n, out, be);
+            double dt = now_sec() - t0;
+            if (r == 0 || dt < best) best = dt;
+        }
+        if (got != refLen || (unit && memcmp(out, ref, refLen * unit) != 0)) { bad++; fprintf(stderr, "mdview-bench: %s: %s %s differs from the reference\n", doc, kernel, names[lv]); }
+        printf("%-22s %-9s %-7s %10.3f %9.1f %7.2fx\n", doc, kernel, names[lv], best * 1e3, best > 0 ? mb / best : 0.0, best > 0 ? base / best : 0.0);
+    }
+    md_simd_select(MD_SIMD_AUTO);
+    return bad;
+}
+
+static int enc_check(Doc* docs, int ndocs, int runs) {
+    int bad = enc_edges();
+    printf("\n%-22s %-9s %-7s %10s %9s %8s\n", "encoding", "kernel", "path", "best ms", "MB/s", "speedup");
+    for (int k = 0; k < ndocs; k++) {
+        const Doc* d = &docs[k];
+        double mb = (double)d->len / (1024.0 * 1024.0), t0, base;
+        unsigned short* w16 = (unsigned short*)malloc(d->len * 2 + 4);
+        unsigned short* r16 = (unsigned short*)malloc(d->len * 2 + 4);
+        char* be = (char*)malloc(d->len * 2 + 4);
+        char* out8 = (char*)malloc(d->len * 3 + 4);
+        if (!w16 || !r16 || !be || !out8) { free(w16); free(r16); free(be); free(out8); return 1; }
+
+        t0 = now_sec(); int v = valid_ref(d->md, d->len); base = now_sec() - t0;
+        printf("%-22s %-9s %-7s %10.3f %9.1f\n", d->name, "validate", "ref", base * 1e3, base > 0 ? mb / base : 0.0);
+        bad += enc_time(d->name, "validate", enc_valid, d->md, d->len, 0, NULL, NULL, (size_t)v, 0, base, mb, runs);
+
+        t0 = now_sec(); size_t n16 = u8to16_ref(d->md, d->len, r16); base = now_sec() - t0;
+        printf("%-22s %-9s %-7s %10.3f %9.1f\n", d->name, "to utf16", "ref", base * 1e3, base > 0 ? mb / base : 0.0);
+        bad += enc_time(d->name, "to utf16", enc_u8to16, d->md, d->len, 0, w16, r16, n16, 2, base, mb, runs);
+
+        t0 = now_sec(); size_t n8 = u16to8_ref(r16, n16, out8); base = now_sec() - t0;
+        if (n8 != d->len || memcmp(out8, d->md, n8) != 0) { bad++; fprintf(stderr, "mdview-bench: %s: UTF-16 round trip differs\n", d->name); }
+        printf("%-22s %-9s %-7s %10.3f %9.1f\n", d->name, "to utf8", "ref", base * 1e3, base > 0 ? mb / base : 0.0);
+        bad += enc_time(d->name, "to utf8", enc_u16to8, r16, n16, 0, out8, d->md, d->len, 1, base, mb, runs);
+        for (size_t i = 0; i < n16; i++) { be[2*i] = (char)(r16[i] >> 8); be[2*i+1] = (char)r16[i]; }
+        bad += enc_time(d->name, "BE to 8", enc_u16to8, be, n16, 1, out8, d->md, d->len, 1, base, mb, runs);
+
+        /* Whole files as mdsource gets them: UTF-16LE with a BOM, BE without */
+        for (int f = 0; f < 2; f++) {
+            MdSource src; memset(&src, 0, sizeof(src));
+            size_t bl = f ? 0 : 2, n = bl + n16 * 2;
+            char* raw = (char*)malloc(n + 1);
+            if (!raw) { bad++; continue; }
+            if (bl) { raw[0] = (char)0xFF; raw[1] = (char)0xFE; }
+            if (f) memcpy(raw, be, n16 * 2); else memcpy(raw + bl, r16, n16 * 2);
+            src.base = raw; src.size = n;
+            t0 = now_sec();
+            int rc = md_source_text(&src, NULL);
+            double dt = now_sec() - t0;
+            if (rc || src.encoding != (f ? MD_ENC_UTF16BE : MD_ENC_UTF16LE) || src.len != d->len || memcmp(src.data, d->md, d->len) != 0) {
+                bad++; fprintf(stderr, "mdview-bench: %s: %s source not detected or transcoded back\n", d->name, f ? "UTF-16BE" : "UTF-16LE");
+            }
+            printf("%-22s %-9s %-7s %10.3f %9.1f\n", d->name, f ? "BE file" : "LE+BOM", "source", dt * 1e3, dt > 0 ? mb / dt : 0.0);
+            md_source_close(&src);
+        }
+        size_t bom;
+        if (md_encoding_detect(d->md, d->len, &bom) != MD_ENC_UTF8) { bad++; fprintf(stderr, "mdview-bench: %s: UTF-8 not detected\n", d->name); }
+        free(w16); free(r16); free(be); free(out8);
+    }
+    return bad ? 1 : 0;
+}
+
+/* ── Grammars ────────────────────────────────────────────────────────── */
+
+/* Random lines of the bits grammars key on: words, numbers, quotes and
+   escapes, comment and bracket marks */
+static const char* GR_BITS[] = {
+    "key", "value", "fun", "true", "null", "0x1F", "3.14", "1e9", "2026-10-17", "12:30:00",
+    "\"s\"", "'c'", "\"", "'", "\"\"\"", "'''", "\\", "#", "//", "/*", "*/", "--",
+    "=", ":", "[", "]", "[[", "{", "}", "(", ")", "-", ".", ",", "$x", "@A", " ", "  ", "\t"
+};
+#define NGRBITS (int)(sizeof(GR_BITS)/sizeof(GR_BITS[0]))
+
+/* Units that walk the DFA far past a token or open a span never closed,
+   repeated into one long line each: the lexer must stay linear in them */
+static const char* GR_LONG[] = { "a.", "a-", "a ", "0.", "\"\\", "'\\", "[a", "/*a" };
+#define NGRLONG (int)(sizeof(GR_LONG)/sizeof(GR_LONG[0]))
+
+static int str_cmp(const void* a, const void* b) { return strcmp(*(char* const*)a, *(char* const*)b); }
+
+static void gr_fence(StrBuf* sb, const char* lang) { sb_append(sb, "```"); sb_append(sb, lang); sb_append(sb, "\n"); }
+
+static void gr_long(StrBuf* sb, const char* lang, size_t lineLen) {
+    gr_fence(sb, lang);
+    for (int u = 0; u < NGRLONG; u++) {
+        size_t ul = strlen(GR_LONG[u]);
+        for (size_t n = 0; n + ul <= lineLen; n += ul) sb_append_n(sb, GR_LONG[u], ul);
+        sb_append(sb, "\n");
+    }
+    sb_append(sb, "```\n");
+}
+
+static char* render_with(MdGrammar* const* gs, int n, const char* md, size_t len, int runs, double* best) {
+    MdOptions o; md_options_default(&o); o.grammars = gs; o.grammarCount = n;
+    MdContext* cx = md_context_new(&o);
+    Doc d; memset(&d, 0, sizeof(d)); d.md = (char*)md; d.len = len;
+    char* html = NULL;
+    double t = cx ? time_render(cx, &d, runs, &html) : 0;
+    if (best) *best = t;
+    md_context_free(cx);
+    return html;
+}
+
+/* Every *.lang of `dir`: compile it, take the tables through save and
+   load (saving again must give the same bytes), render a sample with
+   both, and time lines built to rescan; then load the directory twice
+   through a cache, the second time without compiling anything */
+static int grammar_check(const char* dir, int runs) {
+    enum { GR_LINE = 32 * 1024, GR_MAX = 64 };
+    int bad = 0, n = 0;
+    char* names[GR_MAX]; MdGrammar* comp[GR_MAX]; MdGrammar* back[GR_MAX];
+    DIR* dp = opendir(dir);
+    if (!dp) { fprintf(stderr, "mdview-bench: cannot read grammar directory %s\n", dir); return 1; }
+    struct dirent* e;
+    while (n < GR_MAX && (e = readdir(dp)) != NULL) {
+        size_t nl = strlen(e->d_name);
+        if (nl > 5 && strcmp(e->d_name + nl - 5, ".lang") == 0) names[n++] = strdup(e->d_name);
+    }
+    closedir(dp);
+    if (n) qsort(names, (size_t)n, sizeof(char*), str_cmp);
+
+    printf("\n%-22s %10s %10s %10s %10s %10s %10s %10s\n", "grammar", "compile ms", "tables KB", "load ms", "render ms", "32K line", "128K line", "growth");
+    StrBuf all; sb_init(&all);
+    for (int k = 0; k < n; k++) {
+        char path[1024], err[256] = "", lang[64] = "";
+        snprintf(path, sizeof(path), "%s/%s", dir, names[k]);
+        size_t len = 0; char* text = slurp(path, &len);
+        comp[k] = back[k] = NULL;
+        if (!text) { bad++; fprintf(stderr, "mdview-bench: cannot read %s\n", path); continue; }
+        const char* nm = strstr(text, "\nnames");   /* the first name tags the fences */
+        if (nm && (nm = strchr(nm, '=')) != NULL) sscanf(nm + 1, "%63s", lang);
+
+        double tc = 0, tl = 0, t0;
+        for (int r = 0; r < runs; r++) {
+            if (comp[k]) md_grammar_free(comp[k]);
+            t0 = now_sec(); comp[k] = md_grammar_compile(text, len, err, sizeof(err)); t0 = now_sec() - t0;
+            if (r == 0 || t0 < tc) tc = t0;
+        }
+        free(text);
+        if (!comp[k] || !lang[0]) { bad++; fprintf(stderr, "mdview-bench: %s: %s\n", names[k], comp[k] ? "no names line" : err); continue; }
+        StrBuf a, b; sb_init(&a); sb_init(&b);
+        md_grammar_save(comp[k], &a);
+        for (int r = 0; r < runs; r++) {
+            if (back[k]) md_grammar_free(back[k]);
+            t0 = now_sec(); back[k] = md_grammar_load(a.data, a.len); t0 = now_sec() - t0;
+            if (r == 0 || t0 < tl) tl = t0;
+        }
+        if (back[k]) md_grammar_save(back[k], &b);
+        if (!back[k] || a.len != b.len || memcmp(a.data, b.data, a.len) != 0) { bad++; fprintf(stderr, "mdview-bench: %s: tables do not survive save and load\n", names[k]); }
+
+        StrBuf md; sb_init(&md); rnd_reset();
+        for (int blk = 0; blk < 200; blk++) {
+            gr_fence(&md, lang);
+            for (int line = 0; line < 10; line++) {
+                int bits = 1 + (int)(rnd() % 12);
+                for (int i = 0; i < bits; i++) sb_append(&md, GR_BITS[rnd() % NGRBITS]);
+                sb_append(&md, "\n");
+            }
+            sb_append(&md, "```\n\n");
+        }
+        sb_append_n(&all, md.data, md.len);
+        double tr = 0;
+        char* h1 = render_with(&comp[k], 1, md.data, md.len, runs, &tr);
+        char* h2 = back[k] ? render_with(&back[k], 1, md.data, md.len, 1, NULL) : NULL;
+        if (!h1 || !h2 || strcmp(h1, h2) != 0 || !strstr(h1, "<span class=\"")) { bad++; fprintf(stderr, "mdview-bench: %s: loaded tables render differently\n", names[k]); }
+        free(h1); free(h2);
+
+        /* A quarter of the line is its cost over four when the lexer is linear, over sixteen when it rescans */
+        double tq = 0, tf = 0;
+        md.len = 0; gr_long(&md, lang, GR_LINE);
+        free(render_with(&comp[k], 1, md.data, md.len, runs, &tq));
+        md.len = 0; gr_long(&md, lang, GR_LINE * 4);
+        free(render_with(&comp[k], 1, md.data, md.len, runs, &tf));
+        double growth = tq > 0 ? tf / tq : 0;
+        if (growth > 8 && tf > 0.005) { bad++; fprintf(stderr, "mdview-bench: %s: long lines take %.1fx the time at 4x the length\n", names[k], growth); }
+        printf("%-22s %10.3f %10.1f %10.3f %10.3f %10.3f %10.3f %9.1fx\n", names[k], tc * 1e3, a.len / 1024.0, tl * 1e3, tr * 1e3, tq * 1e3, tf * 1e3, growth);
+        free(a.data); free(b.data); free(md.data);
+    }
+
+    /* grammars.cache: a first load compiles every file, a second one reads them all back */
+    char tmp[] = "/tmp/mdview-bench-XXXXXX", cache[64];
+    if (mkdtemp(tmp)) {
+        snprintf(cache, sizeof(cache), "%s/grammars.cache", tmp);
+        MdGrammars g1, g2;
+        double t0 = now_sec(); int r1 = md_grammars_load(&g1, dir, cache); double t1 = now_sec() - t0;
+        t0 = now_sec(); int r2 = md_grammars_load(&g2, dir, cache); double t2 = now_sec() - t0;
+        if (r1 || r2 || g1.count != n || g1.compiled != n || g2.count != n || g2.cached != n || g2.compiled || g1.stamp != g2.stamp) {
+            bad++; fprintf(stderr, "mdview-bench: cache: first load compiled %d, second compiled %d and cached %d of %d\n", g1.compiled, g2.compiled, g2.cached, n);
+        }
+        if (!bad) {   /* all compiled, so the sample has every language */
+            char* h0 = render_with(comp, n, all.data, all.len, 1, NULL);
+            char* h2 = render_with(g2.items, g2.count, all.data, all.len, 1, NULL);
+            if (!h0 || !h2 || strcmp(h0, h2) != 0) { bad++; fprintf(stderr, "mdview-bench: cache: cached grammars render differently\n"); }
+            free(h0); free(h2);
+        }
+        printf("%-22s %10.3f %10s %10.3f\n", "grammars.cache", t1 * 1e3, "", t2 * 1e3);
+        md_grammars_free(&g1); md_grammars_free(&g2);
+        remove(cache); rmdir(tmp);
+    } else { bad++; fprintf(stderr, "mdview-bench: cannot make a directory for the grammar cache\n"); }
+
+    for (int k = 0; k < n; k++) { md_grammar_free(comp[k]); md_grammar_free(back[k]); free(names[k]); }
+    free(all.data);
+    return bad ? 1 : 0;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: mdview-bench [-s 1,10,50,200] [-c prose,table,nested,deep,inline,code,links,intl] [-n runs] [-f dir] [-w dir] [-t threads] [-m] [-k] [-i dir] [-v] [-x] [-l] [-r] [-u] [-g dir]\n");
+}
+
+int main(int argc, char** argv) {
+    const char* sizes = "1,10"; const char* shapes = NULL;
+    const char* fixDir = "."; const char* writeDir = NULL;
+    int runs = 3, threads = 0, simd = 0, sink = 0, sections = 0, finds = 0, maps = 0, diffs = 0, enc = 0;
+    const char* inputDir = NULL; const char* gramDir = NULL;
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "-s") == 0 && a + 1 < argc) sizes = argv[++a];
+        else if (strcmp(argv[a], "-c") == 0 && a + 1 < argc) shapes = argv[++a];
+        else if (strcmp(argv[a], "-n") == 0 && a + 1 < argc) { runs = atoi(argv[++a]); if (runs < 1) runs = 1; }
+        else if (strcmp(argv[a], "-f") == 0 && a + 1 < argc) fixDir = argv[++a];
+        else if (strcmp(argv[a], "-w") == 0 && a + 1 < argc) writeDir = argv[++a];
+        else if (strcmp(argv[a], "-t") == 0 && a + 1 < argc) threads = atoi(argv[++a]);
+        else if (strcmp(argv[a], "-m") == 0) simd = 1;
+        else if (strcmp(argv[a], "-k") == 0) sink = 1;
+        else if (strcmp(argv[a], "-v") == 0) sections = 1;
+        else if (strcmp(argv[a], "-x") == 0) finds = 1;
+        else if (strcmp(argv[a], "-l") == 0) maps = 1;
+        else if (strcmp(argv[a], "-r") == 0) diffs = 1;
+        else if (strcmp(argv[a], "-u") == 0) enc = 1;
+        else if (strcmp(argv[a], "-i") == 0 && a + 1 < argc) inputDir = argv[++a];
+        else if (strcmp(argv[a], "-g") == 0 && a + 1 < argc) gramDir = argv[++a];
+        else { usage(); return 2; }
+    }
+
+    printf("%-22s %9s %10s %9s %10s %10s %10s %10s %7s %9s\n",
+           "corpus", "in MB", "best ms", "MB/s", "allocs", "ctx ms", "ctx allocs", "peak heap", "out/in", "max RSS");
+
+    /* Every corpus is kept for the concurrency check */
+    Doc docs[64]; int ndocs = 0;
+
+    /* Fixed fixtures */
+    static const char* fixtures[] = { "test.md", "markdown_en.md" };
+    for (int f = 0; f < 2; f++) {
+        char path[1024]; snprintf(path, sizeof(path), "%s/%s", fixDir, fixtures[f]);
+        size_t len = 0; char* md = slurp(path, &len);
+        if (!md) { fprintf(stderr, "mdview-bench: fixture %s not found (use -f)\n", path); continue; }
+        bench_one(fixtures[f], md, len, runs);
+        Doc* d = &docs[ndocs++]; snprintf(d->name, sizeof(d->name), "%s", fixtures[f]); d->md = md; d->len = len;
+    }
+
+    /* Synthetic corpora */
+    for (int s = 0; s < NSHAPES; s++) {
+        if (!in_list(shapes, SHAPES[s].name)) continue;
+        for (const char* p = sizes; *p; ) {
+            int mbs = atoi(p);
+            if (mbs > 0) {
+                StrBuf sb; sb_init(&sb); rnd_reset();
+                SHAPES[s].gen(&sb, (size_t)mbs * 1024 * 1024);
+                char name[64]; snprintf(name, sizeof(name), "%s-%dmb", SHAPES[s].name, mbs);
+                if (writeDir) {
+                    char path[1024]; snprintf(path, sizeof(path), "%s/%s.md", writeDir, name);
+                    FILE* wf = fopen(path, "wb");
+                    if (wf) { fwrite(sb.data, 1, sb.len, wf); fclose(wf); }
+                    else fprintf(stderr, "mdview-bench: cannot write %s\n", path);
+                }
+                bench_one(name, sb.data, sb.len, runs);
+                if (ndocs < 64) { Doc* d = &docs[ndocs++]; snprintf(d->name, sizeof(d->name), "%s", name); d->md = sb.data; d->len = sb.len; }
+                else free(sb.data);
+            }
+            const char* c = strchr(p, ','); if (!c) break; p = c + 1;
+        }
+    }
+
+    int rc = 0;
+    if (simd && ndocs > 0) rc |= simd_paths(docs, ndocs, runs);
+    if (sink && ndocs > 0) rc |= sink_check(docs, ndocs, runs);
+    if (inputDir && ndocs > 0) rc |= input_paths(docs, ndocs, runs, inputDir);
+    if (sections && ndocs > 0) rc |= section_check(docs, ndocs, runs);
+    if (finds && ndocs > 0) rc |= find_check(docs, ndocs, runs);
+    if (maps && ndocs > 0) rc |= map_check(docs, ndocs, runs);
+    if (diffs && ndocs > 0) rc |= doc_check(docs, ndocs, runs);
+    if (enc && ndocs > 0) rc |= enc_check(docs, ndocs, runs);
+    if (gramDir) rc |= grammar_check(gramDir, runs);
+    if (threads > 0 && ndocs > 0) rc |= stress(docs, ndocs, threads, runs);
+    for (int k = 0; k < ndocs; k++) free(docs[k].md);
+    return rc;
+}
@@ -0,0 +1,200 @@
+/*
+ * mdview-render - command-line front end for the MDView converter
+ * ================================================================
+ * Converts a Markdown file (or stdin) to the HTML fragment MDView shows
+ * inside #mdv-ct, so the converter can be profiled on any POSIX box.
+ *
+ * Usage:
+ *   mdview-render [-o out.html] [-n runs] [-t] [-s] [-g dir] [-c toc.html] [-C dir] [file.md | -]
+ *
+ *   -o FILE   write HTML to FILE instead of stdout
+ *   -n RUNS   convert RUNS times (output of the last run is written)
+ *   -t        print read / convert timing to stderr
+ *   -s        stream the HTML to the output through a file sink instead
+ *             of building it in memory (timing then includes the write;
+ *             with -n, all but the last run go to a discarding sink)
+ *   -g DIR    highlight with the grammars in DIR too (cache: DIR/grammars.cache)
+ *   -c FILE   also write the table of contents MDView puts in #mdv-toc
+ *   -C DIR    render cache (mdcache.c) in DIR, 64 MB: an unchanged file
+ *             is copied from it to -o instead of converted (needs a file
+ *             and -o, not -c); -t adds the cache's counts
+ *
+ * Files are memory-mapped (mdsource.c); stdin is read into the heap.
+ * UTF-16 (BOM or not) and legacy 8-bit input is transcoded to UTF-8
+ * first (Windows-1252 for the latter).
+ *
+ * Build:
+ *   gcc -O2 -o mdview-render mdview-render.c mdcore.c mdsource.c mdgrammar.c mdcache.c
+ *
+ * (c) 2026 - MIT License
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "mdcore.h"
+#include "mdsource.h"
+#include "mdgrammar.h"
+#include "mdcache.h"
+
+static double now_sec(void) {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int discard_write(MdSink* s, const char* data, size_t len) { (void)s; (void)data; (void)len; return 0; }
+
+static int write_toc(const char* path, const MdOutline* o) {
+    StrBuf sb; sb_init(&sb);
+    md_outline_toc(o, 4, &sb);
+    FILE* f = fopen(path, "wb");
+    if (f) { fwrite(sb.data, 1, sb.len, f); fclose(f); }
+    free(sb.data);
+    if (!f) { fprintf(stderr, "mdview-render: cannot create %s\n", path); return 1; }
+    return 0;
+}
+
+#define CACHE_BUDGET (64LL * 1024 * 1024)
+
+/* After a miss: keep the output just written, and report */
+static void cache_keep(const char* dir, const MdCacheKey* k, const char* page, int timing) {
+    int rc = md_cache_store(dir, k, page, CACHE_BUDGET);
+    if (!timing) return;
+    MdCacheStats st; md_cache_stats(dir, &st);
+    fprintf(stderr, "cache:   miss, %s (%lld hits, %lld misses, %lld stores, %lld evictions)\n",
+            rc ? "not stored" : "stored", st.hits, st.misses, st.stores, st.evictions);
+}
+
+static const char* const k_encNames[] = { "UTF-8", "UTF-16LE", "UTF-16BE", "Windows-1252" };
+
+static void usage(void) {
+    fprintf(stderr, "usage: mdview-render [-o out.html] [-n runs] [-t] [-s] [-g dir] [-c toc.html] [-C dir] [file.md | -]\n");
+}
+
+int main(int argc, char** argv) {
+    const char* inPath = NULL; const char* outPath = NULL; const char* gramDir = NULL;
+    const char* tocPath = NULL; const char* cacheDir = NULL;
+    int runs = 1, timing = 0, stream = 0;
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "-o") == 0 && a + 1 < argc) outPath = argv[++a];
+        else if (strcmp(argv[a], "-n") == 0 && a + 1 < argc) { runs = atoi(argv[++a]); if (runs < 1) runs = 1; }
+        else if (strcmp(argv[a], "-g") == 0 && a + 1 < argc) gramDir = argv[++a];
+        else if (strcmp(argv[a], "-c") == 0 && a + 1 < argc) tocPath = argv[++a];
+        else if (strcmp(argv[a], "-C") == 0 && a + 1 < argc) cacheDir = argv[++a];
+        else if (strcmp(argv[a], "-t") == 0) timing = 1;
+        else if (strcmp(argv[a], "-s") == 0) stream = 1;
+        else if (strcmp(argv[a], "-h") == 0 || strcmp(argv[a], "--help") == 0) { usage(); return 0; }
+        else if (argv[a][0] == '-' && argv[a][1] != '\0') { usage(); return 2; }
+        else if (!inPath) inPath = argv[a];
+        else { usage(); return 2; }
+    }
+    if (cacheDir && (!inPath || strcmp(inPath, "-") == 0 || !outPath || tocPath)) { usage(); return 2; }
+
+    double t0 = now_sec();
+    MdSource src;
+    if (!inPath || strcmp(inPath, "-") == 0) {
+        if (md_source_read(&src, stdin)) { fprintf(stderr, "mdview-render: cannot read stdin\n"); return 1; }
+    } else if (md_source_open(&src, inPath)) { fprintf(stderr, "mdview-render: cannot open %s\n", inPath); return 1; }
+    if (md_source_text(&src, NULL)) { fprintf(stderr, "mdview-render: out of memory\n"); md_source_close(&src); return 1; }
+    const char* md = src.data; size_t mdLen = src.len;
+    double t1 = now_sec();
+
+    MdOptions opts; md_options_default(&opts);
+    MdGrammars gram = {0};
+    if (gramDir) {
+        char cache[4096];
+        snprintf(cache, sizeof(cache), "%s/grammars.cache", gramDir);
+        double g0 = now_sec();
+        if (md_grammars_load(&gram, gramDir, cache)) { fprintf(stderr, "mdview-render: cannot read %s\n", gramDir); md_source_close(&src); return 1; }
+        if (gram.error[0]) fprintf(stderr, "mdview-render: %s\n", gram.error);
+        if (timing) fprintf(stderr, "grammars: %d (%d compiled, %d cached) in %.3f ms\n", gram.count, gram.compiled, gram.cached, (now_sec() - g0) * 1e3);
+        opts.grammars = gram.items; opts.grammarCount = gram.count;
+    }
+
+    /* The options are the defaults, so only the grammars vary the output */
+    MdCacheKey key;
+    if (cacheDir) {
+        struct stat st;
+        if (stat(inPath, &st)) { fprintf(stderr, "mdview-render: cannot stat %s\n", inPath); md_grammars_free(&gram); md_source_close(&src); return 1; }
+        double k0 = now_sec();
+        md_cache_key(&key, inPath, strlen(inPath), (long long)st.st_size, (long long)st.st_mtime,
+                     md_hash64(md, mdLen, 0), gram.stamp, "mdview-render " __DATE__ " " __TIME__);
+        if (md_cache_fetch(cacheDir, &key, outPath)) {
+            if (timing) {
+                MdCacheStats cs; md_cache_stats(cacheDir, &cs);
+                fprintf(stderr, "cache:   hit in %.3f ms (%lld hits, %lld misses, %lld stores, %lld evictions)\n",
+                        (now_sec() - k0) * 1e3, cs.hits, cs.misses, cs.stores, cs.evictions);
+            }
+            md_grammars_free(&gram); md_source_close(&src);
+            return 0;
+        }
+    }
+
+    MdOutline outline = {0};
+    double best = 0, total = 0;
+    if (stream) {
+        FILE* out = outPath ? fopen(outPath, "wb") : stdout;
+        if (!out) { fprintf(stderr, "mdview-render: cannot create %s\n", outPath); md_source_close(&src); return 1; }
+        MdContext* cx = md_context_new(&opts);
+        if (cx && tocPath) md_context_set_outline(cx, &outline);
+        MdSink sink; md_sink_file(&sink, out);
+        MdSink null = { discard_write, NULL, 0, 0 };
+        int rc = 0;
+        for (int r = 0; r < runs && !rc; r++) {
+            double c0 = now_sec();
+            rc = md_render_to(cx, md, mdLen, r == runs - 1 ? &sink : &null);
+            double dt = now_sec() - c0;
+            total += dt; if (r == 0 || dt < best) best = dt;
+        }
+        md_context_free(cx);
+        if (out != stdout) fclose(out);
+        if (rc) { fprintf(stderr, "mdview-render: write failed\n"); md_grammars_free(&gram); md_source_close(&src); return 1; }
+        if (cacheDir) cache_keep(cacheDir, &key, outPath, timing);
+        if (timing) {
+            fprintf(stderr, "input:   %zu bytes (%s)\n", mdLen, k_encNames[src.encoding]);
+            fprintf(stderr, "load:    %.3f ms\n", (t1 - t0) * 1e3);
+            fprintf(stderr, "stream:  %.3f ms best, %.3f ms mean over %d run(s)\n", best * 1e3, total / runs * 1e3, runs);
+            if (best > 0) fprintf(stderr, "rate:    %.1f MB/s\n", (double)mdLen / (1024.0 * 1024.0) / best);
+        }
+        int trc = tocPath ? write_toc(tocPath, &outline) : 0;
+        md_outline_free(&outline); md_grammars_free(&gram); md_source_close(&src);
+        return trc;
+    }
+
+    char* html = NULL;
+    for (int r = 0; r < runs; r++) {
+        free(html);
+        double c0 = now_sec();
+        MdContext* cx = md_context_new(&opts);   /* a fresh one per run, like md_to_html_n */
+        if (cx && tocPath) md_context_set_outline(cx, &outline);
+        html = cx ? md_render(cx, md, mdLen) : NULL;
+        md_context_free(cx);
+        double dt = now_sec() - c0;
+        total += dt; if (r == 0 || dt < best) best = dt;
+        if (!html) { fprintf(stderr, "mdview-render: conversion failed\n"); md_grammars_free(&gram); md_source_close(&src); return 1; }
+    }
+
+    FILE* out = outPath ? fopen(outPath, "wb") : stdout;
+    if (!out) { fprintf(stderr, "mdview-render: cannot create %s\n", outPath); free(html); md_grammars_free(&gram); md_source_close(&src); return 1; }
+    size_t htmlLen = strlen(html);
+    fwrite(html, 1, htmlLen, out);
+    if (out != stdout) fclose(out);
+    if (cacheDir) cache_keep(cacheDir, &key, outPath, timing);
+
+    if (timing) {
+        double mb = (double)mdLen / (1024.0 * 1024.0);
+        fprintf(stderr, "input:   %zu bytes (%s)\n", mdLen, k_encNames[src.encoding]);
+        fprintf(stderr, "output:  %zu bytes\n", htmlLen);
+        fprintf(stderr, "load:    %.3f ms\n", (t1 - t0) * 1e3);
+        fprintf(stderr, "convert: %.3f ms best, %.3f ms mean over %d run(s)\n", best * 1e3, total / runs * 1e3, runs);
+        if (best > 0) fprintf(stderr, "rate:    %.1f MB/s\n", mb / best);
+    }
+    int trc = tocPath ? write_toc(tocPath, &outline) : 0;
+    free(html); md_outline_free(&outline); md_grammars_free(&gram); md_source_close(&src);
+    return trc;
+}
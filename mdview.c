@@ -2,6 +2,9 @@
  * MDView v2.3 - Total Commander Lister Plugin for Markdown
  * =========================================================
  * Lightweight WLX plugin: built-in Markdown->HTML, embedded MSHTML, zero deps.
+ * The converter itself lives in mdcore.c (portable, shared with the CLI tools);
+ * source files are memory-mapped by mdsource.c, finished pages cached by
+ * mdcache.c.
  *
  * Hotkeys:
  *   Ctrl+Plus/Minus/0  Zoom in / out / reset
@@ -47,11 +50,21 @@
 #include <string.h>
 #include <ctype.h>
 
+#include "mdcore.h"
+#include "mdsource.h"
+#include "mdgrammar.h"
+#include "mdcache.h"
+
 /* ── TC Lister Plugin Interface ──────────────────────────────────────── */
 
 #define LISTPLUGIN_OK    0
 #define LISTPLUGIN_ERROR 1
 
+#define lcs_findfirst    1
+#define lcs_matchcase    2
+#define lcs_wholewords   4
+#define lcs_backwards    8
+
 typedef struct {
     int   size;
     DWORD PluginInterfaceVersionLow;
@@ -60,10 +73,11 @@ typedef struct {
 } ListDefaultParamStruct;
 
 static LRESULT CALLBACK ContainerWndProc(HWND, UINT, WPARAM, LPARAM);
-static char* read_file_w(const WCHAR*);
-static char* md_to_html(const char*);
 static int   is_dark_theme(void);
-static void  navigate_to_html(IWebBrowser2*, const char*, const WCHAR*, WCHAR*);
+static MdContext* new_context(int fontSize);
+typedef struct PageParts PageParts;
+typedef struct Progressive Progressive;
+static int   navigate_to_html(IWebBrowser2*, const PageParts*, const WCHAR*, int);
 
 static const wchar_t CLASS_NAME[] = L"MDViewWLXContainer";
 static HINSTANCE g_hInstance = NULL;
@@ -82,7 +96,27 @@ typedef struct {
     HFONT         hTextFont;     /* Font for raw text view */
     int           splitView;     /* 0 = normal, 1 = split */
     int           syncGuard;     /* Recursion guard for scroll sync */
-    char*         mdUtf8;        /* Raw markdown (UTF-8), owned */
+    MdSource      src;           /* Raw markdown (UTF-8, mapped), owned; shared with the converter */
+    Progressive*  prog;          /* Background conversion of a large source, or NULL */
+    char*         html;          /* Virtualized mode: the whole converted body, or NULL */
+    MdSections    secs;          /* ... and its sections, served to the page one at a time */
+    MdOutline     outline;       /* Headings of the document, gathered while it converts */
+    MdText        text;          /* Find: text index, built on the first search (textState 1, -1 failed) */
+    int           textState;
+    MdMatches     finds;         /* ... and the matches of the last one */
+    size_t        findLen;
+    MdSourceMap   map;           /* Split view: source lines of the top-level blocks ... */
+    struct SyncPt* sync;         /* ... where the page last measured them */
+    int           syncCount, syncHeight;
+    LONG*         editLines;     /* Where each source line starts in the raw view */
+    int           editLineCount;
+    int           fontSize;      /* Body font size it was converted for (collapse thresholds) */
+    WCHAR         file[MAX_PATH]; /* Live reload: the file shown ... */
+    long long     stamp[2];      /* ... its size and write time when last read ... */
+    MdDoc         doc;           /* ... converted block by block ... */
+    int           docReady;      /* ... once it is (a page from the cache: at its first change) ... */
+    MdDocDiff     diff;          /* ... the last change, for the page to patch itself with */
+    struct Watch* watch;         /* ... and the thread waiting on its folder, or NULL */
 } MDViewData;
 
 /* Execute JavaScript on the browser document */
@@ -132,95 +166,177 @@ static void do_copy(MDViewData* d) {
     if (d->pBrowser) browser_execwb(d->pBrowser, OLECMDID_COPY);
 }
 
-static int get_document_title_utf8(IWebBrowser2* pB, char* out, int outsz) {
-    if (!pB || !out || outsz <= 0) return 0;
-    out[0] = '\0';
-    IDispatch* pDisp = NULL;
-    IWebBrowser2_get_Document(pB, &pDisp);
-    if (!pDisp) return 0;
-    IHTMLDocument2* pDoc = NULL;
-    IDispatch_QueryInterface(pDisp, &IID_IHTMLDocument2, (void**)&pDoc);
-    IDispatch_Release(pDisp);
-    if (!pDoc) return 0;
-    BSTR bTitle = NULL;
-    IHTMLDocument2_get_title(pDoc, &bTitle);
-    IHTMLDocument2_Release(pDoc);
-    if (!bTitle) return 0;
-    WideCharToMultiByte(CP_UTF8, 0, bTitle, -1, out, outsz, NULL, NULL);
-    SysFreeString(bTitle);
-    return 1;
+/* ── Split view scroll synchronisation (contributed by Nigurrath) ────── */
+
+/* Both panes are mapped through source lines. The converter's source map
+   gives each top-level block its lines; the page measures where those
+   blocks are (data-line elements, and the placeholders of sections not
+   filled in) once after every layout change and hands the list to
+   window.external.map. A scroll is then one COM read of the position and
+   a binary search, with no script run. */
+
+typedef struct SyncPt { int line, end, y; } SyncPt;   /* lines [line, end) are drawn from y */
+
+/* The source map, built the first time the split view opens */
+static int ensure_map(MDViewData* d) {
+    if (d->map.count) return 0;
+    MdContext* cx = new_context(d->fontSize);
+    int rc = cx ? md_source_map(cx, d->src.data, d->src.len, &d->map) : -1;
+    md_context_free(cx);
+    return rc;
 }
 
-/* ── Split view scroll synchronisation (contributed by Nigurrath) ────── */
+/* window.external.map("line,y;...;-1,height"): the measured blocks, in
+   page order. Each one's lines run to the end of the last block before
+   the next one measured, so they take in raw HTML, which has no mark,
+   and a placeholder takes all the blocks of its section. */
+static void view_map(MDViewData* d, const wchar_t* s) {
+    int n = 1;
+    for (const wchar_t* c = s; *c; c++) n += *c == L';';
+    SyncPt* pts = (SyncPt*)malloc((size_t)n * sizeof(SyncPt));
+    if (!pts) return;
+    int count = 0, height = 0;
+    while (*s) {
+        wchar_t* e; long line = wcstol(s, &e, 10);
+        long y = *e == L',' ? wcstol(e + 1, &e, 10) : 0;
+        if (line < 0) height = (int)y;
+        else if (!count || (line > pts[count-1].line && y >= pts[count-1].y)) {
+            pts[count].line = (int)line; pts[count].y = (int)y; count++;
+        }
+        s = wcschr(e, L';');
+        if (!s) break;
+        s++;
+    }
+    for (int i = 0; i < count; i++) {
+        int next = i + 1 < count ? pts[i+1].line : (d->map.count ? d->map.items[d->map.count-1].end : pts[i].line + 1);
+        int b = md_source_map_find(&d->map, next - 1);
+        pts[i].end = b >= 0 && d->map.items[b].end < next ? d->map.items[b].end : next;
+        if (pts[i].end <= pts[i].line) pts[i].end = pts[i].line + 1;
+    }
+    free(d->sync);
+    d->sync = pts; d->syncCount = count;
+    d->syncHeight = height > (count ? pts[count-1].y : 0) ? height : (count ? pts[count-1].y : 0);
+}
 
-static double get_html_scroll_ratio(MDViewData* d) {
-    if (!d || !d->pBrowser) return 0.0;
-    exec_js(d->pBrowser,
-        L"(function(){var de=document.documentElement,b=document.body;"
-        L"var st=(de&&de.scrollTop)||(b&&b.scrollTop)||0;"
-        L"var sh=Math.max((de&&de.scrollHeight)||0,(b&&b.scrollHeight)||0);"
-        L"var ih=window.innerHeight||(de&&de.clientHeight)||0;"
-        L"document.title=''+st+','+sh+','+ih;})();");
-    char t[128];
-    if (!get_document_title_utf8(d->pBrowser, t, (int)sizeof(t))) return 0.0;
-    double st=0, sh=0, ih=0;
-    if (sscanf(t, "%lf,%lf,%lf", &st, &sh, &ih) != 3) return 0.0;
-    double denom = sh - ih;
-    if (denom < 1.0) denom = 1.0;
-    double r = st / denom;
-    if (r < 0.0) r = 0.0; if (r > 1.0) r = 1.0;
-    return r;
+/* Source line at page position y, with the fraction of the way through it */
+static double sync_line_at(const MDViewData* d, double y) {
+    const SyncPt* p = d->sync; int n = d->syncCount;
+    if (!n) return 0.0;
+    if (y < p[0].y) return p[0].y > 0 ? p[0].line * y / p[0].y : 0.0;
+    int lo = 0, hi = n;   /* first block below y */
+    while (lo < hi) { int mid = (lo + hi) / 2; if (p[mid].y <= y) lo = mid + 1; else hi = mid; }
+    const SyncPt* b = &p[lo-1];
+    double y1 = lo < n ? p[lo].y : d->syncHeight;
+    double t = y1 > b->y ? (y - b->y) / (y1 - b->y) : 0.0;
+    if (t > 1.0) t = 1.0;
+    return b->line + t * (b->end - b->line);
 }
 
-static void set_html_scroll_ratio(MDViewData* d, double r) {
-    if (!d || !d->pBrowser) return;
-    if (r < 0.0) r = 0.0; if (r > 1.0) r = 1.0;
-    wchar_t js[256];
-    swprintf(js, 256,
-        L"(function(){var de=document.documentElement,b=document.body;"
-        L"var sh=Math.max((de&&de.scrollHeight)||0,(b&&b.scrollHeight)||0);"
-        L"var ih=window.innerHeight||(de&&de.clientHeight)||0;"
-        L"var y=(sh-ih)*%.6f; if(y<0)y=0; window.scrollTo(0,y);})();", r);
-    exec_js(d->pBrowser, js);
+/* ... and the page position of source line `line` */
+static double sync_y_at(const MDViewData* d, double line) {
+    const SyncPt* p = d->sync; int n = d->syncCount;
+    if (!n) return 0.0;
+    if (line < p[0].line) return p[0].line > 0 ? p[0].y * line / p[0].line : 0.0;
+    int lo = 0, hi = n;   /* first block starting past line */
+    while (lo < hi) { int mid = (lo + hi) / 2; if (p[mid].line <= line) lo = mid + 1; else hi = mid; }
+    const SyncPt* b = &p[lo-1];
+    double y1 = lo < n ? p[lo].y : d->syncHeight;
+    double t = (line - b->line) / (b->end - b->line);
+    if (t > 1.0) t = 1.0;   /* blank lines after the block: where the next one starts */
+    return b->y + t * (y1 - b->y);
 }
 
-static double get_edit_scroll_ratio(HWND hEdit) {
-    if (!hEdit) return 0.0;
-    SCROLLINFO si; ZeroMemory(&si, sizeof(si));
-    si.cbSize = sizeof(si); si.fMask = SIF_RANGE | SIF_PAGE | SIF_POS;
-    if (!GetScrollInfo(hEdit, SB_VERT, &si)) return 0.0;
-    int maxPos = (int)si.nMax - (int)si.nPage + 1;
-    if (maxPos < 1) return 0.0;
-    double r = (double)si.nPos / (double)maxPos;
-    if (r < 0.0) r = 0.0; if (r > 1.0) r = 1.0;
-    return r;
+/* The page's scroll position, straight from the document and body
+   elements (whichever one scrolls) */
+static int html_scroll_top(IWebBrowser2* pB) {
+    IDispatch* pD = NULL; IWebBrowser2_get_Document(pB, &pD); if (!pD) return 0;
+    IHTMLDocument2* pDoc = NULL; IDispatch_QueryInterface(pD, &IID_IHTMLDocument2, (void**)&pDoc);
+    IHTMLDocument3* pDoc3 = NULL; IDispatch_QueryInterface(pD, &IID_IHTMLDocument3, (void**)&pDoc3);
+    IDispatch_Release(pD);
+    IHTMLElement* el[2] = { NULL, NULL };
+    if (pDoc3) { IHTMLDocument3_get_documentElement(pDoc3, &el[0]); IHTMLDocument3_Release(pDoc3); }
+    if (pDoc) { IHTMLDocument2_get_body(pDoc, &el[1]); IHTMLDocument2_Release(pDoc); }
+    long top = 0;
+    for (int i = 0; i < 2; i++) {
+        if (!el[i]) continue;
+        IHTMLElement2* e2 = NULL; IHTMLElement_QueryInterface(el[i], &IID_IHTMLElement2, (void**)&e2);
+        long v = 0;
+        if (e2) { IHTMLElement2_get_scrollTop(e2, &v); IHTMLElement2_Release(e2); }
+        if (v > top) top = v;
+        IHTMLElement_Release(el[i]);
+    }
+    return (int)top;
 }
 
-static void set_edit_scroll_ratio(HWND hEdit, double r) {
-    if (!hEdit) return;
-    if (r < 0.0) r = 0.0; if (r > 1.0) r = 1.0;
-    SCROLLINFO si; ZeroMemory(&si, sizeof(si));
-    si.cbSize = sizeof(si); si.fMask = SIF_RANGE | SIF_PAGE | SIF_POS;
-    if (!GetScrollInfo(hEdit, SB_VERT, &si)) return;
-    int maxPos = (int)si.nMax - (int)si.nPage + 1;
-    if (maxPos < 1) return;
-    int target = (int)((double)maxPos * r + 0.5);
-    if (target < 0) target = 0; if (target > maxPos) target = maxPos;
-    SendMessageW(hEdit, WM_VSCROLL, MAKEWPARAM(SB_THUMBPOSITION, target), 0);
-    SendMessageW(hEdit, WM_VSCROLL, MAKEWPARAM(SB_THUMBTRACK, target), 0);
+static void html_scroll_to(IWebBrowser2* pB, int y) {
+    IDispatch* pD = NULL; IWebBrowser2_get_Document(pB, &pD); if (!pD) return;
+    IHTMLDocument2* pDoc = NULL; IDispatch_QueryInterface(pD, &IID_IHTMLDocument2, (void**)&pDoc); IDispatch_Release(pD);
+    if (!pDoc) return;
+    IHTMLWindow2* pWin = NULL; IHTMLDocument2_get_parentWindow(pDoc, &pWin); IHTMLDocument2_Release(pDoc);
+    if (!pWin) return;
+    IHTMLWindow2_scrollTo(pWin, 0, y);
+    IHTMLWindow2_Release(pWin);
+}
+
+/* Where each source line starts in the raw view's text, in UTF-16 units:
+   RichEdit keeps a line break as one character */
+static void edit_lines(MDViewData* d) {
+    const char* s = d->src.data; size_t n = d->src.len;
+    int count = 1;
+    for (size_t i = 0; i < n; i++) count += s[i] == '\n';
+    d->editLines = (LONG*)malloc((size_t)count * sizeof(LONG));
+    if (!d->editLines) return;
+    LONG units = 0; int k = 0;
+    d->editLines[k++] = 0;
+    for (size_t i = 0; i < n; i++) {
+        unsigned char b = (unsigned char)s[i];
+        if (b == '\r' && i + 1 < n && s[i+1] == '\n') continue;
+        units += ((b & 0xC0) != 0x80) + (b >= 0xF0);
+        if (b == '\n') d->editLines[k++] = units;
+    }
+    d->editLineCount = k;
+}
+
+/* Display lines (after wrapping) of source line `line` in the raw view */
+static void edit_span(const MDViewData* d, int line, int* dl0, int* dl1) {
+    HWND h = d->hwndText;
+    *dl0 = (int)SendMessageW(h, EM_EXLINEFROMCHAR, 0, d->editLines[line]);
+    *dl1 = line + 1 < d->editLineCount ? (int)SendMessageW(h, EM_EXLINEFROMCHAR, 0, d->editLines[line+1])
+                                       : (int)SendMessageW(h, EM_GETLINECOUNT, 0, 0);
+}
+
+/* Source line at the top of the raw view */
+static double edit_top_line(const MDViewData* d) {
+    int first = (int)SendMessageW(d->hwndText, EM_GETFIRSTVISIBLELINE, 0, 0);
+    LONG ch = (LONG)SendMessageW(d->hwndText, EM_LINEINDEX, first, 0);
+    int lo = 0, hi = d->editLineCount;   /* first line starting past ch */
+    while (lo < hi) { int mid = (lo + hi) / 2; if (d->editLines[mid] <= ch) lo = mid + 1; else hi = mid; }
+    int line = lo > 0 ? lo - 1 : 0, dl0, dl1;
+    edit_span(d, line, &dl0, &dl1);
+    return line + (dl1 > dl0 ? (double)(first - dl0) / (dl1 - dl0) : 0.0);
+}
+
+static void edit_scroll_to_line(const MDViewData* d, double x) {
+    int line = (int)x, dl0, dl1;
+    if (line < 0) line = 0;
+    if (line >= d->editLineCount) line = d->editLineCount - 1;
+    edit_span(d, line, &dl0, &dl1);
+    int target = dl0 + (int)((x - line) * (dl1 - dl0) + 0.5);
+    int first = (int)SendMessageW(d->hwndText, EM_GETFIRSTVISIBLELINE, 0, 0);
+    if (target != first) SendMessageW(d->hwndText, EM_LINESCROLL, 0, target - first);
 }
 
 static void sync_html_to_edit(MDViewData* d) {
-    if (!d || !d->splitView || !d->hwndText || d->syncGuard) return;
+    if (!d || !d->splitView || !d->hwndText || d->syncGuard || !d->syncCount || !d->editLines) return;
     d->syncGuard = 1;
-    set_edit_scroll_ratio(d->hwndText, get_html_scroll_ratio(d));
+    edit_scroll_to_line(d, sync_line_at(d, html_scroll_top(d->pBrowser)));
     d->syncGuard = 0;
 }
 
 static void sync_edit_to_html(MDViewData* d) {
-    if (!d || !d->splitView || !d->hwndText || d->syncGuard) return;
+    if (!d || !d->splitView || !d->hwndText || d->syncGuard || !d->syncCount || !d->editLines) return;
     d->syncGuard = 1;
-    set_html_scroll_ratio(d, get_edit_scroll_ratio(d->hwndText));
+    html_scroll_to(d->pBrowser, (int)(sync_y_at(d, edit_top_line(d)) + 0.5));
     d->syncGuard = 0;
 }
 
@@ -260,13 +376,13 @@ static void toggle_split_view(MDViewData* d);
 
 /* ── RichEdit subclass for raw text pane (contributed by Nigurrath) ──── */
 
-static wchar_t* utf8_to_wide_dup(const char* s) {
-    if (!s) return NULL;
-    int wl = MultiByteToWideChar(CP_UTF8, 0, s, -1, NULL, 0);
-    if (wl <= 0) return NULL;
-    wchar_t* w = (wchar_t*)calloc((size_t)wl, sizeof(wchar_t));
+/* Counted input: the mapped source is not NUL-terminated. One pass into
+   a buffer of n units, which UTF-16 never exceeds. */
+static wchar_t* utf8_to_wide_dup(const char* s, size_t n) {
+    if (!s || n > 0x7FFFFFFF) return NULL;
+    wchar_t* w = (wchar_t*)malloc((n + 1) * sizeof(wchar_t));
     if (!w) return NULL;
-    MultiByteToWideChar(CP_UTF8, 0, s, -1, w, wl);
+    w[md_utf8_to_utf16(s, n, (unsigned short*)w)] = L'\0';
     return w;
 }
 
@@ -314,15 +430,19 @@ static void toggle_split_view(MDViewData* d) {
                 }
                 SendMessageW(hEdit, WM_SETFONT, (WPARAM)d->hTextFont, TRUE);
                 SendMessageW(hEdit, EM_SETMARGINS, EC_LEFTMARGIN|EC_RIGHTMARGIN, MAKELPARAM(10,10));
-                if (d->mdUtf8) {
-                    wchar_t* w = utf8_to_wide_dup(d->mdUtf8);
-                    if (w) { SetWindowTextW(hEdit, w); free(w); }
+                if (d->src.data) {
+                    wchar_t* w = utf8_to_wide_dup(d->src.data, d->src.len);
+                    if (w) { SetWindowTextW(hEdit, w); free(w); edit_lines(d); }
                 }
             }
         }
         d->splitView = 1;
     } else d->splitView = 0;
     layout_views(d);
+    /* The page measures its blocks now and after every layout change
+       while the split view is open */
+    if (d->splitView && d->hwndText && !ensure_map(d)) exec_js(d->pBrowser, L"sv=1;sm()");
+    else exec_js(d->pBrowser, L"sv=0");
     if (d->splitView && d->hwndText) sync_html_to_edit(d);
 }
 
@@ -462,6 +582,116 @@ static LRESULT CALLBACK IEServerSubclassProc(HWND hwnd, UINT msg, WPARAM wP, LPA
     }
 }
 
+/* ── Virtualized Sections ────────────────────────────────────────────── */
+
+/* Very large sources are converted once, up front, together with their
+   section index (md_render_sections). The page starts out as one empty
+   placeholder per section, sized from the converter's height estimate;
+   its script fetches the HTML of the sections near the viewport through
+   window.external and empties far ones again. The TOC and find work
+   from the index, so they still cover the whole document. */
+
+/* A BSTR's length is fixed when it is allocated: transcode in one pass
+   into scratch of the worst-case size, then copy the exact length */
+static BSTR utf8_to_bstr(const char* s, size_t n) {
+    if (n > 0x7FFFFFFF) return NULL;
+    wchar_t* w = (wchar_t*)malloc((n ? n : 1) * sizeof(wchar_t));
+    if (!w) return NULL;
+    BSTR b = SysAllocStringLen(w, (UINT)md_utf8_to_utf16(s, n, (unsigned short*)w));
+    free(w);
+    return b;
+}
+
+/* Placeholders, 1.7em per estimated line (the body line height), with
+   the first source line for scroll sync; the TOC entries carry their
+   section in data-s */
+static void build_virtual_body(StrBuf* sb, const MdSections* ss) {
+    char tmp[96];
+    for (int i = 0; i < ss->count; i++) {
+        int h = ss->items[i].height * 17;
+        sprintf(tmp, "<div class=\"mdv-sec\" data-sl=\"%d\" style=\"height:%d.%dem\"></div>", ss->items[i].line, h / 10, h % 10);
+        sb_append(sb, tmp);
+    }
+    sb_append(sb, "<script>var mdvVirtual=1;</script>");
+}
+
+/* window.external.sec(i) */
+static BSTR virtual_section(const MDViewData* d, int i) {
+    if (i < 0 || i >= d->secs.count) return NULL;
+    return utf8_to_bstr(d->html + d->secs.items[i].off, d->secs.items[i].len);
+}
+
+/* ── Find ──────────────────────────────────────────────────────────── */
+
+/* Find runs over the converter's text index of the document, not the
+   DOM: window.external.find counts the matches, and hits(from, to)
+   places each one in its top-level block (data-line) as a UTF-16 range
+   of that element's text, so the page marks only the ones it shows. The
+   index comes from converting the mapped source once more, with the
+   page's options, on the first search. */
+
+static int ensure_text(MDViewData* d) {
+    if (d->textState) return d->textState > 0 ? 0 : -1;
+    d->textState = -1;
+    MdContext* cx = new_context(d->fontSize);
+    if (!cx) return -1;
+    md_context_set_text(cx, &d->text);
+    char* html;
+    if (d->html) {   /* virtualized: the same cut, for the blocks' sections */
+        MdSections ss; memset(&ss, 0, sizeof(ss));
+        html = md_render_sections(cx, d->src.data, d->src.len, &ss);
+        md_sections_free(&ss);
+    } else html = md_render(cx, d->src.data, d->src.len);
+    md_context_free(cx);
+    if (html && !d->text.failed) d->textState = 1;
+    else md_text_free(&d->text);
+    free(html);
+    return d->textState > 0 ? 0 : -1;
+}
+
+/* window.external.find(text, flags): number of matches, -1 without an index */
+static int view_find(MDViewData* d, const wchar_t* needle, int flags) {
+    if (ensure_text(d)) return -1;
+    size_t wl = wcslen(needle);
+    char* nd = wl ? (char*)malloc(wl * 3) : NULL;
+    if (!nd) { d->finds.count = 0; return 0; }
+    size_t n = md_utf16_to_utf8(needle, wl, 0, nd);
+    int rc = md_text_find(&d->text, nd, n, flags, &d->finds);
+    free(nd);
+    d->findLen = n;
+    return rc ? -1 : (int)d->finds.count;
+}
+
+/* UTF-16 length of n bytes of UTF-8 */
+static size_t u16_len(const char* s, size_t n) {
+    size_t c = 0;
+    for (size_t i = 0; i < n; i++) { unsigned char b = (unsigned char)s[i]; c += (b & 0xC0) != 0x80; c += b >= 0xF0; }
+    return c;
+}
+
+/* window.external.hits(from, to): "line,section,start,end;..." for those
+   matches, start/end in UTF-16 units from the start of the block's text */
+static BSTR view_hits(const MDViewData* d, int from, int to) {
+    const MdText* t = &d->text;
+    if (d->textState <= 0 || from < 0 || to > (int)d->finds.count || from >= to) return NULL;
+    StrBuf out; sb_init(&out);
+    int pb = -1; size_t pos = 0, units = 0;   /* counted so far in block pb */
+    for (int i = from; i < to && out.data; i++) {
+        size_t at = d->finds.at[i];
+        int b = md_text_block(t, at);
+        if (b < 0) { sb_append(&out, i > from ? ";-1,-1,0,0" : "-1,-1,0,0"); continue; }
+        if (b != pb) { pb = b; pos = t->blocks[b].off; units = 0; }
+        units += u16_len(t->text.data + pos, at - pos); pos = at;
+        size_t len = u16_len(t->text.data + at, d->findLen);
+        char tmp[96];
+        sprintf(tmp, "%s%d,%d,%u,%u", i > from ? ";" : "", t->blocks[b].line, t->blocks[b].section, (unsigned)units, (unsigned)(units + len));
+        sb_append(&out, tmp);
+    }
+    BSTR r = out.data ? utf8_to_bstr(out.data, out.len) : NULL;
+    free(out.data);
+    return r;
+}
+
 /* ── Minimal COM Site Implementation ─────────────────────────────────── */
 
 typedef struct SiteImpl {
@@ -469,6 +699,7 @@ typedef struct SiteImpl {
     IOleInPlaceSite   inPlaceSite;
     IOleInPlaceFrame  inPlaceFrame;
     IDocHostUIHandler docHostUI;
+    IDispatch         external;   /* window.external */
     LONG              refCount;
     HWND              hwndParent;
 } SiteImpl;
@@ -477,6 +708,7 @@ typedef struct SiteImpl {
 #define SITE_FROM_INPLACE(p) ((SiteImpl*)((char*)(p) - offsetof(SiteImpl, inPlaceSite)))
 #define SITE_FROM_FRAME(p)   ((SiteImpl*)((char*)(p) - offsetof(SiteImpl, inPlaceFrame)))
 #define SITE_FROM_DOCHOST(p) ((SiteImpl*)((char*)(p) - offsetof(SiteImpl, docHostUI)))
+#define SITE_FROM_EXT(p)     ((SiteImpl*)((char*)(p) - offsetof(SiteImpl, external)))
 
 /* IOleClientSite */
 static HRESULT STDMETHODCALLTYPE CS_QI(IOleClientSite* This, REFIID riid, void** ppv) {
@@ -553,502 +785,74 @@ static HRESULT STDMETHODCALLTYPE DH_Resize(IDocHostUIHandler* This, LPCRECT r, I
 static HRESULT STDMETHODCALLTYPE DH_TransAccel(IDocHostUIHandler* This, LPMSG m, const GUID* g, DWORD d) { return S_FALSE; }
 static HRESULT STDMETHODCALLTYPE DH_OptKey(IDocHostUIHandler* This, LPOLESTR* p, DWORD d) { return E_NOTIMPL; }
 static HRESULT STDMETHODCALLTYPE DH_DropTgt(IDocHostUIHandler* This, IDropTarget* dt, IDropTarget** pdt) { return E_NOTIMPL; }
-static HRESULT STDMETHODCALLTYPE DH_GetExt(IDocHostUIHandler* This, IDispatch** ppd) { *ppd=NULL; return S_FALSE; }
+static HRESULT STDMETHODCALLTYPE DH_GetExt(IDocHostUIHandler* This, IDispatch** ppd) { *ppd=&SITE_FROM_DOCHOST(This)->external; IDispatch_AddRef(*ppd); return S_OK; }
 static HRESULT STDMETHODCALLTYPE DH_TransUrl(IDocHostUIHandler* This, DWORD d, LPWSTR url, LPWSTR* purl) { return S_FALSE; }
 static HRESULT STDMETHODCALLTYPE DH_FilterDO(IDocHostUIHandler* This, IDataObject* d, IDataObject** pd) { return S_FALSE; }
 static IDocHostUIHandlerVtbl g_dhVtbl = { DH_QI, DH_AddRef, DH_Release, DH_CtxMenu, DH_GetHostInfo, DH_ShowUI, DH_HideUI, DH_UpdateUI, DH_EnableMod, DH_OnDocAct, DH_OnFrmAct, DH_Resize, DH_TransAccel, DH_OptKey, DH_DropTgt, DH_GetExt, DH_TransUrl, DH_FilterDO };
 
-static SiteImpl* CreateSiteImpl(HWND hwnd) {
-    SiteImpl* s = (SiteImpl*)calloc(1, sizeof(SiteImpl));
-    if (!s) return NULL;
-    s->clientSite.lpVtbl = &g_csVtbl; s->inPlaceSite.lpVtbl = &g_ipsVtbl;
-    s->inPlaceFrame.lpVtbl = &g_ipfVtbl; s->docHostUI.lpVtbl = &g_dhVtbl;
-    s->refCount = 1; s->hwndParent = hwnd;
-    return s;
-}
-
-/* ── Reference Link Map ──────────────────────────────────────────────── */
-
-typedef struct { char label[128]; char url[1024]; char title[256]; } RefLink;
-typedef struct { RefLink* items; int count; int cap; } RefMap;
-
-static RefMap g_refs = {0};
-
-static void ref_clear(void) { free(g_refs.items); g_refs.items=NULL; g_refs.count=0; g_refs.cap=0; }
-
-static void ref_add(const char* label, const char* url, const char* title) {
-    if (g_refs.count >= g_refs.cap) {
-        g_refs.cap = g_refs.cap ? g_refs.cap*2 : 32;
-        g_refs.items = (RefLink*)realloc(g_refs.items, g_refs.cap * sizeof(RefLink));
-    }
-    RefLink* r = &g_refs.items[g_refs.count++];
-    /* Store label as lowercase for case-insensitive lookup */
-    int i; for(i=0; label[i] && i<127; i++) r->label[i] = (label[i]>='A'&&label[i]<='Z') ? label[i]+32 : label[i];
-    r->label[i] = '\0';
-    strncpy(r->url, url, 1023); r->url[1023]='\0';
-    strncpy(r->title, title, 255); r->title[255]='\0';
-}
-
-static RefLink* ref_find(const char* label) {
-    char lower[128];
-    int i; for(i=0; label[i] && i<127; i++) lower[i] = (label[i]>='A'&&label[i]<='Z') ? label[i]+32 : label[i];
-    lower[i] = '\0';
-    for(int j=0; j<g_refs.count; j++)
-        if(strcmp(g_refs.items[j].label, lower)==0) return &g_refs.items[j];
-    return NULL;
-}
-
-/* ── String Buffer ───────────────────────────────────────────────────── */
-
-typedef struct { char* data; size_t len; size_t cap; } StrBuf;
-
-static void sb_init(StrBuf* sb) { sb->cap=4096; sb->data=(char*)malloc(sb->cap); sb->data[0]='\0'; sb->len=0; }
-static void sb_ensure(StrBuf* sb, size_t x) { while(sb->len+x+1>sb->cap){sb->cap*=2; sb->data=(char*)realloc(sb->data,sb->cap);} }
-static void sb_append(StrBuf* sb, const char* s) { size_t n=strlen(s); sb_ensure(sb,n); memcpy(sb->data+sb->len,s,n); sb->len+=n; sb->data[sb->len]='\0'; }
-static void sb_append_char(StrBuf* sb, char c) { sb_ensure(sb,1); sb->data[sb->len++]=c; sb->data[sb->len]='\0'; }
-static void sb_append_esc(StrBuf* sb, const char* s, size_t n) {
-    for(size_t i=0;i<n;i++) switch(s[i]){
-        case '&': sb_append(sb,"&amp;"); break;
-        case '<': sb_append(sb,"&lt;"); break;
-        case '>': sb_append(sb,"&gt;"); break;
-        case '"': sb_append(sb,"&quot;"); break;
-        default:  sb_append_char(sb,s[i]); break;
-    }
+/* IDispatch: window.external, for the page to fetch sections, find,
+   report where its blocks are and patch itself after a reload */
+enum { EXT_SEC = 1, EXT_FIND = 2, EXT_HITS = 3, EXT_MAP = 4, EXT_PATCH = 5 };
+static BSTR live_patch(const MDViewData* d, int i);
+static HRESULT STDMETHODCALLTYPE EX_QI(IDispatch* This, REFIID riid, void** ppv) {
+    if (IsEqualIID(riid, &IID_IUnknown) || IsEqualIID(riid, &IID_IDispatch)) { *ppv = This; IDispatch_AddRef(This); return S_OK; }
+    *ppv = NULL; return E_NOINTERFACE;
 }
-
-/* ── Markdown Inline Parser ──────────────────────────────────────────── */
-
-static void parse_inline(StrBuf* sb, const char* t, size_t len) {
-    size_t i = 0;
-    while (i < len) {
-        /* Backslash escape */
-        if (t[i]=='\\' && i+1<len) {
-            char nx=t[i+1];
-            if(nx=='*'||nx=='_'||nx=='`'||nx=='['||nx==']'||nx=='('||nx==')'||nx=='#'||nx=='~'||nx=='!'||nx=='|'||nx=='\\'||nx=='-')
-            { sb_append_esc(sb,&t[i+1],1); i+=2; continue; }
-        }
-        /* Line break (2+ trailing spaces + \n) */
-        if (t[i]==' ' && i+1<len && t[i+1]==' ') {
-            size_t j=i+2; while(j<len&&t[j]==' ')j++;
-            if(j<len&&t[j]=='\n'){ sb_append(sb,"<br>\n"); i=j+1; continue; }
-        }
-        /* Inline code */
-        if (t[i]=='`') {
-            int tk=0; size_t st=i; while(i<len&&t[i]=='`'){tk++;i++;}
-            size_t e=i; int found=0;
-            while(e<=len-tk){
-                if(t[e]=='`'){ int ct=0;size_t ce=e; while(ce<len&&t[ce]=='`'){ct++;ce++;}
-                    if(ct==tk){ sb_append(sb,"<code>"); sb_append_esc(sb,t+i,e-i); sb_append(sb,"</code>"); i=ce; found=1; break; } e=ce;
-                } else e++;
-            }
-            if(!found) sb_append_esc(sb,t+st,tk);
-            continue;
-        }
-        /* Image ![alt](url) or ![alt][ref] */
-        if (t[i]=='!' && i+1<len && t[i+1]=='[') {
-            size_t as=i+2,j=as; int d=1;
-            while(j<len&&d>0){if(t[j]=='[')d++;else if(t[j]==']')d--;if(d>0)j++;}
-            if(j<len&&j+1<len&&t[j+1]=='('){
-                /* Inline: ![alt](url) */
-                size_t us=j+2,ue=us; while(ue<len&&t[ue]!=')')ue++;
-                if(ue<len){ sb_append(sb,"<img alt=\""); sb_append_esc(sb,t+as,j-as);
-                    sb_append(sb,"\" src=\""); sb_append_esc(sb,t+us,ue-us);
-                    sb_append(sb,"\" style=\"max-width:100%\">"); i=ue+1; continue; }
-            }
-            if(j<len&&j+1<len&&t[j+1]=='['){
-                /* Reference: ![alt][label] */
-                size_t ls=j+2,le=ls; while(le<len&&t[le]!=']')le++;
-                if(le<len){ char label[128]={0}; size_t ll=le-ls; if(ll>127)ll=127; memcpy(label,t+ls,ll);
-                    RefLink* r=ref_find(label);
-                    if(r){ sb_append(sb,"<img alt=\""); sb_append_esc(sb,t+as,j-as);
-                        sb_append(sb,"\" src=\""); sb_append(sb,r->url);
-                        if(r->title[0]){sb_append(sb,"\" title=\""); sb_append(sb,r->title);}
-                        sb_append(sb,"\" style=\"max-width:100%\">"); i=le+1; continue; }
-                }
-            }
-            /* Also try ![alt] with alt as the label */
-            if(j<len) {
-                char label[128]={0}; size_t ll=j-as; if(ll>127)ll=127; memcpy(label,t+as,ll);
-                RefLink* r=ref_find(label);
-                if(r){ sb_append(sb,"<img alt=\""); sb_append_esc(sb,t+as,j-as);
-                    sb_append(sb,"\" src=\""); sb_append(sb,r->url);
-                    if(r->title[0]){sb_append(sb,"\" title=\""); sb_append(sb,r->title);}
-                    sb_append(sb,"\" style=\"max-width:100%\">"); i=j+1; continue; }
-            }
-        }
-        /* Link [text](url) or [text][ref] */
-        if (t[i]=='[') {
-            size_t ts=i+1,j=ts; int d=1;
-            while(j<len&&d>0){if(t[j]=='[')d++;else if(t[j]==']')d--;if(d>0)j++;}
-            if(j<len&&j+1<len&&t[j+1]=='('){
-                /* Inline: [text](url) */
-                size_t us=j+2,ue=us; while(ue<len&&t[ue]!=')')ue++;
-                if(ue<len){ sb_append(sb,"<a href=\""); sb_append_esc(sb,t+us,ue-us);
-                    sb_append(sb,"\">"); parse_inline(sb,t+ts,j-ts); sb_append(sb,"</a>"); i=ue+1; continue; }
-            }
-            if(j<len&&j+1<len&&t[j+1]=='['){
-                /* Reference: [text][label] */
-                size_t ls=j+2,le=ls; while(le<len&&t[le]!=']')le++;
-                if(le<len){ char label[128]={0}; size_t ll=le-ls; if(ll>127)ll=127; memcpy(label,t+ls,ll);
-                    RefLink* r=ref_find(label);
-                    if(r){ sb_append(sb,"<a href=\""); sb_append(sb,r->url);
-                        if(r->title[0]){sb_append(sb,"\" title=\""); sb_append(sb,r->title);}
-                        sb_append(sb,"\">"); parse_inline(sb,t+ts,j-ts); sb_append(sb,"</a>"); i=le+1; continue; }
-                }
-            }
-            /* Also try [text] with text as the label */
-            if(j<len&&(j+1>=len||t[j+1]!='(')) {
-                char label[128]={0}; size_t ll=j-ts; if(ll>127)ll=127; memcpy(label,t+ts,ll);
-                RefLink* r=ref_find(label);
-                if(r){ sb_append(sb,"<a href=\""); sb_append(sb,r->url);
-                    if(r->title[0]){sb_append(sb,"\" title=\""); sb_append(sb,r->title);}
-                    sb_append(sb,"\">"); parse_inline(sb,t+ts,j-ts); sb_append(sb,"</a>"); i=j+1; continue; }
-            }
-        }
-        /* Strikethrough ~~text~~ */
-        if (t[i]=='~'&&i+1<len&&t[i+1]=='~') {
-            size_t s2=i+2,e2=s2; while(e2+1<len&&!(t[e2]=='~'&&t[e2+1]=='~'))e2++;
-            if(e2+1<len){ sb_append(sb,"<del>"); parse_inline(sb,t+s2,e2-s2); sb_append(sb,"</del>"); i=e2+2; continue; }
-        }
-        /* Bold+Italic ***text*** */
-        if ((t[i]=='*'||t[i]=='_')&&i+2<len&&t[i+1]==t[i]&&t[i+2]==t[i]) {
-            char m=t[i]; size_t s3=i+3,e3=s3;
-            while(e3+2<len&&!(t[e3]==m&&t[e3+1]==m&&t[e3+2]==m))e3++;
-            if(e3+2<len){ sb_append(sb,"<strong><em>"); parse_inline(sb,t+s3,e3-s3); sb_append(sb,"</em></strong>"); i=e3+3; continue; }
-        }
-        /* Bold **text** */
-        if ((t[i]=='*'||t[i]=='_')&&i+1<len&&t[i+1]==t[i]) {
-            char m=t[i]; size_t s2=i+2,e2=s2;
-            while(e2+1<len&&!(t[e2]==m&&t[e2+1]==m))e2++;
-            if(e2+1<len&&e2>s2){ sb_append(sb,"<strong>"); parse_inline(sb,t+s2,e2-s2); sb_append(sb,"</strong>"); i=e2+2; continue; }
-        }
-        /* Italic *text* */
-        if ((t[i]=='*'||t[i]=='_')&&i+1<len&&t[i+1]!=t[i]&&t[i+1]!=' ') {
-            char m=t[i]; size_t s1=i+1,e1=s1; while(e1<len&&t[e1]!=m)e1++;
-            if(e1<len&&e1>s1&&t[e1-1]!=' '){ sb_append(sb,"<em>"); parse_inline(sb,t+s1,e1-s1); sb_append(sb,"</em>"); i=e1+1; continue; }
-        }
-        /* Autolink bare URLs */
-        if (i+8<len&&(strncmp(t+i,"https://",8)==0||strncmp(t+i,"http://",7)==0)) {
-            size_t us=i; while(i<len&&t[i]!=' '&&t[i]!='\n'&&t[i]!='\r'&&t[i]!=')'&&t[i]!='>'&&t[i]!='"')i++;
-            while(i>us&&(t[i-1]=='.'||t[i-1]==','||t[i-1]==';'))i--;
-            sb_append(sb,"<a href=\""); sb_append_esc(sb,t+us,i-us); sb_append(sb,"\">"); sb_append_esc(sb,t+us,i-us); sb_append(sb,"</a>"); continue;
-        }
-        /* Inline HTML — pass through <tag>, </tag>, <tag attr="val">, <br/>, etc. */
-        if (t[i]=='<' && i+1<len && (isalpha(t[i+1]) || t[i+1]=='/' || t[i+1]=='!')) {
-            size_t j=i+1;
-            /* Find the closing > */
-            while(j<len && t[j]!='>') j++;
-            if (j<len) {
-                /* Pass through raw */
-                sb_ensure(sb, j-i+1);
-                for(size_t k=i; k<=j; k++) sb_append_char(sb, t[k]);
-                i=j+1; continue;
-            }
-        }
-        /* Plain char */
-        sb_append_esc(sb,&t[i],1); i++;
+static ULONG STDMETHODCALLTYPE EX_AddRef(IDispatch* This) { return InterlockedIncrement(&SITE_FROM_EXT(This)->refCount); }
+static ULONG STDMETHODCALLTYPE EX_Release(IDispatch* This) { SiteImpl* s = SITE_FROM_EXT(This); LONG r = InterlockedDecrement(&s->refCount); if(r==0) free(s); return r; }
+static HRESULT STDMETHODCALLTYPE EX_TypeCount(IDispatch* This, UINT* n) { *n = 0; return S_OK; }
+static HRESULT STDMETHODCALLTYPE EX_TypeInfo(IDispatch* This, UINT i, LCID l, ITypeInfo** ti) { *ti = NULL; return E_NOTIMPL; }
+static HRESULT STDMETHODCALLTYPE EX_Names(IDispatch* This, REFIID riid, LPOLESTR* names, UINT n, LCID l, DISPID* ids) {
+    HRESULT hr = S_OK;
+    for (UINT i = 0; i < n; i++) {
+        if (wcscmp(names[i], L"sec") == 0) ids[i] = EXT_SEC;
+        else if (wcscmp(names[i], L"find") == 0) ids[i] = EXT_FIND;
+        else if (wcscmp(names[i], L"hits") == 0) ids[i] = EXT_HITS;
+        else if (wcscmp(names[i], L"map") == 0) ids[i] = EXT_MAP;
+        else if (wcscmp(names[i], L"patch") == 0) ids[i] = EXT_PATCH;
+        else { ids[i] = DISPID_UNKNOWN; hr = DISP_E_UNKNOWNNAME; }
     }
+    return hr;
 }
-
-/* ── Markdown Block Parser Helpers ───────────────────────────────────── */
-
-static int count_leading(const char* l, char c) { int n=0; while(l[n]==c)n++; return n; }
-typedef struct { char** lines; int count; } Lines;
-static Lines split_lines(const char* text) {
-    Lines r; r.count=0; int cap=256; r.lines=(char**)malloc(cap*sizeof(char*));
-    const char* p=text;
-    while(*p){ const char* eol=p; while(*eol&&*eol!='\n')eol++;
-        size_t ll=eol-p; if(ll>0&&p[ll-1]=='\r')ll--;
-        char* line=(char*)malloc(ll+1); memcpy(line,p,ll); line[ll]='\0';
-        if(r.count>=cap){cap*=2;r.lines=(char**)realloc(r.lines,cap*sizeof(char*));}
-        r.lines[r.count++]=line; p=eol; if(*p=='\n')p++;
-    } return r;
-}
-static void free_lines(Lines* l) { for(int i=0;i<l->count;i++) free(l->lines[i]); free(l->lines); }
-static int is_hr(const char* l) { const char* p=l; while(*p==' ')p++; char c=*p; if(c!='-'&&c!='*'&&c!='_')return 0; int n=0; while(*p){if(*p==c)n++;else if(*p!=' ')return 0;p++;} return n>=3; }
-
-static int is_table_sep(const char* l) {
-    const char* p=l; while(*p==' ')p++; if(*p=='|')p++;
-    int cells=0;
-    while(*p){ while(*p==' ')p++; if(*p==':')p++; if(*p!='-')return 0; while(*p=='-')p++; if(*p==':')p++; while(*p==' ')p++; cells++; if(*p=='|'){p++;continue;} if(*p=='\0')break; return 0; }
-    return cells>0;
-}
-
-static int parse_trow(const char* l, char cells[][1024], int mx) {
-    const char* p=l; while(*p==' ')p++; if(*p=='|')p++;
-    int nc=0;
-    while(*p&&nc<mx){
-        const char* s=p; int ic=0;
-        while(*p){if(*p=='`')ic=!ic;if(*p=='\\'&&*(p+1)){p+=2;continue;}if(*p=='|'&&!ic)break;p++;}
-        const char* e=p; while(s<e&&*s==' ')s++; while(e>s&&*(e-1)==' ')e--;
-        size_t cl=e-s; if(cl>=1024)cl=1023; memcpy(cells[nc],s,cl); cells[nc][cl]='\0'; nc++;
-        if(*p=='|')p++;
+static HRESULT STDMETHODCALLTYPE EX_Invoke(IDispatch* This, DISPID id, REFIID riid, LCID l, WORD fl, DISPPARAMS* p, VARIANT* res, EXCEPINFO* ei, UINT* ae) {
+    MDViewData* d = (MDViewData*)GetWindowLongPtrW(SITE_FROM_EXT(This)->hwndParent, GWLP_USERDATA);
+    if (id != EXT_SEC && id != EXT_FIND && id != EXT_HITS && id != EXT_MAP && id != EXT_PATCH) return DISP_E_MEMBERNOTFOUND;
+    /* Arguments arrive last first; find's flags are optional */
+    UINT need = id == EXT_SEC || id == EXT_MAP || id == EXT_PATCH ? 1 : 2;
+    if (!p || p->cArgs < (id == EXT_FIND ? 1 : need) || p->cArgs > need) return DISP_E_BADPARAMCOUNT;
+    VARIANT a, b2; VariantInit(&a); VariantInit(&b2);
+    if (FAILED(VariantChangeType(&a, &p->rgvarg[p->cArgs - 1], 0, id == EXT_FIND || id == EXT_MAP ? VT_BSTR : VT_I4))) return DISP_E_TYPEMISMATCH;
+    if (id == EXT_MAP) {
+        if (d) view_map(d, a.bstrVal ? a.bstrVal : L"");
+        VariantClear(&a);
+        if (res) VariantInit(res);
+        return S_OK;
     }
-    if(nc>0&&cells[nc-1][0]=='\0')nc--;
-    return nc;
-}
-
-static void parse_talign(const char* l, char al[], int mx) {
-    const char* p=l; while(*p==' ')p++; if(*p=='|')p++; int c=0;
-    while(*p&&c<mx){ while(*p==' ')p++; int left=(*p==':');if(*p==':')p++; while(*p=='-')p++; int right=(*p==':');if(*p==':')p++; while(*p==' ')p++;
-        if(left&&right)al[c]='c'; else if(right)al[c]='r'; else al[c]='l'; c++; if(*p=='|')p++;
+    if (p->cArgs == 2 && FAILED(VariantChangeType(&b2, &p->rgvarg[0], 0, VT_I4))) { VariantClear(&a); return DISP_E_TYPEMISMATCH; }
+    if (id == EXT_FIND) {
+        int n = d ? view_find(d, a.bstrVal ? a.bstrVal : L"", p->cArgs == 2 ? b2.lVal : 0) : -1;
+        VariantClear(&a);
+        if (res) { VariantInit(res); res->vt = VT_I4; res->lVal = n; }
+        return S_OK;
     }
+    BSTR b = NULL;
+    if (d) b = id == EXT_SEC ? (d->html ? virtual_section(d, a.lVal) : NULL)
+             : id == EXT_PATCH ? live_patch(d, a.lVal) : view_hits(d, a.lVal, b2.lVal);
+    VariantClear(&a);
+    if (!b) b = SysAllocString(L"");
+    if (res) { VariantInit(res); res->vt = VT_BSTR; res->bstrVal = b; } else SysFreeString(b);
+    return S_OK;
 }
+static IDispatchVtbl g_extVtbl = { EX_QI, EX_AddRef, EX_Release, EX_TypeCount, EX_TypeInfo, EX_Names, EX_Invoke };
 
-static int get_indent(const char* l) { int n=0; while(l[n]==' ')n++; if(l[n]=='\t')return n+4; return n; }
-static int is_ul(const char* t) { return(t[0]=='-'||t[0]=='*'||t[0]=='+')&&t[1]==' '; }
-static int is_ol(const char* t) { int i=0; while(t[i]>='0'&&t[i]<='9')i++; if(i==0||i>9)return 0; if((t[i]=='.'||t[i]==')')&&t[i+1]==' ')return i+2; return 0; }
-
-/* ── Markdown Block Parser ───────────────────────────────────────────── */
-
-static int g_md_depth = 0;
-
-static char* md_to_html(const char* markdown) {
-    StrBuf sb; sb_init(&sb);
-    Lines lines = split_lines(markdown);
-    int i = 0;
-    int is_toplevel = (g_md_depth == 0);
-    g_md_depth++;
-
-    /* First pass: collect reference link definitions [label]: URL "title" */
-    /* Only clear at top level; nested calls (blockquotes, lists) keep parent refs */
-    if (is_toplevel) ref_clear();
-    for (int r = 0; r < lines.count; r++) {
-        const char* rl = lines.lines[r];
-        while (*rl == ' ') rl++;
-        if (rl[0] != '[') continue;
-        /* Parse [label]: */
-        const char* ls = rl + 1;
-        const char* le = ls;
-        while (*le && *le != ']') le++;
-        if (*le != ']' || *(le+1) != ':') continue;
-        size_t labLen = le - ls;
-        if (labLen == 0 || labLen > 127) continue;
-        char label[128]; memcpy(label, ls, labLen); label[labLen] = '\0';
-        /* Check it's not a task list item like [x] or [ ] */
-        if (labLen == 1 && (label[0]=='x' || label[0]=='X' || label[0]==' ')) continue;
-        const char* up = le + 2;
-        while (*up == ' ') up++;
-        /* Parse URL (optionally in angle brackets) */
-        char url[1024] = "";
-        if (*up == '<') {
-            up++;
-            const char* ue = up;
-            while (*ue && *ue != '>') ue++;
-            size_t ul = ue - up; if (ul > 1023) ul = 1023;
-            memcpy(url, up, ul); url[ul] = '\0';
-            up = (*ue == '>') ? ue + 1 : ue;
-        } else {
-            const char* ue = up;
-            while (*ue && *ue != ' ' && *ue != '\t' && *ue != '"') ue++;
-            size_t ul = ue - up; if (ul > 1023) ul = 1023;
-            memcpy(url, up, ul); url[ul] = '\0';
-            up = ue;
-        }
-        if (url[0] == '\0') continue;
-        /* Parse optional title in quotes */
-        char title[256] = "";
-        while (*up == ' ' || *up == '\t') up++;
-        if (*up == '"') {
-            up++;
-            const char* te = up;
-            while (*te && *te != '"') te++;
-            size_t tl = te - up; if (tl > 255) tl = 255;
-            memcpy(title, up, tl); title[tl] = '\0';
-        }
-        ref_add(label, url, title);
-        /* Mark this line as consumed by blanking it */
-        lines.lines[r][0] = '\0';
-    }
-
-    while (i < lines.count) {
-        const char* line = lines.lines[i];
-        int indent = get_indent(line);
-        const char* tr = line + indent;
-
-        if (tr[0]=='\0') { i++; continue; }
-
-        /* Fenced code block */
-        if (strncmp(tr,"```",3)==0 || strncmp(tr,"~~~",3)==0) {
-            char fc=tr[0]; const char* lang=tr+3; while(*lang==' ')lang++;
-            sb_append(&sb,"<pre><code");
-            if(*lang){ sb_append(&sb," class=\"language-"); const char* le=lang; while(*le&&*le!=' '&&*le!='`'&&*le!='~')le++; sb_append_esc(&sb,lang,le-lang); sb_append(&sb,"\""); }
-            sb_append(&sb,">"); i++;
-            while(i<lines.count){ const char* cl=lines.lines[i]; const char* ct=cl; while(*ct==' ')ct++;
-                if((fc=='`'&&strncmp(ct,"```",3)==0)||(fc=='~'&&strncmp(ct,"~~~",3)==0)){i++;break;}
-                if(sb.data[sb.len-1]!='>') sb_append(&sb,"\n");
-                sb_append_esc(&sb,cl,strlen(cl)); i++;
-            }
-            sb_append(&sb,"</code></pre>\n"); continue;
-        }
-
-        /* Indented code block */
-        if (indent>=4 && !is_ul(tr) && !is_ol(tr)) {
-            sb_append(&sb,"<pre><code>");
-            while(i<lines.count){ const char* cl=lines.lines[i];
-                if(cl[0]=='\0'){if(i+1<lines.count&&get_indent(lines.lines[i+1])>=4){sb_append(&sb,"\n");i++;continue;}break;}
-                if(get_indent(cl)<4)break;
-                if(sb.data[sb.len-1]!='>') sb_append(&sb,"\n");
-                sb_append_esc(&sb,cl+4,strlen(cl+4)); i++;
-            }
-            sb_append(&sb,"</code></pre>\n"); continue;
-        }
-
-        /* ATX Headings with id for TOC */
-        if (tr[0]=='#') {
-            int lv=count_leading(tr,'#');
-            if(lv>=1&&lv<=6&&tr[lv]==' '){
-                const char* c=tr+lv+1; size_t cl=strlen(c);
-                while(cl>0&&c[cl-1]=='#')cl--; while(cl>0&&c[cl-1]==' ')cl--;
-                char tag[4]; sprintf(tag,"h%d",lv);
-                char idnum[16]; sprintf(idnum,"%d",i);
-                sb_append(&sb,"<"); sb_append(&sb,tag); sb_append(&sb," id=\"mdv-h");
-                sb_append(&sb,idnum); sb_append(&sb,"\">");
-                parse_inline(&sb,c,cl);
-                sb_append(&sb,"</"); sb_append(&sb,tag); sb_append(&sb,">\n"); i++; continue;
-            }
-        }
-
-        /* Setext headings */
-        if (i+1<lines.count && tr[0]!='\0') {
-            const char* nx=lines.lines[i+1]; while(*nx==' ')nx++; int nl=(int)strlen(nx);
-            if(nl>=1){ int ae=1,ad=1; for(int j=0;j<nl;j++){if(nx[j]!='=')ae=0;if(nx[j]!='-')ad=0;}
-                if(ae){ sb_append(&sb,"<h1>"); parse_inline(&sb,tr,strlen(tr)); sb_append(&sb,"</h1>\n"); i+=2; continue; }
-                if(ad&&!is_hr(lines.lines[i+1])){ sb_append(&sb,"<h2>"); parse_inline(&sb,tr,strlen(tr)); sb_append(&sb,"</h2>\n"); i+=2; continue; }
-            }
-        }
-
-        /* HR */
-        if (is_hr(line)) { sb_append(&sb,"<hr>\n"); i++; continue; }
-
-        /* Blockquote */
-        if (tr[0]=='>'&&(tr[1]==' '||tr[1]=='\0')) {
-            StrBuf bq; sb_init(&bq);
-            while(i<lines.count){ const char* bl=lines.lines[i]; while(*bl==' ')bl++;
-                if(bl[0]=='>'&&(bl[1]==' '||bl[1]=='\0')){if(bq.len>0)sb_append(&bq,"\n");sb_append(&bq,bl[1]==' '?bl+2:bl+1);i++;}
-                else if(bl[0]=='\0')break; else{sb_append(&bq,"\n");sb_append(&bq,bl);i++;}
-            }
-            char* inner=md_to_html(bq.data);
-            sb_append(&sb,"<blockquote>\n"); sb_append(&sb,inner); sb_append(&sb,"</blockquote>\n");
-            free(inner); free(bq.data); continue;
-        }
-
-        /* Table */
-        if (i+1<lines.count && is_table_sep(lines.lines[i+1])) {
-            char cells[64][1024]; char al[64]; memset(al,'l',sizeof(al));
-            int nc=parse_trow(line,cells,64); parse_talign(lines.lines[i+1],al,64);
-            sb_append(&sb,"<table>\n<thead>\n<tr>\n");
-            for(int c=0;c<nc;c++){
-                sb_append(&sb,"<th"); if(al[c]=='c')sb_append(&sb," style=\"text-align:center\""); else if(al[c]=='r')sb_append(&sb," style=\"text-align:right\"");
-                sb_append(&sb,">"); parse_inline(&sb,cells[c],strlen(cells[c])); sb_append(&sb,"</th>\n");
-            }
-            sb_append(&sb,"</tr>\n</thead>\n<tbody>\n"); i+=2;
-            while(i<lines.count){ const char* rl=lines.lines[i]; while(*rl==' ')rl++;
-                if(rl[0]=='\0'||!strchr(rl,'|'))break;
-                int rc=parse_trow(lines.lines[i],cells,64); sb_append(&sb,"<tr>\n");
-                for(int c=0;c<nc;c++){
-                    sb_append(&sb,"<td"); if(al[c]=='c')sb_append(&sb," style=\"text-align:center\""); else if(al[c]=='r')sb_append(&sb," style=\"text-align:right\"");
-                    sb_append(&sb,">"); if(c<rc)parse_inline(&sb,cells[c],strlen(cells[c])); sb_append(&sb,"</td>\n");
-                }
-                sb_append(&sb,"</tr>\n"); i++;
-            }
-            sb_append(&sb,"</tbody>\n</table>\n"); continue;
-        }
-
-        /* Lists */
-        if (is_ul(tr) || is_ol(tr)) {
-            int ordered=is_ol(tr); int bi=indent;
-            sb_append(&sb,ordered?"<ol>\n":"<ul>\n");
-            while(i<lines.count){
-                const char* ll=lines.lines[i]; int li=get_indent(ll); const char* lt=ll+li;
-                int iu=is_ul(lt)&&li<=bi+1; int om=is_ol(lt); int io=om&&li<=bi+1;
-                if(lt[0]=='\0'){i++;continue;}
-                if(!iu&&!io&&li<=bi)break;
-                if(iu||io){
-                    const char* ic=iu?lt+2:lt+om;
-                    int task=0,chk=0;
-                    if(strncmp(ic,"[ ] ",4)==0){task=1;ic+=4;}
-                    else if(strncmp(ic,"[x] ",4)==0||strncmp(ic,"[X] ",4)==0){task=1;chk=1;ic+=4;}
-                    sb_append(&sb,"<li>");
-                    if(task) sb_append(&sb,chk?"<input type=\"checkbox\" checked disabled> ":"<input type=\"checkbox\" disabled> ");
-                    parse_inline(&sb,ic,strlen(ic)); i++;
-                    StrBuf nest; sb_init(&nest); int hn=0;
-                    while(i<lines.count){ const char* nl=lines.lines[i]; int ni=get_indent(nl); const char* nt=nl+ni;
-                        if(nt[0]=='\0'){if(i+1<lines.count&&get_indent(lines.lines[i+1])>bi+1){sb_append(&nest,"\n");i++;hn=1;continue;}break;}
-                        if(ni>bi+1){if(nest.len>0)sb_append(&nest,"\n");sb_append(&nest,nl);hn=1;i++;}else break;
-                    }
-                    if(hn){char* nh=md_to_html(nest.data);sb_append(&sb,"\n");sb_append(&sb,nh);free(nh);}
-                    free(nest.data); sb_append(&sb,"</li>\n");
-                } else i++;
-            }
-            sb_append(&sb,ordered?"</ol>\n":"</ul>\n"); continue;
-        }
-
-        /* Raw HTML blocks — pass through unescaped */
-        if (tr[0]=='<') {
-            /* Check for block-level HTML tags */
-            static const char* block_tags[] = {
-                "div","p","table","thead","tbody","tr","th","td","ul","ol","li",
-                "h1","h2","h3","h4","h5","h6","pre","blockquote","hr","br",
-                "section","article","aside","nav","header","footer","main",
-                "figure","figcaption","details","summary","dl","dt","dd",
-                "form","fieldset","input","textarea","select","button","label",
-                "video","audio","source","iframe","canvas","svg","img",
-                "style","script","!--", NULL
-            };
-            int is_html_block = 0;
-            for (int t=0; block_tags[t]; t++) {
-                size_t tl = strlen(block_tags[t]);
-                if (_strnicmp(tr+1, block_tags[t], tl)==0) {
-                    char after = tr[1+tl];
-                    if (after==' '||after=='>'||after=='\0'||after=='\n'||after=='/'||after=='\r') {
-                        is_html_block = 1; break;
-                    }
-                }
-                /* Also match closing tags like </div> at start of line */
-                if (tr[1]=='/' && _strnicmp(tr+2, block_tags[t], tl)==0) {
-                    char after = tr[2+tl];
-                    if (after=='>'||after=='\0'||after=='\n'||after==' ') {
-                        is_html_block = 1; break;
-                    }
-                }
-            }
-            if (is_html_block) {
-                /* Collect contiguous non-blank lines as raw HTML */
-                while (i < lines.count) {
-                    const char* hl = lines.lines[i];
-                    if (hl[0]=='\0') break;
-                    sb_append(&sb, hl);
-                    sb_append(&sb, "\n");
-                    i++;
-                }
-                continue;
-            }
-        }
-
-        /* Paragraph */
-        { StrBuf para; sb_init(&para);
-            while(i<lines.count){
-                const char* pl=lines.lines[i]; int pi=get_indent(pl); const char* pt=pl+pi;
-                if(pt[0]=='\0')break; if(pt[0]=='#'&&pt[1]==' ')break; if(is_hr(pl))break;
-                if(pt[0]=='>'&&(pt[1]==' '||pt[1]=='\0'))break;
-                if(strncmp(pt,"```",3)==0||strncmp(pt,"~~~",3)==0)break;
-                if(is_ul(pt)||is_ol(pt))break;
-                if(i+1<lines.count&&is_table_sep(lines.lines[i+1]))break;
-                if(para.len>0) sb_append(&para,"\n");
-                sb_append(&para,tr); i++;
-                if(i<lines.count){ const char* nx=lines.lines[i]; while(*nx==' ')nx++; int nl2=(int)strlen(nx);
-                    if(nl2>=1){int ae=1,ad=1;for(int j=0;j<nl2;j++){if(nx[j]!='=')ae=0;if(nx[j]!='-')ad=0;}if(ae||ad)break;}
-                    pi=get_indent(lines.lines[i]); tr=lines.lines[i]+pi;
-                }
-            }
-            sb_append(&sb,"<p>"); parse_inline(&sb,para.data,para.len); sb_append(&sb,"</p>\n");
-            free(para.data);
-        }
-    }
-    free_lines(&lines);
-    g_md_depth--;
-    return sb.data;
+static SiteImpl* CreateSiteImpl(HWND hwnd) {
+    SiteImpl* s = (SiteImpl*)calloc(1, sizeof(SiteImpl));
+    if (!s) return NULL;
+    s->clientSite.lpVtbl = &g_csVtbl; s->inPlaceSite.lpVtbl = &g_ipsVtbl;
+    s->inPlaceFrame.lpVtbl = &g_ipfVtbl; s->docHostUI.lpVtbl = &g_dhVtbl;
+    s->external.lpVtbl = &g_extVtbl;
+    s->refCount = 1; s->hwndParent = hwnd;
+    return s;
 }
 
 /* ── Theme Detection ─────────────────────────────────────────────────── */
@@ -1060,6 +864,22 @@ static int is_dark_theme(void) {
     } return 0;
 }
 
+/* ── Source Encoding ─────────────────────────────────────────────────── */
+
+/* Legacy 8-bit sources are read in the ANSI code page when it is a
+   single-byte one, else as Windows-1252 (NULL). Built once; it only
+   changes with the system locale. */
+static const unsigned short* acp_table(void) {
+    static unsigned short t[128];
+    static int state;   /* 0 not built, 1 built, -1 multi-byte code page */
+    if (!state) {
+        CPINFO ci; char b[128];
+        for (int i = 0; i < 128; i++) b[i] = (char)(0x80 + i);
+        state = GetCPInfo(CP_ACP, &ci) && ci.MaxCharSize == 1 && MultiByteToWideChar(CP_ACP, 0, b, 128, (wchar_t*)t, 128) == 128 ? 1 : -1;
+    }
+    return state > 0 ? t : NULL;
+}
+
 /* ── INI Settings Persistence ────────────────────────────────────────── */
 
 static char g_iniPath[MAX_PATH] = {0};
@@ -1069,21 +889,37 @@ typedef struct {
     int isDark;      /* 0 or 1, -1 = auto */
     int maxWidth;    /* column width in px, 0 = no limit, default 0 */
     int lineNums;    /* 0 or 1 */
+    int progressiveKB; /* sources this big or bigger are shown as they convert, 0 = never */
+    int virtualKB;   /* sources this big or bigger keep only nearby sections in the DOM, 0 = never */
+    int cacheMB;     /* render cache size, 0 = off, default 64 */
+    int autoReload;  /* follow the file as it changes, 0 or 1, default 1 */
+    char cacheDir[MAX_PATH]; /* render cache folder, "" = %TEMP%\MDView */
 } MDVSettings;
 
-static MDVSettings g_settings = { 19, -1, 960, 0 };
+static const MDVSettings k_defaultSettings = { 19, -1, 960, 0, 4096, 32768, 64, 1, "" };
 
-static void load_settings(void) {
+/* Each lister window loads its own copy, so nothing here is shared state */
+static void load_settings(MDVSettings* st) {
+    *st = k_defaultSettings;
     if (!g_iniPath[0]) return;
-    g_settings.fontSize = GetPrivateProfileIntA("MDView", "FontSize", 19, g_iniPath);
-    g_settings.isDark   = GetPrivateProfileIntA("MDView", "DarkMode", -1, g_iniPath);
-    g_settings.maxWidth = GetPrivateProfileIntA("MDView", "MaxWidth", 0, g_iniPath);
-    g_settings.lineNums = GetPrivateProfileIntA("MDView", "LineNumbers", 0, g_iniPath);
+    st->fontSize = GetPrivateProfileIntA("MDView", "FontSize", 19, g_iniPath);
+    st->isDark   = GetPrivateProfileIntA("MDView", "DarkMode", -1, g_iniPath);
+    st->maxWidth = GetPrivateProfileIntA("MDView", "MaxWidth", 0, g_iniPath);
+    st->lineNums = GetPrivateProfileIntA("MDView", "LineNumbers", 0, g_iniPath);
+    st->progressiveKB = GetPrivateProfileIntA("MDView", "ProgressiveKB", 4096, g_iniPath);
+    st->virtualKB = GetPrivateProfileIntA("MDView", "VirtualKB", 32768, g_iniPath);
+    st->cacheMB = GetPrivateProfileIntA("MDView", "CacheMB", 64, g_iniPath);
+    st->autoReload = GetPrivateProfileIntA("MDView", "AutoReload", 1, g_iniPath) != 0;
+    GetPrivateProfileStringA("MDView", "CacheDir", "", st->cacheDir, MAX_PATH, g_iniPath);
     /* Clamp */
-    if (g_settings.fontSize < 9) g_settings.fontSize = 9;
-    if (g_settings.fontSize > 30) g_settings.fontSize = 30;
-    if (g_settings.maxWidth != 0 && g_settings.maxWidth < 400) g_settings.maxWidth = 400;
-    if (g_settings.maxWidth > 9999) g_settings.maxWidth = 9999;
+    if (st->fontSize < 9) st->fontSize = 9;
+    if (st->fontSize > 30) st->fontSize = 30;
+    if (st->maxWidth != 0 && st->maxWidth < 400) st->maxWidth = 400;
+    if (st->maxWidth > 9999) st->maxWidth = 9999;
+    if (st->progressiveKB < 0) st->progressiveKB = 0;
+    if (st->virtualKB < 0) st->virtualKB = 0;
+    if (st->cacheMB < 0) st->cacheMB = 0;
+    if (st->cacheMB > 65536) st->cacheMB = 65536;
 }
 
 static void save_setting_int(const char* key, int val) {
@@ -1092,31 +928,89 @@ static void save_setting_int(const char* key, int val) {
     WritePrivateProfileStringA("MDView", key, buf, g_iniPath);
 }
 
+/* ── Highlighter Grammars ────────────────────────────────────────────── */
+
+/* Extra languages from grammars\*.lang beside the plugin, compiled (or
+   read from grammars\grammars.cache) on the first ListLoadW and shared,
+   read-only, by every converter context after that */
+static MdGrammars g_grammars;
+static int g_grammarsLoaded = 0;
+
+static void load_grammars(void) {
+    if (g_grammarsLoaded) return;
+    g_grammarsLoaded = 1;
+    wchar_t dir[MAX_PATH], cache[MAX_PATH];
+    DWORD n = GetModuleFileNameW(g_hInstance, dir, MAX_PATH);
+    wchar_t* slash = wcsrchr(dir, L'\\');
+    if (!n || n >= MAX_PATH || !slash || (size_t)(slash - dir) + 32 > MAX_PATH) return;
+    wcscpy(slash + 1, L"grammars");
+    wcscpy(cache, dir); wcscat(cache, L"\\grammars.cache");
+    md_grammars_load_w(&g_grammars, dir, cache);   /* no directory: built-in languages only */
+}
+
+/* Blocks taller than about 420px open cut to 400px, with "Show more".
+   The converter decides by line count, so the height of a line at this
+   font size sets the thresholds: code is .9em at line-height 1.5 inside
+   32px of padding, quote text 1em at 1.7. */
+static MdContext* new_context(int fontSize) {
+    MdOptions o; md_options_default(&o);
+    o.blockLines = 1;   /* find marks its matches by block */
+    o.collapseCode = (420 - 32) * 20 / (fontSize * 27);
+    o.collapseQuote = 420 * 10 / (fontSize * 17);
+    o.grammars = g_grammars.items; o.grammarCount = g_grammars.count;
+    return md_context_new(&o);
+}
+
+/* ── Render Cache ────────────────────────────────────────────────────── */
+
+/* Pages written in one piece (not progressive or virtualized ones, which
+   the browser puts together) are kept in CacheDir, %TEMP%\MDView unless
+   set, up to CacheMB megabytes (mdcache.c). The key covers the file and
+   everything that shapes its page, so a hit is shown without converting
+   the file. The folder's cache.stats counts hits and misses. */
+
+/* Plugin version and build: a new build starts the pages over */
+static const char k_buildId[] = "MDView 2.3 " __DATE__ " " __TIME__;
+
+static int cache_dir(const MDVSettings* st, WCHAR* dir) {
+    if (st->cacheDir[0]) return MultiByteToWideChar(CP_ACP, 0, st->cacheDir, -1, dir, MAX_PATH) ? 0 : -1;
+    DWORD n = GetTempPathW(MAX_PATH, dir);
+    if (!n || n + 7 > MAX_PATH) return -1;
+    wcscpy(dir + n, L"MDView");
+    return 0;
+}
+
+static int page_key(MdCacheKey* k, const WCHAR* file, const MdSource* src, const MDVSettings* st, int dark, const char* assets) {
+    WIN32_FILE_ATTRIBUTE_DATA fa;
+    if (!GetFileAttributesExW(file, GetFileExInfoStandard, &fa)) return -1;
+    int shape[4] = { st->fontSize, st->maxWidth, st->lineNums, dark };
+    md_cache_key(k, file, wcslen(file) * sizeof(WCHAR),
+                 (long long)(((unsigned long long)fa.nFileSizeHigh << 32) | fa.nFileSizeLow),
+                 (long long)(((unsigned long long)fa.ftLastWriteTime.dwHighDateTime << 32) | fa.ftLastWriteTime.dwLowDateTime),
+                 md_hash64(src->data, src->len, 0), md_hash64(shape, sizeof(shape), md_hash64(assets, strlen(assets), g_grammars.stamp)), k_buildId);
+    return 0;
+}
+
 /* ── CSS ─────────────────────────────────────────────────────────────── */
 
-static void build_css(StrBuf* sb) {
-    sb_append(sb,
+/* The static style. Font size and column width are the page's own,
+   in the prologue write_page puts after it. */
+static const char k_css[] =
     "*{box-sizing:border-box}"
-    "html{background:#fff;min-height:100%;width:100%}");
+    "html{background:#fff;min-height:100%;width:100%}"
 
     /* Body — full viewport background */
-    sb_append(sb, "body{font-family:'Segoe UI',Tahoma,Geneva,Verdana,sans-serif;");
-    { char tmp[64]; sprintf(tmp, "font-size:%dpx;", g_settings.fontSize); sb_append(sb, tmp); }
-    sb_append(sb, "line-height:1.7;color:#24292e;background:#fff;margin:0;padding:0;"
-    "transition:background .2s,color .2s}");
-    sb_append(sb, "body.dark{color:#d4d4d4;background:#1e1e1e}");
+    "body{font-family:'Segoe UI',Tahoma,Geneva,Verdana,sans-serif;"
+    "line-height:1.7;color:#24292e;background:#fff;margin:0;padding:0;"
+    "transition:background .2s,color .2s}"
+    "body.dark{color:#d4d4d4;background:#1e1e1e}"
 
     /* Content container — centered, optional max-width */
-    sb_append(sb, "#mdv-ct{margin:0 auto;padding:12px 32px 24px;");
-    if (g_settings.maxWidth > 0) {
-        char tmp[64]; sprintf(tmp, "max-width:%dpx;", g_settings.maxWidth); sb_append(sb, tmp);
-    }
-    sb_append(sb, "}");
+    "#mdv-ct{margin:0 auto;padding:12px 32px 24px}"
 
-    sb_append(sb,
     "h1,h2,h3,h4,h5,h6{color:#1a1a1a;margin-top:1.4em;margin-bottom:.6em;font-weight:600}"
     "body.dark h1,body.dark h2,body.dark h3,body.dark h4,body.dark h5,body.dark h6{color:#e0e0e0}"
-    "#mdv-ct>:first-child{margin-top:0}"
+    "#mdv-ct>:first-child,.mdv-sec:first-child>:first-child{margin-top:0}"
     "h1{font-size:2em;padding-bottom:.3em;border-bottom:1px solid #e1e4e8}"
     "h2{font-size:1.5em;padding-bottom:.25em;border-bottom:1px solid #e1e4e8}"
     "body.dark h1,body.dark h2{border-bottom-color:#444}"
@@ -1149,16 +1043,15 @@ static void build_css(StrBuf* sb) {
     "input[type=checkbox]{margin-right:6px}"
     "del{color:#999}body.dark del{color:#888}"
 
-    /* Line numbers */
-    "pre.ln{padding-left:0}pre.ln code{display:block}"
-    ".ln-wrap{display:table;width:100%}"
-    ".ln-nums{display:table-cell;width:1px;padding:0 12px;text-align:right;"
-    "color:#6a737d;border-right:1px solid #e1e4e8;user-select:none;"
-    "-webkit-user-select:none;white-space:pre;vertical-align:top;"
+    /* Line numbers: the converter opens every <pre> with a gutter, shown
+       while the body has class ln; its numbers are generated content */
+    ".ln-nums{display:none}"
+    "body.ln .ln-nums{display:block;float:left;padding:0 12px;margin-right:16px;text-align:right;"
+    "color:#6a737d;border-right:1px solid #e1e4e8;-ms-user-select:none;user-select:none;white-space:pre;"
     "font-family:Consolas,'Courier New',monospace;font-size:.9em;line-height:1.5}"
+    "body.ln .ln-nums:before{content:attr(data-n)}"
     "body.dark .ln-nums{color:#aaa;border-right-color:#404040}"
-    ".ln-code{display:table-cell;padding:0 16px;white-space:pre-wrap;word-wrap:break-word;"
-    "vertical-align:top;overflow-x:auto;font-family:Consolas,'Courier New',monospace;font-size:.9em;line-height:1.5}"
+    "body.ln pre{padding-left:0}body.ln pre>code{display:block;overflow:hidden}"
 
     /* Expand/collapse */
     ".mdv-collapsible{max-height:400px;overflow:hidden;position:relative}"
@@ -1170,8 +1063,9 @@ static void build_css(StrBuf* sb) {
     ".mdv-collapse-fade{position:absolute;bottom:0;left:0;right:0;height:60px;"
     "background:linear-gradient(rgba(246,248,250,0),#f6f8fa);pointer-events:none}"
     "body.dark .mdv-collapse-fade{background:linear-gradient(rgba(45,45,45,0),#2d2d2d)}"
+    ".mdv-collapsible.expanded>.mdv-collapse-fade{display:none}"
 
-    /* Syntax highlighting */
+    /* Syntax highlighting: sh-* spans come from the converter */
     ".sh-kw{color:#d73a49}body.dark .sh-kw{color:#569cd6}"
     ".sh-str{color:#032f62}body.dark .sh-str{color:#ce9178}"
     ".sh-num{color:#005cc5}body.dark .sh-num{color:#b5cea8}"
@@ -1259,19 +1153,14 @@ static void build_css(StrBuf* sb) {
     "body.dark .help-sep{background:#444}"
     ".help-foot{font-size:13px;color:#999;text-align:center;margin-top:14px}"
     "body.dark .help-foot{color:#777}"
-    );
-}
+    ;
 
 /* ── JavaScript ──────────────────────────────────────────────────────── */
 
-static void build_js(StrBuf* sb) {
-    /* Initial values from settings */
-    char init[128];
-    sprintf(init, "<script>var fs=%d,mw=%d,ln=%d,tt=null;",
-            g_settings.fontSize, g_settings.maxWidth, g_settings.lineNums);
-    sb_append(sb, init);
-
-    sb_append(sb,
+/* The static script. The settings it starts from (fs, mw, ln) are set by
+   the page's prologue before it runs. */
+static const char k_js[] =
+    "var tt=null;"
     /* Toast */
     "function toast(m){var t=document.getElementById('mdv-toast');t.innerText=m;t.className='on';"
     "if(tt)clearTimeout(tt);tt=setTimeout(function(){t.className=''},1500)}"
@@ -1280,7 +1169,7 @@ static void build_js(StrBuf* sb) {
     "function zi(){fs=Math.min(fs+1,30);af()}"
     "function zo(){fs=Math.max(fs-1,9);af()}"
     "function zr(){fs=19;af()}"
-    "function af(){document.body.style.fontSize=fs+'px';toast('Font: '+fs+'px')}"
+    "function af(){document.body.style.fontSize=fs+'px';toast('Font: '+fs+'px');smq()}"
 
     /* Theme toggle */
     "function td(){var b=document.body,h=document.documentElement;"
@@ -1291,58 +1180,70 @@ static void build_js(StrBuf* sb) {
 
     /* Column width */
     "function cw(){if(mw===0)mw=800;mw=Math.min(mw+80,9999);aw()}"
-    "function cn(){if(mw===0)return;mw=mw-80;if(mw<400){mw=0;document.getElementById('mdv-ct').style.maxWidth='none';toast('Width: full');return;}aw()}"
-    "function aw(){document.getElementById('mdv-ct').style.maxWidth=mw+'px';toast('Width: '+mw+'px')}"
-
-    /* Line numbers toggle */
-    "function tl(){"
-    "ln=ln?0:1;var ps=document.querySelectorAll('pre');"
-    "for(var i=0;i<ps.length;i++){"
-    "var p=ps[i];"
-    "if(ln&&!p._lnDone){"
-    "  var code=p.getElementsByTagName('code')[0];if(!code)continue;"
-    "  var htm=code.innerHTML;"
-    /* Count lines by splitting on newlines in the HTML */
-    "  var tmp=htm.replace(/<br\\s*\\/?>/gi,'\\n');"
-    "  var lines=tmp.split('\\n');"
-    "  while(lines.length>1&&lines[lines.length-1].replace(/\\s|&nbsp;/g,'')==='')lines.pop();"
-    "  var nums='';"
-    "  for(var j=0;j<lines.length;j++){nums+=(j+1)+'\\n';}"
-    "  var wrap=document.createElement('div');wrap.className='ln-wrap';"
-    "  var nd=document.createElement('div');nd.className='ln-nums';"
-    "  nd.style.whiteSpace='pre';nd.appendChild(document.createTextNode(nums));"
-    "  var cd=document.createElement('div');cd.className='ln-code';cd.innerHTML=htm;"
-    "  wrap.appendChild(nd);wrap.appendChild(cd);"
-    "  code.innerHTML='';code.appendChild(wrap);"
-    "  p.className=(p.className?p.className+' ':'')+'ln';p._lnDone=1;"
-    "}else if(!ln&&p._lnDone){"
-    "  var cd2=p.querySelector('.ln-code');if(cd2){var code2=p.getElementsByTagName('code')[0];"
-    "  if(code2){code2.innerHTML=cd2.innerHTML;}}"
-    "  p.className=p.className.replace(/\\bln\\b/g,'').replace(/^\\s+|\\s+$/g,'');p._lnDone=0;"
-    "}}"
-    "toast(ln?'Line numbers ON':'Line numbers OFF')}"
+    "function cn(){if(mw===0)return;mw=mw-80;if(mw<400){mw=0;document.getElementById('mdv-ct').style.maxWidth='none';toast('Width: full');smq();return;}aw()}"
+    "function aw(){document.getElementById('mdv-ct').style.maxWidth=mw+'px';toast('Width: '+mw+'px');smq()}"
 
-    /* TOC */
-    "function btoc(){var toc=document.getElementById('mdv-toc');"
-    "var hs=document.querySelectorAll('h1[id],h2[id],h3[id],h4[id]');"
-    "var old=toc.querySelectorAll('.ti');for(var i=0;i<old.length;i++)old[i].parentNode.removeChild(old[i]);"
-    "for(var i=0;i<hs.length;i++){var h=hs[i],a=document.createElement('a');"
-    "a.className='ti t'+h.tagName.charAt(1);a.innerText=h.innerText;a.href='#'+h.id;"
-    "a.onclick=(function(id){return function(e){e.preventDefault?e.preventDefault():e.returnValue=false;var el=document.getElementById(id);if(el)el.scrollIntoView()}})(h.id);"
-    "toc.appendChild(a)}}"
+    /* Line numbers: one class on the body shows or hides every gutter */
+    "function tl(){ln=ln?0:1;var b=document.body;"
+    "b.className=(b.className.replace(/\\bln\\b/g,'')+(ln?' ln':'')).replace(/^\\s+|\\s+$/g,'');"
+    "toast(ln?'Line numbers ON':'Line numbers OFF');smq()}"
+
+    /* TOC: the entries come prebuilt with the page; one handler serves them.
+       Virtualized, the section (data-s) is filled in before the jump. */
     "function ttoc(){var toc=document.getElementById('mdv-toc');"
     "if(toc.className.indexOf('on')>=0){toc.className='';document.body.style.marginRight='0'}"
-    "else{btoc();toc.className='on';document.body.style.marginRight='280px'}}"
-
-    /* Find */
-    "var fm=[],fi=-1;"
-    "function cf(){var ms=document.querySelectorAll('.hl');for(var i=0;i<ms.length;i++){"
+    "else{toc.className='on';document.body.style.marginRight='280px'}smq()}"
+    "function tocGo(e){e=e||window.event;var a=e.target||e.srcElement;"
+    "if(!a||a.tagName!=='A')return;pd(e);"
+    "var s=a.getAttribute('data-s'),h=a.getAttribute('href');"
+    "if(vs&&s!==null)vsFill(+s);"
+    "var el=h?document.getElementById(h.substring(h.indexOf('#')+1)):null;"
+    "if(!el&&vs&&s!==null)el=vs[+s];"
+    "if(el){el.scrollIntoView();if(vs)vsUpd()}}"
+
+    /* Find. The host's text index counts the matches (window.external.find)
+       and places a window of them around the current one (hits) as UTF-16
+       ranges of a data-line block's text, so only those are marked. fx: 1
+       match case, 2 whole words, 4 start from the last. Without an index,
+       every match in #mdv-ct is marked in the DOM. */
+    "var fm=[],fi=-1,fN=0,fW=0,fI=0,fq='',fx=0,fE=null,fT=null;"
+    "function fUnmark(){var ms=document.querySelectorAll('.hl');for(var i=0;i<ms.length;i++){"
     "var m=ms[i],p=m.parentNode;p.replaceChild(document.createTextNode(m.innerText),m);p.normalize()}"
-    "fm=[];fi=-1;document.getElementById('mdv-fc').innerText=''}"
-
-    "function df(txt){cf();if(!txt)return;"
-    "var lo=txt.toLowerCase();"
-    "var ct=document.getElementById('mdv-ct');if(!ct)return;"
+    "fm=[];fW=0;if(fE){fE._pin=0;fE=null}}"
+    "function cf(){fUnmark();fi=-1;fN=0;fI=0;fq='';document.getElementById('mdv-fc').innerText=''}"
+
+    "function df(txt,fl){cf();fq=txt||'';fx=fl||0;if(!fq){ufh();return}"
+    "var n=-1;try{n=window.external.find(fq,fx&3)}catch(ex){}"
+    "if(n>=0){fI=1;fN=n;if(n)fGo(fx&4?n-1:0);else ufh();return}"
+    "var ct=document.getElementById('mdv-ct');if(ct)hlIn(ct,fq);"
+    "var ms=document.querySelectorAll('.hl');for(var i=0;i<ms.length;i++)fm.push([ms[i]]);"
+    "fi=fm.length?(fx&4?fm.length-1:0):-1;ufh()}"
+
+    /* Mark the window around match i, filling (and pinning) its section first */
+    "function fMark(i){fUnmark();fW=Math.max(0,i-32);"
+    "var r=window.external.hits(fW,Math.min(fN,fW+64)),p=r?r.split(';'):[],k,j;"
+    "for(k=0;k<p.length;k++){p[k]=p[k].split(',');fm.push(null)}"
+    "if(vs&&p[i-fW]&&+p[i-fW][1]>=0){var s=+p[i-fW][1];vsFill(s);fE=vs[s];fE._pin=1}"
+    "for(k=0;k<p.length;k=j){for(j=k+1;j<p.length&&p[j][0]===p[k][0];j++);"
+    "var el=+p[k][0]<0?null:document.querySelector('[data-line=\"'+p[k][0]+'\"]');"
+    "if(el)hlRanges(el,p.slice(k,j),k)}}"
+
+    "function fTexts(n,a){for(var c=n.firstChild;c;c=c.nextSibling){"
+    "if(c.nodeType===3)a.push(c);else if(c.nodeType===1&&c.tagName!=='SCRIPT'&&c.tagName!=='STYLE'&&c.className!=='mdv-expand-btn')fTexts(c,a)}return a}"
+
+    /* Wrap the ranges [a,b) of el's text in .hl spans (several when a match
+       crosses elements); last first, so the offsets before stay valid */
+    "function hlRanges(el,hs,k0){var ts=fTexts(el,[]),os=[],o=0,t,k;"
+    "for(t=0;t<ts.length;t++){os.push(o);o+=ts[t].nodeValue.length}"
+    "for(k=hs.length-1;k>=0;k--){var a=+hs[k][2],b=+hs[k][3],sp=[];"
+    "for(t=ts.length-1;t>=0;t--){var n=ts[t],l=n.nodeValue.length;"
+    "if(os[t]>=b)continue;if(os[t]+l<=a)break;"
+    "var s=Math.max(a-os[t],0),e=Math.min(b-os[t],l);if(e<l)n.splitText(e);var m=s?n.splitText(s):n;"
+    "var w=document.createElement('span');w.className='hl';m.parentNode.replaceChild(w,m);w.appendChild(m);sp.unshift(w)}"
+    "fm[k0+k]=sp.length?sp:null}}"
+
+    /* Wrap every match of txt in the text under ct in a .hl span */
+    "function hlIn(ct,txt){var lo=txt.toLowerCase();"
     "var ns=[];try{"
     "var w=document.createTreeWalker(ct,4,{acceptNode:function(n){return 1}},false);"
     "while(w.nextNode()){var n=w.currentNode;"
@@ -1359,34 +1260,32 @@ static void build_js(StrBuf* sb) {
     "if(pos>idx)f.appendChild(document.createTextNode(v.substring(idx,pos)));"
     "var sp=document.createElement('span');sp.className='hl';"
     "sp.appendChild(document.createTextNode(v.substring(pos,pos+txt.length)));f.appendChild(sp);idx=pos+txt.length}"
-    "if(idx<v.length)f.appendChild(document.createTextNode(v.substring(idx)));nd.parentNode.replaceChild(f,nd)}"
-    "fm=document.querySelectorAll('.hl');fi=fm.length>0?0:-1;ufh()}"
+    "if(idx<v.length)f.appendChild(document.createTextNode(v.substring(idx)));nd.parentNode.replaceChild(f,nd)}}"
 
-    "function ufh(){for(var i=0;i<fm.length;i++)fm[i].className='hl';"
-    "if(fi>=0&&fi<fm.length){fm[fi].className='hl hl-a';"
-    "var r=fm[fi].getBoundingClientRect();"
+    "function fGo(i){fi=i;if(fI&&!(i>=fW&&i<fW+fm.length&&fm[i-fW]&&document.body.contains(fm[i-fW][0])))fMark(i);ufh()}"
+
+    /* ns: leave the page where it is */
+    "function ufh(ns){var c=document.getElementById('mdv-fc'),n=fI?fN:fm.length,a=fi>=0?fm[fi-fW]:null,k,j;"
+    "for(k=0;k<fm.length;k++)if(fm[k])for(j=0;j<fm[k].length;j++)fm[k][j].className='hl';"
+    "if(a){for(j=0;j<a.length;j++)a[j].className='hl hl-a';"
+    "if(!ns){var r=a[0].getBoundingClientRect();"
     "var wh=window.innerHeight||document.documentElement.clientHeight;"
     "var st=document.documentElement.scrollTop||document.body.scrollTop;"
     "var target=st+r.top-Math.max(wh/3,60);"
-    "if(target<0)target=0;window.scrollTo(0,target)}"
-    "var c=document.getElementById('mdv-fc');"
-    "if(fm.length>0)c.innerText=(fi+1)+' of '+fm.length;"
-    "else c.innerText=document.getElementById('mdv-fi').value?'No matches':''}"
-
-    "function fn(){if(fm.length===0)return;fi=(fi+1)%fm.length;ufh()}"
-    "function fp(){if(fm.length===0)return;fi=(fi-1+fm.length)%fm.length;ufh()}"
+    "if(target<0)target=0;window.scrollTo(0,target)}}"
+    "else if(fE&&!ns)fE.scrollIntoView();"
+    "if(vs&&fi>=0)vsUpd();"
+    "c.innerText=n>0?(fi+1)+' of '+n:fq?'No matches':''}"
+
+    /* Typing is debounced; next/previous first run a pending search */
+    "function fIn(){if(fT)clearTimeout(fT);fT=setTimeout(function(){fT=null;"
+    "var v=document.getElementById('mdv-fi').value;if(v!==fq)df(v)},150)}"
+    "function fSync(){if(fT){clearTimeout(fT);fT=null;df(document.getElementById('mdv-fi').value)}}"
+    "function fn(){fSync();var n=fI?fN:fm.length;if(n>0)fGo((fi+1)%n)}"
+    "function fp(){fSync();var n=fI?fN:fm.length;if(n>0)fGo((fi-1+n)%n)}"
     "function sf(){var b=document.getElementById('mdv-fb');b.className='on';"
-    "var inp=document.getElementById('mdv-fi');inp.focus();inp.select();"
-    "mdvStartFind()}"
-    "function hf(){document.getElementById('mdv-fb').className='';cf();mdvStopFind()}"
-
-    /* Poll-based find: watches input value since MSHTML inline events are unreliable */
-    "var _fwt=null,_flv='';"
-    "function mdvStartFind(){mdvStopFind();_flv=document.getElementById('mdv-fi').value||'';"
-    "_fwt=setInterval(function(){"
-    "var inp=document.getElementById('mdv-fi');if(!inp)return;"
-    "var v=inp.value;if(v!==_flv){_flv=v;df(v)}},150)}"
-    "function mdvStopFind(){if(_fwt){clearInterval(_fwt);_fwt=null}}"
+    "var inp=document.getElementById('mdv-fi');inp.focus();inp.select()}"
+    "function hf(){document.getElementById('mdv-fb').className='';if(fT){clearTimeout(fT);fT=null}cf()}"
 
     /* Help */
     "function th(){var h=document.getElementById('mdv-help');h.className=h.className==='on'?'':'on'}"
@@ -1397,77 +1296,91 @@ static void build_js(StrBuf* sb) {
     "if(sh>0)b.style.width=(st/sh*100)+'%';else b.style.width='0'}"
     "window.onscroll=up;"
 
-    /* Syntax highlighting — regex-based, applied once on load */
-    "function shAll(){"
-    "var pres=document.querySelectorAll('pre code[class]');"
-    "for(var i=0;i<pres.length;i++){var el=pres[i],cls=el.className||'';"
-    "var lang=cls.replace('language-','');"
-    "if(!lang)continue;"
-    "var h=el.innerHTML;"
-
-    /* Comments */
-    "if(lang==='html'||lang==='xml'){"
-    "h=h.replace(/(&lt;!--[\\s\\S]*?--&gt;)/g,'<span class=\"sh-cm\">$1</span>');"
-    "}else{"
-    "h=h.replace(/((?:^|\\n)\\s*#[^\\n]*)/g,'<span class=\"sh-cm\">$1</span>');"  /* # comments for python/bash/ruby */
-    "h=h.replace(/(\\/{2}[^\\n]*)/g,'<span class=\"sh-cm\">$1</span>');"          /* // comments */
-    "h=h.replace(/(--[^\\n]*)/g,'<span class=\"sh-cm\">$1</span>');"              /* -- sql comments */
-    "h=h.replace(/(\\/\\*[\\s\\S]*?\\*\\/)/g,'<span class=\"sh-cm\">$1</span>');" /* block comments */
-    "}"
-
-    /* Strings */
-    "h=h.replace(/(&quot;(?:[^&]|&(?!quot;))*?&quot;)/g,'<span class=\"sh-str\">$1</span>');"
-    "h=h.replace(/('(?:[^'\\\\]|\\\\.)*?')/g,'<span class=\"sh-str\">$1</span>');"
-    "h=h.replace(/(`(?:[^`\\\\]|\\\\.)*?`)/g,'<span class=\"sh-str\">$1</span>');"
-
-    /* Numbers */
-    "h=h.replace(/\\b(\\d+\\.?\\d*(?:e[+-]?\\d+)?|0x[0-9a-fA-F]+)\\b/g,'<span class=\"sh-num\">$1</span>');"
-
-    /* HTML/XML tags */
-    "if(lang==='html'||lang==='xml'){"
-    "h=h.replace(/(&lt;\\/?)([a-zA-Z][a-zA-Z0-9]*)/g,'$1<span class=\"sh-tag\">$2</span>');"
-    "h=h.replace(/\\s([a-zA-Z-]+)(=)/g,' <span class=\"sh-attr\">$1</span>$2');"
-    "}else{"
-
-    /* Keywords per language family */
-    "var kws='';"
-    "if(lang==='js'||lang==='javascript'||lang==='typescript'||lang==='ts')"
-    "kws='\\\\b(var|let|const|function|return|if|else|for|while|do|switch|case|break|continue|new|this|class|extends|import|export|from|default|try|catch|finally|throw|typeof|instanceof|async|await|yield|of|in|null|undefined|true|false)\\\\b';"
-    "else if(lang==='python'||lang==='py')"
-    "kws='\\\\b(def|class|return|if|elif|else|for|while|break|continue|import|from|as|try|except|finally|raise|with|yield|lambda|pass|and|or|not|in|is|None|True|False|self|print|global|nonlocal|assert|del)\\\\b';"
-    "else if(lang==='c'||lang==='cpp'||lang==='csharp'||lang==='cs'||lang==='java'||lang==='rust'||lang==='go')"
-    "kws='\\\\b(int|char|float|double|void|long|short|unsigned|signed|struct|enum|union|typedef|sizeof|static|extern|const|volatile|register|auto|return|if|else|for|while|do|switch|case|break|continue|goto|default|class|public|private|protected|virtual|override|new|delete|this|true|false|null|NULL|nullptr|fn|let|mut|pub|impl|use|mod|match|loop|async|await|func|package|import|var|type|interface|defer|range|select|chan)\\\\b';"
-    "else if(lang==='sql')"
-    "kws='\\\\b(SELECT|FROM|WHERE|INSERT|UPDATE|DELETE|CREATE|DROP|ALTER|TABLE|INDEX|JOIN|LEFT|RIGHT|INNER|OUTER|ON|AND|OR|NOT|IN|IS|NULL|AS|ORDER|BY|GROUP|HAVING|LIMIT|OFFSET|UNION|ALL|DISTINCT|INTO|VALUES|SET|BEGIN|COMMIT|ROLLBACK|EXISTS|BETWEEN|LIKE|COUNT|SUM|AVG|MAX|MIN|select|from|where|insert|update|delete|create|drop|alter|table|join|left|right|inner|outer|on|and|or|not|in|is|null|as|order|by|group|having|limit)\\\\b';"
-    "else if(lang==='bash'||lang==='sh'||lang==='shell'||lang==='zsh')"
-    "kws='\\\\b(if|then|else|elif|fi|for|while|do|done|case|esac|in|function|return|local|export|source|echo|exit|cd|ls|grep|sed|awk|cat|rm|mkdir|cp|mv|chmod|chown|sudo|apt|yum|pip|npm)\\\\b';"
-    "else if(lang==='css'||lang==='scss'||lang==='less')"
-    "kws='\\\\b(color|background|margin|padding|border|font|display|position|width|height|top|left|right|bottom|flex|grid|none|block|inline|relative|absolute|fixed|inherit|auto|important|solid|transparent)\\\\b';"
-    "else if(lang==='php')"
-    "kws='\\\\b(function|return|if|else|elseif|for|foreach|while|do|switch|case|break|continue|class|public|private|protected|static|new|echo|print|null|true|false|array|isset|empty|unset|require|include|use|namespace|try|catch|finally|throw|var)\\\\b';"
-    "if(kws){var re=new RegExp(kws,'g');h=h.replace(re,'<span class=\"sh-kw\">$1</span>');}"
-
-    /* Function calls: word followed by ( */
-    "h=h.replace(/\\b([a-zA-Z_][a-zA-Z0-9_]*)\\s*\\(/g,'<span class=\"sh-fn\">$1</span>(');"
-    "}"
-
-    "el.innerHTML=h;}}"
-
-    /* Expand/collapse for long blocks */
-    "function initCollapse(){"
-    "var blocks=document.querySelectorAll('pre,blockquote');"
-    "for(var i=0;i<blocks.length;i++){"
-    "var b=blocks[i];if(b.scrollHeight>420){"
-    "b.className=(b.className?b.className+' ':'')+'mdv-collapsible';"
-    "var fade=document.createElement('div');fade.className='mdv-collapse-fade';b.appendChild(fade);"
-    "var btn=document.createElement('button');btn.className='mdv-expand-btn';"
-    "btn.innerText='\\u25BC Show more';btn.onclick=(function(bl,fd,bt){"
-    "return function(){if(bl.className.indexOf('expanded')>=0){"
-    "bl.className=bl.className.replace(' expanded','');bt.innerText='\\u25BC Show more';fd.style.display=''}"
-    "else{bl.className+=' expanded';bt.innerText='\\u25B2 Show less';fd.style.display='none'}}"
-    "})(b,fade,btn);"
-    "b.parentNode.insertBefore(btn,b.nextSibling);"
-    "}}}"
+    /* Virtualized sections: .mdv-sec placeholders are filled from
+       window.external near the viewport and emptied far from it */
+    "var vs=null,vsOn=[],vsT=null;"
+    "function vsInit(){vs=document.querySelectorAll('.mdv-sec');"
+    "window.onscroll=function(){up();if(!vsT)vsT=setTimeout(vsUpd,30)};"
+    "window.onresize=function(){window.onscroll();smq()};vsUpd()}"
+    "function vsFill(i){var e=vs[i];if(e._on)return;"
+    "e.innerHTML=window.external.sec(i);e.style.height='';e._on=1;vsOn.push(i);smq()}"
+    "function vsUpd(){vsT=null;if(!vs)return;"
+    "var wh=window.innerHeight||document.documentElement.clientHeight,n=vs.length,lo=0,hi=n;"
+    "while(lo<hi){var m=(lo+hi)>>1;if(vs[m].getBoundingClientRect().bottom<-wh)lo=m+1;else hi=m}"
+    /* Fill from a screen above to two below; above the viewport, keep what is shown in place */
+    "for(var i=lo;i<n&&vs[i].getBoundingClientRect().top<2*wh;i++){if(vs[i]._on)continue;"
+    "var h0=vs[i].offsetHeight,up0=vs[i].getBoundingClientRect().bottom<=0;"
+    "vsFill(i);if(up0)window.scrollBy(0,vs[i].offsetHeight-h0)}"
+    /* Empty the far ones, at the height they had */
+    "var keep=[];for(var j=0;j<vsOn.length;j++){var e=vs[vsOn[j]],r=e.getBoundingClientRect();"
+    "if(e._pin||(r.bottom>-3*wh&&r.top<4*wh))keep.push(vsOn[j]);"
+    "else{e.style.height=e.offsetHeight+'px';e.innerHTML='';e._on=0;smq()}}vsOn=keep}"
+
+    /* Expand/collapse: the converter marked the long blocks and put a
+       button after each, so one handler on the content serves them all */
+    "function cx(e){e=e||window.event;var t=e.target||e.srcElement;"
+    "if(t.className!=='mdv-expand-btn')return;"
+    "var b=t.previousElementSibling,x=b.className.indexOf(' expanded')<0;"
+    "b.className=x?b.className+' expanded':b.className.replace(' expanded','');"
+    "t.innerText=x?'\\u25B2 Show less':'\\u25BC Show more';smq()}"
+
+    /* Scroll sync, while the split view is open (sv): where each top-level
+       block starts, or an unfilled section's placeholder (data-sl), sent
+       to the plugin once the layout has settled after a change */
+    "var sv=0,smT=null;"
+    "function smq(){if(!sv)return;if(smT)clearTimeout(smT);smT=setTimeout(sm,150)}"
+    "function sm(){smT=null;var de=document.documentElement,b=document.body,"
+    "y0=Math.max(de.scrollTop,b.scrollTop),r=[],i,e,l,"
+    "a=document.getElementById('mdv-ct').querySelectorAll('[data-line],.mdv-sec');"
+    "for(i=0;i<a.length;i++){e=a[i];l=e.getAttribute('data-line');"
+    "if(l===null){if(e._on)continue;l=e.getAttribute('data-sl')}"
+    "r.push(l+','+Math.round(e.getBoundingClientRect().top+y0))}"
+    "r.push('-1,'+Math.max(de.scrollHeight,b.scrollHeight));"
+    "try{window.external.map(r.join(';'))}catch(ex){}}"
+
+    /* Progressive rendering: the plugin appended a chunk to #mdv-ct / the last one */
+    "function mdvChunk(){up();smq()}"
+    "function mdvDone(){mdvChunk();"
+    "if(fq)df(fq,fx)}"
+
+    /* Live reload: the plugin converted the blocks that changed. Each hunk,
+       "lineAt,lineEnd,del,shift" (MdDocHunk), replaces the nodes from its
+       first block (-1: the start) up to the kept block at lineEnd (-1: the
+       end); the kept blocks after it move down by its shift. The block at
+       the top of the view stays where it was. If an anchor is missing, or
+       the plugin had no blocks to diff against (all), the whole body is
+       swapped instead. */
+    "function mvh(e,d){var m=/^mdv-h(\\d+)$/.exec(e.id);if(m)e.id='mdv-h'+(+m[1]+d)}"
+    "function mdvPatch(all){var x=window.external,ct=document.getElementById('mdv-ct'),p=all?'':x.patch(-1),"
+    "hs=[],by={},els,top=null,ty=0,ok=!all,i,k,h,e,l,g,dl;"
+    "if(!ct||!(p||all))return;fUnmark();"
+    "if(p){p=p.split(';');for(k=0;k<p.length;k++){h=p[k].split(',');hs.push([+h[0],+h[1],+h[2],+h[3]])}}"
+    "els=ct.querySelectorAll('[data-line]');"
+    "for(i=0;i<els.length;i++)if(els[i].parentNode===ct)by[els[i].getAttribute('data-line')]=els[i];"
+    "for(k=0;k<hs.length;k++){h=hs[k];h.s=h[2]?(h[0]<0?ct.firstChild:by[h[0]]):null;h.e=h[1]<0?null:by[h[1]];"
+    "if((h[2]&&!h.s)||(h[1]>=0&&!h.e)||(h.s&&h.e&&!(h.s.compareDocumentPosition(h.e)&4)))ok=0}"
+    "if(!ok){ct.innerHTML=x.patch(-3);els=[]}"
+    "for(i=0;i<els.length;i++){e=els[i];if(e.parentNode!==ct)continue;l=+e.getAttribute('data-line');g=0;dl=0;"
+    "for(k=0;k<hs.length;k++){h=hs[k];if(h[2]&&(h[0]<0||l>=h[0])&&(h[1]<0||l<h[1]))g=1;if(h[1]>=0&&l>=h[1])dl=h[3]}"
+    "if(g)continue;if(!top&&e.getBoundingClientRect().bottom>0){top=e;ty=e.getBoundingClientRect().top}"
+    "if(dl){e.setAttribute('data-line',l+dl);mvh(e,dl);"
+    "var hd=e.querySelectorAll('[id^=\"mdv-h\"]');for(k=0;k<hd.length;k++)mvh(hd[k],dl)}}"
+    "for(k=0;ok&&k<hs.length;k++){h=hs[k];e=h.s;"
+    "while(e&&e!==h.e){l=e.nextSibling;ct.removeChild(e);e=l}"
+    "p=x.patch(k);if(p){if(h.e)h.e.insertAdjacentHTML('beforebegin',p);else ct.insertAdjacentHTML('beforeend',p)}}"
+    "var t=document.getElementById('mdv-toc-t');if(t){while(t.nextSibling)t.parentNode.removeChild(t.nextSibling);"
+    "t.parentNode.insertAdjacentHTML('beforeend',x.patch(-2))}"
+    "if(top&&document.body.contains(top))window.scrollBy(0,Math.round(top.getBoundingClientRect().top-ty));"
+    "rf();up();smq()}"
+
+    /* The search again over the new version, at the same match number,
+       without moving the page */
+    "function rf(){if(!fq)return;var i=fi,n=-1;fm=[];fW=0;fi=-1;"
+    "try{n=window.external.find(fq,fx&3)}catch(ex){}"
+    "if(n>=0){fI=1;fN=n;if(n){fi=Math.min(Math.max(i,0),n-1);fMark(fi)}}"
+    "else{fI=0;fN=0;hlIn(document.getElementById('mdv-ct'),fq);var ms=document.querySelectorAll('.hl');"
+    "for(var j=0;j<ms.length;j++)fm.push([ms[j]]);if(fm.length)fi=Math.min(Math.max(i,0),fm.length-1)}"
+    "ufh(1)}"
 
     /* Keyboard handler (backup — primary interception is via IE subclass) */
     "function pd(e){if(e.preventDefault)e.preventDefault();else e.returnValue=false}"
@@ -1490,11 +1403,113 @@ static void build_js(StrBuf* sb) {
 
     /* Init */
     "window.onload=function(){"
-    "shAll();initCollapse();"
-    "shAll();initCollapse();"
-    "if(ln)tl();"  /* apply line numbers if saved */
+    "document.getElementById('mdv-toc').onclick=tocGo;"
+    "if(window.mdvVirtual)vsInit();"
+    "var f=document.getElementById('mdv-fi');"
+    "if(f.addEventListener){f.addEventListener('input',fIn,false);f.addEventListener('keyup',fIn,false)}"
+    "else f.attachEvent('onpropertychange',fIn);"
+    "document.getElementById('mdv-ct').onclick=cx;"
+    "if(!window.mdvVirtual)window.onresize=smq;"
     "up()};"
-    "</script>");
+    ;
+
+/* ── Shared Assets ───────────────────────────────────────────────────── */
+
+/* The style and script are the same for every page, so they are written
+   once, as mdv-<hash>.css and .js in the cache folder, and pages link
+   them: the browser reads and parses them once and keeps them in its
+   cache. A page carries only its settings prologue (write_page), or both
+   inline where the files cannot be written. The name is a hash of the
+   two, so builds with the same ones (the 32- and 64-bit plugin) share
+   them; another set is only dropped once nothing has used it for
+   ASSET_KEEP_DAYS, so two builds in use never delete each other's. */
+
+#define ASSET_TOUCH_DAYS  1    /* assets in use are re-stamped this often */
+#define ASSET_KEEP_DAYS   30
+
+static long long age_days(const FILETIME* ft) {
+    FILETIME now; GetSystemTimeAsFileTime(&now);
+    unsigned long long n = ((unsigned long long)now.dwHighDateTime << 32) | now.dwLowDateTime,
+                       t = ((unsigned long long)ft->dwHighDateTime << 32) | ft->dwLowDateTime;
+    return n > t ? (long long)((n - t) / 864000000000ULL) : 0;   /* 100 ns units */
+}
+
+/* Write an asset unless it is there already; one that is there gets a
+   new write time once a day. Written through a temp file and a rename,
+   so no page ever links half of one. *touched: either happened. */
+static int put_asset(const WCHAR* path, const char* data, size_t len, int* touched) {
+    WIN32_FILE_ATTRIBUTE_DATA fa;
+    if (GetFileAttributesExW(path, GetFileExInfoStandard, &fa)) {
+        if (age_days(&fa.ftLastWriteTime) < ASSET_TOUCH_DAYS) return 0;
+        HANDLE h = CreateFileW(path, FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL);
+        if (h != INVALID_HANDLE_VALUE) {
+            FILETIME now; GetSystemTimeAsFileTime(&now);
+            if (SetFileTime(h, NULL, NULL, &now)) *touched = 1;
+            CloseHandle(h);
+        }
+        return 0;
+    }
+    WCHAR tmp[MAX_PATH + 16];
+    wsprintfW(tmp, L"%s.%08x", path, GetCurrentThreadId());
+    FILE* f = _wfopen(tmp, L"wb");
+    if (!f) return -1;
+    int bad = fwrite(data, 1, len, f) != len;
+    if (fclose(f) != 0) bad = 1;
+    if (bad || !MoveFileExW(tmp, path, MOVEFILE_REPLACE_EXISTING)) { _wremove(tmp); return -1; }
+    *touched = 1;
+    return 0;
+}
+
+/* Other assets nothing has used for ASSET_KEEP_DAYS, checked when this
+   set is written or re-stamped */
+static void drop_old_assets(const WCHAR* dir, const WCHAR* keep) {
+    WCHAR pat[MAX_PATH + 16], path[MAX_PATH + 16];
+    wsprintfW(pat, L"%s\\mdv-*.*", dir);
+    WIN32_FIND_DATAW fd;
+    HANDLE h = FindFirstFileW(pat, &fd);
+    if (h == INVALID_HANDLE_VALUE) return;
+    do {
+        const WCHAR* ext = wcsrchr(fd.cFileName, L'.');
+        if (!ext || (_wcsicmp(ext, L".css") && _wcsicmp(ext, L".js")) || wcsncmp(fd.cFileName, keep, wcslen(keep)) == 0
+            || age_days(&fd.ftLastWriteTime) < ASSET_KEEP_DAYS) continue;
+        wsprintfW(path, L"%s\\%s", dir, fd.cFileName);
+        DeleteFileW(path);
+    } while (FindNextFileW(h, &fd));
+    FindClose(h);
+}
+
+/* Make sure the assets are in the cache folder and put their
+   file:// URL, less the extension, in `url`. -1 if they must go inline. */
+static int shared_assets(const MDVSettings* st, char* url, size_t cap) {
+    static const char hex[] = "0123456789ABCDEF";
+    WCHAR dir[MAX_PATH], name[32], path[MAX_PATH];
+    if (cache_dir(st, dir)) return -1;
+    unsigned long long id = md_hash64(k_js, sizeof(k_js) - 1, md_hash64(k_css, sizeof(k_css) - 1, 0));
+    wsprintfW(name, L"mdv-%08x%08x", (unsigned)(id >> 32), (unsigned)id);
+    if (wcslen(dir) + wcslen(name) + 6 > MAX_PATH) return -1;
+    CreateDirectoryW(dir, NULL);
+    wsprintfW(path, L"%s\\%s", dir, name);
+    size_t pn = wcslen(path); int touched = 0;
+    wcscpy(path + pn, L".css");
+    if (put_asset(path, k_css, sizeof(k_css) - 1, &touched)) return -1;
+    wcscpy(path + pn, L".js");
+    if (put_asset(path, k_js, sizeof(k_js) - 1, &touched)) return -1;
+    if (touched) drop_old_assets(dir, name);
+    path[pn] = 0;
+
+    /* file:///C:/dir/mdv-..., everything but plain characters escaped */
+    char u8[MAX_PATH * 3];
+    if (!WideCharToMultiByte(CP_UTF8, 0, path, -1, u8, (int)sizeof(u8), NULL, NULL)) return -1;
+    size_t n = 8;
+    memcpy(url, "file:///", 8);
+    for (const unsigned char* p = (const unsigned char*)u8; *p; p++) {
+        if (n + 4 > cap) return -1;
+        if (*p == '\\') url[n++] = '/';
+        else if (*p < 128 && (isalnum(*p) || strchr("-._~/:", *p))) url[n++] = (char)*p;
+        else { url[n++] = '%'; url[n++] = hex[*p >> 4]; url[n++] = hex[*p & 15]; }
+    }
+    url[n] = 0;
+    return 0;
 }
 
 /* ── HTML UI elements ────────────────────────────────────────────────── */
@@ -1509,7 +1524,6 @@ static const char* get_ui(void) {
     "<button class=\"fb\" onclick=\"fn()\">&raquo;</button>"
     "<button class=\"fb\" onclick=\"hf()\">&times;</button>"
     "</div>"
-    "<div id=\"mdv-toc\"><div id=\"mdv-toc-t\">Table of Contents</div></div>"
     "<div id=\"mdv-toast\"></div>"
     "<div id=\"mdv-help\">"
     "<h3>MDView Keyboard Shortcuts</h3>"
@@ -1545,18 +1559,6 @@ static const char* get_ui(void) {
     "</div>";
 }
 
-/* ── File Reading ────────────────────────────────────────────────────── */
-
-static char* read_file_w(const WCHAR* fn) {
-    FILE* f=_wfopen(fn,L"rb"); if(!f)return NULL;
-    fseek(f,0,SEEK_END); long sz=ftell(f); fseek(f,0,SEEK_SET);
-    char* buf=(char*)malloc(sz+1); if(!buf){fclose(f);return NULL;}
-    fread(buf,1,sz,f); buf[sz]='\0'; fclose(f);
-    if(sz>=3&&(unsigned char)buf[0]==0xEF&&(unsigned char)buf[1]==0xBB&&(unsigned char)buf[2]==0xBF)
-        memmove(buf,buf+3,sz-2);
-    return buf;
-}
-
 /* ── WebBrowser Control ──────────────────────────────────────────────── */
 
 #ifndef READYSTATE_LOADED
@@ -1580,28 +1582,94 @@ static HRESULT create_browser(HWND hwnd, IWebBrowser2** ppB, IOleObject** ppO, S
     *ppB=pB; *ppO=pO; return S_OK;
 }
 
-static void navigate_to_html(IWebBrowser2* pB, const char* html, const WCHAR* dir, WCHAR* outTempPath) {
-    outTempPath[0] = 0;
+/* Everything around the converted body, in page order */
+struct PageParts {
+    const char* md; size_t mdLen;
+    const char* body; size_t bodyLen;   /* already converted (progressive first chunk), or NULL */
+    int dark, lineNums, fontSize, maxWidth;
+    const char* assets;   /* URL of the shared style and script less ".css"/".js", or NULL: inline */
+    const char* ui;
+    MdOutline* outline;   /* converting the body fills it; with `body`, as it is */
+};
+
+static int write_body(MdSink* out, const PageParts* pg) {
+    if (pg->body) return md_sink_write(out, pg->body, pg->bodyLen);
+    MdContext* cx = new_context(pg->fontSize);
+    if (cx) md_context_set_outline(cx, pg->outline);
+    int rc = cx ? md_render_to(cx, pg->md, pg->mdLen, out) : -1;
+    md_context_free(cx);
+    return rc;
+}
+
+/* The TOC entries, h1-h4, straight from the outline of the conversion */
+static int write_toc(MdSink* out, const MdOutline* o) {
+    StrBuf sb; sb_init(&sb);
+    md_outline_toc(o, 4, &sb);
+    int rc = md_sink_write(out, sb.data, sb.len);
+    free(sb.data);
+    return rc;
+}
+
+/* Stream the page into a sink; the body is converted straight into it,
+   so neither it nor the page is ever held whole. 0 on success. */
+static int write_page(MdSink* out, const PageParts* pg) {
+    /* The prologue: what of the style and script depends on the settings */
+    char css[80], js[64];
+    int n = sprintf(css, "body{font-size:%dpx}", pg->fontSize);
+    if (pg->maxWidth > 0) sprintf(css + n, "#mdv-ct{max-width:%dpx}", pg->maxWidth);
+    sprintf(js, "var fs=%d,mw=%d,ln=%d;", pg->fontSize, pg->maxWidth, pg->lineNums);
+
+    int rc = md_sink_puts(out, pg->dark ? "<!DOCTYPE html><html style=\"background:#1e1e1e\"><head>" : "<!DOCTYPE html><html><head>")
+          || md_sink_puts(out, "<meta http-equiv=\"X-UA-Compatible\" content=\"IE=edge\">"
+                               "<meta charset=\"utf-8\">")
+          || (pg->assets ? md_sink_puts(out, "<link rel=\"stylesheet\" href=\"") || md_sink_puts(out, pg->assets)
+                           || md_sink_puts(out, ".css\"><style>")
+                         : md_sink_puts(out, "<style>") || md_sink_write(out, k_css, sizeof(k_css) - 1))
+          || md_sink_puts(out, css)
+          || md_sink_puts(out, "</style></head>")
+          || md_sink_puts(out, pg->dark ? (pg->lineNums ? "<body class=\"dark ln\">" : "<body class=\"dark\">")
+                                        : (pg->lineNums ? "<body class=\"ln\">" : "<body>"))
+          || md_sink_puts(out, "<script>")
+          || md_sink_puts(out, js)
+          || (pg->assets ? md_sink_puts(out, "</script><script src=\"") || md_sink_puts(out, pg->assets)
+                           || md_sink_puts(out, ".js\"></script>")
+                         : md_sink_write(out, k_js, sizeof(k_js) - 1) || md_sink_puts(out, "</script>"))
+          || md_sink_puts(out, pg->ui)
+          || md_sink_puts(out, "<div id=\"mdv-ct\">")
+          || write_body(out, pg)
+          || md_sink_puts(out, "</div><div id=\"mdv-toc\"><div id=\"mdv-toc-t\">Table of Contents</div>")
+          || write_toc(out, pg->outline)
+          || md_sink_puts(out, "</div></body></html>");
+    return rc ? -1 : 0;
+}
 
-    /* Write HTML to a temp file in the same directory as the .md file.
-       This makes MSHTML load in the Local Machine zone so file:// images work. */
-    WCHAR tempPath[MAX_PATH];
+/* The temp file for the page, in the same directory as the .md file.
+   This makes MSHTML load in the Local Machine zone so file:// images work. */
+static void temp_page_path(const WCHAR* dir, WCHAR* tempPath) {
     wcscpy(tempPath, dir);
     /* Append a unique temp filename */
     WCHAR tempName[64];
     wsprintfW(tempName, L"_mdview_%08x.html", GetTickCount());
     wcscat(tempPath, tempName);
+}
 
+/* Show the page from tempPath, written here unless `ready` (a render
+   cache hit put it there already). 1 if the page is in that file, 0 if
+   it went through the document.write fallback. */
+static int navigate_to_html(IWebBrowser2* pB, const PageParts* pg, const WCHAR* tempPath, int ready) {
     /* Write UTF-8 HTML with BOM and Mark of the Web */
-    FILE* tf = _wfopen(tempPath, L"wb");
-    if (tf) {
-        /* UTF-8 BOM */
-        fputc(0xEF, tf); fputc(0xBB, tf); fputc(0xBF, tf);
-        /* Mark of the Web — tells MSHTML to allow script execution in local files */
-        fprintf(tf, "<!-- saved from url=(0016)http://localhost -->\r\n");
-        fwrite(html, 1, strlen(html), tf);
-        fclose(tf);
-        wcscpy(outTempPath, tempPath);
+    FILE* tf = ready ? NULL : _wfopen(tempPath, L"wb");
+    if (ready || tf) {
+        if (tf) {
+            /* UTF-8 BOM */
+            fputc(0xEF, tf); fputc(0xBB, tf); fputc(0xBF, tf);
+            /* Mark of the Web — tells MSHTML to allow script execution in local files */
+            fprintf(tf, "<!-- saved from url=(0016)http://localhost -->\r\n");
+            MdSink fs; md_sink_file(&fs, tf);
+            int failed = write_page(&fs, pg) != 0;
+            if (fclose(tf) != 0) failed = 1;
+            if (failed) { _wremove(tempPath); goto fallback; }  /* e.g. disk full */
+        }
 
         /* Navigate to the temp file */
         VARIANT ve; VariantInit(&ve);
@@ -1615,9 +1683,10 @@ static void navigate_to_html(IWebBrowser2* pB, const char* html, const WCHAR* di
             IWebBrowser2_get_ReadyState(pB,&rs);
             if(rs!=READYSTATE_COMPLETE) Sleep(10);
         } while(rs!=READYSTATE_COMPLETE && --to>0);
-        return;
+        return 1;
     }
 
+fallback:;
     /* Fallback: about:blank + document.write (no local image support) */
     VARIANT ve; VariantInit(&ve);
     BSTR url=SysAllocString(L"about:blank");
@@ -1629,20 +1698,278 @@ static void navigate_to_html(IWebBrowser2* pB, const char* html, const WCHAR* di
         if(rs!=READYSTATE_LOADED&&rs!=READYSTATE_INTERACTIVE&&rs!=READYSTATE_COMPLETE)Sleep(10);
     }while(rs!=READYSTATE_LOADED&&rs!=READYSTATE_INTERACTIVE&&rs!=READYSTATE_COMPLETE&&--to>0);
 
-    IDispatch* pD=NULL; IWebBrowser2_get_Document(pB,&pD); if(!pD)return;
+    IDispatch* pD=NULL; IWebBrowser2_get_Document(pB,&pD); if(!pD)return 0;
     IHTMLDocument2* pDoc=NULL; IDispatch_QueryInterface(pD,&IID_IHTMLDocument2,(void**)&pDoc); IDispatch_Release(pD);
-    if(!pDoc)return;
-
-    int wl=MultiByteToWideChar(CP_UTF8,0,html,-1,NULL,0);
-    wchar_t* wh=(wchar_t*)malloc(wl*sizeof(wchar_t));
-    MultiByteToWideChar(CP_UTF8,0,html,-1,wh,wl);
-    BSTR bh=SysAllocString(wh); free(wh);
+    if(!pDoc)return 0;
+
+    /* document.write needs the whole page: build it in memory, then
+       transcode straight into the BSTR. about:blank cannot link files,
+       so the style and script go inline. */
+    PageParts inl = *pg; inl.assets = NULL;
+    StrBuf page; sb_init_cap(&page, pg->mdLen + pg->mdLen/4 + sizeof(k_css) + sizeof(k_js) + 65536);
+    MdSink ms; md_sink_buf(&ms, &page);
+    if (!page.data || write_page(&ms, &inl)) { free(page.data); IHTMLDocument2_Release(pDoc); return 0; }
+    BSTR bh=utf8_to_bstr(page.data,page.len);
+    free(page.data);
+    if(!bh){ IHTMLDocument2_Release(pDoc); return 0; }
 
     SAFEARRAY* sa=SafeArrayCreateVector(VT_VARIANT,0,1);
     VARIANT* pv; SafeArrayAccessData(sa,(void**)&pv);
     pv->vt=VT_BSTR; pv->bstrVal=bh; SafeArrayUnaccessData(sa);
     IHTMLDocument2_write(pDoc,sa); IHTMLDocument2_close(pDoc);
     SafeArrayDestroy(sa); IHTMLDocument2_Release(pDoc);
+    return 0;
+}
+
+/* ── Progressive Rendering ───────────────────────────────────────────── */
+
+/* Large sources are converted on a worker thread into block-aligned
+   chunks (mdcore's aligned sink). The first, about a screenful, becomes
+   the page body; the rest are queued and appended to #mdv-ct one per
+   WM_MDV_CHUNK, so the lister stays responsive while they arrive. */
+
+#define WM_MDV_CHUNK      (WM_APP + 1)
+#define PROG_FIRST_CHUNK  (32 * 1024)
+#define PROG_CHUNK        (256 * 1024)
+
+typedef struct ProgChunk { struct ProgChunk* next; size_t len; char data[1]; } ProgChunk;
+
+struct Progressive {
+    HWND hwnd;                 /* container, receives WM_MDV_CHUNK */
+    const char* md; size_t mdLen;
+    int fontSize;
+    CRITICAL_SECTION lock;     /* guards head/tail/done */
+    ProgChunk* head; ProgChunk* tail;
+    int done;                  /* worker finished (or failed) */
+    volatile LONG cancel;
+    HANDLE thread, firstReady; /* firstReady: first chunk queued, or done */
+    MdOutline outline;         /* worker's, the GUI thread's once done */
+    int pageReady, finished;   /* GUI thread only */
+};
+
+static int prog_write(MdSink* s, const char* data, size_t len) {
+    Progressive* p = (Progressive*)s->user;
+    if (p->cancel) return 1;
+    ProgChunk* c = (ProgChunk*)malloc(offsetof(ProgChunk, data) + len);
+    if (!c) return -1;
+    c->next = NULL; c->len = len; memcpy(c->data, data, len);
+    EnterCriticalSection(&p->lock);
+    int first = s->chunk == PROG_FIRST_CHUNK;
+    if (p->tail) p->tail->next = c; else p->head = c;
+    p->tail = c;
+    LeaveCriticalSection(&p->lock);
+    s->chunk = PROG_CHUNK;
+    if (first) SetEvent(p->firstReady); else PostMessageW(p->hwnd, WM_MDV_CHUNK, 0, 0);
+    return 0;
+}
+
+static DWORD WINAPI prog_thread(LPVOID arg) {
+    Progressive* p = (Progressive*)arg;
+    MdContext* cx = new_context(p->fontSize);
+    if (cx) md_context_set_outline(cx, &p->outline);
+    MdSink s = { prog_write, p, PROG_FIRST_CHUNK, 1 };
+    if (cx) md_render_to(cx, p->md, p->mdLen, &s);
+    md_context_free(cx);
+    EnterCriticalSection(&p->lock); p->done = 1; LeaveCriticalSection(&p->lock);
+    SetEvent(p->firstReady);
+    PostMessageW(p->hwnd, WM_MDV_CHUNK, 0, 0);
+    return 0;
+}
+
+static ProgChunk* prog_pop(Progressive* p, int* done) {
+    EnterCriticalSection(&p->lock);
+    ProgChunk* c = p->head;
+    if (c) { p->head = c->next; if (!p->head) p->tail = NULL; }
+    *done = p->done && !p->head;
+    LeaveCriticalSection(&p->lock);
+    return c;
+}
+
+/* Start converting `md` (which must outlive the worker); NULL on failure */
+static Progressive* prog_start(HWND hwnd, const char* md, size_t len, int fontSize) {
+    Progressive* p = (Progressive*)calloc(1, sizeof(Progressive));
+    if (!p) return NULL;
+    p->hwnd = hwnd; p->md = md; p->mdLen = len; p->fontSize = fontSize;
+    InitializeCriticalSection(&p->lock);
+    p->firstReady = CreateEventW(NULL, TRUE, FALSE, NULL);
+    p->thread = p->firstReady ? CreateThread(NULL, 0, prog_thread, p, 0, NULL) : NULL;
+    if (!p->thread) {
+        if (p->firstReady) CloseHandle(p->firstReady);
+        DeleteCriticalSection(&p->lock); free(p);
+        return NULL;
+    }
+    return p;
+}
+
+/* Cancel the worker, wait for it and drop whatever it queued */
+static void prog_stop(Progressive* p) {
+    if (!p) return;
+    InterlockedExchange(&p->cancel, 1);
+    WaitForSingleObject(p->thread, INFINITE);
+    CloseHandle(p->thread); CloseHandle(p->firstReady);
+    int done; ProgChunk* c;
+    while ((c = prog_pop(p, &done)) != NULL) free(c);
+    md_outline_free(&p->outline);
+    DeleteCriticalSection(&p->lock);
+    free(p);
+}
+
+/* Append HTML to the end of element `elem` */
+static void insert_html_end(IWebBrowser2* pB, const wchar_t* elem, const char* html, size_t len) {
+    IDispatch* pD = NULL; IWebBrowser2_get_Document(pB, &pD); if (!pD) return;
+    IHTMLDocument3* pDoc = NULL; IDispatch_QueryInterface(pD, &IID_IHTMLDocument3, (void**)&pDoc); IDispatch_Release(pD);
+    if (!pDoc) return;
+    BSTR id = SysAllocString(elem);
+    IHTMLElement* ct = NULL; IHTMLDocument3_getElementById(pDoc, id, &ct);
+    SysFreeString(id); IHTMLDocument3_Release(pDoc);
+    if (!ct) return;
+    BSTR bh = utf8_to_bstr(html, len);
+    if (bh) {
+        BSTR where = SysAllocString(L"beforeEnd");
+        IHTMLElement_insertAdjacentHTML(ct, where, bh);
+        SysFreeString(where); SysFreeString(bh);
+    }
+    IHTMLElement_Release(ct);
+}
+
+/* WM_MDV_CHUNK: show one queued chunk, then yield so input is handled
+   between chunks. After the last, the outline is complete: it becomes
+   the view's and fills the TOC. */
+static void prog_show_next(MDViewData* d) {
+    Progressive* p = d->prog;
+    if (!p->pageReady || p->finished) return;
+    int done; ProgChunk* c = prog_pop(p, &done);
+    if (c) {
+        insert_html_end(d->pBrowser, L"mdv-ct", c->data, c->len);
+        free(c);
+        if (!done) { exec_js(d->pBrowser, L"mdvChunk()"); PostMessageW(d->hwndContainer, WM_MDV_CHUNK, 0, 0); }
+    }
+    if (!done) return;
+    md_source_detach(&d->src);   /* the worker has finished reading it */
+    md_outline_free(&d->outline);
+    d->outline = p->outline; memset(&p->outline, 0, sizeof(p->outline));
+    StrBuf toc; sb_init(&toc); md_outline_toc(&d->outline, 4, &toc);
+    if (toc.len) insert_html_end(d->pBrowser, L"mdv-toc", toc.data, toc.len);
+    free(toc.data);
+    exec_js(d->pBrowser, L"mdvDone()");
+    p->finished = 1;
+}
+
+/* ── Live Reload ─────────────────────────────────────────────────────── */
+
+/* With AutoReload on, a page written in one piece follows its file. A
+   thread waits on change notifications for the file's folder and posts
+   WM_MDV_FILE; once they have stopped for RELOAD_MS the file is read
+   again if its size or write time moved, and md_doc_update converts only
+   the top-level blocks that changed. The page swaps those in (mdvPatch),
+   so its scroll position, search and expanded blocks stay. Virtualized
+   and progressive pages load as before. */
+
+#define WM_MDV_FILE   (WM_APP + 2)
+#define RELOAD_TIMER  1
+#define RELOAD_MS     300
+
+struct Watch { HWND hwnd; HANDLE change, stop, thread; };
+
+static DWORD WINAPI watch_thread(LPVOID arg) {
+    struct Watch* w = (struct Watch*)arg;
+    HANDLE hs[2] = { w->stop, w->change };
+    while (WaitForMultipleObjects(2, hs, FALSE, INFINITE) == WAIT_OBJECT_0 + 1) {
+        PostMessageW(w->hwnd, WM_MDV_FILE, 0, 0);
+        if (!FindNextChangeNotification(w->change)) break;
+    }
+    return 0;
+}
+
+/* Notifications come for the whole folder: any file there wakes the
+   window, and live_reload compares the stamp */
+static struct Watch* watch_start(HWND hwnd, const WCHAR* dir) {
+    struct Watch* w = (struct Watch*)calloc(1, sizeof(struct Watch));
+    if (!w) return NULL;
+    w->hwnd = hwnd;
+    w->change = FindFirstChangeNotificationW(dir, FALSE, FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE);
+    w->stop = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (w->change != INVALID_HANDLE_VALUE && w->stop && (w->thread = CreateThread(NULL, 0, watch_thread, w, 0, NULL)) != NULL) return w;
+    if (w->change != INVALID_HANDLE_VALUE) FindCloseChangeNotification(w->change);
+    if (w->stop) CloseHandle(w->stop);
+    free(w);
+    return NULL;
+}
+
+static void watch_stop(struct Watch* w) {
+    if (!w) return;
+    SetEvent(w->stop);
+    WaitForSingleObject(w->thread, INFINITE);
+    CloseHandle(w->thread); CloseHandle(w->stop); FindCloseChangeNotification(w->change);
+    free(w);
+}
+
+static int file_stamp(const WCHAR* file, long long st[2]) {
+    WIN32_FILE_ATTRIBUTE_DATA fa;
+    if (!GetFileAttributesExW(file, GetFileExInfoStandard, &fa)) return -1;
+    st[0] = (long long)(((unsigned long long)fa.nFileSizeHigh << 32) | fa.nFileSizeLow);
+    st[1] = (long long)(((unsigned long long)fa.ftLastWriteTime.dwHighDateTime << 32) | fa.ftLastWriteTime.dwLowDateTime);
+    return 0;
+}
+
+/* window.external.patch(i), after mdvPatch was called. -1: the hunks,
+   "lineAt,lineEnd,del,shift;..."; i >= 0: the new blocks of hunk i; -2:
+   the TOC entries; -3: the whole body, when the page cannot place a hunk */
+static BSTR live_patch(const MDViewData* d, int i) {
+    const MdDoc* doc = &d->doc; const MdDocDiff* df = &d->diff;
+    if (i >= df->count || i < -3) return NULL;
+    if (i >= 0) {
+        const MdDocHunk* h = &df->items[i];
+        if (!h->ins) return NULL;
+        const MdDocBlock *f = &doc->blocks[h->to], *e = &doc->blocks[h->to + h->ins - 1];
+        return utf8_to_bstr(doc->html.data + f->off, e->off + e->len - f->off);
+    }
+    if (i == -3) return doc->html.data ? utf8_to_bstr(doc->html.data, doc->html.len) : NULL;
+    StrBuf sb; sb_init(&sb);
+    if (i == -2) md_outline_toc(&doc->outline, 4, &sb);
+    else for (int k = 0; k < df->count; k++) {
+        const MdDocHunk* h = &df->items[k];
+        char tmp[64];
+        sprintf(tmp, "%s%d,%d,%d,%d", k ? ";" : "", h->lineAt, h->lineEnd, h->del, h->shift);
+        sb_append(&sb, tmp);
+    }
+    BSTR r = sb.data ? utf8_to_bstr(sb.data, sb.len) : NULL;
+    free(sb.data);
+    return r;
+}
+
+/* WM_TIMER: the notifications stopped. A file that cannot be opened yet
+   (still locked by its writer) is tried again; one that cannot be read
+   or converted keeps the page as it is until the next change. The new
+   source is held as a heap copy, like the first. Everything built from
+   the old one goes with it: the find index and the source map are made
+   again when next needed. A page that came from the cache has no blocks
+   to diff against yet, so its first change swaps the whole body. */
+static void live_reload(MDViewData* d) {
+    long long st[2]; MdSource src;
+    if (file_stamp(d->file, st) || (st[0] == d->stamp[0] && st[1] == d->stamp[1])) return;
+    if (md_source_open_w(&src, d->file)) { SetTimer(d->hwndContainer, RELOAD_TIMER, RELOAD_MS, NULL); return; }
+    if (md_source_text(&src, acp_table())) { md_source_close(&src); return; }
+    MdContext* cx = new_context(d->fontSize);
+    int rc = cx ? md_doc_update(cx, &d->doc, src.data, src.len, &d->diff) : -1;
+    md_context_free(cx);
+    if (rc || md_source_detach(&src)) { md_source_close(&src); return; }
+    int whole = !d->docReady;
+    d->docReady = 1;
+    d->stamp[0] = st[0]; d->stamp[1] = st[1];
+    md_source_close(&d->src); d->src = src;
+    if (!whole && !d->diff.count) return;   /* the same text again */
+    double top = d->hwndText && d->editLines ? edit_top_line(d) : 0;
+    md_text_free(&d->text); d->textState = 0; d->finds.count = 0;
+    md_source_map_free(&d->map); free(d->sync); d->sync = NULL; d->syncCount = 0;
+    free(d->editLines); d->editLines = NULL; d->editLineCount = 0;
+    if (d->hwndText) {
+        wchar_t* w = utf8_to_wide_dup(d->src.data, d->src.len);
+        if (w) { SetWindowTextW(d->hwndText, w); free(w); edit_lines(d); }
+        if (d->editLines) edit_scroll_to_line(d, top);
+    }
+    if (d->splitView) ensure_map(d);
+    exec_js(d->pBrowser, whole ? L"mdvPatch(1)" : L"mdvPatch()");
 }
 
 /* ── Window Procedure ────────────────────────────────────────────────── */
@@ -1686,6 +2013,15 @@ static void save_current_settings(IWebBrowser2* pB) {
 static LRESULT CALLBACK ContainerWndProc(HWND hwnd, UINT msg, WPARAM wP, LPARAM lP) {
     MDViewData* d=(MDViewData*)GetWindowLongPtrW(hwnd,GWLP_USERDATA);
     switch(msg){
+    case WM_MDV_CHUNK:
+        if (d && d->prog) prog_show_next(d);
+        return 0;
+    case WM_MDV_FILE:   /* each one restarts the wait */
+        if (d) SetTimer(hwnd, RELOAD_TIMER, RELOAD_MS, NULL);
+        return 0;
+    case WM_TIMER:
+        if (d && wP == RELOAD_TIMER) { KillTimer(hwnd, RELOAD_TIMER); live_reload(d); }
+        return 0;
     case WM_SIZE:
         if (d && d->pBrowser) layout_views(d);
         return 0;
@@ -1711,7 +2047,13 @@ static LRESULT CALLBACK ContainerWndProc(HWND hwnd, UINT msg, WPARAM wP, LPARAM
             }
             if (d->hTextFont && d->hTextFont != (HFONT)GetStockObject(DEFAULT_GUI_FONT))
                 DeleteObject(d->hTextFont);
-            if (d->mdUtf8) { free(d->mdUtf8); d->mdUtf8 = NULL; }
+            prog_stop(d->prog); d->prog = NULL;  /* before the source it reads goes */
+            watch_stop(d->watch); KillTimer(hwnd, RELOAD_TIMER);
+            md_doc_free(&d->doc); md_doc_diff_free(&d->diff);
+            free(d->html); md_sections_free(&d->secs); md_outline_free(&d->outline);
+            md_text_free(&d->text); md_matches_free(&d->finds);
+            md_source_map_free(&d->map); free(d->sync); free(d->editLines);
+            md_source_close(&d->src);
             if(d->pBrowser) IWebBrowser2_Release(d->pBrowser);
             if(d->pOleObj){ IOleObject_Close(d->pOleObj,OLECLOSE_NOSAVE); IOleObject_Release(d->pOleObj); }
             /* Clean up temp HTML file */
@@ -1727,6 +2069,7 @@ static LRESULT CALLBACK ContainerWndProc(HWND hwnd, UINT msg, WPARAM wP, LPARAM
 
 BOOL WINAPI DllMain(HINSTANCE hInst, DWORD reason, LPVOID res) {
     if(reason==DLL_PROCESS_ATTACH){g_hInstance=hInst;DisableThreadLibraryCalls(hInst);}
+    if(reason==DLL_PROCESS_DETACH&&!res)md_grammars_free(&g_grammars);  /* unloaded, not process exit */
     return TRUE;
 }
 
@@ -1750,7 +2093,8 @@ static void ensure_ie11_emulation(void) {
 
 __declspec(dllexport) HWND __stdcall ListLoadW(HWND pw, WCHAR* file, int flags) {
     ensure_ie11_emulation();
-    load_settings();
+    load_grammars();
+    MDVSettings st; load_settings(&st);
 
     if(!g_classRegistered){
         WNDCLASSEXW wc={0}; wc.cbSize=sizeof(wc); wc.lpfnWndProc=ContainerWndProc;
@@ -1758,55 +2102,104 @@ __declspec(dllexport) HWND __stdcall ListLoadW(HWND pw, WCHAR* file, int flags)
         RegisterClassExW(&wc); g_classRegistered=1;
     }
 
-    char* md=read_file_w(file); if(!md)return NULL;
-    char* body=md_to_html(md);
-    if(!body){ free(md); return NULL; }
+    long long stamp[2]; int stamped = !file_stamp(file, stamp);   /* before reading: a write after it is seen */
+    MdSource src; if(md_source_open_w(&src,file))return NULL;
+    if(md_source_text(&src,acp_table())){md_source_close(&src);return NULL;}
 
     /* Determine theme: saved preference, or auto-detect */
-    int dark = (g_settings.isDark >= 0) ? g_settings.isDark : is_dark_theme();
+    int dark = (st.isDark >= 0) ? st.isDark : is_dark_theme();
 
-    /* Build CSS and JS dynamically with current settings */
-    StrBuf cssBuf; sb_init(&cssBuf); build_css(&cssBuf);
-    StrBuf jsBuf;  sb_init(&jsBuf);  build_js(&jsBuf);
+    /* Extract directory from file path for temp file placement */
+    WCHAR fileDir[MAX_PATH], tempPath[MAX_PATH];
+    wcsncpy(fileDir, file, MAX_PATH); fileDir[MAX_PATH-1]=0;
+    WCHAR* lastSep = wcsrchr(fileDir, L'\\');
+    if (!lastSep) lastSep = wcsrchr(fileDir, L'/');
+    if (lastSep) lastSep[1] = 0; else { fileDir[0]=L'.'; fileDir[1]=L'\\'; fileDir[2]=0; }
+    temp_page_path(fileDir, tempPath);
+
+    /* The shared style and script; pages link them where they could be written */
+    char assets[MAX_PATH * 9 + 16];
+    if (shared_assets(&st, assets, sizeof(assets))) assets[0] = 0;
+
+    /* Render cache: a page written in one piece may be there already */
+    int bigVirtual = st.virtualKB && src.len >= (size_t)st.virtualKB * 1024;
+    int bigProg = st.progressiveKB && src.len >= (size_t)st.progressiveKB * 1024;
+    WCHAR cacheDir[MAX_PATH]; MdCacheKey cacheKey;
+    int cacheable = st.cacheMB > 0 && !bigVirtual && !bigProg
+                 && !cache_dir(&st, cacheDir) && !page_key(&cacheKey, file, &src, &st, dark, assets);
+    int cached = cacheable && md_cache_fetch_w(cacheDir, &cacheKey, tempPath);
+    int live = st.autoReload && stamped && !bigVirtual && !bigProg && wcslen(file) < MAX_PATH;
     const char* ui = get_ui();
 
-    size_t fl=strlen(body)+cssBuf.len+jsBuf.len+strlen(ui)+2048;
-    char* full=(char*)malloc(fl);
-    snprintf(full,fl,
-        "<!DOCTYPE html><html%s><head>"
-        "<meta http-equiv=\"X-UA-Compatible\" content=\"IE=edge\">"
-        "<meta charset=\"utf-8\"><style>%s</style></head><body%s>"
-        "%s%s<div id=\"mdv-ct\">%s</div></body></html>",
-        dark?" style=\"background:#1e1e1e\"":"", cssBuf.data, dark?" class=\"dark\"":"", jsBuf.data, ui, body);
-    free(body); free(cssBuf.data); free(jsBuf.data);
+    PageParts pg = { src.data, src.len, NULL, 0, dark, st.lineNums, st.fontSize, st.maxWidth, assets[0] ? assets : NULL, ui, NULL };
 
     RECT rc; GetClientRect(pw,&rc);
     HWND hwnd=CreateWindowExW(0,CLASS_NAME,L"MDView",
         WS_CHILD|WS_VISIBLE|WS_CLIPCHILDREN,0,0,rc.right,rc.bottom,pw,NULL,g_hInstance,NULL);
-    if(!hwnd){free(full);free(md);return NULL;}
+    if(!hwnd){md_source_close(&src);if(cached)DeleteFileW(tempPath);return NULL;}
 
     OleInitialize(NULL);
     MDViewData* data=(MDViewData*)calloc(1,sizeof(MDViewData));
     data->hwndContainer = hwnd;
-    data->mdUtf8 = md; /* Keep raw markdown for split view (contributed by Nigurrath) */
+    data->src = src; /* Keep raw markdown for split view (contributed by Nigurrath) */
+    data->fontSize = st.fontSize;
     SetWindowLongPtrW(hwnd,GWLP_USERDATA,(LONG_PTR)data);
+    pg.outline = &data->outline;
+
+    /* Very large file: convert it whole with its sections, which the page
+       then fetches as it scrolls. Large file: start converting now, while
+       the browser is created, and show it as it arrives. */
+    StrBuf vbody = {0};
+    if (bigVirtual) {
+        MdContext* cx = new_context(st.fontSize);
+        if (cx) md_context_set_outline(cx, &data->outline);
+        data->html = cx ? md_render_sections(cx, src.data, src.len, &data->secs) : NULL;
+        md_context_free(cx);
+        if (data->html) { sb_init(&vbody); build_virtual_body(&vbody, &data->secs); pg.body = vbody.data; pg.bodyLen = vbody.len; }
+        else md_outline_free(&data->outline);
+    }
+    if (!data->html && bigProg)
+        data->prog = prog_start(hwnd, data->src.data, data->src.len, st.fontSize);
+
+    /* Live reload: the body converted block by block, kept for the next
+       version. A page from the cache is not converted here at all. */
+    MdContext* dcx = live && !cached ? new_context(st.fontSize) : NULL;
+    if (dcx && !md_doc_update(dcx, &data->doc, src.data, src.len, &data->diff)) {
+        pg.body = data->doc.html.data ? data->doc.html.data : ""; pg.bodyLen = data->doc.html.len;
+        pg.outline = &data->doc.outline; data->docReady = 1;
+    }
+    md_context_free(dcx);
 
     SiteImpl* site=NULL;
     HRESULT hr=create_browser(hwnd,&data->pBrowser,&data->pOleObj,&site);
-    if(FAILED(hr)){free(data->mdUtf8);free(data);free(full);DestroyWindow(hwnd);return NULL;}
+    if(FAILED(hr)){prog_stop(data->prog);md_doc_free(&data->doc);md_doc_diff_free(&data->diff);free(data->html);md_sections_free(&data->secs);md_outline_free(&data->outline);free(vbody.data);md_source_close(&data->src);free(data);if(cached)DeleteFileW(tempPath);DestroyWindow(hwnd);return NULL;}
 
     layout_views(data);
     IWebBrowser2_put_Silent(data->pBrowser, VARIANT_TRUE);
 
-    /* Extract directory from file path for temp file placement */
-    WCHAR fileDir[MAX_PATH];
-    wcsncpy(fileDir, file, MAX_PATH); fileDir[MAX_PATH-1]=0;
-    WCHAR* lastSep = wcsrchr(fileDir, L'\\');
-    if (!lastSep) lastSep = wcsrchr(fileDir, L'/');
-    if (lastSep) lastSep[1] = 0; else { fileDir[0]=L'.'; fileDir[1]=L'\\'; fileDir[2]=0; }
+    /* Progressive: the page starts out with the first chunk as its body */
+    ProgChunk* first = NULL;
+    if (data->prog) {
+        WaitForSingleObject(data->prog->firstReady, INFINITE);
+        int done; first = prog_pop(data->prog, &done);
+        pg.body = first ? first->data : ""; pg.bodyLen = first ? first->len : 0;
+    }
 
-    navigate_to_html(data->pBrowser, full, fileDir, data->tempFile);
-    free(full);
+    if (navigate_to_html(data->pBrowser, &pg, tempPath, cached)) {
+        wcscpy(data->tempFile, tempPath);
+        if (cacheable && !cached) md_cache_store_w(cacheDir, &cacheKey, tempPath, (long long)st.cacheMB << 20);
+    }
+    free(first); free(vbody.data);
+    if (data->prog) { data->prog->pageReady = 1; PostMessageW(hwnd, WM_MDV_CHUNK, 0, 0); }
+    if (live) {
+        wcscpy(data->file, file); data->stamp[0] = stamp[0]; data->stamp[1] = stamp[1];
+        data->watch = watch_start(hwnd, fileDir);
+    }
+    if (!data->watch) { md_doc_free(&data->doc); md_doc_diff_free(&data->diff); data->docReady = 0; }
+    /* Converted: the view is kept as a heap copy from here on, so the file
+       can be saved in place while it is shown (progressive pages: once the
+       last piece is in; if memory runs out, it stays mapped) */
+    if (!data->prog) md_source_detach(&data->src);
 
     IOleObject_DoVerb(data->pOleObj, OLEIVERB_UIACTIVATE, NULL,
                       (IOleClientSite*)&site->clientSite, 0, hwnd, &rc);
@@ -1840,40 +2233,42 @@ __declspec(dllexport) void __stdcall ListGetDetectString(char* ds, int mx) {
     strncpy(ds,"EXT=\"MD\" | EXT=\"MARKDOWN\" | EXT=\"MKD\" | EXT=\"MKDN\"",mx-1); ds[mx-1]='\0';
 }
 
-__declspec(dllexport) int __stdcall ListSearchText(HWND w, int p, char* s) {
-    /* TC Lister search: p&1=find first, p&2=find next, p&4=backwards */
+__declspec(dllexport) int __stdcall ListSearchTextW(HWND w, WCHAR* s, int p) {
+    /* TC Lister search: lcs_findfirst starts one, then find next/previous */
     if (!s || !s[0]) return LISTPLUGIN_ERROR;
     MDViewData* d = (MDViewData*)GetWindowLongPtrW(w, GWLP_USERDATA);
     if (!d || !d->pBrowser) return LISTPLUGIN_ERROR;
-
-    /* Use our JS find infrastructure: on first search populate, then navigate */
-    int wl = MultiByteToWideChar(CP_UTF8, 0, s, -1, NULL, 0);
-    wchar_t* ws = (wchar_t*)malloc(wl * sizeof(wchar_t));
-    MultiByteToWideChar(CP_UTF8, 0, s, -1, ws, wl);
-
-    /* Escape single quotes in search term */
-    wchar_t escaped[512]; int ei = 0;
-    for (int i = 0; ws[i] && ei < 500; i++) {
-        if (ws[i] == L'\'') { escaped[ei++] = L'\\'; escaped[ei++] = L'\''; }
-        else if (ws[i] == L'\\') { escaped[ei++] = L'\\'; escaped[ei++] = L'\\'; }
-        else escaped[ei++] = ws[i];
-    }
-    escaped[ei] = 0;
-    free(ws);
-
-    wchar_t js[1024];
-    if (p & 1) {
-        /* First search: populate matches */
-        swprintf(js, 1024, L"df('%ls')", escaped);
-        exec_js(d->pBrowser, js);
-    } else {
-        /* Next/prev */
-        if (p & 4) exec_js(d->pBrowser, L"fp()");
-        else exec_js(d->pBrowser, L"fn()");
+    if (!(p & lcs_findfirst)) { exec_js(d->pBrowser, (p & lcs_backwards) ? L"fp()" : L"fn()"); return LISTPLUGIN_OK; }
+
+    /* df('<term>',flags), the term escaped for a JS string */
+    size_t n = wcslen(s);
+    wchar_t* js = (wchar_t*)malloc((n * 6 + 32) * sizeof(wchar_t));
+    if (!js) return LISTPLUGIN_ERROR;
+    size_t k = 4;
+    wcscpy(js, L"df('");
+    for (size_t i = 0; i < n; i++) {
+        wchar_t c = s[i];
+        if (c == L'\'' || c == L'\\') { js[k++] = L'\\'; js[k++] = c; }
+        else if (c == L'\n') { js[k++] = L'\\'; js[k++] = L'n'; }
+        else if (c == L'\r') { js[k++] = L'\\'; js[k++] = L'r'; }
+        else if (c == 0x2028 || c == 0x2029) k += swprintf(js + k, 7, L"\\u%04x", (unsigned)c);
+        else js[k++] = c;
     }
-
+    swprintf(js + k, 24, L"',%d)", ((p & lcs_matchcase) ? 1 : 0) | ((p & lcs_wholewords) ? 2 : 0) | ((p & lcs_backwards) ? 4 : 0));
+    exec_js(d->pBrowser, js);
+    free(js);
     return LISTPLUGIN_OK;
 }
+
+__declspec(dllexport) int __stdcall ListSearchText(HWND w, char* s, int p) {
+    if (!s) return LISTPLUGIN_ERROR;
+    /* An ANSI byte never makes more than one UTF-16 unit */
+    int len = (int)strlen(s) + 1;
+    WCHAR* ws = (WCHAR*)malloc(len * sizeof(WCHAR));
+    if (!ws) return LISTPLUGIN_ERROR;
+    if (!MultiByteToWideChar(CP_ACP, 0, s, len, ws, len)) ws[0] = L'\0';
+    int r = ListSearchTextW(w, ws, p); free(ws); return r;
+}
 __declspec(dllexport) int __stdcall ListSendCommand(HWND w, int c, int p) { return LISTPLUGIN_OK; }
 
 __declspec(dllexport) void __stdcall ListSetDefaultParams(ListDefaultParamStruct* p) {